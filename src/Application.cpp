@@ -1,8 +1,15 @@
 #include "Application.h"
 
-Application::Application() {}
+Application::Application(bool _isProfilingStartup, bool _isProfilingLoading) :
+    device(nullptr),
+    loaderDevice(nullptr),
+    isProfilingStartup(_isProfilingStartup),
+    isProfilingLoading(_isProfilingLoading) {}
 
 void Application::initialize() {
+    // every device makes its logger Irrlicht's global one when it is created, so the main device comes last and keeps it
+    loaderDevice = irr::createDevice(irr::video::EDT_NULL);
+
     device = irr::createDevice(
         irr::video::EDT_OPENGL,
         irr::core::dimension2d<irr::u32>(1024, 768),
@@ -25,7 +32,7 @@ void Application::initialize() {
     smgr = device->getSceneManager();
     guienv = device->getGUIEnvironment();
 
-    applicationDelegate = std::make_shared<ApplicationDelegate>(device);
+    applicationDelegate = std::make_shared<ApplicationDelegate>(device, loaderDevice, isProfilingStartup, isProfilingLoading);
 
     applicationDelegate->initialize();
 
@@ -35,6 +42,9 @@ void Application::initialize() {
 }
 
 void Application::run() {
+    auto startTime = std::chrono::steady_clock::now();
+    auto isFirstFrameDrawn = false;
+
     initialize();
 
     while (device->run()) {
@@ -43,7 +53,24 @@ void Application::run() {
         }
 
         applicationDelegate->update();
+
+        if (isProfilingStartup && !isFirstFrameDrawn) {
+            isFirstFrameDrawn = true;
+
+            auto startupTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+
+            std::cout << "Drew the first frame " << startupTime << " ms after starting" << std::endl;
+        }
     }
 
+    // the textures and images the delegate holds have to be released while the driver is still there
+    device->setEventReceiver(nullptr);
+    eventReceiver.reset();
+    applicationDelegate.reset();
+
     device->drop();
+
+    if (loaderDevice != nullptr) {
+        loaderDevice->drop();
+    }
 }
@@ -5,12 +5,15 @@
 
 #include <irrlicht/irrlicht.h>
 
+#include <chrono>
 #include <iostream>
 #include <string>
 
 class Application {
 public:
-    Application();
+    //! _isProfilingStartup prints how long the assets took to load and when the first frame was drawn
+    /** _isProfilingLoading prints how long each stage of loading a model took. */
+    Application(bool _isProfilingStartup, bool _isProfilingLoading);
 
     void run();
 
@@ -18,10 +21,16 @@ private:
     void initialize();
 
     irr::IrrlichtDevice* device;
+
+    //! a windowless device the model loader parses and decodes through off the main thread
+    irr::IrrlichtDevice* loaderDevice;
     irr::video::IVideoDriver* driver;
     irr::scene::ISceneManager* smgr;
     irr::gui::IGUIEnvironment* guienv;
 
+    bool isProfilingStartup;
+    bool isProfilingLoading;
+
     std::shared_ptr<ApplicationDelegate> applicationDelegate;
     std::unique_ptr<IrrlichtEventReceiver> eventReceiver;
 };
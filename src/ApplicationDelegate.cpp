@@ -1,27 +1,51 @@
 ﻿#include "ApplicationDelegate.h"
 
-ApplicationDelegate::ApplicationDelegate(irr::IrrlichtDevice* _device) :
+namespace {
+    //! indexed by SymmetryAxis
+    const char* const SYMMETRY_CHECK_BOX_NAMES[SymmetryMap::AXIS_COUNT] = { "symmetryXCheckBox", "symmetryYCheckBox", "symmetryZCheckBox" };
+
+    //! indexed by channel, from the second on
+    const char* const CHANNEL_CHECK_BOX_NAMES[PAINT_CHANNEL_COUNT - 1] = { "channelCheckBox1", "channelCheckBox2", "channelCheckBox3" };
+    const char* const CHANNEL_VALUE_SLIDER_NAMES[PAINT_CHANNEL_COUNT - 1] = { "channelValueSlider1", "channelValueSlider2", "channelValueSlider3" };
+
+    bool isDdsFilename(const std::wstring& filename)
+    {
+        if (filename.size() < 4) {
+            return false;
+        }
+
+        auto extension = filename.substr(filename.size() - 4);
+
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::towlower);
+
+        return extension == L".dds";
+    }
+}
+
+ApplicationDelegate::ApplicationDelegate(irr::IrrlichtDevice* _device, irr::IrrlichtDevice* _loaderDevice, bool _isProfilingStartup, bool _isProfilingLoading) :
     device(_device),
+    driver(device->getVideoDriver()),
     smgr(device->getSceneManager()),
     guienv(device->getGUIEnvironment()),
-    driver(device->getVideoDriver()),
     camera(nullptr),
+    modelSceneNode(nullptr),
     loadModelDialogIsOpen(false),
     saveTextureDialogIsOpen(false),
-    triangleSelector(nullptr),
-    modelMesh(nullptr),
-    modelSceneNode(nullptr),
-    brushImage(nullptr),
-    brushTexture(nullptr),
-    selectedTextureImage(nullptr),
-    selectedTexture(nullptr),
-    tempImage(nullptr),
-    tempTexture(nullptr),
+    isDrawing(false),
+    previousIsDrawing(false),
     brushSize(25),
     brushFeatherRadius(5),
     brushColor(irr::video::SColor(255, 0, 0, 0)),
-    isDrawing(false),
-    previousIsDrawing(false)
+    brushOpacity(1.f),
+    isProfilingStartup(_isProfilingStartup),
+    isProfilingLoading(_isProfilingLoading),
+    modelLoader(threadPool, _loaderDevice, _isProfilingLoading),
+    projectFile(threadPool),
+    paintThread([this]() {
+        forEachPaintSurface([](PaintSurface& surface) {
+            surface.composite();
+        });
+    })
 {
 }
 
@@ -43,7 +67,13 @@ void ApplicationDelegate::initGUI()
 
 void ApplicationDelegate::loadGUI()
 {
-    guienv->loadGUI("media/gui.xml", nullptr);
+    auto loadStart = std::chrono::steady_clock::now();
+
+    auto source = loadCachedGUI(guienv, "media/gui.xml");
+
+    if (isProfilingStartup) {
+        printAssetLoadTime("media/gui.xml", source, loadStart);
+    }
 }
 
 irr::gui::IGUIElement* ApplicationDelegate::getElementByName(const std::string& name)
@@ -80,10 +110,37 @@ irr::gui::IGUIElement* ApplicationDelegate::getElementByName(const std::string&
 
 void ApplicationDelegate::resetFont()
 {
-    irr::gui::IGUIFont* font = guienv->getFont("media/calibri.xml");
+    auto loadStart = std::chrono::steady_clock::now();
+
+    AssetSource source;
+    irr::gui::IGUIFont* font = getCachedFont(guienv, "media/calibri.xml", source);
+
+    if (isProfilingStartup) {
+        printAssetLoadTime("media/calibri.xml", source, loadStart);
+    }
+
     guienv->getSkin()->setFont(font);
 }
 
+void ApplicationDelegate::printAssetLoadTime(const std::string& filename, AssetSource source, std::chrono::steady_clock::time_point loadStart)
+{
+    auto loadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - loadStart).count();
+
+    switch (source) {
+    case AssetSource::Cache:
+        std::cout << "Loaded " << filename << " from its cache in " << loadTime << " ms" << std::endl;
+        break;
+    case AssetSource::Xml:
+        std::cout << "Parsed and cached " << filename << " in " << loadTime << " ms" << std::endl;
+        break;
+    case AssetSource::Environment:
+        std::cout << "Parsed " << filename << " in " << loadTime << " ms" << std::endl;
+        break;
+    case AssetSource::None:
+        break;
+    }
+}
+
 void ApplicationDelegate::quit()
 {
     device->closeDevice();
@@ -91,11 +148,21 @@ void ApplicationDelegate::quit()
 
 void ApplicationDelegate::update()
 {
+    updateModelLoading();
+
+    projectFile.update();
+
+    paintTextureUnderCursor();
+
+    updatePaintSurfaces();
+
+    updateResourceWindow();
+
     driver->beginScene(true, true, irr::video::SColor(0, 200, 200, 200));
 
     smgr->drawAll();
 
-    paintTextureUnderCursor();
+    drawLasso();
 
     guienv->drawAll();
 
@@ -104,21 +171,21 @@ void ApplicationDelegate::update()
 
 void ApplicationDelegate::paintTextureUnderCursor()
 {
-    if (triangleSelector == nullptr) {
+    if (!triangleSelector) {
         return;
     }
 
-    const unsigned int MAX_TRIANGLES = 100;
     const unsigned int TEXTURE_CURSOR_SIZE = 25;
 
     const auto TRIANGLE_COLOR = irr::video::SColor(255, 0, 255, 0);
 
-    auto triangles = new irr::core::triangle3df[MAX_TRIANGLES];
-
-    int matchedTriangles = 0;
-
     auto cursorPosition = device->getCursorControl()->getPosition();
 
+    // the preview waits for the end of the last stroke, which may still be painted; the position is tried again next frame
+    if (!isDrawing && !paintThread.isIdle()) {
+        return;
+    }
+
     if (cursorPosition == previousMouseCursorPosition && previousIsDrawing == isDrawing)
     {
         // mouse cursor position did not change - no need to perform all these operations
@@ -130,18 +197,46 @@ void ApplicationDelegate::paintTextureUnderCursor()
         previousIsDrawing = isDrawing;
     }
 
+    // the brush preview of the previous position is taken back before anything else is painted
+    forEachPaintSurface([](PaintSurface& surface) {
+        surface.restorePreview();
+    });
+
+    // the lasso only collects the cursor positions, its faces are selected once the button goes up
+    if (paintTool == PaintTool::Lasso) {
+        if (isDrawing) {
+            lassoPoints.push_back(cursorPosition);
+        }
+
+        return;
+    }
+
+    if (paintTool == PaintTool::Projection) {
+        paintProjectedDab(cursorPosition);
+        return;
+    }
+
     irr::core::line3df ray = smgr->getSceneCollisionManager()->getRayFromScreenCoordinates(cursorPosition, camera);
 
     irr::core::vector3df collisionPoint;
     irr::core::triangle3df selectedTriangle;
     irr::scene::ISceneNode* selectedNode;
 
-    bool collisionDetected = smgr->getSceneCollisionManager()->getCollisionPoint(ray, triangleSelector, collisionPoint, selectedTriangle, selectedNode);
+    bool collisionDetected = smgr->getSceneCollisionManager()->getCollisionPoint(ray, triangleSelector.get(), collisionPoint, selectedTriangle, selectedNode);
 
     if (!collisionDetected) {
         return;
     }
 
+    // vertex colors need neither a texture nor the triangle under the cursor; they are only painted while the button is down
+    if (paintTool == PaintTool::VertexColor) {
+        if (isDrawing) {
+            paintVertexDab(collisionPoint);
+        }
+
+        return;
+    }
+
     auto materialsTabControl = reinterpret_cast<irr::gui::IGUITabControl*>(getElementByName("texturePreviewTabControl"));
 
     auto currentMaterialTabIndex = materialsTabControl->getActiveTab();
@@ -158,363 +253,1421 @@ void ApplicationDelegate::paintTextureUnderCursor()
         return;
     }
 
-    auto meshSceneNode = reinterpret_cast<irr::scene::IAnimatedMeshSceneNode*>(modelSceneNode);
-    auto animatedMesh = meshSceneNode->getMesh();
-    
-    {
-        irr::video::S3DVertex A, B, C;
-
-        auto meshBufferCount = animatedMesh->getMeshBufferCount();
-        auto meshBuffer = animatedMesh->getMeshBuffer(0);
+    if (symmetryMap == nullptr) {
+        return;
+    }
 
-        bool foundA = false;
-        bool foundB = false;
-        bool foundC = false;
+    // the hit triangle is looked up by the positions of its corners, rather than by searching the mesh buffers
+    SymmetryMap::SurfacePoint hitPoint;
 
-        irr::video::SMaterial selectedMaterial;
+    if (!symmetryMap->findPoint(selectedTriangle, collisionPoint, hitPoint)) {
+        return;
+    }
 
-        int materialTabCount = -1;
-        int materialTabIndex = -1;
+    auto meshBufferIndex = symmetryMap->getMeshBufferIndex(hitPoint);
 
-        for (auto t = 0; t < animatedMesh->getMeshBufferCount(); ++t)
-        {
-            auto meshBuffer = animatedMesh->getMeshBuffer(t);
-            auto material = meshBuffer->getMaterial();
+    if (paintTool == PaintTool::Select) {
+        if (isDrawing && faceSelection != nullptr) {
+            // strokes queued before may still be reading the selection
+            finishPainting();
 
-            if (material.getTexture(0) != nullptr)
-            {
-                ++materialTabCount;
+            if (selectsMaterials) {
+                faceSelection->setMeshBufferSelected(meshBufferIndex, !deselects);
+            }
+            else {
+                faceSelection->setSelected(hitPoint.triangle, !deselects);
             }
+        }
 
-            auto vertices = static_cast<irr::video::S3DVertex*>(meshBuffer->getVertices());
+        return;
+    }
 
-            for (auto i = 0; i < meshBuffer->getVertexCount(); ++i)
-            {
-                if (vertices[i].Pos == selectedTriangle.pointA)
-                {
-                    A = vertices[i];
-                    foundA = true;
+    auto surface = paintSurfaces[meshBufferIndex];
 
-                    materialTabIndex = materialTabCount;
-                    selectedMaterial = material;
-                }
-                else if (vertices[i].Pos == selectedTriangle.pointB)
-                {
-                    B = vertices[i];
-                    foundB = true;
-                }
-                else if (vertices[i].Pos == selectedTriangle.pointC)
-                {
-                    C = vertices[i];
-                    foundC = true;
-                }
-            }
+    if (surface == nullptr) {
+        return;
+    }
+
+    // TODO: rework this
+    // this code is garbage, but it will open the corresponding material in the preview window, if a model has multiple materials, which is a superior feature
+    int materialTabIndex = -1;
+
+    for (irr::u32 t = 0; t <= meshBufferIndex; ++t) {
+        if (paintSurfaces[t] != nullptr) {
+            ++materialTabIndex;
         }
+    }
 
-        if (foundA && foundB && foundC) {
-            irr::core::vector3df a = B.Pos - A.Pos;
-            irr::core::vector3df b = C.Pos - A.Pos;
-            irr::core::vector3df p = collisionPoint - A.Pos;
+    if (materialsTabControl->getActiveTab() != materialTabIndex) {
+        materialsTabControl->setActiveTab(materialTabIndex);
 
-            float u, v;
+        updateLayersWindow();
+    }
 
-            // au + bv = p
-            if (a.X != 0) {
-                v = ((a.X * p.Y) - (a.Y * p.X)) / ((a.X * b.Y) - (a.Y * b.X));
-                u = (p.X - (b.X * v)) / a.X;
-            }
-            else if (a.Y != 0) {
-                v = ((a.Y * p.Z) - (a.Z * p.Y)) / ((a.Y * b.Z) - (a.Z * b.Y));
-                u = (p.Y - (b.Y * v)) / a.Y;
-            }
-            else if (a.Z != 0) {
-                v = ((a.Z * p.X) - (a.X * p.Z)) / ((a.Z * b.X) - (a.X * b.Z));
-                u = (p.Z - (b.Z * v)) / a.Z;
-            }
-            else {
-                throw "Invalid input - zero basis vector";
-            }
+    if (paintTool == PaintTool::Sphere) {
+        paintSphereDab(collisionPoint, symmetryMap->getNormal(hitPoint).normalize());
+        return;
+    }
 
-            // assert((a * u + b * v) == p);
+    // a fill happens once when the button goes down and leaves no preview while hovering
+    if (paintTool == PaintTool::Fill) {
+        if (isDrawing && !hasFilled) {
+            hasFilled = true;
 
-            auto t2 = B.TCoords - A.TCoords;
-            auto t1 = C.TCoords - A.TCoords;
+            fillTextureAt(*surface, symmetryMap->getTextureCoords(hitPoint));
+        }
 
-            auto uvCoords = A.TCoords + t1 * u + t2 * v;
+        return;
+    }
 
-            // ...
-            auto textureImage = selectedMaterial.getTexture(0);
+    // a stencil is laid once when the button goes down, and previewed where it would go while hovering
+    if (paintTool == PaintTool::Stencil) {
+        if (!isDrawing || !hasStamped) {
+            hasStamped = isDrawing;
 
-            if (textureImage == nullptr) {
-                return;
-            }
+            paintStencil(*surface, symmetryMap->getTextureCoords(hitPoint));
+        }
+
+        return;
+    }
 
-            // TODO: rework this
-            // this code is garbage, but it will open the corresponding material in the preview window, if a model has multiple materials, which is a superior feature
-            auto materialsTabControl = reinterpret_cast<irr::gui::IGUITabControl*>(getElementByName("texturePreviewTabControl"));
+    // the dab is repeated at its mirror across every plane of symmetry, and at the mirrors of those
+    std::vector<SymmetryMap::SurfacePoint> points(1, hitPoint);
 
-            materialsTabControl->setActiveTab(materialTabIndex);
+    for (irr::u32 axis = 0; axis < SymmetryMap::AXIS_COUNT; ++axis) {
+        if ((symmetryAxes & (1 << axis)) == 0) {
+            continue;
+        }
 
-            auto textureSize = textureImage->getOriginalSize();
+        auto pointCount = points.size();
 
-            auto point = irr::core::vector2di(
-                (textureSize.Width * uvCoords.X) - (brushImage->getDimension().Width / 2),
-                (textureSize.Height * uvCoords.Y) - (brushImage->getDimension().Height / 2)
-            );
+        for (std::size_t i = 0; i < pointCount; ++i) {
+            SymmetryMap::SurfacePoint mirroredPoint;
 
-            selectedTextureImage->copyTo(tempImage);
+            if (symmetryMap->getMirroredPoint(points[i], static_cast<SymmetryAxis>(axis), mirroredPoint)) {
+                points.push_back(mirroredPoint);
+            }
+        }
+    }
 
-            for (auto x = 0; x < brushImage->getDimension().Width; ++x) {
-                for (auto y = 0; y < brushImage->getDimension().Height; ++y) {
-                    auto brushColor = brushImage->getPixel(x, y);
-                    auto originalColor = tempImage->getPixel(point.X + x, point.Y + y);
+    std::vector<std::pair<PaintSurface*, irr::core::vector2di>> dabs;
 
-                    if (brushColor.getAlpha() == 0) {
-                        continue;
-                    }
+    for (const auto& point : points) {
+        auto pointSurface = paintSurfaces[symmetryMap->getMeshBufferIndex(point)];
 
-                    if (brushColor.getAlpha() == 255) {
-                        tempImage->setPixel(point.X + x, point.Y + y, brushColor, false);
-                        continue;
-                    }
+        if (pointSurface == nullptr) {
+            continue;
+        }
 
-                    /*
-                        Alpha blending.
-                        
-                        Important: the "front" or "top" or "overlay" color must be (r0, g0, b0, a0)
-                        whilst the "back" or "bottom" or "background" color must be (r1, g1, b1, a1)
-                        or the results will be unpredictable
-                    */
-                    auto a1 = originalColor.getAlpha();
-                    auto r1 = originalColor.getRed();
-                    auto g1 = originalColor.getGreen();
-                    auto b1 = originalColor.getBlue();
-
-                    auto a0 = brushColor.getAlpha();
-                    auto r0 = brushColor.getRed();
-                    auto g0 = brushColor.getGreen();
-                    auto b0 = brushColor.getBlue();
-
-                    auto a00 = a0 / 255.f;
-                    auto a01 = a1 / 255.f;
-
-                    auto finalColor = irr::video::SColor(
-                        255 * (a00 + (a01 * (1 - a00))),
-                        ((r0 * a00) + (r1 * a01 * (1 - a00))),
-                        ((g0* a00) + (g1 * a01 * (1 - a00))),
-                        ((b0* a00) + (b1 * a01 * (1 - a00)))
-                    );
-
-                    tempImage->setPixel(point.X + x, point.Y + y, finalColor, false);
-                }
-            }
+        auto uvCoords = symmetryMap->getTextureCoords(point);
+        auto textureSize = pointSurface->getLayers().getActiveLayer().getSize();
+
+        auto position = irr::core::vector2di(
+            (textureSize.Width * uvCoords.X) - (brushImage->getDimension().Width / 2),
+            (textureSize.Height * uvCoords.Y) - (brushImage->getDimension().Height / 2)
+        );
 
-            driver->removeTexture(tempTexture);
-            tempTexture = driver->addTexture("__tempTexture__", tempImage);
+        // a point on a plane of symmetry is its own mirror
+        auto dab = std::make_pair(pointSurface.get(), position);
 
-            selectedNode->setMaterialTexture(0, tempTexture);
+        if (std::find(dabs.begin(), dabs.end(), dab) != dabs.end()) {
+            continue;
+        }
 
-            texturePreviewImage->setImage(tempTexture);
+        dabs.push_back(dab);
 
-            if (isDrawing)
-            {
-                tempImage->copyTo(selectedTextureImage);
-            }
+        if (brushType == BrushType::Color) {
+            paintDab(*pointSurface, position);
+        }
+        else {
+            paintFilterDab(*pointSurface, position, static_cast<irr::u32>(dabs.size() - 1));
         }
     }
 }
 
-void ApplicationDelegate::createBrush(float brushSize, float featherRadius, irr::video::SColor color)
+std::shared_ptr<const BrushState> ApplicationDelegate::captureBrush() const
 {
-    const auto size = (brushSize + featherRadius) * 2;
+    auto brush = std::make_shared<BrushState>();
+
+    // a brush made again later replaces brushImage, while the queued commands keep painting with this one
+    brush->image = ResourceHandle<irr::video::IImage>::share(brushImage.get());
+    brush->color = brushColor;
+    brush->opacity = brushOpacity;
+    brush->type = brushType;
+    brush->filterRadius = filterRadius;
+    brush->paintedChannels = paintedChannels;
+    std::copy(std::begin(channelValues), std::end(channelValues), brush->channelValues);
+    brush->selection = faceSelection;
+
+    return brush;
+}
 
-    auto brush = driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(size, size));
+void ApplicationDelegate::paintDab(PaintSurface& surface, const irr::core::vector2di& point)
+{
+    // dabs go into the active layer, the surface recomposites the tiles they touch
+    auto& textureImage = surface.getLayers().getActiveLayer();
+    auto textureSize = textureImage.getSize();
 
-    brush->fill(irr::video::SColor(0, 0, 0, 0));
+    auto brush = captureBrush();
 
-    auto maxDistance = featherRadius + brushSize;
+    auto dabRect = irr::core::recti(point, brush->image->getDimension());
+    dabRect.clipAgainst(irr::core::recti(0, 0, textureSize.Width, textureSize.Height));
 
-    irr::core::vector2df centre(size / 2, size / 2);
+    if (dabRect.getArea() == 0) {
+        return;
+    }
 
-    for (auto x = 0; x < size; ++x) {
-        for (auto y = 0; y < size; ++y) {
-            auto distanceFromCentre = irr::core::vector2df(x, y).getDistanceFrom(centre); // sqrt(pow(((size / 2) - x), 2) + pow(((size / 2) - y), 2));
+    // while drawing, dabs only add coverage to the stroke, which goes into the layer once at the brush opacity
+    if (isDrawing) {
+        auto strokeSurface = &surface;
 
-            if (distanceFromCentre <= brushSize)
-            {
-                brush->setPixel(x, y, color);
+        paintThread.push([this, strokeSurface, brush, point]() {
+            auto& layers = strokeSurface->getLayers();
+
+            if (!layers.isStroking()) {
+                beginStroke(*strokeSurface, *brush);
             }
-            else if (featherRadius > 0)
-            {
-                if (distanceFromCentre <= brushSize + featherRadius)
-                {
-                    // linear interpolation:
-                    //
-                    // x = distanceFromCentre
-                    // y = y0 + ((x - x0) * ((y1 - y0) / (x1 - x0)))
-                    // 
-                    // x0 = brushSize
-                    // y0 = 1
-                    // x1 = brushSize + featherRadius
-                    // y1 = 0
-                    // y = 1 + ((distanceFromCentre - brushSize) * ((0 - 1) / (brushSize + featherRadius - brushSize)) = 1 + ((distanceFromCentre - brushSize) * (-1 / featherRadius)
-                    //
-                    // alternatively:
-                    // 
-                    // x0 = brushSize + featherRadius
-                    // y0 = 0
-                    // x1 = brushSize
-                    // y1 = 1
-                    // y = 0 + ((distanceFromCentre - brushSize - featherRadius) * ((1 - 0) / (brushSize - brushSize - featherRadius))) = ((distanceFromCentre - brushSize - featherRadius) * (1 / (-featherRadius)))
 
-                    auto multiplier = 1 + ((distanceFromCentre - brushSize) * (-1 / featherRadius));
+            markChannelsDirty(*strokeSurface, layers.addStrokeDab(brush->image.get(), point));
+        });
 
-                    brush->setPixel(x, y, irr::video::SColor(multiplier * 255, color.getRed(), color.getGreen(), color.getBlue()));
-                }
-            }
-        }
+        return;
     }
 
-    if (brushTexture != nullptr)
-    {
-        driver->removeTexture(brushTexture);
-    }
+    // while only hovering, the dab is undone on the next cursor move
+    surface.beginPreview(dabRect);
 
-    brushImage = brush;
+    auto previewBrush = brush->image.get();
+    auto mask = getSelectionMask(surface, brush->selection.get());
 
-    brushTexture = driver->addTexture("__brush__", brushImage);
-}
+    if (mask != nullptr) {
+        mask->maskImage(brush->image.get(), maskedBrushImage.get(), point);
+        previewBrush = maskedBrushImage.get();
+    }
 
-void ApplicationDelegate::beginDrawing()
-{
-    isDrawing = true;
-}
+    textureImage.blend(previewBrush, point, BlendMode::Normal, brush->opacity);
 
-void ApplicationDelegate::endDrawing()
-{
-    isDrawing = false;
+    // only the tiles under the dab are recomposited and uploaded, before the next frame is drawn
+    surface.markDirty(dabRect);
 }
 
-bool ApplicationDelegate::isMouseOverGUI()
+void ApplicationDelegate::paintFilterDab(PaintSurface& surface, const irr::core::vector2di& point, irr::u32 strand)
 {
-    auto element = device->getGUIEnvironment()->getFocus();
-
-    if (element == nullptr)
-    {
-        return false;
+    // a smudge has nothing to lay down before it picked colors up, so like a fill it leaves no preview while hovering
+    if (!isDrawing && brushType == BrushType::Smudge) {
+        return;
     }
 
-    std::string elementName = element->getName();
+    auto dabSurface = &surface;
+    auto brush = captureBrush();
+    auto isStroke = isDrawing;
 
-    return elementName != "modelViewer";
-}
+    // filter dabs go straight into the layer rather than into a stroke, since each works on what the one before left
+    runPaintCommand([this, dabSurface, brush, point, strand, isStroke]() {
+        auto& layer = dabSurface->getLayers().getActiveLayer();
+        const auto& textureSize = layer.getSize();
 
-void ApplicationDelegate::saveTexture()
-{
-    if (textureFilename.empty()) {
-        auto saveTextureDialog = new SaveFileDialog(L"Save texture as", guienv, 0, -1);
+        auto dabRect = irr::core::recti(point, brush->image->getDimension());
+        dabRect.clipAgainst(irr::core::recti(0, 0, textureSize.Width, textureSize.Height));
 
-        if (saveTextureDialog == nullptr) {
-            std::cerr << "Could not save texture to a non-existent (empty name) file" << std::endl;
+        if (dabRect.getArea() == 0) {
             return;
         }
 
-        saveTextureDialog->setName("saveTextureDialog");
-
-        guienv->getRootGUIElement()->addChild(saveTextureDialog);
+        if (!isStroke) {
+            dabSurface->beginPreview(dabRect);
+        }
 
-        return;
-    }
+        auto mask = getSelectionMask(*dabSurface, brush->selection.get());
 
-    saveTexture(textureFilename);
-}
+        auto paintedRect = brush->type == BrushType::Smudge
+            ? filterBrush.smudgeDab(layer, brush->image.get(), point, strand, brush->opacity, mask)
+            : filterBrush.blurDab(threadPool, layer, brush->image.get(), point, brush->filterRadius, brush->type == BrushType::Sharpen, brush->opacity, mask);
 
-void ApplicationDelegate::saveTexture(const std::wstring& filename)
-{
-    driver->writeImageToFile(selectedTextureImage, filename.c_str());
+        if (paintedRect.getArea() != 0) {
+            dabSurface->markDirty(paintedRect);
+        }
+    });
 }
 
-void ApplicationDelegate::loadModel(const std::wstring& filename)
+void ApplicationDelegate::paintStencil(PaintSurface& surface, const irr::core::vector2df& uvCoords)
 {
-    if (modelSceneNode != nullptr) {
-        modelSceneNode->remove();
-    }
-
-    if (filename.empty()) {
-        std::cerr << "Could not load non-existent (empty filename) model" << std::endl;
+    if (stencil == nullptr) {
         return;
     }
 
-    modelMesh = smgr->getMesh(filename.c_str());
+    // resampled here rather than on the paint thread, which only blends, so the cache is only ever touched from this one
+    auto image = stencil->getResampled(threadPool, stencilScale, stencilRotation);
 
-    modelSceneNode = smgr->addAnimatedMeshSceneNode(modelMesh);
+    const auto& textureSize = surface.getLayers().getActiveLayer().getSize();
 
-    modelMesh->drop();
+    auto position = irr::core::vector2di(
+        irr::core::floor32(textureSize.Width * uvCoords.X) - static_cast<irr::s32>(image->size.Width / 2),
+        irr::core::floor32(textureSize.Height * uvCoords.Y) - static_cast<irr::s32>(image->size.Height / 2)
+    );
 
-    reinterpret_cast<irr::scene::IAnimatedMeshSceneNode*>(modelSceneNode)->setAnimationSpeed(0);
+    auto stencilSurface = &surface;
+    auto brush = captureBrush();
+    auto isStroke = isDrawing;
 
-    modelSceneNode->setMaterialFlag(irr::video::EMF_LIGHTING, false);
+    runPaintCommand([this, stencilSurface, brush, image, position, isStroke]() {
+        auto& layer = stencilSurface->getLayers().getActiveLayer();
+        const auto& size = layer.getSize();
 
-    auto materialsTabControl = reinterpret_cast<irr::gui::IGUITabControl*>(getElementByName("texturePreviewTabControl"));
+        auto stencilRect = irr::core::recti(position, image->size);
+        stencilRect.clipAgainst(irr::core::recti(0, 0, size.Width, size.Height));
 
-    materialsTabControl->clear();
+        if (stencilRect.getArea() == 0) {
+            return;
+        }
 
-    for (auto i = 0; i < modelSceneNode->getMaterialCount(); ++i) {
-        auto material = modelSceneNode->getMaterial(i);
-        auto texture = material.getTexture(0);
+        if (!isStroke) {
+            stencilSurface->beginPreview(stencilRect);
+        }
+
+        auto stampedRect = stampStencil(threadPool, layer, *image, position, brush->opacity, getSelectionMask(*stencilSurface, brush->selection.get()));
+
+        if (stampedRect.getArea() == 0) {
+            return;
+        }
 
-        if (texture == nullptr) {
+        stencilSurface->markDirty(stampedRect);
+    });
+}
+
+void ApplicationDelegate::beginStroke(PaintSurface& surface, const BrushState& brush)
+{
+    auto& layers = surface.getLayers();
+    layers.beginStroke(brush.color, brush.opacity, BlendMode::Normal, getSelectionMask(surface, brush.selection.get()));
+
+    const auto& size = layers.getActiveLayer().getSize();
+
+    // the other channels of the materials using the surface take the same coverage, each in its own grey
+    for (irr::u32 channel = 0; channel < PAINT_CHANNEL_COUNT - 1; ++channel) {
+        if ((brush.paintedChannels & (1 << channel)) == 0) {
             continue;
         }
 
-        std::wostringstream tabCaption;
-        
-        tabCaption << "Material " << i + 1;
+        auto grey = brush.channelValues[channel];
 
-        auto tab = materialsTabControl->addTab(tabCaption.str().c_str());
+        for (irr::u32 i = 0; i < paintSurfaces.size(); ++i) {
+            auto channelSurface = channelSurfaces[channel][i].get();
 
-        auto textureImage = guienv->addImage(irr::core::recti(10, 10, tab->getAbsoluteClippingRect().getWidth() - 10, tab->getAbsoluteClippingRect().getHeight() - 10));
-        
-        textureImage->setImage(texture);
+            if (paintSurfaces[i].get() != &surface || channelSurface == nullptr) {
+                continue;
+            }
 
-        textureImage->setName("image");
-        textureImage->setScaleImage(true);
+            auto& channelLayers = channelSurface->getLayers();
 
-        tab->addChild(textureImage);
+            // the coverage is held in the tiles of the first channel, which a texture of another size does not line up with
+            if (channelLayers.isStroking() || channelLayers.getActiveLayer().getSize() != size) {
+                continue;
+            }
 
-        textureImage->setScaleImage(true);
+            channelLayers.joinStroke(layers.getStroke(), irr::video::SColor(255, grey, grey, grey));
+        }
+    }
+}
 
-        // TODO: refactor this to be done on every __tab change__ and potentially use some caching
-        selectedTextureImage = driver->createImage(texture, irr::core::vector2di(0, 0), texture->getOriginalSize());
-        
-        tempImage = driver->createImage(irr::video::ECF_A8R8G8B8, selectedTextureImage);
-        tempTexture = driver->addTexture("__tempTexture__", tempImage);
+const TexelMask* ApplicationDelegate::getSelectionMask(PaintSurface& surface, const FaceSelection* selection)
+{
+    if (selection == nullptr) {
+        return nullptr;
     }
 
-    createBrush(brushSize, brushFeatherRadius, brushColor);
+    surface.updateMask(threadPool, *selection);
 
-    updatePropertiesWindow();
+    return surface.getMask();
+}
 
-    triangleSelector = smgr->createTriangleSelector(reinterpret_cast<irr::scene::IAnimatedMeshSceneNode*>(modelSceneNode));
+void ApplicationDelegate::markChannelsDirty(PaintSurface& surface, const irr::core::recti& rect)
+{
+    const auto& stroke = surface.getLayers().getStroke();
 
-    auto toolWindow = reinterpret_cast<irr::gui::IGUIWindow*>(getElementByName("toolWindow"));
-    toolWindow->setVisible(true);
+    for (irr::u32 channel = 0; channel < PAINT_CHANNEL_COUNT - 1; ++channel) {
+        for (irr::u32 i = 0; i < paintSurfaces.size(); ++i) {
+            auto channelSurface = channelSurfaces[channel][i].get();
 
-    auto saveTextureButton = reinterpret_cast<irr::gui::IGUIButton*>(getElementByName("saveTextureButton"));
-    saveTextureButton->setVisible(true);
-    saveTextureButton->setEnabled(true);
+            if (paintSurfaces[i].get() == &surface && channelSurface != nullptr && channelSurface->getLayers().getStroke() == stroke) {
+                channelSurface->getLayers().markDirty(rect);
+            }
+        }
+    }
 }
 
-void ApplicationDelegate::openSaveTextureDialog()
+void ApplicationDelegate::paintProjectedDab(const irr::core::vector2di& cursorPosition)
 {
-    if (saveTextureDialogIsOpen) {
+    if (projectionPainter == nullptr || modelSceneNode == nullptr) {
         return;
     }
 
-    auto saveTextureDialog = new SaveFileDialog(
-        L"Save levels file",
-        guienv,
-        nullptr,
+    auto viewport = driver->getViewPort();
+    auto viewportSize = irr::core::dimension2du(viewport.getWidth(), viewport.getHeight());
+    auto transform = getProjectionTransform();
+
+    // mesh buffers sharing a surface share a target, so their coverage lands in the same tiles
+    std::vector<PaintSurface*> targetSurfaces;
+    std::vector<irr::core::dimension2du> targetSizes;
+    std::vector<irr::s32> targets;
+
+    for (const auto& surface : paintSurfaces) {
+        if (surface == nullptr) {
+            targets.push_back(-1);
+            continue;
+        }
+
+        auto target = std::find(targetSurfaces.begin(), targetSurfaces.end(), surface.get());
+
+        if (target == targetSurfaces.end()) {
+            targetSurfaces.push_back(surface.get());
+            targetSizes.push_back(surface->getLayers().getActiveLayer().getSize());
+            target = targetSurfaces.end() - 1;
+        }
+
+        targets.push_back(static_cast<irr::s32>(target - targetSurfaces.begin()));
+    }
+
+    auto brush = captureBrush();
+    auto position = cursorPosition - viewport.UpperLeftCorner - irr::core::vector2di(brush->image->getDimension().Width / 2, brush->image->getDimension().Height / 2);
+
+    auto isStroke = isDrawing;
+
+    runPaintCommand([this, transform, viewportSize, brush, position, targets, targetSizes, targetSurfaces, isStroke]() {
+        // the mesh is only projected again once the camera or the window changed
+        projectionPainter->setView(transform, viewportSize);
+        projectionPainter->projectDab(brush->image.get(), position, targets, targetSizes, projectedTiles);
+
+        paintProjectedTiles(targetSurfaces, *brush, isStroke);
+    });
+}
+
+irr::core::matrix4 ApplicationDelegate::getProjectionTransform() const
+{
+    auto transform = camera->getProjectionMatrix();
+    transform *= camera->getViewMatrix();
+    transform *= modelSceneNode->getAbsoluteTransformation();
+
+    return transform;
+}
+
+void ApplicationDelegate::paintSphereDab(const irr::core::vector3df& centre, const irr::core::vector3df& normal)
+{
+    // the sphere is as wide, at the distance of the point under the cursor, as the brush is on the screen
+    auto distance = camera->getAbsolutePosition().getDistanceFrom(centre);
+    auto radius = brushSize * distance * std::tan(camera->getFOV() * 0.5f) / std::max(1, driver->getViewPort().getHeight());
+
+    // mirroring the sphere across a plane through the origin is mirroring its centre and normal
+    std::vector<std::pair<irr::core::vector3df, irr::core::vector3df>> spheres(1, std::make_pair(centre, normal));
+
+    for (irr::u32 axis = 0; axis < SymmetryMap::AXIS_COUNT; ++axis) {
+        if ((symmetryAxes & (1 << axis)) == 0) {
+            continue;
+        }
+
+        auto sphereCount = spheres.size();
+
+        for (std::size_t i = 0; i < sphereCount; ++i) {
+            auto mirroredSphere = spheres[i];
+
+            (&mirroredSphere.first.X)[axis] = -(&mirroredSphere.first.X)[axis];
+            (&mirroredSphere.second.X)[axis] = -(&mirroredSphere.second.X)[axis];
+
+            spheres.push_back(mirroredSphere);
+        }
+    }
+
+    std::vector<PaintSurface*> targetSurfaces;
+    std::set<PaintSurface*> visitedSurfaces;
+
+    // spheres paint the first channel, the others follow its strokes; a virtual texture's atlas would not fit into memory
+    for (auto& surface : paintSurfaces) {
+        if (surface != nullptr && !surface->isVirtual() && visitedSurfaces.insert(surface.get()).second) {
+            targetSurfaces.push_back(surface.get());
+        }
+    }
+
+    auto brush = captureBrush();
+    auto isStroke = isDrawing;
+
+    runPaintCommand([this, spheres, radius, targetSurfaces, brush, isStroke]() {
+        // only spheres need the atlas, so it is built for the first of them, off the main thread while drawing
+        for (auto surface : targetSurfaces) {
+            if (surface->getAtlas() == nullptr) {
+                surface->updateAtlas(threadPool);
+            }
+        }
+
+        projectedTiles.clear();
+
+        for (irr::u32 target = 0; target < targetSurfaces.size(); ++target) {
+            for (const auto& sphere : spheres) {
+                targetSurfaces[target]->getAtlas()->addSphereDab(threadPool, brush->image.get(), sphere.first, radius, sphere.second, target, projectedTiles);
+            }
+        }
+
+        paintProjectedTiles(targetSurfaces, *brush, isStroke);
+    });
+}
+
+void ApplicationDelegate::paintVertexDab(const irr::core::vector3df& centre)
+{
+    if (vertexPainter == nullptr) {
+        return;
+    }
+
+    // the brush's solid radius and feather are measured in pixels on the screen, at the distance of the point under the cursor
+    auto distance = camera->getAbsolutePosition().getDistanceFrom(centre);
+    auto pixelSize = 2.f * distance * std::tan(camera->getFOV() * 0.5f) / std::max(1, driver->getViewPort().getHeight());
+
+    // vertex colors are never touched by the paint thread, so they are painted right here
+    if (!vertexPainter->isStroking()) {
+        vertexPainter->beginStroke(brushColor, brushOpacity, faceSelection.get());
+    }
+
+    std::vector<irr::core::vector3df> centres(1, centre);
+
+    for (irr::u32 axis = 0; axis < SymmetryMap::AXIS_COUNT; ++axis) {
+        if ((symmetryAxes & (1 << axis)) == 0) {
+            continue;
+        }
+
+        auto centreCount = centres.size();
+
+        for (std::size_t i = 0; i < centreCount; ++i) {
+            auto mirroredCentre = centres[i];
+
+            (&mirroredCentre.X)[axis] = -(&mirroredCentre.X)[axis];
+
+            centres.push_back(mirroredCentre);
+        }
+    }
+
+    for (const auto& dabCentre : centres) {
+        vertexPainter->addDab(dabCentre, brushSize * pixelSize, brushFeatherRadius * pixelSize);
+    }
+}
+
+void ApplicationDelegate::paintProjectedTiles(const std::vector<PaintSurface*>& targetSurfaces, const BrushState& brush, bool isStroke)
+{
+    // mirrored dabs may reach the same tile, which is painted once with the coverage of all of them
+    std::sort(projectedTiles.begin(), projectedTiles.end(), [](const ProjectedTile& a, const ProjectedTile& b) {
+        return std::make_tuple(a.target, a.tileY, a.tileX) < std::make_tuple(b.target, b.tileY, b.tileX);
+    });
+
+    std::size_t tileCount = 0;
+
+    for (std::size_t t = 0; t < projectedTiles.size(); ++t) {
+        auto& tile = projectedTiles[t];
+
+        if (tileCount > 0) {
+            auto& previousTile = projectedTiles[tileCount - 1];
+
+            if (previousTile.target == tile.target && previousTile.tileX == tile.tileX && previousTile.tileY == tile.tileY) {
+                std::transform(previousTile.coverage.begin(), previousTile.coverage.end(), tile.coverage.begin(), previousTile.coverage.begin(), [](irr::u8 a, irr::u8 b) {
+                    return std::max(a, b);
+                });
+
+                continue;
+            }
+        }
+
+        if (t != tileCount) {
+            projectedTiles[tileCount] = std::move(tile);
+        }
+
+        ++tileCount;
+    }
+
+    projectedTiles.resize(tileCount);
+
+    // while drawing, the coverage joins the stroke of each surface just like that of a dab painted in texture space
+    if (isStroke) {
+        for (const auto& tile : projectedTiles) {
+            auto& surface = *targetSurfaces[tile.target];
+            auto& layers = surface.getLayers();
+
+            if (!layers.isStroking()) {
+                beginStroke(surface, brush);
+            }
+
+            markChannelsDirty(surface, layers.addStrokeCoverage(tile.tileX, tile.tileY, tile.coverage.data()));
+        }
+
+        return;
+    }
+
+    std::vector<irr::core::recti> tileRects;
+
+    for (const auto& tile : projectedTiles) {
+        const auto& size = targetSurfaces[tile.target]->getLayers().getActiveLayer().getSize();
+
+        auto x0 = tile.tileX * ProjectionPainter::TILE_SIZE;
+        auto y0 = tile.tileY * ProjectionPainter::TILE_SIZE;
+
+        tileRects.push_back(irr::core::recti(x0, y0, std::min(x0 + ProjectionPainter::TILE_SIZE, size.Width), std::min(y0 + ProjectionPainter::TILE_SIZE, size.Height)));
+
+        targetSurfaces[tile.target]->beginPreview(tileRects.back());
+    }
+
+    std::vector<const TexelMask*> targetMasks;
+
+    for (auto targetSurface : targetSurfaces) {
+        targetMasks.push_back(getSelectionMask(*targetSurface, brush.selection.get()));
+    }
+
+    // every tile is blended by one task, which is all the layers need to be painted into from several threads
+    auto rgb = brush.color.color & 0x00FFFFFF;
+
+    threadPool.parallelFor(projectedTiles.size(), [&](std::size_t t) {
+        const auto& tile = projectedTiles[t];
+        const auto& tileRect = tileRects[t];
+
+        auto& layer = targetSurfaces[tile.target]->getLayers().getActiveLayer();
+
+        irr::u32 texels[ProjectionPainter::TILE_SIZE];
+
+        for (auto y = tileRect.UpperLeftCorner.Y; y < tileRect.LowerRightCorner.Y; ++y) {
+            auto tileY = y - tileRect.UpperLeftCorner.Y;
+            auto coverage = tile.coverage.data() + (tileY * ProjectionPainter::TILE_SIZE);
+            auto maskRow = targetMasks[tile.target] != nullptr ? targetMasks[tile.target]->getRow(tile.tileX, tile.tileY, tileY) : ~0ull;
+
+            for (irr::s32 x = 0; x < tileRect.getWidth(); ++x) {
+                texels[x] = (maskRow & (1ull << x)) != 0 ? (static_cast<irr::u32>(coverage[x]) << 24) | rgb : rgb;
+            }
+
+            layer.blendSpan(tileRect.UpperLeftCorner.X, y, texels, tileRect.getWidth(), BlendMode::Normal, brush.opacity);
+        }
+    });
+
+    for (std::size_t t = 0; t < projectedTiles.size(); ++t) {
+        targetSurfaces[projectedTiles[t].target]->markDirty(tileRects[t]);
+    }
+}
+
+void ApplicationDelegate::runPaintCommand(std::function<void()> command)
+{
+    if (isDrawing) {
+        paintThread.push(std::move(command));
+    }
+    else {
+        command();
+    }
+}
+
+void ApplicationDelegate::finishPainting()
+{
+    paintThread.finish();
+}
+
+void ApplicationDelegate::fillTextureAt(PaintSurface& surface, const irr::core::vector2df& uvCoords)
+{
+    finishPainting();
+
+    auto& layer = surface.getLayers().getActiveLayer();
+    const auto& textureSize = layer.getSize();
+
+    auto seed = irr::core::vector2di(
+        irr::core::clamp<irr::s32>(irr::core::floor32(textureSize.Width * uvCoords.X), 0, textureSize.Width - 1),
+        irr::core::clamp<irr::s32>(irr::core::floor32(textureSize.Height * uvCoords.Y), 0, textureSize.Height - 1)
+    );
+
+    auto filledRect = floodFill(threadPool, layer, surface.getIslands(), seed, fillTolerance, brushColor, brushOpacity);
+
+    if (filledRect.getArea() == 0) {
+        return;
+    }
+
+    surface.markDirty(filledRect);
+}
+
+void ApplicationDelegate::updatePaintSurfaces()
+{
+    if (modelSceneNode == nullptr) {
+        return;
+    }
+
+    // the thumbnails in the material tabs may lag behind a fast stroke, the model itself never does
+    const auto PREVIEW_UPDATE_BUDGET = std::chrono::milliseconds(2);
+
+    auto world = modelSceneNode->getAbsoluteTransformation();
+    auto previewDeadline = std::chrono::steady_clock::now() + PREVIEW_UPDATE_BUDGET;
+
+    // while it has commands, the paint thread composites what they painted itself; only hover previews are left to this thread
+    if (paintThread.isIdle()) {
+        forEachPaintSurface([](PaintSurface& surface) {
+            surface.composite();
+        });
+    }
+
+    forEachPaintSurface([&](PaintSurface& surface) {
+        surface.updateResidency(camera, world);
+        surface.upload(previewDeadline);
+    });
+}
+
+void ApplicationDelegate::forEachPaintSurface(const std::function<void(PaintSurface&)>& action)
+{
+    std::set<PaintSurface*> visitedSurfaces;
+
+    for (auto& surface : paintSurfaces)
+    {
+        // materials sharing a texture share its surface
+        if (surface != nullptr && visitedSurfaces.insert(surface.get()).second)
+        {
+            action(*surface);
+        }
+    }
+
+    // the other channels come after the first, so projects keep the layers of the first channel in front
+    for (auto& surfaces : channelSurfaces)
+    {
+        for (auto& surface : surfaces)
+        {
+            if (surface != nullptr && visitedSurfaces.insert(surface.get()).second)
+            {
+                action(*surface);
+            }
+        }
+    }
+}
+
+std::shared_ptr<PaintSurface> ApplicationDelegate::getSelectedPaintSurface()
+{
+    auto materialsTabControl = reinterpret_cast<irr::gui::IGUITabControl*>(getElementByName("texturePreviewTabControl"));
+
+    auto tabIndex = materialsTabControl->getActiveTab();
+
+    // there is one tab for every material with a surface
+    for (auto& surface : paintSurfaces)
+    {
+        if (surface != nullptr && tabIndex-- == 0)
+        {
+            return surface;
+        }
+    }
+
+    return nullptr;
+}
+
+void ApplicationDelegate::createBrush(float brushSize, float featherRadius, irr::video::SColor color)
+{
+    const auto size = (brushSize + featherRadius) * 2;
+
+    auto brush = driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(size, size));
+
+    brush->fill(irr::video::SColor(0, 0, 0, 0));
+
+    auto maxDistance = featherRadius + brushSize;
+
+    irr::core::vector2df centre(size / 2, size / 2);
+
+    for (auto x = 0; x < size; ++x) {
+        for (auto y = 0; y < size; ++y) {
+            auto distanceFromCentre = irr::core::vector2df(x, y).getDistanceFrom(centre); // sqrt(pow(((size / 2) - x), 2) + pow(((size / 2) - y), 2));
+
+            if (distanceFromCentre <= brushSize)
+            {
+                brush->setPixel(x, y, color);
+            }
+            else if (featherRadius > 0)
+            {
+                if (distanceFromCentre <= brushSize + featherRadius)
+                {
+                    // linear interpolation:
+                    //
+                    // x = distanceFromCentre
+                    // y = y0 + ((x - x0) * ((y1 - y0) / (x1 - x0)))
+                    // 
+                    // x0 = brushSize
+                    // y0 = 1
+                    // x1 = brushSize + featherRadius
+                    // y1 = 0
+                    // y = 1 + ((distanceFromCentre - brushSize) * ((0 - 1) / (brushSize + featherRadius - brushSize)) = 1 + ((distanceFromCentre - brushSize) * (-1 / featherRadius)
+                    //
+                    // alternatively:
+                    // 
+                    // x0 = brushSize + featherRadius
+                    // y0 = 0
+                    // x1 = brushSize
+                    // y1 = 1
+                    // y = 0 + ((distanceFromCentre - brushSize - featherRadius) * ((1 - 0) / (brushSize - brushSize - featherRadius))) = ((distanceFromCentre - brushSize - featherRadius) * (1 / (-featherRadius)))
+
+                    auto multiplier = 1 + ((distanceFromCentre - brushSize) * (-1 / featherRadius));
+
+                    brush->setPixel(x, y, irr::video::SColor(multiplier * 255, color.getRed(), color.getGreen(), color.getBlue()));
+                }
+            }
+        }
+    }
+
+    // the previous texture has to leave the cache before another one is added under its name
+    brushTexture.reset();
+
+    brushImage = ResourceHandle<irr::video::IImage>(brush);
+    maskedBrushImage = ResourceHandle<irr::video::IImage>(driver->createImage(irr::video::ECF_A8R8G8B8, brush->getDimension()));
+
+    brushTexture = TextureHandle(driver, driver->addTexture("__brush__", brushImage.get()));
+}
+
+void ApplicationDelegate::beginDrawing()
+{
+    isDrawing = true;
+    hasFilled = false;
+    hasStamped = false;
+}
+
+void ApplicationDelegate::endDrawing()
+{
+    if (!isDrawing) {
+        return;
+    }
+
+    isDrawing = false;
+
+    if (paintTool == PaintTool::Lasso) {
+        selectInLasso();
+    }
+
+    lassoPoints.clear();
+
+    if (vertexPainter != nullptr) {
+        vertexPainter->endStroke();
+    }
+
+    // queued after the dabs of the stroke, so it ends once they are all painted
+    paintThread.push([this]() {
+        endStrokes();
+    });
+}
+
+void ApplicationDelegate::endStrokes()
+{
+    filterBrush.endSmudge();
+
+    std::vector<LayerStack*> strokingStacks;
+
+    forEachPaintSurface([&strokingStacks](PaintSurface& surface) {
+        if (surface.getLayers().isStroking()) {
+            strokingStacks.push_back(&surface.getLayers());
+        }
+    });
+
+    // the channels sharing a stroke blend it in one pass over its tiles, while the coverage of each tile is in cache
+    while (!strokingStacks.empty()) {
+        auto stroke = strokingStacks.front()->getStroke();
+
+        auto sharing = std::stable_partition(strokingStacks.begin(), strokingStacks.end(), [&stroke](LayerStack* stack) {
+            return stack->getStroke() == stroke;
+        });
+
+        LayerStack::endSharedStroke(threadPool, std::vector<LayerStack*>(strokingStacks.begin(), sharing));
+
+        strokingStacks.erase(strokingStacks.begin(), sharing);
+    }
+}
+
+void ApplicationDelegate::selectInLasso()
+{
+    if (projectionPainter == nullptr || modelSceneNode == nullptr || faceSelection == nullptr || lassoPoints.size() < 3) {
+        return;
+    }
+
+    finishPainting();
+
+    auto viewport = driver->getViewPort();
+
+    projectionPainter->setView(getProjectionTransform(), irr::core::dimension2du(viewport.getWidth(), viewport.getHeight()));
+
+    auto viewportCorner = driver->getViewPort().UpperLeftCorner;
+
+    std::vector<irr::core::vector2df> polygon;
+
+    for (const auto& point : lassoPoints) {
+        polygon.push_back(irr::core::vector2df(static_cast<irr::f32>(point.X - viewportCorner.X), static_cast<irr::f32>(point.Y - viewportCorner.Y)));
+    }
+
+    std::vector<irr::u32> triangles;
+    projectionPainter->getTrianglesInPolygon(polygon, triangles);
+
+    for (auto triangle : triangles) {
+        if (selectsMaterials) {
+            faceSelection->setMeshBufferSelected(faceSelection->getMeshBufferIndex(triangle), !deselects);
+        }
+        else {
+            faceSelection->setSelected(triangle, !deselects);
+        }
+    }
+}
+
+void ApplicationDelegate::drawLasso()
+{
+    const auto LASSO_COLOR = irr::video::SColor(255, 255, 255, 0);
+
+    for (std::size_t i = 1; i < lassoPoints.size(); ++i) {
+        driver->draw2DLine(lassoPoints[i - 1], lassoPoints[i], LASSO_COLOR);
+    }
+
+    // the loop is closed from the cursor back to where it started
+    if (lassoPoints.size() > 2) {
+        driver->draw2DLine(lassoPoints.back(), lassoPoints.front(), LASSO_COLOR);
+    }
+}
+
+void ApplicationDelegate::clearSelection()
+{
+    finishPainting();
+
+    if (faceSelection != nullptr) {
+        faceSelection->clear();
+    }
+
+    // the brush preview is taken back and put back without the mask on the next update
+    previousMouseCursorPosition = irr::core::vector2di(-1, -1);
+}
+
+bool ApplicationDelegate::isMouseOverGUI()
+{
+    auto element = device->getGUIEnvironment()->getFocus();
+
+    if (element == nullptr)
+    {
+        return false;
+    }
+
+    std::string elementName = element->getName();
+
+    return elementName != "modelViewer";
+}
+
+void ApplicationDelegate::saveTexture()
+{
+    if (textureFilename.empty()) {
+        auto saveTextureDialog = new SaveFileDialog(L"Save texture as", guienv, 0, -1);
+
+        if (saveTextureDialog == nullptr) {
+            std::cerr << "Could not save texture to a non-existent (empty name) file" << std::endl;
+            return;
+        }
+
+        saveTextureDialog->setName("saveTextureDialog");
+
+        guienv->getRootGUIElement()->addChild(saveTextureDialog);
+
+        return;
+    }
+
+    saveTexture(textureFilename);
+}
+
+void ApplicationDelegate::saveTexture(const std::wstring& filename)
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        std::cerr << "Could not save texture - no material is selected" << std::endl;
+        return;
+    }
+
+    // the brush preview must not end up in the file
+    surface->restorePreview();
+    surface->composite();
+
+    auto image = surface->getImage();
+    auto islands = surface->getIslands();
+
+    if (paddingWidth == 0 || islands == nullptr) {
+        writeTexture(*surface, image, filename, 0);
+        return;
+    }
+
+    // the islands are padded in a copy, the layers and the texture on screen are left as painted
+    ResourceHandle<irr::video::IImage> paddedImage(driver->createImage(image->getColorFormat(), image->getDimension()));
+    image->copyTo(paddedImage.get());
+
+    padUvIslands(threadPool, *islands, paddedImage.get(), paddingWidth);
+
+    writeTexture(*surface, paddedImage.get(), filename, paddingWidth);
+}
+
+void ApplicationDelegate::writeTexture(PaintSurface& surface, irr::video::IImage* image, const std::wstring& filename, irr::u32 margin)
+{
+    if (!isDdsFilename(filename)) {
+        driver->writeImageToFile(image, filename.c_str());
+        return;
+    }
+
+    auto file = device->getFileSystem()->createAndWriteFile(filename.c_str());
+
+    if (file == nullptr) {
+        std::cerr << "Could not save texture - the file could not be opened for writing" << std::endl;
+        return;
+    }
+
+    auto& exporter = surface.getExporter();
+
+    exporter.setMargin(margin);
+
+    auto isWritten = exporter.write(threadPool, image, ddsFormat, ddsMipFilter, file);
+
+    file->drop();
+
+    if (!isWritten) {
+        std::cerr << "Could not save texture - writing the DDS file failed" << std::endl;
+    }
+}
+
+void ApplicationDelegate::loadModel(const std::wstring& filename)
+{
+    if (filename.empty()) {
+        std::cerr << "Could not load non-existent (empty filename) model" << std::endl;
+        return;
+    }
+
+    // loadProject sets it again after this
+    isLoadingProject = false;
+
+    // the current model stays on screen and paintable until the new one is ready
+    modelLoader.start(filename);
+
+    auto loadProgressWindow = getElementByName("loadProgressWindow");
+    loadProgressWindow->setVisible(true);
+
+    guienv->getRootGUIElement()->bringToFront(loadProgressWindow);
+}
+
+void ApplicationDelegate::cancelLoadingModel()
+{
+    modelLoader.cancel();
+}
+
+void ApplicationDelegate::updateModelLoading()
+{
+    auto stage = modelLoader.getStage();
+
+    if (stage == ModelLoader::Stage::Idle) {
+        return;
+    }
+
+    if (modelLoader.isLoading()) {
+        updateLoadProgress(stage, modelLoader.getProgress());
+        return;
+    }
+
+    getElementByName("loadProgressWindow")->setVisible(false);
+
+    auto model = modelLoader.takeResult();
+
+    if (model != nullptr) {
+        finishLoadingModel(std::move(model));
+    }
+    else if (isLoadingProject) {
+        // the project whose model failed to load or was cancelled is not the one on screen
+        projectFilename.clear();
+    }
+
+    isLoadingProject = false;
+}
+
+void ApplicationDelegate::updateLoadProgress(ModelLoader::Stage stage, float progress)
+{
+    const wchar_t* caption = L"";
+
+    switch (stage) {
+    case ModelLoader::Stage::Parsing:
+        caption = L"Parsing model...";
+        break;
+    case ModelLoader::Stage::DecodingTextures:
+        caption = L"Decoding textures...";
+        break;
+    case ModelLoader::Stage::BuildingSelector:
+        caption = L"Building triangle selector...";
+        break;
+    case ModelLoader::Stage::BuildingSymmetryMap:
+        caption = L"Finding mirrored triangles...";
+        break;
+    case ModelLoader::Stage::MappingIslands:
+        caption = L"Mapping UV islands...";
+        break;
+    default:
+        break;
+    }
+
+    getElementByName("loadProgressText")->setText(caption);
+
+    auto track = getElementByName("loadProgressTrack");
+    auto fill = getElementByName("loadProgressFill", track);
+
+    auto trackRect = track->getRelativePosition();
+    auto fillWidth = static_cast<irr::s32>((trackRect.getWidth() - 2) * progress);
+
+    fill->setRelativePosition(irr::core::recti(1, 1, 1 + fillWidth, trackRect.getHeight() - 1));
+}
+
+void ApplicationDelegate::finishLoadingModel(std::unique_ptr<LoadedModel> model)
+{
+    // queued commands point at the surfaces about to be cleared
+    finishPainting();
+
+    auto uploadStart = std::chrono::steady_clock::now();
+
+    // the surfaces of the previous model reference its mesh buffers
+    paintSurfaces.clear();
+    paintSurfaces.resize(model->mesh->getMeshBufferCount());
+
+    for (auto& surfaces : channelSurfaces) {
+        surfaces.clear();
+        surfaces.resize(model->mesh->getMeshBufferCount());
+    }
+
+    std::map<irr::io::path, std::shared_ptr<PaintSurface>> surfacesByTexture;
+
+    // textures the new model uses again are moved back, the rest go once the previous model is off the scene
+    std::vector<TextureHandle> previousTextures;
+    previousTextures.swap(modelTextures);
+
+    // only the GPU uploads and the scene graph changes are left for the main thread
+    for (irr::u32 i = 0; i < model->mesh->getMeshBufferCount(); ++i)
+    {
+        auto meshBuffer = model->mesh->getMeshBuffer(i);
+        auto& material = meshBuffer->getMaterial();
+
+        for (irr::u32 layer = 0; layer < irr::video::MATERIAL_MAX_TEXTURES; ++layer)
+        {
+            auto placeholder = material.getTexture(layer);
+
+            if (placeholder == nullptr) {
+                continue;
+            }
+
+            auto textureName = placeholder->getName();
+            auto image = model->images.find(textureName);
+
+            // a texture too large to upload as a whole is never created, its pages are uploaded on demand
+            if (layer == 0 && image != model->images.end() && PaintSurface::needsVirtualTexture(driver, image->second->getDimension())) {
+                auto& surface = surfacesByTexture[textureName];
+
+                if (surface == nullptr) {
+                    surface = std::make_shared<PaintSurface>(driver, image->second);
+                }
+
+                for (irr::u32 otherLayer = 0; otherLayer < irr::video::MATERIAL_MAX_TEXTURES; ++otherLayer) {
+                    material.setTexture(otherLayer, nullptr);
+                }
+
+                surface->applyTo(material);
+                surface->addMeshBuffer(meshBuffer);
+
+                paintSurfaces[i] = surface;
+
+                break;
+            }
+
+            auto texture = driver->findTexture(textureName);
+            auto isCachedTexture = texture != nullptr;
+
+            if (texture == nullptr && image != model->images.end()) {
+                texture = driver->addTexture(textureName, image->second);
+
+                if (texture != nullptr) {
+                    modelTextures.emplace_back(driver, texture);
+                }
+            }
+            else if (isCachedTexture) {
+                auto previousTexture = std::find_if(previousTextures.begin(), previousTextures.end(), [texture](const TextureHandle& handle) {
+                    return handle.get() == texture;
+                });
+
+                if (previousTexture != previousTextures.end()) {
+                    modelTextures.push_back(std::move(*previousTexture));
+                    previousTextures.erase(previousTexture);
+                }
+            }
+
+            material.setTexture(layer, texture);
+
+            if (layer >= PAINT_CHANNEL_COUNT || texture == nullptr) {
+                continue;
+            }
+
+            auto& surface = surfacesByTexture[textureName];
+
+            if (surface == nullptr) {
+                // the decoded image is kept as the edit source, so the texture never has to be read back from the GPU
+                if (image != model->images.end()) {
+                    surface = std::make_shared<PaintSurface>(driver, image->second, texture);
+
+                    // a texture of the same name may still hold what was painted on it before
+                    if (isCachedTexture) {
+                        surface->markDirty(irr::core::recti(irr::core::vector2di(0, 0), image->second->getDimension()));
+                    }
+                }
+                else {
+                    ResourceHandle<irr::video::IImage> readbackImage(driver->createImage(texture, irr::core::vector2di(0, 0), texture->getOriginalSize()));
+
+                    if (readbackImage) {
+                        surface = std::make_shared<PaintSurface>(driver, readbackImage.get(), texture);
+                    }
+                }
+            }
+
+            if (surface != nullptr) {
+                surface->addMeshBuffer(meshBuffer);
+
+                if (layer == 0) {
+                    paintSurfaces[i] = surface;
+                }
+                else {
+                    channelSurfaces[layer - 1][i] = surface;
+                }
+            }
+        }
+    }
+
+    if (isProfilingLoading) {
+        auto uploadTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - uploadStart).count();
+
+        std::cout << "Uploaded " << model->images.size() << " textures in " << uploadTime << " ms" << std::endl;
+    }
+
+    // only the first channel is filled or painted with spheres, the others follow its strokes
+    std::set<PaintSurface*> firstChannelSurfaces;
+
+    for (auto& surface : paintSurfaces) {
+        if (surface != nullptr) {
+            firstChannelSurfaces.insert(surface.get());
+        }
+    }
+
+    // fills stay inside the UV island they start on; the loader mapped the islands of every decoded texture already
+    for (auto& loadedIslands : model->islands) {
+        auto surface = surfacesByTexture.find(loadedIslands.first);
+
+        if (surface != surfacesByTexture.end() && firstChannelSurfaces.count(surface->second.get()) != 0) {
+            surface->second->adoptIslands(loadedIslands.second.meshBuffers, loadedIslands.second.islands);
+        }
+    }
+
+    // textures read back from the GPU, or shown in other channels as well, are mapped here
+    for (auto surface : firstChannelSurfaces) {
+        if (surface->getIslands() == nullptr) {
+            surface->updateIslands(threadPool);
+        }
+    }
+
+    if (modelSceneNode != nullptr) {
+        modelSceneNode->remove();
+    }
+
+    previousTextures.clear();
+
+    // the mesh is taken over from the loaded model, which would drop it otherwise
+    modelMesh = ResourceHandle<irr::scene::IAnimatedMesh>(model->mesh);
+    model->mesh = nullptr;
+
+    modelSceneNode = smgr->addAnimatedMeshSceneNode(modelMesh.get());
+
+    reinterpret_cast<irr::scene::IAnimatedMeshSceneNode*>(modelSceneNode)->setAnimationSpeed(0);
+
+    modelSceneNode->setMaterialFlag(irr::video::EMF_LIGHTING, false);
+
+    auto materialsTabControl = reinterpret_cast<irr::gui::IGUITabControl*>(getElementByName("texturePreviewTabControl"));
+
+    materialsTabControl->clear();
+
+    for (auto i = 0; i < modelSceneNode->getMaterialCount(); ++i) {
+        auto surface = paintSurfaces[i];
+
+        if (surface == nullptr) {
+            continue;
+        }
+
+        std::wostringstream tabCaption;
+        
+        tabCaption << "Material " << i + 1;
+
+        auto tab = materialsTabControl->addTab(tabCaption.str().c_str());
+
+        auto textureImage = guienv->addImage(irr::core::recti(10, 10, tab->getAbsoluteClippingRect().getWidth() - 10, tab->getAbsoluteClippingRect().getHeight() - 10));
+        
+        textureImage->setImage(surface->getPreviewTexture());
+
+        textureImage->setName("image");
+        textureImage->setScaleImage(true);
+
+        tab->addChild(textureImage);
+
+        textureImage->setScaleImage(true);
+    }
+
+    createBrush(brushSize, brushFeatherRadius, brushColor);
+
+    updatePropertiesWindow();
+
+    updateLayersWindow();
+
+    triangleSelector = ResourceHandle<irr::scene::ITriangleSelector>(model->triangleSelector);
+    model->triangleSelector = nullptr;
+
+    symmetryMap = std::move(model->symmetryMap);
+
+    projectionPainter = std::move(model->projectionPainter);
+
+    vertexPainter = std::move(model->vertexPainter);
+
+    // the selection of the previous model numbers triangles which are gone
+    faceSelection = std::make_shared<FaceSelection>(modelMesh.get());
+
+    modelFilename = model->filename;
+
+    auto toolWindow = reinterpret_cast<irr::gui::IGUIWindow*>(getElementByName("toolWindow"));
+    toolWindow->setVisible(true);
+
+    auto saveTextureButton = reinterpret_cast<irr::gui::IGUIButton*>(getElementByName("saveTextureButton"));
+    saveTextureButton->setVisible(true);
+    saveTextureButton->setEnabled(true);
+
+    auto saveProjectButton = reinterpret_cast<irr::gui::IGUIButton*>(getElementByName("saveProjectButton"));
+    saveProjectButton->setVisible(true);
+    saveProjectButton->setEnabled(true);
+
+    if (isLoadingProject) {
+        finishLoadingProject();
+    }
+    else {
+        // a different model is not saved into the project of the previous one
+        projectFilename.clear();
+    }
+}
+
+void ApplicationDelegate::saveProject()
+{
+    if (projectFilename.empty()) {
+        auto saveProjectDialog = new SaveFileDialog(L"Save project as", guienv, 0, -1);
+
+        saveProjectDialog->setName("saveProjectDialog");
+
+        guienv->getRootGUIElement()->addChild(saveProjectDialog);
+
+        return;
+    }
+
+    saveProject(projectFilename);
+}
+
+void ApplicationDelegate::saveProject(const std::wstring& filename)
+{
+    auto surfaces = getProjectSurfaces();
+
+    if (surfaces.empty()) {
+        std::cerr << "Could not save project - the model has no textures to paint on" << std::endl;
+        return;
+    }
+
+    ProjectSettings settings;
+
+    settings.modelFilename = modelFilename;
+    settings.cameraPosition = camera->getPosition();
+    settings.cameraTarget = camera->getTarget();
+
+    // the brush in use is the only preset there is so far
+    settings.brushPresets.push_back(BrushPreset { L"Current brush", brushSize, brushFeatherRadius, brushColor, brushOpacity });
+
+    for (auto surface : surfaces) {
+        // the brush preview must not end up in the file, and the layers have to be resolved
+        surface->restorePreview();
+        surface->composite();
+    }
+
+    if (!projectFile.save(filename, settings, surfaces)) {
+        return;
+    }
+
+    projectFilename = filename;
+}
+
+void ApplicationDelegate::loadProject(const std::wstring& filename)
+{
+    ProjectSettings settings;
+
+    if (!projectFile.open(filename, settings)) {
+        return;
+    }
+
+    if (settings.modelFilename.empty()) {
+        std::cerr << "Could not load project - it names no model" << std::endl;
+        return;
+    }
+
+    loadModel(settings.modelFilename);
+
+    projectFilename = filename;
+
+    isLoadingProject = true;
+    loadingProjectSettings = settings;
+}
+
+void ApplicationDelegate::finishLoadingProject()
+{
+    isLoadingProject = false;
+
+    if (!projectFile.loadLayers(getProjectSurfaces())) {
+        std::cerr << "Could not load the layers of the project" << std::endl;
+    }
+
+    camera->setPosition(loadingProjectSettings.cameraPosition);
+    camera->setTarget(loadingProjectSettings.cameraTarget);
+
+    auto modelOffsetXSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("modelOffsetXSlider"));
+    modelOffsetXSlider->setPos(static_cast<irr::s32>(loadingProjectSettings.cameraPosition.X));
+
+    auto modelOffsetYSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("modelOffsetYSlider"));
+    modelOffsetYSlider->setPos(static_cast<irr::s32>(loadingProjectSettings.cameraPosition.Y));
+
+    auto modelOffsetZSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("modelOffsetZSlider"));
+    modelOffsetZSlider->setPos(static_cast<irr::s32>(loadingProjectSettings.cameraPosition.Z));
+
+    if (!loadingProjectSettings.brushPresets.empty()) {
+        const auto& preset = loadingProjectSettings.brushPresets.front();
+
+        brushSize = preset.size;
+        brushFeatherRadius = preset.featherRadius;
+        brushColor = preset.color;
+        brushOpacity = preset.opacity;
+
+        createBrush(brushSize, brushFeatherRadius, brushColor);
+
+        updatePropertiesWindow();
+    }
+
+    updateLayersWindow();
+}
+
+std::vector<PaintSurface*> ApplicationDelegate::getProjectSurfaces()
+{
+    // the layers are saved or loaded as they are once the last stroke went into them
+    finishPainting();
+
+    std::vector<PaintSurface*> surfaces;
+
+    forEachPaintSurface([&surfaces](PaintSurface& surface) {
+        surfaces.push_back(&surface);
+    });
+
+    return surfaces;
+}
+
+void ApplicationDelegate::openSaveTextureDialog()
+{
+    if (saveTextureDialogIsOpen) {
+        return;
+    }
+
+    auto saveTextureDialog = new SaveFileDialog(
+        L"Save levels file",
+        guienv,
+        nullptr,
         static_cast<irr::s32>(-1),
         true
     );
@@ -555,6 +1708,66 @@ void ApplicationDelegate::closeLoadModelDialog()
     loadModelDialogIsOpen = false;
 }
 
+void ApplicationDelegate::closeSaveProjectDialog()
+{
+    auto saveProjectDialog = reinterpret_cast<SaveFileDialog*>(getElementByName("saveProjectDialog"));
+
+    saveProjectDialog->remove();
+}
+
+void ApplicationDelegate::openLoadProjectDialog()
+{
+    auto loadProjectDialog = guienv->addFileOpenDialog(L"Select project");
+
+    loadProjectDialog->setName(L"loadProjectDialog");
+
+    guienv->getRootGUIElement()->addChild(loadProjectDialog);
+}
+
+void ApplicationDelegate::closeLoadProjectDialog()
+{
+    auto loadProjectDialog = reinterpret_cast<irr::gui::IGUIFileOpenDialog*>(getElementByName("loadProjectDialog"));
+
+    loadProjectDialog->remove();
+}
+
+void ApplicationDelegate::loadStencil(const std::wstring& filename)
+{
+    auto image = ResourceHandle<irr::video::IImage>(driver->createImageFromFile(irr::io::path(filename.c_str())));
+
+    if (!image) {
+        std::cerr << "Could not load stencil image" << std::endl;
+        return;
+    }
+
+    // the preview of the previous stencil may still be on the model
+    finishPainting();
+
+    stencil.reset(new Stencil(driver, image.get()));
+
+    auto stencilNameText = getElementByName("stencilNameText");
+    stencilNameText->setText(filename.substr(filename.find_last_of(L"/\\") + 1).c_str());
+
+    // the new stencil is previewed at the cursor on the next update
+    previousMouseCursorPosition = irr::core::vector2di(-1, -1);
+}
+
+void ApplicationDelegate::openLoadStencilDialog()
+{
+    auto loadStencilDialog = guienv->addFileOpenDialog(L"Select stencil image");
+
+    loadStencilDialog->setName(L"loadStencilDialog");
+
+    guienv->getRootGUIElement()->addChild(loadStencilDialog);
+}
+
+void ApplicationDelegate::closeLoadStencilDialog()
+{
+    auto loadStencilDialog = reinterpret_cast<irr::gui::IGUIFileOpenDialog*>(getElementByName("loadStencilDialog"));
+
+    loadStencilDialog->remove();
+}
+
 void ApplicationDelegate::updatePropertiesWindow()
 {
     auto brushSizeSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushSizeSlider"));
@@ -563,6 +1776,9 @@ void ApplicationDelegate::updatePropertiesWindow()
     auto brushFeatherSizeSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushFeatherSizeScroll"));
     brushFeatherSizeSlider->setPos(brushFeatherRadius);
 
+    auto brushOpacitySlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushOpacitySlider"));
+    brushOpacitySlider->setPos(static_cast<irr::s32>((brushOpacity * 100.f) + 0.5f));
+
     auto brushRedColorSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushColorRedSlider"));
     brushRedColorSlider->setPos(brushColor.getRed());
 
@@ -573,10 +1789,56 @@ void ApplicationDelegate::updatePropertiesWindow()
     brushBlueColorSlider->setPos(brushColor.getRed());
 
     auto brushPreviewImage = reinterpret_cast<irr::gui::IGUIImage*>(getElementByName("brushPreviewImage"));
-    brushPreviewImage->setImage(brushTexture);
+    brushPreviewImage->setImage(brushTexture.get());
 
     brushPreviewImage->setScaleImage(true);
 
+    auto toolComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("toolComboBox"));
+    toolComboBox->setSelected(static_cast<irr::s32>(paintTool));
+
+    auto brushTypeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("brushTypeComboBox"));
+    brushTypeComboBox->setSelected(static_cast<irr::s32>(brushType));
+
+    auto filterRadiusSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("filterRadiusSlider"));
+    filterRadiusSlider->setPos(filterRadius);
+
+    auto fillToleranceSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("fillToleranceSlider"));
+    fillToleranceSlider->setPos(static_cast<irr::s32>(((fillTolerance * 100) + 127) / 255));
+
+    auto stencilScaleSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("stencilScaleSlider"));
+    stencilScaleSlider->setPos(static_cast<irr::s32>((stencilScale * 100.f) + 0.5f));
+
+    auto stencilRotationSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("stencilRotationSlider"));
+    stencilRotationSlider->setPos(static_cast<irr::s32>(stencilRotation + 0.5f));
+
+    for (irr::u32 axis = 0; axis < SymmetryMap::AXIS_COUNT; ++axis) {
+        auto symmetryCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName(SYMMETRY_CHECK_BOX_NAMES[axis]));
+        symmetryCheckBox->setChecked((symmetryAxes & (1 << axis)) != 0);
+    }
+
+    auto selectionModeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("selectionModeComboBox"));
+    selectionModeComboBox->setSelected(selectsMaterials ? 1 : 0);
+
+    auto deselectCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("deselectCheckBox"));
+    deselectCheckBox->setChecked(deselects);
+
+    for (irr::u32 channel = 0; channel < PAINT_CHANNEL_COUNT - 1; ++channel) {
+        auto channelCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName(CHANNEL_CHECK_BOX_NAMES[channel]));
+        channelCheckBox->setChecked((paintedChannels & (1 << channel)) != 0);
+
+        auto channelValueSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName(CHANNEL_VALUE_SLIDER_NAMES[channel]));
+        channelValueSlider->setPos(channelValues[channel]);
+    }
+
+    auto paddingSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("paddingSlider"));
+    paddingSlider->setPos(paddingWidth);
+
+    auto ddsFormatComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("ddsFormatComboBox"));
+    ddsFormatComboBox->setSelected(static_cast<irr::s32>(ddsFormat));
+
+    auto ddsMipFilterComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("ddsMipFilterComboBox"));
+    ddsMipFilterComboBox->setSelected(static_cast<irr::s32>(ddsMipFilter));
+
     /*brushPreviewImage->getAbsoluteClippingRect().getWidth() < brushTexture->getSize().Width ||
     brushPreviewImage->getAbsoluteClippingRect().getHeight() < brushTexture->getSize().Height*/
 }
@@ -589,6 +1851,9 @@ void ApplicationDelegate::updateBrushProperties()
     auto brushFeatherSizeSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushFeatherSizeScroll"));
     brushFeatherRadius = brushFeatherSizeSlider->getPos();
 
+    auto brushOpacitySlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushOpacitySlider"));
+    brushOpacity = brushOpacitySlider->getPos() / 100.f;
+
     auto brushRedColorSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("brushColorRedSlider"));
     auto brushRed = brushRedColorSlider->getPos();
 
@@ -603,7 +1868,7 @@ void ApplicationDelegate::updateBrushProperties()
     createBrush(brushSize, brushFeatherRadius, brushColor);
 
     auto brushPreviewImage = reinterpret_cast<irr::gui::IGUIImage*>(getElementByName("brushPreviewImage"));
-    brushPreviewImage->setImage(brushTexture);
+    brushPreviewImage->setImage(brushTexture.get());
 
     brushPreviewImage->setScaleImage(
         brushPreviewImage->getAbsoluteClippingRect().getWidth() < brushTexture->getSize().Width ||
@@ -611,6 +1876,294 @@ void ApplicationDelegate::updateBrushProperties()
     );
 }
 
+void ApplicationDelegate::updateToolProperties()
+{
+    auto toolComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("toolComboBox"));
+    paintTool = static_cast<PaintTool>(toolComboBox->getSelected());
+
+    auto brushTypeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("brushTypeComboBox"));
+    brushType = static_cast<BrushType>(brushTypeComboBox->getSelected());
+
+    auto filterRadiusSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("filterRadiusSlider"));
+    filterRadius = static_cast<irr::u32>(filterRadiusSlider->getPos());
+
+    auto fillToleranceSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("fillToleranceSlider"));
+    fillTolerance = static_cast<irr::u32>(((fillToleranceSlider->getPos() * 255) + 50) / 100);
+
+    symmetryAxes = 0;
+
+    for (irr::u32 axis = 0; axis < SymmetryMap::AXIS_COUNT; ++axis) {
+        auto symmetryCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName(SYMMETRY_CHECK_BOX_NAMES[axis]));
+
+        if (symmetryCheckBox->isChecked()) {
+            symmetryAxes |= 1 << axis;
+        }
+    }
+
+    auto selectionModeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("selectionModeComboBox"));
+    selectsMaterials = selectionModeComboBox->getSelected() == 1;
+
+    auto deselectCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("deselectCheckBox"));
+    deselects = deselectCheckBox->isChecked();
+
+    // the brush preview of the cursor position is taken back, or put back, on the next update
+    previousMouseCursorPosition = irr::core::vector2di(-1, -1);
+}
+
+void ApplicationDelegate::updateStencilProperties()
+{
+    auto stencilScaleSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("stencilScaleSlider"));
+    stencilScale = stencilScaleSlider->getPos() / 100.f;
+
+    auto stencilRotationSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("stencilRotationSlider"));
+    stencilRotation = static_cast<irr::f32>(stencilRotationSlider->getPos());
+
+    previousMouseCursorPosition = irr::core::vector2di(-1, -1);
+}
+
+void ApplicationDelegate::updateChannelProperties()
+{
+    paintedChannels = 0;
+
+    for (irr::u32 channel = 0; channel < PAINT_CHANNEL_COUNT - 1; ++channel) {
+        auto channelCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName(CHANNEL_CHECK_BOX_NAMES[channel]));
+
+        if (channelCheckBox->isChecked()) {
+            paintedChannels |= 1 << channel;
+        }
+
+        auto channelValueSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName(CHANNEL_VALUE_SLIDER_NAMES[channel]));
+        channelValues[channel] = static_cast<irr::u8>(channelValueSlider->getPos());
+    }
+}
+
+void ApplicationDelegate::updateExportProperties()
+{
+    auto paddingSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("paddingSlider"));
+    paddingWidth = paddingSlider->getPos();
+
+    auto ddsFormatComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("ddsFormatComboBox"));
+    ddsFormat = static_cast<BlockFormat>(ddsFormatComboBox->getSelected());
+
+    auto ddsMipFilterComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("ddsMipFilterComboBox"));
+    ddsMipFilter = static_cast<MipFilter>(ddsMipFilterComboBox->getSelected());
+}
+
+void ApplicationDelegate::addLayer()
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    surface->restorePreview();
+
+    auto& layers = surface->getLayers();
+
+    std::wostringstream layerName;
+
+    layerName << L"Layer " << layers.getLayerCount();
+
+    layers.addLayer(layerName.str());
+
+    updateLayersWindow();
+}
+
+void ApplicationDelegate::removeLayer()
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    surface->restorePreview();
+
+    auto& layers = surface->getLayers();
+
+    layers.removeLayer(layers.getActiveLayerIndex());
+
+    updateLayersWindow();
+}
+
+void ApplicationDelegate::selectLayer()
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    auto layerList = reinterpret_cast<irr::gui::IGUIListBox*>(getElementByName("layerList"));
+
+    if (layerList->getSelected() < 0) {
+        return;
+    }
+
+    surface->restorePreview();
+
+    auto& layers = surface->getLayers();
+
+    // the list shows the top layer first
+    layers.setActiveLayerIndex(layers.getLayerCount() - 1 - layerList->getSelected());
+
+    updateLayersWindow();
+}
+
+void ApplicationDelegate::updateLayerProperties()
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    surface->restorePreview();
+
+    auto& layers = surface->getLayers();
+    auto layerIndex = layers.getActiveLayerIndex();
+
+    auto layerVisibleCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("layerVisibleCheckBox"));
+    layers.setLayerVisible(layerIndex, layerVisibleCheckBox->isChecked());
+
+    auto layerOpacitySlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("layerOpacitySlider"));
+    layers.setLayerOpacity(layerIndex, layerOpacitySlider->getPos() / 100.f);
+
+    auto layerBlendModeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("layerBlendModeComboBox"));
+    layers.setLayerBlendMode(layerIndex, static_cast<BlendMode>(layerBlendModeComboBox->getSelected()));
+
+    updateLayersWindow();
+}
+
+void ApplicationDelegate::updatePaintPrecision()
+{
+    finishPainting();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    surface->restorePreview();
+
+    auto& layers = surface->getLayers();
+
+    auto highPrecisionCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("highPrecisionCheckBox"));
+    layers.setHighPrecision(highPrecisionCheckBox->isChecked());
+}
+
+void ApplicationDelegate::updateLayersWindow()
+{
+    // names, visibility, opacity and blend modes only change on the main thread, so queued strokes need not be waited for
+    auto layerList = reinterpret_cast<irr::gui::IGUIListBox*>(getElementByName("layerList"));
+
+    layerList->clear();
+
+    auto surface = getSelectedPaintSurface();
+
+    if (surface == nullptr) {
+        return;
+    }
+
+    const auto& layers = surface->getLayers();
+
+    for (auto i = layers.getLayerCount(); i > 0; --i) {
+        const auto& layer = layers.getLayer(i - 1);
+
+        std::wstring caption = layer.getName();
+
+        if (!layer.isVisible()) {
+            caption += L" (hidden)";
+        }
+
+        layerList->addItem(caption.c_str());
+    }
+
+    layerList->setSelected(layers.getLayerCount() - 1 - layers.getActiveLayerIndex());
+
+    const auto& activeLayer = layers.getLayer(layers.getActiveLayerIndex());
+
+    auto layerVisibleCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("layerVisibleCheckBox"));
+    layerVisibleCheckBox->setChecked(activeLayer.isVisible());
+
+    auto layerOpacitySlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("layerOpacitySlider"));
+    layerOpacitySlider->setPos(static_cast<irr::s32>((activeLayer.getOpacity() * 100.f) + 0.5f));
+
+    auto layerBlendModeComboBox = reinterpret_cast<irr::gui::IGUIComboBox*>(getElementByName("layerBlendModeComboBox"));
+    layerBlendModeComboBox->setSelected(static_cast<irr::s32>(activeLayer.getBlendMode()));
+
+    auto highPrecisionCheckBox = reinterpret_cast<irr::gui::IGUICheckBox*>(getElementByName("highPrecisionCheckBox"));
+    highPrecisionCheckBox->setChecked(layers.isHighPrecision());
+}
+
+void ApplicationDelegate::toggleResourceWindow()
+{
+    auto resourceWindow = getElementByName("resourceWindow");
+
+    resourceWindow->setVisible(!resourceWindow->isVisible());
+
+    if (resourceWindow->isVisible()) {
+        guienv->getRootGUIElement()->bringToFront(resourceWindow);
+
+        // shown right away rather than after the next interval
+        resourceWindowUpdateTime = std::chrono::steady_clock::time_point();
+    }
+}
+
+void ApplicationDelegate::updateResourceWindow()
+{
+    const auto UPDATE_INTERVAL = std::chrono::milliseconds(500);
+    const auto MEGABYTE = 1024.f * 1024.f;
+
+    auto resourceWindow = getElementByName("resourceWindow");
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (!resourceWindow->isVisible() || now - resourceWindowUpdateTime < UPDATE_INTERVAL) {
+        return;
+    }
+
+    resourceWindowUpdateTime = now;
+
+    // the paint thread adds tiles to the layers while it paints, so the figure from before the stroke stays up until it is done
+    if (paintThread.isIdle()) {
+        layerTileBytes = 0;
+
+        forEachPaintSurface([this](PaintSurface& surface) {
+            layerTileBytes += surface.getLayers().getMemoryUsage();
+        });
+    }
+
+    auto paintLatency = paintThread.takeLatency();
+
+    auto cpuImages = getResourceUsage(ResourceCategory::CpuImages);
+    auto gpuTextures = getResourceUsage(ResourceCategory::GpuTextures);
+    auto meshData = getResourceUsage(ResourceCategory::MeshData);
+
+    std::wostringstream text;
+
+    text << std::fixed << std::setprecision(1);
+    text << L"CPU images: " << cpuImages.count << L" (" << cpuImages.bytes / MEGABYTE << L" MB)\n";
+    text << L"GPU textures: " << gpuTextures.count << L" (" << gpuTextures.bytes / MEGABYTE << L" MB), " << driver->getTextureCount() << L" in the driver\n";
+    text << L"Mesh data: " << meshData.count << L" (" << meshData.bytes / MEGABYTE << L" MB)\n";
+    text << L"Layer tiles: " << layerTileBytes / MEGABYTE << L" MB\n";
+    text << L"Paint queue: " << paintThread.getQueueDepth() << L" commands\n";
+    text << L"Paint latency: " << paintLatency.averageMilliseconds << L" ms average, " << paintLatency.longestMilliseconds << L" ms longest over " << paintLatency.commandCount << L" commands\n";
+    text << L"Last project save: " << projectFile.getLastSavedTileCount() << L" tiles (" << projectFile.getLastSaveSize() / MEGABYTE << L" MB appended)";
+
+    getElementByName("resourceUsageText", resourceWindow)->setText(text.str().c_str());
+}
+
 void ApplicationDelegate::updateModelProperties()
 {
     // auto modelScaleSlider = reinterpret_cast<irr::gui::IGUIScrollBar*>(getElementByName("modelScaleSlider"));
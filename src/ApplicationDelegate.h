@@ -1,21 +1,94 @@
 #pragma once
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cwctype>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
 #include <map>
 #include <memory>
 #include <queue>
+#include <set>
 #include <sstream>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include <irrlicht/irrlicht.h>
 
+#include "AssetCache.h"
+#include "DdsExporter.h"
+#include "EdgePadding.h"
+#include "FaceSelection.h"
+#include "FilterBrush.h"
+#include "FloodFill.h"
+#include "ModelLoader.h"
+#include "PaintSurface.h"
+#include "PaintThread.h"
+#include "ProjectFile.h"
+#include "ProjectionPainter.h"
+#include "ResourceHandle.h"
 #include "SaveFileDialog.h"
+#include "Stencil.h"
+#include "SymmetryMap.h"
+#include "ThreadPool.h"
+#include "VertexPainter.h"
+
+//! what pressing the mouse button on the model does
+enum class PaintTool
+{
+    Brush,
+    Fill,
+
+    //! the brush is laid on the screen and painted onto every visible surface under it
+    Projection,
+
+    //! the brush is a sphere around the point under the cursor, painting the surface inside it whatever the UVs
+    Sphere,
+
+    //! the faces, or whole materials, the cursor goes over while the button is down are selected, and painting kept to them
+    Select,
+
+    //! a loop drawn on the screen selects the visible faces inside it
+    Lasso,
+
+    //! an image is laid onto the texture centred at the point clicked, scaled and rotated as set in the stencil tab
+    Stencil,
+
+    //! the brush paints the colors of the vertices around the point under the cursor rather than a texture
+    VertexColor
+};
+
+//! texture layers of a material a stroke paints at once; the first is the one shown in the material tabs
+const irr::u32 PAINT_CHANNEL_COUNT = 4;
+
+static_assert(PAINT_CHANNEL_COUNT <= irr::video::MATERIAL_MAX_TEXTURES, "a material has a texture layer per channel");
+
+//! what a paint command paints with, taken when it is made so the brush can change while the paint thread catches up
+struct BrushState
+{
+    ResourceHandle<irr::video::IImage> image;
+    irr::video::SColor color;
+    irr::f32 opacity;
+    BrushType type;
+    irr::u32 filterRadius;
+    irr::u32 paintedChannels;
+    irr::u8 channelValues[PAINT_CHANNEL_COUNT - 1];
+
+    //! nullptr for anywhere; only changed once the paint thread is done with everything queued
+    std::shared_ptr<const FaceSelection> selection;
+};
 
 class ApplicationDelegate
 {
 public:
-    ApplicationDelegate(irr::IrrlichtDevice* _device);
+    //! _loaderDevice is handed to the model loader, see ModelLoader
+    /** With _isProfilingStartup, how long the GUI and its font took to load is printed, with _isProfilingLoading how long
+        each model took to load and to upload. */
+    ApplicationDelegate(irr::IrrlichtDevice* _device, irr::IrrlichtDevice* _loaderDevice, bool _isProfilingStartup, bool _isProfilingLoading);
 
     void initialize();
 
@@ -27,6 +100,16 @@ public:
 
     void loadModel(const std::wstring& filename);
 
+    void saveProject();
+
+    //! appends what was painted since the last save to the project file, or writes all of it to a new one
+    void saveProject(const std::wstring& filename);
+
+    //! loads the project's model and replaces its layers with the project's once it is loaded
+    void loadProject(const std::wstring& filename);
+
+    void cancelLoadingModel();
+
     void openSaveTextureDialog();
 
     void closeSaveTextureDialog();
@@ -35,6 +118,19 @@ public:
 
     void closeLoadModelDialog();
 
+    void closeSaveProjectDialog();
+
+    void openLoadProjectDialog();
+
+    void closeLoadProjectDialog();
+
+    //! loads the image the stencil tool lays onto the texture
+    void loadStencil(const std::wstring& filename);
+
+    void openLoadStencilDialog();
+
+    void closeLoadStencilDialog();
+
     void beginDrawing();
 
     void endDrawing();
@@ -43,6 +139,34 @@ public:
 
     void updateModelProperties();
 
+    void addLayer();
+
+    void removeLayer();
+
+    void selectLayer();
+
+    void updateLayerProperties();
+
+    //! switches the selected material between 8 bit and 16 bit linear-light painting
+    void updatePaintPrecision();
+
+    void updateToolProperties();
+
+    void updateStencilProperties();
+
+    void updateExportProperties();
+
+    //! reads which of the other channels strokes paint into, and the grey they paint each in
+    void updateChannelProperties();
+
+    //! lets painting go anywhere again
+    void clearSelection();
+
+    void updateLayersWindow();
+
+    //! shows or hides the live counts of images, textures and mesh data
+    void toggleResourceWindow();
+
     bool isMouseOverGUI();
 
     void quit();
@@ -54,8 +178,83 @@ private:
 
     void resetFont();
 
+    void printAssetLoadTime(const std::string& filename, AssetSource source, std::chrono::steady_clock::time_point loadStart);
+
     void paintTextureUnderCursor();
 
+    //! the brush as it is now, for the paint commands made from it
+    std::shared_ptr<const BrushState> captureBrush() const;
+
+    void paintDab(PaintSurface& surface, const irr::core::vector2di& point);
+
+    //! blurs, sharpens or smudges the texels of the active layer under the brush; strand tells the mirrored dabs of a smudge apart
+    void paintFilterDab(PaintSurface& surface, const irr::core::vector2di& point, irr::u32 strand);
+
+    //! blends the stencil, resampled for its scale and rotation, into the active layer centred at a point of the texture
+    void paintStencil(PaintSurface& surface, const irr::core::vector2df& uvCoords);
+
+    //! paints the vertex colors around a point of the mesh, and around its mirrors, as wide as the brush is on the screen
+    void paintVertexDab(const irr::core::vector3df& centre);
+
+    //! blends the strokes of every surface into their layers; runs on the paint thread
+    void endStrokes();
+
+    //! starts a stroke on a surface, shared with the surfaces of the channels painted along with it
+    void beginStroke(PaintSurface& surface, const BrushState& brush);
+
+    //! marks a rectangle painted into on the surfaces sharing the stroke of a surface
+    void markChannelsDirty(PaintSurface& surface, const irr::core::recti& rect);
+
+    //! the texels of a surface painting is kept to, rasterized again first if the selection changed; nullptr for anywhere
+    const TexelMask* getSelectionMask(PaintSurface& surface, const FaceSelection* selection);
+
+    //! selects or deselects the faces inside the loop drawn with the lasso
+    void selectInLasso();
+
+    void drawLasso();
+
+    //! the projection, view and world matrices combined, as the camera sees the model now
+    irr::core::matrix4 getProjectionTransform() const;
+
+    //! paints the brush centred on a point of the screen onto the model as the camera sees it
+    void paintProjectedDab(const irr::core::vector2di& cursorPosition);
+
+    //! paints a sphere as wide as the brush appears on the screen, and its mirrors, onto every surface it reaches
+    void paintSphereDab(const irr::core::vector3df& centre, const irr::core::vector3df& normal);
+
+    //! adds projectedTiles to the strokes of their surfaces, or previews them when isStroke is false
+    void paintProjectedTiles(const std::vector<PaintSurface*>& targetSurfaces, const BrushState& brush, bool isStroke);
+
+    //! queues painting on the paint thread while drawing, and runs it right away for a preview while hovering
+    void runPaintCommand(std::function<void()> command);
+
+    //! waits for the paint thread to be done with everything queued, before the layers are touched outside a stroke
+    void finishPainting();
+
+    void fillTextureAt(PaintSurface& surface, const irr::core::vector2df& uvCoords);
+
+    //! writes an image of a surface in the format its extension asks for, a DDS file through the surface's exporter
+    /** margin is how far beyond the painted tiles the image may differ from the surface's composite. */
+    void writeTexture(PaintSurface& surface, irr::video::IImage* image, const std::wstring& filename, irr::u32 margin);
+
+    void updatePaintSurfaces();
+
+    void forEachPaintSurface(const std::function<void(PaintSurface&)>& action);
+
+    std::shared_ptr<PaintSurface> getSelectedPaintSurface();
+
+    void updateModelLoading();
+
+    void updateLoadProgress(ModelLoader::Stage stage, float progress);
+
+    void finishLoadingModel(std::unique_ptr<LoadedModel> model);
+
+    //! loads the layers, the camera and the brush of the project opened by loadProject
+    void finishLoadingProject();
+
+    //! the surfaces in the order their layers are saved in a project
+    std::vector<PaintSurface*> getProjectSurfaces();
+
     irr::gui::IGUIElement* getElementByName(const std::string& name);
     irr::gui::IGUIElement* getElementByName(const std::string& name, irr::gui::IGUIElement* parent);
 
@@ -63,6 +262,8 @@ private:
 
     void updatePropertiesWindow();
 
+    void updateResourceWindow();
+
     irr::IrrlichtDevice* device;
 
     irr::video::IVideoDriver* driver;
@@ -72,18 +273,38 @@ private:
     irr::scene::ICameraSceneNode* camera;
 
     irr::scene::ISceneNode* modelSceneNode;
-    irr::scene::IAnimatedMesh* modelMesh;
+    ResourceHandle<irr::scene::IAnimatedMesh> modelMesh;
+
+    //! the textures added for the model's materials, removed from the driver once another model no longer uses them
+    std::vector<TextureHandle> modelTextures;
+
+    ResourceHandle<irr::video::IImage> brushImage;
+
+    //! the brush with the alpha cleared outside the selection, for previews; as large as brushImage
+    ResourceHandle<irr::video::IImage> maskedBrushImage;
+    TextureHandle brushTexture;
+
+    //! one per mesh buffer, empty for untextured ones; mesh buffers sharing a texture share its surface
+    std::vector<std::shared_ptr<PaintSurface>> paintSurfaces;
 
-    irr::video::IImage* brushImage;
-    irr::video::ITexture* brushTexture;
+    //! the textures of the other channels, also one per mesh buffer, empty where a material has no texture in that layer
+    std::vector<std::shared_ptr<PaintSurface>> channelSurfaces[PAINT_CHANNEL_COUNT - 1];
 
-    irr::video::IImage* selectedTextureImage;
-    irr::video::ITexture* selectedTexture;
+    ResourceHandle<irr::scene::ITriangleSelector> triangleSelector;
 
-    irr::video::IImage* tempImage;
-    irr::video::ITexture* tempTexture;
+    std::unique_ptr<SymmetryMap> symmetryMap;
 
-    irr::scene::ITriangleSelector* triangleSelector;
+    std::unique_ptr<ProjectionPainter> projectionPainter;
+
+    std::unique_ptr<VertexPainter> vertexPainter;
+
+    //! kept allocated from one projected dab to the next
+    std::vector<ProjectedTile> projectedTiles;
+
+    std::shared_ptr<FaceSelection> faceSelection;
+
+    //! the cursor positions of the lasso being drawn
+    std::vector<irr::core::vector2di> lassoPoints;
 
     irr::core::vector2di previousMouseCursorPosition;
 
@@ -97,5 +318,80 @@ private:
     unsigned int brushFeatherRadius = 5;
     irr::video::SColor brushColor;
 
+    //! opacity of a whole stroke, however often its dabs overlap
+    irr::f32 brushOpacity = 1.f;
+
+    PaintTool paintTool = PaintTool::Brush;
+
+    //! one bit per channel past the first which strokes paint into as well, each in a grey of its own
+    irr::u32 paintedChannels = 0;
+    irr::u8 channelValues[PAINT_CHANNEL_COUNT - 1] = { 128, 128, 128 };
+
+    //! largest difference in any channel between the seed texel and a filled one, 0 - 255
+    irr::u32 fillTolerance = 26;
+
+    //! texels the UV islands are bled outward by in saved textures, 0 to save them as painted
+    irr::u32 paddingWidth = 8;
+
+    BlockFormat ddsFormat = BlockFormat::BC3;
+    MipFilter ddsMipFilter = MipFilter::Kaiser;
+
+    //! one bit per SymmetryAxis across which dabs are mirrored
+    irr::u32 symmetryAxes = 0;
+
+    BrushType brushType = BrushType::Color;
+
+    //! texels the blur and sharpen brushes reach out to either side, up to FilterBrush::MAX_RADIUS
+    irr::u32 filterRadius = 4;
+
+    //! only used by the paint thread while drawing, and while it is idle for previews
+    FilterBrush filterBrush;
+
+    //! nullptr until an image has been loaded
+    std::unique_ptr<Stencil> stencil;
+
+    irr::f32 stencilScale = 1.f;
+
+    //! clockwise, in degrees
+    irr::f32 stencilRotation = 0.f;
+
+    //! whether the selection tools take whole materials rather than faces, and take them out of the selection rather than in
+    bool selectsMaterials = false;
+    bool deselects = false;
+
+    //! a fill happens once per press of the mouse button, not on every move while it is held
+    bool hasFilled = false;
+
+    //! a stencil too is laid once per press of the mouse button
+    bool hasStamped = false;
+
     std::wstring textureFilename;
+
+    //! when the resource window's figures were last refreshed
+    std::chrono::steady_clock::time_point resourceWindowUpdateTime;
+
+    //! the file of the model on screen, as saved in projects
+    std::wstring modelFilename;
+
+    //! where saveProject saves to without asking, empty until a project was saved or opened
+    std::wstring projectFilename;
+
+    //! the project loadProject opened while its model is loading
+    bool isLoadingProject = false;
+    ProjectSettings loadingProjectSettings;
+
+    bool isProfilingStartup;
+    bool isProfilingLoading;
+
+    ThreadPool threadPool;
+
+    ModelLoader modelLoader;
+
+    ProjectFile projectFile;
+
+    //! the memory of the layers when the paint thread was last idle, which is the only time it can be added up
+    std::size_t layerTileBytes = 0;
+
+    //! last, so it is stopped before anything its commands use is destroyed
+    PaintThread paintThread;
 };
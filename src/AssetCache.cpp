@@ -0,0 +1,897 @@
+#include "AssetCache.h"
+
+#include <cstdio>
+#include <cwchar>
+#include <iostream>
+#include <map>
+#include <vector>
+
+#include "BitmapFont.h"
+#include "Payload.h"
+
+namespace {
+    const irr::u32 GUI_CACHE_TAG = makeTag('G', 'U', 'I', 'C');
+    const irr::u32 FONT_CACHE_TAG = makeTag('F', 'O', 'N', 'T');
+
+    //! changes whenever the layout of a cache does, which makes older caches stale
+    const irr::u32 CACHE_VERSION = 1;
+
+    const char* const CACHE_EXTENSION = ".cache";
+
+    enum class GuiAttributeType : irr::u8
+    {
+        Bool,
+        Int,
+        Float,
+        String,
+        Enum,
+        Color,
+        Rect,
+        Position,
+        Texture
+    };
+
+    //! an attribute as the GUI environment writes it, parsed the way its attributes parse it
+    struct GuiAttribute
+    {
+        GuiAttributeType type;
+        std::wstring name;
+
+        //! the value of strings and enums, and the filename of textures
+        std::wstring text;
+
+        //! the value of bools, ints and colours, the corners of rectangles and the coordinates of positions
+        irr::s32 values[4];
+
+        irr::f32 number;
+    };
+
+    //! an element and what is in it, in the order the GUI environment reads them
+    /** The root stands for the environment itself, whose attributes are those of the skin. */
+    struct GuiElement
+    {
+        std::wstring type;
+
+        //! whether the element had attributes at all, since deserializing an empty set resets the element to defaults
+        bool hasAttributes;
+        std::vector<GuiAttribute> attributes;
+
+        std::vector<GuiElement> children;
+    };
+
+    //! the narrow name Irrlicht uses for a wide one, converted character by character as it converts them
+    std::string getNarrowName(const std::wstring& name)
+    {
+        std::string narrowName;
+
+        for (auto character : name)
+        {
+            narrowName.push_back(static_cast<char>(character));
+        }
+
+        return narrowName;
+    }
+
+    bool readFile(const std::string& filename, std::vector<irr::u8>& bytes)
+    {
+        auto file = std::fopen(filename.c_str(), "rb");
+
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        std::fseek(file, 0, SEEK_END);
+        auto size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+
+        bytes.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+
+        auto isRead = size >= 0 && std::fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+
+        std::fclose(file);
+
+        return isRead;
+    }
+
+    //! writes a cache; it is only an optimization, so failing to is not an error
+    void writeFile(const std::string& filename, const std::vector<irr::u8>& bytes)
+    {
+        auto file = std::fopen(filename.c_str(), "wb");
+
+        if (file == nullptr)
+        {
+            return;
+        }
+
+        auto isWritten = std::fwrite(bytes.data(), 1, bytes.size(), file) == bytes.size();
+
+        if (std::fclose(file) != 0 || !isWritten)
+        {
+            std::remove(filename.c_str());
+        }
+    }
+
+    //! FNV-1a, which is quick to compute and spreads small edits well
+    irr::u64 getHash(const std::vector<irr::u8>& bytes)
+    {
+        irr::u64 hash = 0xCBF29CE484222325ull;
+
+        for (auto byte : bytes)
+        {
+            hash = (hash ^ byte) * 0x100000001B3ull;
+        }
+
+        return hash;
+    }
+
+    void putCacheHeader(PayloadWriter& writer, irr::u32 tag, const std::vector<irr::u8>& source)
+    {
+        writer.putU32(tag);
+        writer.putU32(CACHE_VERSION);
+        writer.putU64(source.size());
+        writer.putU64(getHash(source));
+    }
+
+    //! whether a cache was made from the source as it is now
+    bool isCacheOf(PayloadReader& reader, irr::u32 tag, const std::vector<irr::u8>& source)
+    {
+        auto cacheTag = reader.getU32();
+        auto version = reader.getU32();
+        auto sourceSize = reader.getU64();
+        auto sourceHash = reader.getU64();
+
+        return reader.isValid() && cacheTag == tag && version == CACHE_VERSION && sourceSize == source.size() && sourceHash == getHash(source);
+    }
+
+    //! reads the numbers of a rectangle or a position, which are separated by commas and spaces
+    bool parseIntegers(const wchar_t* text, irr::s32* values, irr::u32 count)
+    {
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            wchar_t* end;
+            values[i] = static_cast<irr::s32>(std::wcstol(text, &end, 10));
+
+            if (end == text)
+            {
+                return false;
+            }
+
+            text = end;
+
+            while (*text == L',' || *text == L' ')
+            {
+                ++text;
+            }
+        }
+
+        return true;
+    }
+
+    //! reads the attribute the reader is at; false for kinds of attributes the cache does not know
+    bool readGuiAttribute(irr::io::IXMLReader* reader, GuiAttribute& attribute)
+    {
+        std::wstring kind = reader->getNodeName();
+        auto value = reader->getAttributeValueSafe(L"value");
+
+        attribute.name = reader->getAttributeValueSafe(L"name");
+        attribute.number = 0.f;
+
+        for (auto& component : attribute.values)
+        {
+            component = 0;
+        }
+
+        if (kind == L"bool")
+        {
+            attribute.type = GuiAttributeType::Bool;
+            attribute.values[0] = std::wcscmp(value, L"true") == 0 ? 1 : 0;
+        }
+        else if (kind == L"int")
+        {
+            attribute.type = GuiAttributeType::Int;
+            attribute.values[0] = static_cast<irr::s32>(std::wcstol(value, nullptr, 10));
+        }
+        else if (kind == L"float")
+        {
+            attribute.type = GuiAttributeType::Float;
+            attribute.number = std::wcstof(value, nullptr);
+        }
+        else if (kind == L"string")
+        {
+            attribute.type = GuiAttributeType::String;
+            attribute.text = value;
+        }
+        else if (kind == L"enum")
+        {
+            attribute.type = GuiAttributeType::Enum;
+            attribute.text = value;
+        }
+        else if (kind == L"color")
+        {
+            attribute.type = GuiAttributeType::Color;
+            attribute.values[0] = static_cast<irr::s32>(std::wcstoul(value, nullptr, 16));
+        }
+        else if (kind == L"rect")
+        {
+            attribute.type = GuiAttributeType::Rect;
+            return parseIntegers(value, attribute.values, 4);
+        }
+        else if (kind == L"position")
+        {
+            attribute.type = GuiAttributeType::Position;
+            return parseIntegers(value, attribute.values, 2);
+        }
+        else if (kind == L"texture")
+        {
+            attribute.type = GuiAttributeType::Texture;
+            attribute.text = value;
+        }
+        else
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    //! reads the attributes element the reader is at, up to its end
+    bool readGuiAttributes(irr::io::IXMLReader* reader, std::vector<GuiAttribute>& attributes)
+    {
+        if (reader->isEmptyElement())
+        {
+            return true;
+        }
+
+        while (reader->read())
+        {
+            if (reader->getNodeType() == irr::io::EXN_ELEMENT_END && std::wcscmp(reader->getNodeName(), L"attributes") == 0)
+            {
+                return true;
+            }
+
+            if (reader->getNodeType() == irr::io::EXN_ELEMENT)
+            {
+                GuiAttribute attribute;
+
+                if (!readGuiAttribute(reader, attribute))
+                {
+                    return false;
+                }
+
+                attributes.push_back(attribute);
+            }
+        }
+
+        return false;
+    }
+
+    //! reads what is in the element the reader is at, up to its end
+    /** Elements with anything the environment would apply in another order than the cache does, such as attributes following
+        children, are left to the environment. */
+    bool readGuiElement(irr::io::IXMLReader* reader, GuiElement& element)
+    {
+        element.hasAttributes = false;
+
+        if (reader->isEmptyElement())
+        {
+            return true;
+        }
+
+        while (reader->read())
+        {
+            if (reader->getNodeType() == irr::io::EXN_ELEMENT_END)
+            {
+                return true;
+            }
+
+            if (reader->getNodeType() != irr::io::EXN_ELEMENT)
+            {
+                continue;
+            }
+
+            std::wstring name = reader->getNodeName();
+
+            if (name == L"attributes")
+            {
+                if (element.hasAttributes || !element.children.empty() || !readGuiAttributes(reader, element.attributes))
+                {
+                    return false;
+                }
+
+                element.hasAttributes = true;
+            }
+            else if (name == L"element")
+            {
+                GuiElement child;
+                child.type = reader->getAttributeValueSafe(L"type");
+
+                if (!readGuiElement(reader, child))
+                {
+                    return false;
+                }
+
+                element.children.push_back(std::move(child));
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        return false;
+    }
+
+    bool parseGui(irr::io::IXMLReader* reader, GuiElement& root)
+    {
+        while (reader->read())
+        {
+            if (reader->getNodeType() == irr::io::EXN_ELEMENT)
+            {
+                return std::wcscmp(reader->getNodeName(), L"irr_gui") == 0 && readGuiElement(reader, root);
+            }
+        }
+
+        return false;
+    }
+
+    //! the names of attributes and the types of elements, which repeat throughout a GUI, so the cache stores each once
+    class GuiNameTable
+    {
+    public:
+        irr::u32 getIndex(const std::wstring& name)
+        {
+            auto index = indices.find(name);
+
+            if (index != indices.end())
+            {
+                return index->second;
+            }
+
+            indices[name] = static_cast<irr::u32>(names.size());
+            names.push_back(name);
+
+            return static_cast<irr::u32>(names.size() - 1);
+        }
+
+        void addNames(const GuiElement& element)
+        {
+            getIndex(element.type);
+
+            for (const auto& attribute : element.attributes)
+            {
+                getIndex(attribute.name);
+            }
+
+            for (const auto& child : element.children)
+            {
+                addNames(child);
+            }
+        }
+
+        void put(PayloadWriter& writer) const
+        {
+            writer.putU32(static_cast<irr::u32>(names.size()));
+
+            for (const auto& name : names)
+            {
+                writer.putString(name);
+            }
+        }
+
+        bool get(PayloadReader& reader)
+        {
+            auto count = reader.getU32();
+
+            for (irr::u32 i = 0; i < count && reader.isValid(); ++i)
+            {
+                names.push_back(reader.getString());
+            }
+
+            return reader.isValid();
+        }
+
+        //! the name at an index read from a cache; false if the cache is corrupt
+        bool getName(irr::u32 index, std::wstring& name) const
+        {
+            if (index >= names.size())
+            {
+                return false;
+            }
+
+            name = names[index];
+
+            return true;
+        }
+
+    private:
+        std::vector<std::wstring> names;
+        std::map<std::wstring, irr::u32> indices;
+    };
+
+    //! writes an element and its children, each attribute with only the values its type has
+    void putGuiElement(PayloadWriter& writer, GuiNameTable& names, const GuiElement& element)
+    {
+        writer.putU32(names.getIndex(element.type));
+        writer.putU8(element.hasAttributes ? 1 : 0);
+        writer.putU32(static_cast<irr::u32>(element.attributes.size()));
+
+        for (const auto& attribute : element.attributes)
+        {
+            writer.putU8(static_cast<irr::u8>(attribute.type));
+            writer.putU32(names.getIndex(attribute.name));
+
+            switch (attribute.type)
+            {
+            case GuiAttributeType::Bool:
+            case GuiAttributeType::Int:
+            case GuiAttributeType::Color:
+                writer.putU32(static_cast<irr::u32>(attribute.values[0]));
+                break;
+            case GuiAttributeType::Float:
+                writer.putF32(attribute.number);
+                break;
+            case GuiAttributeType::String:
+            case GuiAttributeType::Enum:
+            case GuiAttributeType::Texture:
+                writer.putString(attribute.text);
+                break;
+            case GuiAttributeType::Rect:
+                for (auto component : attribute.values)
+                {
+                    writer.putU32(static_cast<irr::u32>(component));
+                }
+                break;
+            case GuiAttributeType::Position:
+                writer.putU32(static_cast<irr::u32>(attribute.values[0]));
+                writer.putU32(static_cast<irr::u32>(attribute.values[1]));
+                break;
+            }
+        }
+
+        writer.putU32(static_cast<irr::u32>(element.children.size()));
+
+        for (const auto& child : element.children)
+        {
+            putGuiElement(writer, names, child);
+        }
+    }
+
+    bool getGuiElement(PayloadReader& reader, const GuiNameTable& names, GuiElement& element)
+    {
+        if (!names.getName(reader.getU32(), element.type))
+        {
+            return false;
+        }
+
+        element.hasAttributes = reader.getU8() != 0;
+
+        auto attributeCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < attributeCount && reader.isValid(); ++i)
+        {
+            GuiAttribute attribute;
+            attribute.type = static_cast<GuiAttributeType>(reader.getU8());
+            attribute.number = 0.f;
+
+            for (auto& component : attribute.values)
+            {
+                component = 0;
+            }
+
+            if (!names.getName(reader.getU32(), attribute.name))
+            {
+                return false;
+            }
+
+            switch (attribute.type)
+            {
+            case GuiAttributeType::Bool:
+            case GuiAttributeType::Int:
+            case GuiAttributeType::Color:
+                attribute.values[0] = static_cast<irr::s32>(reader.getU32());
+                break;
+            case GuiAttributeType::Float:
+                attribute.number = reader.getF32();
+                break;
+            case GuiAttributeType::String:
+            case GuiAttributeType::Enum:
+            case GuiAttributeType::Texture:
+                attribute.text = reader.getString();
+                break;
+            case GuiAttributeType::Rect:
+                for (auto& component : attribute.values)
+                {
+                    component = static_cast<irr::s32>(reader.getU32());
+                }
+                break;
+            case GuiAttributeType::Position:
+                attribute.values[0] = static_cast<irr::s32>(reader.getU32());
+                attribute.values[1] = static_cast<irr::s32>(reader.getU32());
+                break;
+            default:
+                return false;
+            }
+
+            element.attributes.push_back(attribute);
+        }
+
+        auto childCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < childCount && reader.isValid(); ++i)
+        {
+            element.children.emplace_back();
+
+            if (!getGuiElement(reader, names, element.children.back()))
+            {
+                return false;
+            }
+        }
+
+        return reader.isValid();
+    }
+
+    void putGui(PayloadWriter& writer, const GuiElement& root)
+    {
+        GuiNameTable names;
+        names.addNames(root);
+        names.put(writer);
+
+        putGuiElement(writer, names, root);
+    }
+
+    bool getGui(PayloadReader& reader, GuiElement& root)
+    {
+        GuiNameTable names;
+
+        return names.get(reader) && getGuiElement(reader, names, root);
+    }
+
+    irr::io::IAttributes* createAttributes(irr::gui::IGUIEnvironment* guienv, const std::vector<GuiAttribute>& attributes)
+    {
+        auto driver = guienv->getVideoDriver();
+        auto guiAttributes = guienv->getFileSystem()->createEmptyAttributes(driver);
+
+        for (const auto& attribute : attributes)
+        {
+            auto name = getNarrowName(attribute.name);
+
+            switch (attribute.type)
+            {
+            case GuiAttributeType::Bool:
+                guiAttributes->addBool(name.c_str(), attribute.values[0] != 0);
+                break;
+            case GuiAttributeType::Int:
+                guiAttributes->addInt(name.c_str(), attribute.values[0]);
+                break;
+            case GuiAttributeType::Float:
+                guiAttributes->addFloat(name.c_str(), attribute.number);
+                break;
+            case GuiAttributeType::String:
+                guiAttributes->addString(name.c_str(), attribute.text.c_str());
+                break;
+            case GuiAttributeType::Enum:
+                guiAttributes->addEnum(name.c_str(), getNarrowName(attribute.text).c_str(), nullptr);
+                break;
+            case GuiAttributeType::Color:
+                guiAttributes->addColor(name.c_str(), irr::video::SColor(static_cast<irr::u32>(attribute.values[0])));
+                break;
+            case GuiAttributeType::Rect:
+                guiAttributes->addRect(name.c_str(), irr::core::rect<irr::s32>(attribute.values[0], attribute.values[1], attribute.values[2], attribute.values[3]));
+                break;
+            case GuiAttributeType::Position:
+                guiAttributes->addPosition2d(name.c_str(), irr::core::position2di(attribute.values[0], attribute.values[1]));
+                break;
+            case GuiAttributeType::Texture:
+            {
+                // an empty filename stands for no texture, as it does when the environment reads it
+                irr::io::path textureFilename = getNarrowName(attribute.text).c_str();
+
+                guiAttributes->addTexture(name.c_str(), attribute.text.empty() ? nullptr : driver->getTexture(textureFilename), textureFilename);
+                break;
+            }
+            }
+        }
+
+        return guiAttributes;
+    }
+
+    //! adds an element and its children to parent, or to the root if parent is null
+    void addGuiElement(irr::gui::IGUIEnvironment* guienv, const GuiElement& element, irr::gui::IGUIElement* parent)
+    {
+        auto type = getNarrowName(element.type);
+        auto guiElement = guienv->addGUIElement(type.c_str(), parent);
+
+        // like the environment, carry on with the children, which end up in the root
+        if (guiElement == nullptr)
+        {
+            std::cerr << "Could not create GUI element of unknown type " << type << std::endl;
+        }
+        else if (element.hasAttributes)
+        {
+            auto attributes = createAttributes(guienv, element.attributes);
+            guiElement->deserializeAttributes(attributes);
+            attributes->drop();
+        }
+
+        for (const auto& child : element.children)
+        {
+            addGuiElement(guienv, child, guiElement);
+        }
+    }
+
+    //! applies the root's attributes to the skin and adds the elements in it to the root element
+    void addGui(irr::gui::IGUIEnvironment* guienv, const GuiElement& root)
+    {
+        if (root.hasAttributes)
+        {
+            auto attributes = createAttributes(guienv, root.attributes);
+            guienv->deserializeAttributes(attributes);
+            attributes->drop();
+        }
+
+        for (const auto& element : root.children)
+        {
+            addGuiElement(guienv, element, nullptr);
+        }
+    }
+
+    bool parseFont(irr::io::IXMLReader* reader, BitmapFontDescription& description)
+    {
+        auto isBitmapFont = false;
+
+        while (reader->read())
+        {
+            if (reader->getNodeType() != irr::io::EXN_ELEMENT)
+            {
+                continue;
+            }
+
+            std::wstring name = reader->getNodeName();
+
+            if (name == L"font")
+            {
+                isBitmapFont = std::wcscmp(reader->getAttributeValueSafe(L"type"), L"bitmap") == 0;
+
+                if (!isBitmapFont)
+                {
+                    break;
+                }
+            }
+            else if (name == L"Texture")
+            {
+                BitmapFontTexture texture;
+                texture.index = static_cast<irr::u32>(reader->getAttributeValueAsInt(L"index"));
+                texture.filename = reader->getAttributeValueSafe(L"filename");
+                texture.hasAlpha = std::wcscmp(reader->getAttributeValueSafe(L"hasAlpha"), L"false") != 0;
+
+                description.textures.push_back(texture);
+            }
+            else if (name == L"c")
+            {
+                irr::s32 corners[4];
+
+                if (!parseIntegers(reader->getAttributeValueSafe(L"r"), corners, 4))
+                {
+                    isBitmapFont = false;
+                    break;
+                }
+
+                BitmapFontGlyph glyph;
+                glyph.character = reader->getAttributeValueSafe(L"c")[0];
+                glyph.rect = irr::core::rect<irr::s32>(corners[0], corners[1], corners[2], corners[3]);
+                glyph.underhang = reader->getAttributeValueAsInt(L"u");
+                glyph.overhang = reader->getAttributeValueAsInt(L"o");
+                glyph.texture = static_cast<irr::u32>(reader->getAttributeValueAsInt(L"i"));
+
+                description.glyphs.push_back(glyph);
+            }
+        }
+
+        return isBitmapFont && !description.glyphs.empty();
+    }
+
+    void putFont(PayloadWriter& writer, const BitmapFontDescription& description)
+    {
+        writer.putU32(static_cast<irr::u32>(description.textures.size()));
+
+        for (const auto& texture : description.textures)
+        {
+            writer.putU32(texture.index);
+            writer.putString(texture.filename);
+            writer.putU8(texture.hasAlpha ? 1 : 0);
+        }
+
+        writer.putU32(static_cast<irr::u32>(description.glyphs.size()));
+
+        for (const auto& glyph : description.glyphs)
+        {
+            writer.putU32(static_cast<irr::u32>(glyph.character));
+            writer.putU32(static_cast<irr::u32>(glyph.rect.UpperLeftCorner.X));
+            writer.putU32(static_cast<irr::u32>(glyph.rect.UpperLeftCorner.Y));
+            writer.putU32(static_cast<irr::u32>(glyph.rect.LowerRightCorner.X));
+            writer.putU32(static_cast<irr::u32>(glyph.rect.LowerRightCorner.Y));
+            writer.putU32(static_cast<irr::u32>(glyph.underhang));
+            writer.putU32(static_cast<irr::u32>(glyph.overhang));
+            writer.putU32(glyph.texture);
+        }
+    }
+
+    bool getFont(PayloadReader& reader, BitmapFontDescription& description)
+    {
+        auto textureCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < textureCount && reader.isValid(); ++i)
+        {
+            BitmapFontTexture texture;
+            texture.index = reader.getU32();
+            texture.filename = reader.getString();
+            texture.hasAlpha = reader.getU8() != 0;
+
+            description.textures.push_back(texture);
+        }
+
+        auto glyphCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < glyphCount && reader.isValid(); ++i)
+        {
+            BitmapFontGlyph glyph;
+            glyph.character = static_cast<wchar_t>(reader.getU32());
+            glyph.rect.UpperLeftCorner.X = static_cast<irr::s32>(reader.getU32());
+            glyph.rect.UpperLeftCorner.Y = static_cast<irr::s32>(reader.getU32());
+            glyph.rect.LowerRightCorner.X = static_cast<irr::s32>(reader.getU32());
+            glyph.rect.LowerRightCorner.Y = static_cast<irr::s32>(reader.getU32());
+            glyph.underhang = static_cast<irr::s32>(reader.getU32());
+            glyph.overhang = static_cast<irr::s32>(reader.getU32());
+            glyph.texture = reader.getU32();
+
+            description.glyphs.push_back(glyph);
+        }
+
+        return reader.isValid() && !description.glyphs.empty();
+    }
+}
+
+AssetSource loadCachedGUI(irr::gui::IGUIEnvironment* guienv, const std::string& filename)
+{
+    std::vector<irr::u8> source;
+
+    if (!readFile(filename, source))
+    {
+        std::cerr << "Could not load GUI - " << filename << " could not be read" << std::endl;
+        return AssetSource::None;
+    }
+
+    const auto cacheFilename = filename + CACHE_EXTENSION;
+
+    GuiElement root;
+    std::vector<irr::u8> cache;
+
+    if (readFile(cacheFilename, cache))
+    {
+        PayloadReader reader(cache);
+
+        if (isCacheOf(reader, GUI_CACHE_TAG, source) && getGui(reader, root) && reader.isAtEnd())
+        {
+            addGui(guienv, root);
+
+            return AssetSource::Cache;
+        }
+
+        root = GuiElement();
+    }
+
+    auto reader = guienv->getFileSystem()->createXMLReader(filename.c_str());
+    auto isParsed = reader != nullptr && parseGui(reader, root);
+
+    if (reader != nullptr)
+    {
+        reader->drop();
+    }
+
+    if (!isParsed)
+    {
+        return guienv->loadGUI(filename.c_str()) ? AssetSource::Environment : AssetSource::None;
+    }
+
+    cache.clear();
+
+    PayloadWriter writer(cache);
+    putCacheHeader(writer, GUI_CACHE_TAG, source);
+    putGui(writer, root);
+
+    writeFile(cacheFilename, cache);
+
+    addGui(guienv, root);
+
+    return AssetSource::Xml;
+}
+
+irr::gui::IGUIFont* getCachedFont(irr::gui::IGUIEnvironment* guienv, const std::string& filename, AssetSource& source)
+{
+    const irr::io::path path = filename.c_str();
+
+    // a font's sprite bank is named after it, so if there is one, the environment already has the font
+    if (guienv->getSpriteBank(path) != nullptr)
+    {
+        source = AssetSource::Environment;
+        return guienv->getFont(path);
+    }
+
+    std::vector<irr::u8> fontSource;
+
+    if (!readFile(filename, fontSource))
+    {
+        std::cerr << "Could not load font - " << filename << " could not be read" << std::endl;
+
+        source = AssetSource::None;
+        return nullptr;
+    }
+
+    const auto cacheFilename = filename + CACHE_EXTENSION;
+
+    BitmapFontDescription description;
+    std::vector<irr::u8> cache;
+
+    source = AssetSource::Xml;
+
+    if (readFile(cacheFilename, cache))
+    {
+        PayloadReader reader(cache);
+
+        if (isCacheOf(reader, FONT_CACHE_TAG, fontSource) && getFont(reader, description) && reader.isAtEnd())
+        {
+            source = AssetSource::Cache;
+        }
+        else
+        {
+            description = BitmapFontDescription();
+        }
+    }
+
+    if (source == AssetSource::Xml)
+    {
+        auto reader = guienv->getFileSystem()->createXMLReader(path);
+        auto isParsed = reader != nullptr && parseFont(reader, description);
+
+        if (reader != nullptr)
+        {
+            reader->drop();
+        }
+
+        if (!isParsed)
+        {
+            auto font = guienv->getFont(path);
+
+            source = font != nullptr ? AssetSource::Environment : AssetSource::None;
+            return font;
+        }
+
+        cache.clear();
+
+        PayloadWriter writer(cache);
+        putCacheHeader(writer, FONT_CACHE_TAG, fontSource);
+        putFont(writer, description);
+
+        writeFile(cacheFilename, cache);
+    }
+
+    auto font = new BitmapFont(guienv, path);
+
+    if (!font->load(description, guienv->getFileSystem()->getFileDir(path)))
+    {
+        std::cerr << "Could not load font " << filename << std::endl;
+
+        font->drop();
+
+        source = AssetSource::None;
+        return nullptr;
+    }
+
+    guienv->addFont(path, font);
+
+    // the environment holds the font from now on
+    font->drop();
+
+    return font;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+
+#include <irrlicht/irrlicht.h>
+
+//! where a startup asset was built from
+enum class AssetSource
+{
+    //! the binary cache next to the XML, which was up to date
+    Cache,
+    //! the XML, which was parsed and cached
+    Xml,
+    //! the XML, parsed by the GUI environment itself, since it holds something the cache does not know
+    Environment,
+    //! nowhere, the asset could not be loaded
+    None
+};
+
+//! Loads a GUI saved by the GUI environment, like IGUIEnvironment::loadGUI, into the root element.
+/** The element tree is cached in a binary file next to the XML, named after it with .cache appended, and the XML is only
+    parsed when the hash of its bytes no longer matches the one the cache was made from. */
+AssetSource loadCachedGUI(irr::gui::IGUIEnvironment* guienv, const std::string& filename);
+
+//! Gets a bitmap font, like IGUIEnvironment::getFont, with its glyph table cached the way loadCachedGUI caches the GUI.
+/** The font is added to the environment under its filename, so getFont finds it from then on. */
+irr::gui::IGUIFont* getCachedFont(irr::gui::IGUIEnvironment* guienv, const std::string& filename, AssetSource& source);
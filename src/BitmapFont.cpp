@@ -0,0 +1,301 @@
+#include "BitmapFont.h"
+
+#include <algorithm>
+#include <iostream>
+
+BitmapFont::BitmapFont(irr::gui::IGUIEnvironment* guienv, const irr::io::path& filename) :
+    driver(guienv->getVideoDriver()),
+    spriteBank(guienv->getSpriteBank(filename)),
+    wrongCharacter(0),
+    maxHeight(0),
+    kerningWidth(0),
+    kerningHeight(0),
+    invisibleCharacters(L" ")
+{
+    if (spriteBank == nullptr)
+    {
+        spriteBank = guienv->addEmptySpriteBank(filename);
+    }
+
+    // the environment owns the bank, the font only keeps it alive
+    if (spriteBank != nullptr)
+    {
+        spriteBank->grab();
+    }
+}
+
+BitmapFont::~BitmapFont()
+{
+    if (spriteBank != nullptr)
+    {
+        spriteBank->drop();
+    }
+}
+
+bool BitmapFont::load(const BitmapFontDescription& description, const irr::io::path& directory)
+{
+    if (spriteBank == nullptr)
+    {
+        return false;
+    }
+
+    for (const auto& texture : description.textures)
+    {
+        while (texture.index + 1 > spriteBank->getTextureCount())
+        {
+            spriteBank->addTexture(nullptr);
+        }
+
+        // glyphs are drawn texel for texel, mipmaps would only blur them when the font is scaled
+        auto createMipMaps = driver->getTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS);
+        driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, false);
+
+        spriteBank->setTexture(texture.index, driver->getTexture(directory + "/" + irr::io::path(texture.filename.c_str())));
+
+        driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, createMipMaps);
+
+        if (spriteBank->getTexture(texture.index) == nullptr)
+        {
+            std::cerr << "Could not load the texture of a font" << std::endl;
+            return false;
+        }
+
+        if (!texture.hasAlpha)
+        {
+            driver->makeColorKeyTexture(spriteBank->getTexture(texture.index), irr::core::position2di(0, 0));
+        }
+    }
+
+    for (const auto& glyph : description.glyphs)
+    {
+        irr::gui::SGUISpriteFrame frame;
+        frame.textureNumber = glyph.texture;
+        frame.rectNumber = spriteBank->getPositions().size();
+
+        irr::gui::SGUISprite sprite;
+        sprite.Frames.push_back(frame);
+        sprite.frameTime = 0;
+
+        spriteBank->getPositions().push_back(glyph.rect);
+
+        areaIndices[glyph.character] = static_cast<irr::u32>(areas.size());
+        areas.push_back(Area { glyph.underhang, glyph.overhang, glyph.rect.getWidth(), spriteBank->getSprites().size() });
+
+        spriteBank->getSprites().push_back(sprite);
+
+        maxHeight = std::max(maxHeight, glyph.rect.getHeight());
+    }
+
+    if (areas.empty())
+    {
+        return false;
+    }
+
+    auto space = areaIndices.find(L' ');
+    wrongCharacter = space != areaIndices.end() ? space->second : 0;
+
+    return true;
+}
+
+void BitmapFont::draw(const irr::core::stringw& text, const irr::core::rect<irr::s32>& position, irr::video::SColor color, bool hcenter, bool vcenter, const irr::core::rect<irr::s32>* clip)
+{
+    irr::core::dimension2d<irr::s32> textDimension;
+    irr::core::position2di offset = position.UpperLeftCorner;
+
+    if (hcenter || vcenter || clip != nullptr)
+    {
+        textDimension = irr::core::dimension2d<irr::s32>(getDimension(text.c_str()));
+    }
+
+    if (hcenter)
+    {
+        offset.X += (position.getWidth() - textDimension.Width) >> 1;
+    }
+
+    if (vcenter)
+    {
+        offset.Y += (position.getHeight() - textDimension.Height) >> 1;
+    }
+
+    if (clip != nullptr)
+    {
+        irr::core::rect<irr::s32> clippedRect(offset, textDimension);
+        clippedRect.clipAgainst(*clip);
+
+        if (!clippedRect.isValid())
+        {
+            return;
+        }
+    }
+
+    irr::core::array<irr::u32> sprites(text.size());
+    irr::core::array<irr::core::position2di> offsets(text.size());
+
+    for (irr::u32 i = 0; i < text.size(); ++i)
+    {
+        auto character = text[i];
+        auto isLineBreak = false;
+
+        if (character == L'\r')
+        {
+            isLineBreak = true;
+
+            if (text[i + 1] == L'\n')
+            {
+                character = text[++i];
+            }
+        }
+        else if (character == L'\n')
+        {
+            isLineBreak = true;
+        }
+
+        if (isLineBreak)
+        {
+            offset.Y += maxHeight;
+            offset.X = position.UpperLeftCorner.X;
+
+            if (hcenter)
+            {
+                offset.X += (position.getWidth() - textDimension.Width) >> 1;
+            }
+
+            continue;
+        }
+
+        const auto& area = getArea(character);
+
+        offset.X += area.underhang;
+
+        if (invisibleCharacters.find(character) == std::wstring::npos)
+        {
+            sprites.push_back(area.sprite);
+            offsets.push_back(offset);
+        }
+
+        offset.X += area.width + area.overhang + kerningWidth;
+    }
+
+    spriteBank->draw2DSpriteBatch(sprites, offsets, clip, color);
+}
+
+irr::core::dimension2d<irr::u32> BitmapFont::getDimension(const wchar_t* text) const
+{
+    irr::core::dimension2d<irr::u32> dimension(0, 0);
+    irr::core::dimension2d<irr::u32> line(0, maxHeight);
+
+    for (auto character = text; *character != 0; ++character)
+    {
+        auto isLineBreak = false;
+
+        if (*character == L'\r')
+        {
+            isLineBreak = true;
+
+            if (character[1] == L'\n')
+            {
+                ++character;
+            }
+        }
+        else if (*character == L'\n')
+        {
+            isLineBreak = true;
+        }
+
+        if (isLineBreak)
+        {
+            dimension.Height += line.Height;
+            dimension.Width = std::max(dimension.Width, line.Width);
+            line.Width = 0;
+
+            continue;
+        }
+
+        const auto& area = getArea(*character);
+
+        line.Width += area.underhang + area.width + area.overhang + kerningWidth;
+    }
+
+    dimension.Height += line.Height;
+    dimension.Width = std::max(dimension.Width, line.Width);
+
+    return dimension;
+}
+
+irr::s32 BitmapFont::getCharacterFromPos(const wchar_t* text, irr::s32 pixel_x) const
+{
+    irr::s32 x = 0;
+
+    for (irr::s32 i = 0; text[i] != 0; ++i)
+    {
+        const auto& area = getArea(text[i]);
+
+        x += area.width + area.overhang + area.underhang + kerningWidth;
+
+        if (x >= pixel_x)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+irr::gui::EGUI_FONT_TYPE BitmapFont::getType() const
+{
+    return irr::gui::EGFT_BITMAP;
+}
+
+void BitmapFont::setKerningWidth(irr::s32 kerning)
+{
+    kerningWidth = kerning;
+}
+
+void BitmapFont::setKerningHeight(irr::s32 kerning)
+{
+    kerningHeight = kerning;
+}
+
+irr::s32 BitmapFont::getKerningWidth(const wchar_t* thisLetter, const wchar_t* previousLetter) const
+{
+    auto kerning = kerningWidth;
+
+    if (thisLetter != nullptr)
+    {
+        kerning += getArea(*thisLetter).overhang;
+
+        if (previousLetter != nullptr)
+        {
+            kerning += getArea(*previousLetter).underhang;
+        }
+    }
+
+    return kerning;
+}
+
+irr::s32 BitmapFont::getKerningHeight() const
+{
+    return kerningHeight;
+}
+
+void BitmapFont::setInvisibleCharacters(const wchar_t* s)
+{
+    invisibleCharacters = s;
+}
+
+irr::gui::IGUISpriteBank* BitmapFont::getSpriteBank() const
+{
+    return spriteBank;
+}
+
+irr::u32 BitmapFont::getSpriteNoFromChar(const wchar_t* c) const
+{
+    return getArea(*c).sprite;
+}
+
+const BitmapFont::Area& BitmapFont::getArea(wchar_t character) const
+{
+    auto index = areaIndices.find(character);
+
+    return areas[index != areaIndices.end() ? index->second : wrongCharacter];
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+//! A texture of a bitmap font, as listed by the font's XML.
+struct BitmapFontTexture
+{
+    irr::u32 index;
+    std::wstring filename;
+
+    //! without an alpha channel, the colour of the texel at the top left is keyed out
+    bool hasAlpha;
+};
+
+//! A character of a bitmap font, as listed by the font's XML.
+struct BitmapFontGlyph
+{
+    wchar_t character;
+
+    //! where the character is in its texture
+    irr::core::rect<irr::s32> rect;
+
+    //! space added before and after the character
+    irr::s32 underhang;
+    irr::s32 overhang;
+
+    irr::u32 texture;
+};
+
+//! Everything the XML of a bitmap font says, in the order it says it.
+struct BitmapFontDescription
+{
+    std::vector<BitmapFontTexture> textures;
+    std::vector<BitmapFontGlyph> glyphs;
+};
+
+//! A bitmap font built from a description rather than from XML.
+/** Lays out and draws text the way the fonts of the GUI environment loaded from XML do, so a font built from a cached
+    description looks no different from one the environment loaded itself. */
+class BitmapFont : public irr::gui::IGUIFontBitmap
+{
+public:
+    //! filename names the font's sprite bank, as the GUI environment names the banks of the fonts it loads
+    BitmapFont(irr::gui::IGUIEnvironment* guienv, const irr::io::path& filename);
+
+    ~BitmapFont() override;
+
+    //! loads the textures, relative to directory, and adds the glyphs; false if a texture could not be loaded
+    bool load(const BitmapFontDescription& description, const irr::io::path& directory);
+
+    void draw(const irr::core::stringw& text, const irr::core::rect<irr::s32>& position, irr::video::SColor color, bool hcenter = false, bool vcenter = false, const irr::core::rect<irr::s32>* clip = 0) override;
+
+    irr::core::dimension2d<irr::u32> getDimension(const wchar_t* text) const override;
+
+    irr::s32 getCharacterFromPos(const wchar_t* text, irr::s32 pixel_x) const override;
+
+    irr::gui::EGUI_FONT_TYPE getType() const override;
+
+    void setKerningWidth(irr::s32 kerning) override;
+
+    void setKerningHeight(irr::s32 kerning) override;
+
+    irr::s32 getKerningWidth(const wchar_t* thisLetter = 0, const wchar_t* previousLetter = 0) const override;
+
+    irr::s32 getKerningHeight() const override;
+
+    void setInvisibleCharacters(const wchar_t* s) override;
+
+    irr::gui::IGUISpriteBank* getSpriteBank() const override;
+
+    irr::u32 getSpriteNoFromChar(const wchar_t* c) const override;
+
+private:
+    //! how much room a character takes, and which sprite draws it
+    struct Area
+    {
+        irr::s32 underhang;
+        irr::s32 overhang;
+        irr::s32 width;
+        irr::u32 sprite;
+    };
+
+    //! characters the font has no glyph for take the area of a space
+    const Area& getArea(wchar_t character) const;
+
+    irr::video::IVideoDriver* driver;
+    irr::gui::IGUISpriteBank* spriteBank;
+
+    std::vector<Area> areas;
+    std::unordered_map<wchar_t, irr::u32> areaIndices;
+    irr::u32 wrongCharacter;
+
+    irr::s32 maxHeight;
+    irr::s32 kerningWidth;
+    irr::s32 kerningHeight;
+
+    std::wstring invisibleCharacters;
+};
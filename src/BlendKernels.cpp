@@ -0,0 +1,1175 @@
+#include "BlendKernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLEND_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define BLEND_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+/*
+    Every kernel computes the same thing, with the same floating point operations in the same order,
+    so the SIMD variants give exactly the results of the scalar one:
+
+        sa = source alpha * opacity, da = destination alpha
+        alpha = sa + da * (1 - sa)
+        color = (sa * ((1 - da) * cs + da * B(cb, cs)) + da * (1 - sa) * cb) / alpha
+
+    B is the blend mode; erasing keeps the destination color and only takes away alpha: alpha = da * (1 - sa).
+    Destination texels of every format are widened to A8R8G8B8 before and narrowed after blending.
+*/
+
+namespace {
+    typedef void (*BlendRowFunction)(irr::f32 opacity, irr::u8* destination, const irr::u32* source, irr::u32 count);
+
+    const irr::f32 INV_255 = 1.f / 255.f;
+
+    //! keeps the division defined where both texels are fully transparent, the numerator is zero there anyway
+    const irr::f32 MIN_ALPHA = 1e-30f;
+
+    // pixel formats
+
+    struct FormatA8R8G8B8
+    {
+        static const irr::video::ECOLOR_FORMAT COLOR_FORMAT = irr::video::ECF_A8R8G8B8;
+        static const irr::u32 BYTES_PER_TEXEL = 4;
+
+        static irr::u32 read(const irr::u8* texel)
+        {
+            irr::u32 color;
+            std::memcpy(&color, texel, 4);
+            return color;
+        }
+
+        static void write(irr::u8* texel, irr::u32 color)
+        {
+            std::memcpy(texel, &color, 4);
+        }
+    };
+
+    //! bytes are stored red, green, blue
+    struct FormatR8G8B8
+    {
+        static const irr::video::ECOLOR_FORMAT COLOR_FORMAT = irr::video::ECF_R8G8B8;
+        static const irr::u32 BYTES_PER_TEXEL = 3;
+
+        static irr::u32 read(const irr::u8* texel)
+        {
+            return 0xFF000000 | (texel[0] << 16) | (texel[1] << 8) | texel[2];
+        }
+
+        static void write(irr::u8* texel, irr::u32 color)
+        {
+            texel[0] = (color >> 16) & 0xFF;
+            texel[1] = (color >> 8) & 0xFF;
+            texel[2] = color & 0xFF;
+        }
+    };
+
+    struct FormatA1R5G5B5
+    {
+        static const irr::video::ECOLOR_FORMAT COLOR_FORMAT = irr::video::ECF_A1R5G5B5;
+        static const irr::u32 BYTES_PER_TEXEL = 2;
+
+        static irr::u32 widen(irr::u32 channel)
+        {
+            return (channel << 3) | (channel >> 2);
+        }
+
+        static irr::u32 narrow(irr::u32 channel)
+        {
+            return ((channel * 31) + 127) / 255;
+        }
+
+        static irr::u32 read(const irr::u8* texel)
+        {
+            irr::u16 color;
+            std::memcpy(&color, texel, 2);
+
+            return ((color & 0x8000) ? 0xFF000000 : 0)
+                | (widen((color >> 10) & 0x1F) << 16)
+                | (widen((color >> 5) & 0x1F) << 8)
+                | widen(color & 0x1F);
+        }
+
+        static void write(irr::u8* texel, irr::u32 color)
+        {
+            irr::u16 narrowColor = static_cast<irr::u16>(
+                (((color >> 24) >= 128) ? 0x8000 : 0)
+                | (narrow((color >> 16) & 0xFF) << 10)
+                | (narrow((color >> 8) & 0xFF) << 5)
+                | narrow(color & 0xFF));
+
+            std::memcpy(texel, &narrowColor, 2);
+        }
+    };
+
+    // blend modes; each has a scalar and a lane-wise form of the same expression
+
+    struct NormalOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 /*backdrop*/, irr::f32 source)
+        {
+            return source;
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float /*backdrop*/, typename Lanes::Float source)
+        {
+            return source;
+        }
+    };
+
+    struct MultiplyOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return backdrop * source;
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            return Lanes::mul(backdrop, source);
+        }
+    };
+
+    struct ScreenOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return (backdrop + source) - (backdrop * source);
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            return Lanes::sub(Lanes::add(backdrop, source), Lanes::mul(backdrop, source));
+        }
+    };
+
+    struct AddOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return std::min(backdrop + source, 1.f);
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            return Lanes::min(Lanes::add(backdrop, source), Lanes::set(1.f));
+        }
+    };
+
+    struct EraseOp
+    {
+        static const bool ERASES = true;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 /*source*/)
+        {
+            return backdrop;
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float /*source*/)
+        {
+            return backdrop;
+        }
+    };
+
+    struct OverlayOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return backdrop <= 0.5f
+                ? (2.f * backdrop) * source
+                : 1.f - ((2.f * (1.f - backdrop)) * (1.f - source));
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            auto one = Lanes::set(1.f);
+            auto two = Lanes::set(2.f);
+
+            auto multiplied = Lanes::mul(Lanes::mul(two, backdrop), source);
+            auto screened = Lanes::sub(one, Lanes::mul(Lanes::mul(two, Lanes::sub(one, backdrop)), Lanes::sub(one, source)));
+
+            return Lanes::select(Lanes::lessOrEqual(backdrop, Lanes::set(0.5f)), multiplied, screened);
+        }
+    };
+
+    struct LightenOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return std::max(backdrop, source);
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            return Lanes::max(backdrop, source);
+        }
+    };
+
+    struct DarkenOp
+    {
+        static const bool ERASES = false;
+
+        static irr::f32 blend(irr::f32 backdrop, irr::f32 source)
+        {
+            return std::min(backdrop, source);
+        }
+
+        template <class Lanes>
+        static typename Lanes::Float blend(typename Lanes::Float backdrop, typename Lanes::Float source)
+        {
+            return Lanes::min(backdrop, source);
+        }
+    };
+
+    // scalar kernel, which defines the results of all the others
+
+    irr::u32 toByte(irr::f32 value)
+    {
+        return static_cast<irr::u32>((value * 255.f) + 0.5f);
+    }
+
+    template <class Op>
+    irr::u32 blendTexel(irr::u32 destination, irr::u32 source, irr::f32 opacity)
+    {
+        auto sa = (static_cast<irr::f32>(source >> 24) * INV_255) * opacity;
+        auto da = static_cast<irr::f32>(destination >> 24) * INV_255;
+        auto oneMinusSa = 1.f - sa;
+
+        if (Op::ERASES)
+        {
+            return (toByte(da * oneMinusSa) << 24) | (destination & 0x00FFFFFF);
+        }
+
+        auto alpha = sa + (da * oneMinusSa);
+        auto safeAlpha = std::max(alpha, MIN_ALPHA);
+        auto oneMinusDa = 1.f - da;
+        auto backdropWeight = da * oneMinusSa;
+
+        auto result = toByte(alpha) << 24;
+
+        for (irr::u32 shift = 0; shift < 24; shift += 8)
+        {
+            auto cs = static_cast<irr::f32>((source >> shift) & 0xFF) * INV_255;
+            auto cb = static_cast<irr::f32>((destination >> shift) & 0xFF) * INV_255;
+
+            auto blended = (oneMinusDa * cs) + (da * Op::blend(cb, cs));
+            auto value = ((sa * blended) + (backdropWeight * cb)) / safeAlpha;
+
+            result |= toByte(value) << shift;
+        }
+
+        return result;
+    }
+
+    template <class Op, class Format>
+    void blendRowScalar(irr::f32 opacity, irr::u8* destination, const irr::u32* source, irr::u32 count)
+    {
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            auto texel = destination + (i * Format::BYTES_PER_TEXEL);
+
+            Format::write(texel, blendTexel<Op>(Format::read(texel), source[i], opacity));
+        }
+    }
+
+    // SIMD kernel, written once against a small set of lane-wise operations
+
+    template <class Lanes, class Format>
+    typename Lanes::Int loadDestination(const irr::u8* texels)
+    {
+        if (Format::COLOR_FORMAT == irr::video::ECF_A8R8G8B8)
+        {
+            return Lanes::load(reinterpret_cast<const irr::u32*>(texels));
+        }
+
+        irr::u32 colors[Lanes::WIDTH];
+
+        for (irr::u32 i = 0; i < Lanes::WIDTH; ++i)
+        {
+            colors[i] = Format::read(texels + (i * Format::BYTES_PER_TEXEL));
+        }
+
+        return Lanes::load(colors);
+    }
+
+    template <class Lanes, class Format>
+    void storeDestination(irr::u8* texels, typename Lanes::Int colors)
+    {
+        if (Format::COLOR_FORMAT == irr::video::ECF_A8R8G8B8)
+        {
+            Lanes::store(reinterpret_cast<irr::u32*>(texels), colors);
+            return;
+        }
+
+        irr::u32 wideColors[Lanes::WIDTH];
+
+        Lanes::store(wideColors, colors);
+
+        for (irr::u32 i = 0; i < Lanes::WIDTH; ++i)
+        {
+            Format::write(texels + (i * Format::BYTES_PER_TEXEL), wideColors[i]);
+        }
+    }
+
+    template <class Lanes>
+    typename Lanes::Float getChannel(typename Lanes::Int colors, int shift)
+    {
+        return Lanes::mul(Lanes::toFloat(Lanes::bitAnd(Lanes::shiftRight(colors, shift), Lanes::setInt(0xFF))), Lanes::set(INV_255));
+    }
+
+    template <class Lanes>
+    typename Lanes::Int toBytes(typename Lanes::Float values)
+    {
+        return Lanes::truncate(Lanes::add(Lanes::mul(values, Lanes::set(255.f)), Lanes::set(0.5f)));
+    }
+
+    template <class Lanes, class Op>
+    typename Lanes::Int blendTexels(typename Lanes::Int destination, typename Lanes::Int source, typename Lanes::Float opacity)
+    {
+        auto one = Lanes::set(1.f);
+
+        auto sa = Lanes::mul(getChannel<Lanes>(source, 24), opacity);
+        auto da = getChannel<Lanes>(destination, 24);
+        auto oneMinusSa = Lanes::sub(one, sa);
+
+        if (Op::ERASES)
+        {
+            return Lanes::bitOr(Lanes::shiftLeft(toBytes<Lanes>(Lanes::mul(da, oneMinusSa)), 24), Lanes::bitAnd(destination, Lanes::setInt(0x00FFFFFF)));
+        }
+
+        auto alpha = Lanes::add(sa, Lanes::mul(da, oneMinusSa));
+        auto safeAlpha = Lanes::max(alpha, Lanes::set(MIN_ALPHA));
+        auto oneMinusDa = Lanes::sub(one, da);
+        auto backdropWeight = Lanes::mul(da, oneMinusSa);
+
+        auto result = Lanes::shiftLeft(toBytes<Lanes>(alpha), 24);
+
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            auto cs = getChannel<Lanes>(source, shift);
+            auto cb = getChannel<Lanes>(destination, shift);
+
+            auto blended = Lanes::add(Lanes::mul(oneMinusDa, cs), Lanes::mul(da, Op::template blend<Lanes>(cb, cs)));
+            auto value = Lanes::div(Lanes::add(Lanes::mul(sa, blended), Lanes::mul(backdropWeight, cb)), safeAlpha);
+
+            result = Lanes::bitOr(result, Lanes::shiftLeft(toBytes<Lanes>(value), shift));
+        }
+
+        return result;
+    }
+
+    template <class Lanes, class Op, class Format>
+    void blendRowSimd(irr::f32 opacity, irr::u8* destination, const irr::u32* source, irr::u32 count)
+    {
+        auto opacities = Lanes::set(opacity);
+
+        irr::u32 i = 0;
+
+        for (; i + Lanes::WIDTH <= count; i += Lanes::WIDTH)
+        {
+            auto texels = destination + (i * Format::BYTES_PER_TEXEL);
+
+            auto result = blendTexels<Lanes, Op>(loadDestination<Lanes, Format>(texels), Lanes::load(source + i), opacities);
+
+            storeDestination<Lanes, Format>(texels, result);
+        }
+
+        // the remainder goes through the scalar kernel, which gives the same results
+        blendRowScalar<Op, Format>(opacity, destination + (i * Format::BYTES_PER_TEXEL), source + i, count - i);
+    }
+
+#ifdef BLEND_KERNELS_SSE2
+    struct Sse2Lanes
+    {
+        static const irr::u32 WIDTH = 4;
+
+        typedef __m128 Float;
+        typedef __m128i Int;
+
+        static Int load(const irr::u32* values) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(values)); }
+        static void store(irr::u32* values, Int v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(values), v); }
+        static Float set(irr::f32 value) { return _mm_set1_ps(value); }
+        static Int setInt(irr::u32 value) { return _mm_set1_epi32(static_cast<int>(value)); }
+        static Float toFloat(Int v) { return _mm_cvtepi32_ps(v); }
+        static Int truncate(Float v) { return _mm_cvttps_epi32(v); }
+        static Float add(Float a, Float b) { return _mm_add_ps(a, b); }
+        static Float sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+        static Float div(Float a, Float b) { return _mm_div_ps(a, b); }
+        static Float min(Float a, Float b) { return _mm_min_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm_max_ps(a, b); }
+        static Float lessOrEqual(Float a, Float b) { return _mm_cmple_ps(a, b); }
+        static Float select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+        static Int bitAnd(Int a, Int b) { return _mm_and_si128(a, b); }
+        static Int bitOr(Int a, Int b) { return _mm_or_si128(a, b); }
+        static Int shiftLeft(Int v, int count) { return _mm_slli_epi32(v, count); }
+        static Int shiftRight(Int v, int count) { return _mm_srli_epi32(v, count); }
+    };
+#endif
+
+#ifdef BLEND_KERNELS_AVX2
+    struct Avx2Lanes
+    {
+        static const irr::u32 WIDTH = 8;
+
+        typedef __m256 Float;
+        typedef __m256i Int;
+
+        static Int load(const irr::u32* values) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values)); }
+        static void store(irr::u32* values, Int v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(values), v); }
+        static Float set(irr::f32 value) { return _mm256_set1_ps(value); }
+        static Int setInt(irr::u32 value) { return _mm256_set1_epi32(static_cast<int>(value)); }
+        static Float toFloat(Int v) { return _mm256_cvtepi32_ps(v); }
+        static Int truncate(Float v) { return _mm256_cvttps_epi32(v); }
+        static Float add(Float a, Float b) { return _mm256_add_ps(a, b); }
+        static Float sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+        static Float mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+        static Float div(Float a, Float b) { return _mm256_div_ps(a, b); }
+        static Float min(Float a, Float b) { return _mm256_min_ps(a, b); }
+        static Float max(Float a, Float b) { return _mm256_max_ps(a, b); }
+        static Float lessOrEqual(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        static Float select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+        static Int bitAnd(Int a, Int b) { return _mm256_and_si256(a, b); }
+        static Int bitOr(Int a, Int b) { return _mm256_or_si256(a, b); }
+        static Int shiftLeft(Int v, int count) { return _mm256_slli_epi32(v, count); }
+        static Int shiftRight(Int v, int count) { return _mm256_srli_epi32(v, count); }
+    };
+#endif
+
+    // kernel tables
+
+    template <class Op, class Format>
+    BlendRowFunction getKernel(BlendKernelVariant variant)
+    {
+        switch (variant)
+        {
+#ifdef BLEND_KERNELS_SSE2
+        case BlendKernelVariant::Sse2:
+            return &blendRowSimd<Sse2Lanes, Op, Format>;
+#endif
+#ifdef BLEND_KERNELS_AVX2
+        case BlendKernelVariant::Avx2:
+            return &blendRowSimd<Avx2Lanes, Op, Format>;
+#endif
+        default:
+            return &blendRowScalar<Op, Format>;
+        }
+    }
+
+    template <class Format>
+    BlendRowFunction getKernel(BlendKernelVariant variant, BlendMode blendMode)
+    {
+        switch (blendMode)
+        {
+        case BlendMode::Multiply:
+            return getKernel<MultiplyOp, Format>(variant);
+        case BlendMode::Screen:
+            return getKernel<ScreenOp, Format>(variant);
+        case BlendMode::Add:
+            return getKernel<AddOp, Format>(variant);
+        case BlendMode::Erase:
+            return getKernel<EraseOp, Format>(variant);
+        case BlendMode::Overlay:
+            return getKernel<OverlayOp, Format>(variant);
+        case BlendMode::Lighten:
+            return getKernel<LightenOp, Format>(variant);
+        case BlendMode::Darken:
+            return getKernel<DarkenOp, Format>(variant);
+        default:
+            return getKernel<NormalOp, Format>(variant);
+        }
+    }
+
+    BlendRowFunction getKernel(BlendKernelVariant variant, BlendMode blendMode, irr::video::ECOLOR_FORMAT format)
+    {
+        switch (format)
+        {
+        case irr::video::ECF_A8R8G8B8:
+            return getKernel<FormatA8R8G8B8>(variant, blendMode);
+        case irr::video::ECF_R8G8B8:
+            return getKernel<FormatR8G8B8>(variant, blendMode);
+        case irr::video::ECF_A1R5G5B5:
+            return getKernel<FormatA1R5G5B5>(variant, blendMode);
+        default:
+            return nullptr;
+        }
+    }
+
+    BlendKernelVariant getWidestVariant()
+    {
+        static const auto widestVariant = isBlendKernelVariantSupported(BlendKernelVariant::Avx2) ? BlendKernelVariant::Avx2
+            : isBlendKernelVariantSupported(BlendKernelVariant::Sse2)                                ? BlendKernelVariant::Sse2
+                                                                                                     : BlendKernelVariant::Scalar;
+
+        return widestVariant;
+    }
+
+    template <class Format>
+    void readRow(const irr::u8* source, irr::u32* destination, irr::u32 count)
+    {
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            destination[i] = Format::read(source + (i * Format::BYTES_PER_TEXEL));
+        }
+    }
+
+    template <class Format>
+    void writeRow(irr::u8* destination, const irr::u32* source, irr::u32 count)
+    {
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            Format::write(destination + (i * Format::BYTES_PER_TEXEL), source[i]);
+        }
+    }
+
+    const char* getVariantName(BlendKernelVariant variant)
+    {
+        switch (variant)
+        {
+        case BlendKernelVariant::Sse2:
+            return "SSE2";
+        case BlendKernelVariant::Avx2:
+            return "AVX2";
+        default:
+            return "scalar";
+        }
+    }
+
+    const char* getFormatName(irr::video::ECOLOR_FORMAT format)
+    {
+        switch (format)
+        {
+        case irr::video::ECF_A8R8G8B8:
+            return "A8R8G8B8";
+        case irr::video::ECF_R8G8B8:
+            return "R8G8B8";
+        default:
+            return "A1R5G5B5";
+        }
+    }
+
+    // linear light
+
+    const irr::f32 INV_65535 = 1.f / 65535.f;
+
+    //! lookup tables between 8 bit sRGB and 16 bit linear light, built on first use
+    struct SrgbTables
+    {
+        SrgbTables()
+        {
+            for (irr::u32 i = 0; i < 256; ++i)
+            {
+                auto value = i / 255.;
+
+                auto linear = value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+
+                toLinear[i] = static_cast<irr::f32>(linear);
+                toLinearWord[i] = static_cast<irr::u16>((linear * 65535.) + 0.5);
+            }
+
+            // a full table rather than a coarser one with interpolation, the darkest sRGB steps are only about 20 words apart
+            for (irr::u32 i = 0; i < 65536; ++i)
+            {
+                auto linear = i / 65535.;
+
+                auto value = linear <= 0.0031308 ? linear * 12.92 : (1.055 * std::pow(linear, 1. / 2.4)) - 0.055;
+
+                toSrgb[i] = static_cast<irr::u8>((value * 255.) + 0.5);
+            }
+        }
+
+        irr::f32 toLinear[256];
+        irr::u16 toLinearWord[256];
+        irr::u8 toSrgb[65536];
+    };
+
+    const SrgbTables& getSrgbTables()
+    {
+        static const SrgbTables tables;
+
+        return tables;
+    }
+
+    irr::u16 toWord(irr::f32 value)
+    {
+        return static_cast<irr::u16>((value * 65535.f) + 0.5f);
+    }
+
+    //! the same blend as blendTexel, on 16 bit linear-light destination texels
+    template <class Op>
+    void blendRowLinear(irr::f32 opacity, irr::u16* destination, const irr::u32* source, irr::u32 count)
+    {
+        const auto& tables = getSrgbTables();
+
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            auto texel = destination + (i * 4);
+
+            auto sa = (static_cast<irr::f32>(source[i] >> 24) * INV_255) * opacity;
+            auto da = static_cast<irr::f32>(texel[3]) * INV_65535;
+            auto oneMinusSa = 1.f - sa;
+
+            if (Op::ERASES)
+            {
+                texel[3] = toWord(da * oneMinusSa);
+                continue;
+            }
+
+            auto alpha = sa + (da * oneMinusSa);
+            auto safeAlpha = std::max(alpha, MIN_ALPHA);
+            auto oneMinusDa = 1.f - da;
+            auto backdropWeight = da * oneMinusSa;
+
+            for (irr::u32 channel = 0; channel < 3; ++channel)
+            {
+                auto cs = tables.toLinear[(source[i] >> (channel * 8)) & 0xFF];
+                auto cb = static_cast<irr::f32>(texel[channel]) * INV_65535;
+
+                auto blended = (oneMinusDa * cs) + (da * Op::blend(cb, cs));
+                auto value = ((sa * blended) + (backdropWeight * cb)) / safeAlpha;
+
+                texel[channel] = toWord(value);
+            }
+
+            texel[3] = toWord(alpha);
+        }
+    }
+
+    const irr::video::ECOLOR_FORMAT BLEND_FORMATS[] = { irr::video::ECF_A8R8G8B8, irr::video::ECF_R8G8B8, irr::video::ECF_A1R5G5B5 };
+
+    //! random texels with plenty of fully transparent and fully opaque ones, which are the usual edge cases
+    std::vector<irr::u32> createTestTexels(std::mt19937& random, irr::u32 count)
+    {
+        std::uniform_int_distribution<irr::u32> texelDistribution;
+        std::uniform_int_distribution<int> alphaKind(0, 3);
+
+        std::vector<irr::u32> texels(count);
+
+        for (auto& texel : texels)
+        {
+            texel = texelDistribution(random);
+
+            auto kind = alphaKind(random);
+
+            if (kind == 0)
+            {
+                texel &= 0x00FFFFFF;
+            }
+            else if (kind == 1)
+            {
+                texel |= 0xFF000000;
+            }
+        }
+
+        return texels;
+    }
+}
+
+bool isBlendFormatSupported(irr::video::ECOLOR_FORMAT format)
+{
+    return format == irr::video::ECF_A8R8G8B8 || format == irr::video::ECF_R8G8B8 || format == irr::video::ECF_A1R5G5B5;
+}
+
+irr::u32 getBlendFormatBytesPerTexel(irr::video::ECOLOR_FORMAT format)
+{
+    return format == irr::video::ECF_A8R8G8B8 ? 4 : format == irr::video::ECF_R8G8B8 ? 3 : 2;
+}
+
+void readRow(irr::video::ECOLOR_FORMAT sourceFormat, const void* source, irr::u32* destination, irr::u32 count)
+{
+    auto texels = static_cast<const irr::u8*>(source);
+
+    switch (sourceFormat)
+    {
+    case irr::video::ECF_A8R8G8B8:
+        std::memcpy(destination, texels, count * 4);
+        break;
+    case irr::video::ECF_R8G8B8:
+        readRow<FormatR8G8B8>(texels, destination, count);
+        break;
+    case irr::video::ECF_A1R5G5B5:
+        readRow<FormatA1R5G5B5>(texels, destination, count);
+        break;
+    default:
+        std::cerr << "Could not read texels of an unsupported color format" << std::endl;
+        break;
+    }
+}
+
+void writeRow(irr::video::ECOLOR_FORMAT destinationFormat, void* destination, const irr::u32* source, irr::u32 count)
+{
+    auto texels = static_cast<irr::u8*>(destination);
+
+    switch (destinationFormat)
+    {
+    case irr::video::ECF_A8R8G8B8:
+        std::memcpy(texels, source, count * 4);
+        break;
+    case irr::video::ECF_R8G8B8:
+        writeRow<FormatR8G8B8>(texels, source, count);
+        break;
+    case irr::video::ECF_A1R5G5B5:
+        writeRow<FormatA1R5G5B5>(texels, source, count);
+        break;
+    default:
+        std::cerr << "Could not write texels of an unsupported color format" << std::endl;
+        break;
+    }
+}
+
+void linearRowToSrgb(const irr::u16* source, irr::u32* destination, irr::u32 count)
+{
+    const auto& tables = getSrgbTables();
+
+    for (irr::u32 i = 0; i < count; ++i)
+    {
+        auto texel = source + (i * 4);
+
+        // alpha is not gamma encoded
+        destination[i] = ((((texel[3] * 255u) + 32767u) / 65535u) << 24)
+            | (tables.toSrgb[texel[2]] << 16)
+            | (tables.toSrgb[texel[1]] << 8)
+            | tables.toSrgb[texel[0]];
+    }
+}
+
+void srgbRowToLinear(const irr::u32* source, irr::u16* destination, irr::u32 count)
+{
+    const auto& tables = getSrgbTables();
+
+    for (irr::u32 i = 0; i < count; ++i)
+    {
+        auto texel = destination + (i * 4);
+
+        texel[0] = tables.toLinearWord[source[i] & 0xFF];
+        texel[1] = tables.toLinearWord[(source[i] >> 8) & 0xFF];
+        texel[2] = tables.toLinearWord[(source[i] >> 16) & 0xFF];
+        texel[3] = static_cast<irr::u16>((source[i] >> 24) * 257);
+    }
+}
+
+void blendRowLinear(BlendMode blendMode, irr::f32 opacity, irr::u16* destination, const irr::u32* source, irr::u32 count)
+{
+    switch (blendMode)
+    {
+    case BlendMode::Multiply:
+        blendRowLinear<MultiplyOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Screen:
+        blendRowLinear<ScreenOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Add:
+        blendRowLinear<AddOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Erase:
+        blendRowLinear<EraseOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Overlay:
+        blendRowLinear<OverlayOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Lighten:
+        blendRowLinear<LightenOp>(opacity, destination, source, count);
+        break;
+    case BlendMode::Darken:
+        blendRowLinear<DarkenOp>(opacity, destination, source, count);
+        break;
+    default:
+        blendRowLinear<NormalOp>(opacity, destination, source, count);
+        break;
+    }
+}
+
+bool isBlendKernelVariantSupported(BlendKernelVariant variant)
+{
+    switch (variant)
+    {
+    case BlendKernelVariant::Scalar:
+        return true;
+#ifdef BLEND_KERNELS_SSE2
+    case BlendKernelVariant::Sse2:
+        return true;
+#endif
+#ifdef BLEND_KERNELS_AVX2
+    case BlendKernelVariant::Avx2:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+void blendRow(BlendMode blendMode, irr::video::ECOLOR_FORMAT destinationFormat, irr::f32 opacity, void* destination, const irr::u32* source, irr::u32 count)
+{
+    blendRow(getWidestVariant(), blendMode, destinationFormat, opacity, destination, source, count);
+}
+
+void blendRow(BlendKernelVariant variant, BlendMode blendMode, irr::video::ECOLOR_FORMAT destinationFormat, irr::f32 opacity, void* destination, const irr::u32* source, irr::u32 count)
+{
+    auto kernel = getKernel(variant, blendMode, destinationFormat);
+
+    if (kernel == nullptr)
+    {
+        std::cerr << "Could not blend into an unsupported color format" << std::endl;
+        return;
+    }
+
+    kernel(opacity, static_cast<irr::u8*>(destination), source, count);
+}
+
+const wchar_t* getBlendModeName(BlendMode blendMode)
+{
+    switch (blendMode)
+    {
+    case BlendMode::Multiply:
+        return L"Multiply";
+    case BlendMode::Screen:
+        return L"Screen";
+    case BlendMode::Add:
+        return L"Add";
+    case BlendMode::Erase:
+        return L"Erase";
+    case BlendMode::Overlay:
+        return L"Overlay";
+    case BlendMode::Lighten:
+        return L"Lighten";
+    case BlendMode::Darken:
+        return L"Darken";
+    default:
+        return L"Normal";
+    }
+}
+
+void benchmarkBlendKernels()
+{
+    const irr::u32 ROW_LENGTH = 4096;
+    const auto MEASURE_TIME = std::chrono::milliseconds(100);
+
+    std::mt19937 random(1);
+
+    auto source = createTestTexels(random, ROW_LENGTH);
+    auto destinationTexels = createTestTexels(random, ROW_LENGTH);
+
+    std::cout << "Blend kernels, Mpixels/s, half opacity" << std::endl;
+    std::cout << std::left << std::setw(10) << "mode";
+
+    for (auto format : BLEND_FORMATS)
+    {
+        for (irr::u32 variant = 0; variant < BLEND_KERNEL_VARIANT_COUNT; ++variant)
+        {
+            if (isBlendKernelVariantSupported(static_cast<BlendKernelVariant>(variant)))
+            {
+                std::cout << std::right << std::setw(18) << (std::string(getFormatName(format)) + " " + getVariantName(static_cast<BlendKernelVariant>(variant)));
+            }
+        }
+    }
+
+    std::cout << std::endl;
+
+    for (irr::u32 mode = 0; mode < BLEND_MODE_COUNT; ++mode)
+    {
+        std::wstring modeName = getBlendModeName(static_cast<BlendMode>(mode));
+
+        std::cout << std::left << std::setw(10) << std::string(modeName.begin(), modeName.end());
+
+        for (auto format : BLEND_FORMATS)
+        {
+            std::vector<irr::u8> destination(ROW_LENGTH * getBlendFormatBytesPerTexel(format));
+
+            for (irr::u32 i = 0; i < ROW_LENGTH; ++i)
+            {
+                std::memcpy(destination.data() + (i * getBlendFormatBytesPerTexel(format)), &destinationTexels[i], getBlendFormatBytesPerTexel(format));
+            }
+
+            for (irr::u32 variant = 0; variant < BLEND_KERNEL_VARIANT_COUNT; ++variant)
+            {
+                if (!isBlendKernelVariantSupported(static_cast<BlendKernelVariant>(variant)))
+                {
+                    continue;
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                auto elapsed = std::chrono::steady_clock::duration::zero();
+
+                irr::u64 texelCount = 0;
+
+                while (elapsed < MEASURE_TIME)
+                {
+                    blendRow(static_cast<BlendKernelVariant>(variant), static_cast<BlendMode>(mode), format, 0.5f, destination.data(), source.data(), ROW_LENGTH);
+
+                    texelCount += ROW_LENGTH;
+                    elapsed = std::chrono::steady_clock::now() - start;
+                }
+
+                auto seconds = std::chrono::duration<double>(elapsed).count();
+
+                std::cout << std::right << std::setw(18) << std::fixed << std::setprecision(1) << (texelCount / seconds / 1e6);
+            }
+        }
+
+        std::cout << std::endl;
+    }
+
+    // the linear-light path against the 8 bit one: blending a dab, then converting the tile back for upload and save
+    std::vector<irr::u16> linearTexels(ROW_LENGTH * 4);
+    std::vector<irr::u32> srgbTexels(ROW_LENGTH);
+
+    srgbRowToLinear(destinationTexels.data(), linearTexels.data(), ROW_LENGTH);
+
+    auto measure = [&](const std::function<void()>& run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::steady_clock::duration::zero();
+
+        irr::u64 texelCount = 0;
+
+        while (elapsed < MEASURE_TIME)
+        {
+            run();
+
+            texelCount += ROW_LENGTH;
+            elapsed = std::chrono::steady_clock::now() - start;
+        }
+
+        return texelCount / std::chrono::duration<double>(elapsed).count() / 1e6;
+    };
+
+    std::cout << std::endl
+              << "Normal blend, Mpixels/s: 8 bit sRGB " << std::setprecision(1)
+              << measure([&]() { blendRow(BlendMode::Normal, irr::video::ECF_A8R8G8B8, 0.5f, srgbTexels.data(), source.data(), ROW_LENGTH); })
+              << ", 16 bit linear " << measure([&]() { blendRowLinear(BlendMode::Normal, 0.5f, linearTexels.data(), source.data(), ROW_LENGTH); })
+              << ", linear to sRGB conversion " << measure([&]() { linearRowToSrgb(linearTexels.data(), srgbTexels.data(), ROW_LENGTH); })
+              << std::endl;
+
+    std::cout << "Memory per painted texel: 4 bytes at 8 bit, 12 bytes with the 16 bit linear buffer kept alongside" << std::endl;
+}
+
+TestBlendKernels::TestBlendKernels() :
+    failureCount(0)
+{
+    std::cerr << "TestBlendKernels..." << std::flush;
+
+    const irr::f32 OPACITIES[] = { 1.f, 0.5f, 0.1f, 0.f };
+
+    // known results of the scalar kernels
+    testTexel(BlendMode::Normal, 0xFF102030, 0xFF405060, 1.f, 0xFF405060);
+    testTexel(BlendMode::Normal, 0xFF102030, 0x00405060, 1.f, 0xFF102030);
+    testTexel(BlendMode::Normal, 0xFF102030, 0xFF405060, 0.f, 0xFF102030);
+    testTexel(BlendMode::Normal, 0x00000000, 0x80FF0000, 1.f, 0x80FF0000);
+    testTexel(BlendMode::Normal, 0xFF000000, 0x80FFFFFF, 1.f, 0xFF808080);
+    testTexel(BlendMode::Multiply, 0xFF804020, 0xFFFFFFFF, 1.f, 0xFF804020);
+    testTexel(BlendMode::Multiply, 0xFF804020, 0xFF000000, 1.f, 0xFF000000);
+    testTexel(BlendMode::Screen, 0xFF804020, 0xFF000000, 1.f, 0xFF804020);
+    testTexel(BlendMode::Screen, 0xFF804020, 0xFFFFFFFF, 1.f, 0xFFFFFFFF);
+    testTexel(BlendMode::Add, 0xFF804020, 0xFF808080, 1.f, 0xFFFFC0A0);
+    testTexel(BlendMode::Erase, 0xFF804020, 0xFF000000, 1.f, 0x00804020);
+    testTexel(BlendMode::Erase, 0xFF804020, 0x80000000, 1.f, 0x7F804020);
+    testTexel(BlendMode::Overlay, 0xFF000000, 0xFFFFFFFF, 1.f, 0xFF000000);
+    testTexel(BlendMode::Overlay, 0xFFFFFFFF, 0xFF000000, 1.f, 0xFFFFFFFF);
+    testTexel(BlendMode::Lighten, 0xFF804020, 0xFF408040, 1.f, 0xFF808040);
+    testTexel(BlendMode::Darken, 0xFF804020, 0xFF408040, 1.f, 0xFF404020);
+
+    testFormatRoundTrip(irr::video::ECF_R8G8B8);
+    testFormatRoundTrip(irr::video::ECF_A1R5G5B5);
+    testLinear();
+
+    // every SIMD kernel has to give exactly what the scalar one gives
+    for (irr::u32 variant = 1; variant < BLEND_KERNEL_VARIANT_COUNT; ++variant)
+    {
+        if (!isBlendKernelVariantSupported(static_cast<BlendKernelVariant>(variant)))
+        {
+            continue;
+        }
+
+        for (irr::u32 mode = 0; mode < BLEND_MODE_COUNT; ++mode)
+        {
+            for (auto format : BLEND_FORMATS)
+            {
+                for (auto opacity : OPACITIES)
+                {
+                    testAgainstScalar(static_cast<BlendKernelVariant>(variant), static_cast<BlendMode>(mode), format, opacity);
+                }
+            }
+        }
+    }
+
+    std::cerr << (hasPassed() ? "OK" : "FAILED") << std::endl;
+}
+
+bool TestBlendKernels::hasPassed() const
+{
+    return failureCount == 0;
+}
+
+void TestBlendKernels::testAgainstScalar(BlendKernelVariant variant, BlendMode blendMode, irr::video::ECOLOR_FORMAT format, irr::f32 opacity)
+{
+    // not a multiple of any lane count, so the scalar remainder is covered as well
+    const irr::u32 TEXEL_COUNT = 1027;
+
+    std::mt19937 random(static_cast<unsigned int>(blendMode) + 1);
+
+    auto source = createTestTexels(random, TEXEL_COUNT);
+    auto destinationTexels = createTestTexels(random, TEXEL_COUNT);
+
+    auto bytesPerTexel = getBlendFormatBytesPerTexel(format);
+
+    std::vector<irr::u8> expected(TEXEL_COUNT * bytesPerTexel);
+
+    for (irr::u32 i = 0; i < TEXEL_COUNT; ++i)
+    {
+        std::memcpy(expected.data() + (i * bytesPerTexel), &destinationTexels[i], bytesPerTexel);
+    }
+
+    auto result = expected;
+
+    blendRow(BlendKernelVariant::Scalar, blendMode, format, opacity, expected.data(), source.data(), TEXEL_COUNT);
+    blendRow(variant, blendMode, format, opacity, result.data(), source.data(), TEXEL_COUNT);
+
+    for (irr::u32 i = 0; i < TEXEL_COUNT * bytesPerTexel; ++i)
+    {
+        if (result[i] != expected[i])
+        {
+            std::wstring modeName = getBlendModeName(blendMode);
+
+            std::cerr << std::endl
+                      << getVariantName(variant) << " " << std::string(modeName.begin(), modeName.end()) << " " << getFormatName(format)
+                      << " at opacity " << opacity << " differs from the scalar kernel at texel " << (i / bytesPerTexel);
+
+            assertEqual(result[i], expected[i], "SIMD byte");
+            return;
+        }
+    }
+}
+
+void TestBlendKernels::testFormatRoundTrip(irr::video::ECOLOR_FORMAT format)
+{
+    auto bytesPerTexel = getBlendFormatBytesPerTexel(format);
+
+    // all 16 bit values, and for 24 bit every value of each channel in turn
+    const irr::u32 TEXEL_COUNT = 1 << 16;
+
+    std::vector<irr::u8> texels(TEXEL_COUNT * bytesPerTexel);
+
+    for (irr::u32 i = 0; i < TEXEL_COUNT; ++i)
+    {
+        auto value = bytesPerTexel == 2 ? i : ((i & 0xFF) << ((i >> 8) % 3) * 8);
+
+        std::memcpy(texels.data() + (i * bytesPerTexel), &value, bytesPerTexel);
+    }
+
+    std::vector<irr::u32> wideTexels(TEXEL_COUNT);
+    auto result = texels;
+
+    readRow(format, texels.data(), wideTexels.data(), TEXEL_COUNT);
+    writeRow(format, result.data(), wideTexels.data(), TEXEL_COUNT);
+
+    for (irr::u32 i = 0; i < TEXEL_COUNT * bytesPerTexel; ++i)
+    {
+        if (result[i] != texels[i])
+        {
+            std::cerr << std::endl
+                      << getFormatName(format) << " texel " << (i / bytesPerTexel) << " changed on the way through A8R8G8B8";
+
+            assertEqual(result[i], texels[i], "byte");
+            return;
+        }
+    }
+}
+
+void TestBlendKernels::testLinear()
+{
+    std::vector<irr::u32> texels(256);
+
+    for (irr::u32 i = 0; i < 256; ++i)
+    {
+        texels[i] = (i << 24) | (i << 16) | ((255 - i) << 8) | i;
+    }
+
+    std::vector<irr::u16> linearTexels(256 * 4);
+    std::vector<irr::u32> result(256);
+
+    srgbRowToLinear(texels.data(), linearTexels.data(), 256);
+    linearRowToSrgb(linearTexels.data(), result.data(), 256);
+
+    for (irr::u32 i = 0; i < 256; ++i)
+    {
+        if (result[i] != texels[i])
+        {
+            assertEqual(result[i], texels[i], "texel back from linear light");
+            return;
+        }
+    }
+
+    // 8 bit blending stalls a few steps short of the brush color at this opacity, 16 bits get within one step
+    irr::u32 eightBit = 0xFF000000;
+    irr::u16 linear[4] = { 0, 0, 0, 65535 };
+    irr::u32 brush = 0xFFFFFFFF;
+
+    for (auto i = 0; i < 2000; ++i)
+    {
+        blendRow(BlendKernelVariant::Scalar, BlendMode::Normal, irr::video::ECF_A8R8G8B8, 0.02f, &eightBit, &brush, 1);
+        blendRowLinear(BlendMode::Normal, 0.02f, linear, &brush, 1);
+    }
+
+    irr::u32 linearResult;
+    linearRowToSrgb(linear, &linearResult, 1);
+
+    if ((linearResult & 0xFF) < 0xFE || (eightBit & 0xFF) >= (linearResult & 0xFF))
+    {
+        std::cerr << std::endl
+                  << "Faint dabs reached " << std::hex << eightBit << " at 8 bit and " << linearResult << std::dec << " in linear light";
+
+        assertEqual(linearResult, 0xFFFFFFFF, "texel after faint dabs");
+    }
+}
+
+void TestBlendKernels::testTexel(BlendMode blendMode, irr::u32 destination, irr::u32 source, irr::f32 opacity, irr::u32 expectedResult)
+{
+    blendRow(BlendKernelVariant::Scalar, blendMode, irr::video::ECF_A8R8G8B8, opacity, &destination, &source, 1);
+
+    assertEqual(destination, expectedResult, "texel");
+}
+
+void TestBlendKernels::assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description)
+{
+    if (subject != expectedResult)
+    {
+        std::cerr << std::endl
+                  << "The test expected " << description << " " << std::hex << expectedResult << " but got " << subject << std::dec << std::endl;
+
+        ++failureCount;
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <irrlicht/irrlicht.h>
+
+enum class BlendMode
+{
+    Normal,
+    Multiply,
+    Screen,
+    Add,
+    Erase,
+    Overlay,
+    Lighten,
+    Darken
+};
+
+const irr::u32 BLEND_MODE_COUNT = 8;
+
+//! instruction sets a kernel can be compiled for, narrowest first
+enum class BlendKernelVariant
+{
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+const irr::u32 BLEND_KERNEL_VARIANT_COUNT = 3;
+
+//! whether blendRow can write into textures of this color format
+bool isBlendFormatSupported(irr::video::ECOLOR_FORMAT format);
+
+//! 4 for A8R8G8B8, 3 for R8G8B8 and 2 for A1R5G5B5
+irr::u32 getBlendFormatBytesPerTexel(irr::video::ECOLOR_FORMAT format);
+
+//! widens a row of texels in one of the supported formats to A8R8G8B8, rounding the same way the kernels do
+void readRow(irr::video::ECOLOR_FORMAT sourceFormat, const void* source, irr::u32* destination, irr::u32 count);
+
+//! narrows a row of A8R8G8B8 texels into one of the supported formats
+void writeRow(irr::video::ECOLOR_FORMAT destinationFormat, void* destination, const irr::u32* source, irr::u32 count);
+
+//! whether the variant was compiled in; SSE2 is part of every x86-64 build, AVX2 needs the compiler to target it
+bool isBlendKernelVariantSupported(BlendKernelVariant variant);
+
+//! blends a row of non-premultiplied A8R8G8B8 source texels into a row of destination texels in one of the supported formats
+/** The kernel for the blend mode and format is picked once per call; the widest supported variant is used. */
+void blendRow(BlendMode blendMode, irr::video::ECOLOR_FORMAT destinationFormat, irr::f32 opacity, void* destination, const irr::u32* source, irr::u32 count);
+
+//! same as above with an explicit variant, which has to be supported
+void blendRow(BlendKernelVariant variant, BlendMode blendMode, irr::video::ECOLOR_FORMAT destinationFormat, irr::f32 opacity, void* destination, const irr::u32* source, irr::u32 count);
+
+//! converts a row of 16 bit linear-light texels, stored as blue, green, red and alpha words, to 8 bit sRGB A8R8G8B8
+void linearRowToSrgb(const irr::u16* source, irr::u32* destination, irr::u32 count);
+
+//! converts a row of 8 bit sRGB A8R8G8B8 texels to 16 bit linear light
+void srgbRowToLinear(const irr::u32* source, irr::u16* destination, irr::u32 count);
+
+//! blends a row of sRGB A8R8G8B8 source texels into a row of 16 bit linear-light texels
+/** Blending happens in linear light with 16 bits kept per channel, so dabs at low opacity keep adding up instead of rounding away. */
+void blendRowLinear(BlendMode blendMode, irr::f32 opacity, irr::u16* destination, const irr::u32* source, irr::u32 count);
+
+const wchar_t* getBlendModeName(BlendMode blendMode);
+
+//! prints Mpixels/s for every blend mode, format and supported variant, and what the linear-light path costs
+void benchmarkBlendKernels();
+
+//! Checks every SIMD kernel against the scalar one bit for bit, and the scalar ones against known results.
+class TestBlendKernels
+{
+public:
+    TestBlendKernels();
+
+    bool hasPassed() const;
+
+private:
+    void testAgainstScalar(BlendKernelVariant variant, BlendMode blendMode, irr::video::ECOLOR_FORMAT format, irr::f32 opacity);
+
+    //! every texel of a narrower format has to come back unchanged after being widened to A8R8G8B8
+    void testFormatRoundTrip(irr::video::ECOLOR_FORMAT format);
+
+    //! every 8 bit value has to come back unchanged from linear light, and repeated faint dabs have to add up there
+    void testLinear();
+
+    void testTexel(BlendMode blendMode, irr::u32 destination, irr::u32 source, irr::f32 opacity, irr::u32 expectedResult);
+
+    void assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description);
+
+    irr::u32 failureCount;
+};
@@ -0,0 +1,1371 @@
+#include "DdsExporter.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <random>
+
+#include "ThreadPool.h"
+
+namespace {
+    typedef irr::u8 BlockTexels[16][4];
+
+    const irr::u32 KAISER_TAP_COUNT = 6;
+
+    //! shape of the Kaiser window, higher is smoother with less ringing
+    const irr::f32 KAISER_ALPHA = 4.f;
+
+    //! how many texels of a coarser level a changed texel of the level below can reach, beyond the ones it lies under
+    const irr::s32 BOX_REACH = 0;
+    const irr::s32 KAISER_REACH = 2;
+
+    //! interpolation weights of the 4 bit indices of BC7, out of 64
+    const irr::u32 BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    const irr::u32 DXGI_FORMAT_BC7_UNORM = 98;
+
+    irr::u32 getBlockBytes(BlockFormat format)
+    {
+        return format == BlockFormat::BC1 ? 8 : 16;
+    }
+
+    irr::u32 makeFourCc(char a, char b, char c, char d)
+    {
+        return static_cast<irr::u32>(a) | (static_cast<irr::u32>(b) << 8) | (static_cast<irr::u32>(c) << 16) | (static_cast<irr::u32>(d) << 24);
+    }
+
+    irr::f32 getBesselI0(irr::f32 x)
+    {
+        irr::f32 sum = 1.f;
+        irr::f32 term = 1.f;
+
+        for (irr::u32 k = 1; k < 20; ++k)
+        {
+            auto factor = x / (2.f * k);
+
+            term *= factor * factor;
+            sum += term;
+        }
+
+        return sum;
+    }
+
+    //! weights of the source texels 2x - 2 .. 2x + 3 for the texel x of the next level
+    const irr::f32* getKaiserWeights()
+    {
+        static const auto weights = [] {
+            std::array<irr::f32, KAISER_TAP_COUNT> kaiserWeights;
+
+            irr::f32 sum = 0.f;
+
+            for (irr::u32 tap = 0; tap < KAISER_TAP_COUNT; ++tap)
+            {
+                // distance from the center of the coarser texel, in source texels
+                auto distance = tap - ((KAISER_TAP_COUNT - 1) / 2.f);
+
+                auto x = irr::core::PI * distance / 2.f;
+                auto t = distance / (KAISER_TAP_COUNT / 2.f);
+
+                auto sinc = std::sin(x) / x;
+                auto window = getBesselI0(KAISER_ALPHA * std::sqrt(1.f - (t * t))) / getBesselI0(KAISER_ALPHA);
+
+                kaiserWeights[tap] = sinc * window;
+                sum += kaiserWeights[tap];
+            }
+
+            for (auto& weight : kaiserWeights)
+            {
+                weight /= sum;
+            }
+
+            return kaiserWeights;
+        }();
+
+        return weights.data();
+    }
+
+    //! the ends of the spread of the texels along their principal axis, over their first channelCount channels
+    void findEndpoints(const BlockTexels& texels, irr::u32 channelCount, irr::f32* first, irr::f32* second)
+    {
+        irr::f32 mean[4] = {};
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            for (irr::u32 c = 0; c < channelCount; ++c)
+            {
+                mean[c] += texels[i][c] / 16.f;
+            }
+        }
+
+        irr::f32 covariance[4][4] = {};
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            for (irr::u32 a = 0; a < channelCount; ++a)
+            {
+                for (irr::u32 b = 0; b < channelCount; ++b)
+                {
+                    covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+                }
+            }
+        }
+
+        // power iteration, starting from the channel which varies the most
+        irr::u32 widestChannel = 0;
+
+        for (irr::u32 c = 1; c < channelCount; ++c)
+        {
+            if (covariance[c][c] > covariance[widestChannel][widestChannel])
+            {
+                widestChannel = c;
+            }
+        }
+
+        irr::f32 axis[4] = {};
+
+        for (irr::u32 c = 0; c < channelCount; ++c)
+        {
+            axis[c] = covariance[widestChannel][c];
+        }
+
+        for (irr::u32 iteration = 0; iteration < 8; ++iteration)
+        {
+            irr::f32 nextAxis[4] = {};
+            irr::f32 largest = 0.f;
+
+            for (irr::u32 a = 0; a < channelCount; ++a)
+            {
+                for (irr::u32 b = 0; b < channelCount; ++b)
+                {
+                    nextAxis[a] += covariance[a][b] * axis[b];
+                }
+
+                largest = std::max(largest, std::abs(nextAxis[a]));
+            }
+
+            if (largest == 0.f)
+            {
+                break;
+            }
+
+            for (irr::u32 c = 0; c < channelCount; ++c)
+            {
+                axis[c] = nextAxis[c] / largest;
+            }
+        }
+
+        irr::f32 axisLengthSquared = 0.f;
+
+        for (irr::u32 c = 0; c < channelCount; ++c)
+        {
+            axisLengthSquared += axis[c] * axis[c];
+        }
+
+        auto lowest = 0.f;
+        auto highest = 0.f;
+
+        if (axisLengthSquared > 1e-8f)
+        {
+            lowest = std::numeric_limits<irr::f32>::max();
+            highest = -lowest;
+
+            for (irr::u32 i = 0; i < 16; ++i)
+            {
+                irr::f32 projection = 0.f;
+
+                for (irr::u32 c = 0; c < channelCount; ++c)
+                {
+                    projection += (texels[i][c] - mean[c]) * axis[c];
+                }
+
+                lowest = std::min(lowest, projection / axisLengthSquared);
+                highest = std::max(highest, projection / axisLengthSquared);
+            }
+        }
+
+        for (irr::u32 c = 0; c < channelCount; ++c)
+        {
+            first[c] = irr::core::clamp(mean[c] + (axis[c] * highest), 0.f, 255.f);
+            second[c] = irr::core::clamp(mean[c] + (axis[c] * lowest), 0.f, 255.f);
+        }
+    }
+
+    //! the endpoints which fit the texels best in the least squares sense, given how far each texel lies from first toward second
+    /** Returns false when the weights do not tell the two endpoints apart. */
+    bool fitEndpoints(const BlockTexels& texels, irr::u32 channelCount, const irr::f32* weights, irr::f32* first, irr::f32* second)
+    {
+        irr::f32 aa = 0.f, ab = 0.f, bb = 0.f;
+        irr::f32 ax[4] = {}, bx[4] = {};
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            auto a = 1.f - weights[i];
+            auto b = weights[i];
+
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+
+            for (irr::u32 c = 0; c < channelCount; ++c)
+            {
+                ax[c] += a * texels[i][c];
+                bx[c] += b * texels[i][c];
+            }
+        }
+
+        auto determinant = (aa * bb) - (ab * ab);
+
+        if (std::abs(determinant) < 1e-6f)
+        {
+            return false;
+        }
+
+        for (irr::u32 c = 0; c < channelCount; ++c)
+        {
+            first[c] = irr::core::clamp(((ax[c] * bb) - (bx[c] * ab)) / determinant, 0.f, 255.f);
+            second[c] = irr::core::clamp(((bx[c] * aa) - (ax[c] * ab)) / determinant, 0.f, 255.f);
+        }
+
+        return true;
+    }
+
+    irr::u16 packRgb565(const irr::f32* color)
+    {
+        auto quantize = [](irr::f32 value, irr::u32 maximum) {
+            return static_cast<irr::u32>((irr::core::clamp(value, 0.f, 255.f) * maximum / 255.f) + 0.5f);
+        };
+
+        return static_cast<irr::u16>((quantize(color[0], 31) << 11) | (quantize(color[1], 63) << 5) | quantize(color[2], 31));
+    }
+
+    void unpackRgb565(irr::u16 packed, irr::s32* color)
+    {
+        auto r = (packed >> 11) & 31;
+        auto g = (packed >> 5) & 63;
+        auto b = packed & 31;
+
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    //! writes a BC1 color block in the 4 color mode with endpoints near first and second, and returns its squared error
+    /** weights receive how far the color chosen for each texel lies from the first endpoint written toward the second. */
+    irr::u32 encodeColors(const BlockTexels& texels, const irr::f32* first, const irr::f32* second, irr::u8* block, irr::f32* weights)
+    {
+        static const irr::f32 PALETTE_WEIGHTS[4] = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+
+        auto color0 = packRgb565(first);
+        auto color1 = packRgb565(second);
+
+        // the 4 color mode is chosen by the first endpoint being the greater one
+        if (color0 < color1)
+        {
+            std::swap(color0, color1);
+        }
+
+        irr::s32 palette[4][3];
+
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+
+        for (irr::u32 c = 0; c < 3; ++c)
+        {
+            palette[2][c] = ((2 * palette[0][c]) + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + (2 * palette[1][c])) / 3;
+        }
+
+        // equal endpoints would switch to the 3 color mode, where only the first entry is the same
+        auto paletteSize = color0 == color1 ? 1u : 4u;
+
+        irr::u32 indices = 0;
+        irr::u32 error = 0;
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            irr::u32 best = 0;
+            auto bestDistance = std::numeric_limits<irr::u32>::max();
+
+            for (irr::u32 entry = 0; entry < paletteSize; ++entry)
+            {
+                irr::u32 distance = 0;
+
+                for (irr::u32 c = 0; c < 3; ++c)
+                {
+                    auto difference = texels[i][c] - palette[entry][c];
+
+                    distance += static_cast<irr::u32>(difference * difference);
+                }
+
+                if (distance < bestDistance)
+                {
+                    best = entry;
+                    bestDistance = distance;
+                }
+            }
+
+            indices |= best << (i * 2);
+            error += bestDistance;
+            weights[i] = PALETTE_WEIGHTS[best];
+        }
+
+        block[0] = color0 & 0xFF;
+        block[1] = color0 >> 8;
+        block[2] = color1 & 0xFF;
+        block[3] = color1 >> 8;
+
+        for (irr::u32 b = 0; b < 4; ++b)
+        {
+            block[4 + b] = (indices >> (b * 8)) & 0xFF;
+        }
+
+        return error;
+    }
+
+    void encodeBc1(const BlockTexels& texels, irr::u8* block)
+    {
+        irr::f32 first[4], second[4], weights[16];
+
+        findEndpoints(texels, 3, first, second);
+
+        auto error = encodeColors(texels, first, second, block, weights);
+
+        // fitting the endpoints to the indices just found usually brings them closer to the texels
+        irr::u8 refinedBlock[8];
+
+        if (error != 0 && fitEndpoints(texels, 3, weights, first, second) && encodeColors(texels, first, second, refinedBlock, weights) < error)
+        {
+            std::memcpy(block, refinedBlock, sizeof(refinedBlock));
+        }
+    }
+
+    //! writes the alpha half of a BC3 block, in the mode interpolating 6 values between the extremes
+    void encodeAlpha(const BlockTexels& texels, irr::u8* block)
+    {
+        irr::s32 lowest = 255;
+        irr::s32 highest = 0;
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            lowest = std::min<irr::s32>(lowest, texels[i][3]);
+            highest = std::max<irr::s32>(highest, texels[i][3]);
+        }
+
+        irr::s32 palette[8] = { highest, lowest };
+
+        for (irr::s32 i = 1; i <= 6; ++i)
+        {
+            palette[i + 1] = (((7 - i) * highest) + (i * lowest)) / 7;
+        }
+
+        irr::u64 indices = 0;
+
+        for (irr::u32 i = 0; i < 16 && highest != lowest; ++i)
+        {
+            irr::u64 best = 0;
+
+            for (irr::u32 entry = 1; entry < 8; ++entry)
+            {
+                if (std::abs(texels[i][3] - palette[entry]) < std::abs(texels[i][3] - palette[best]))
+                {
+                    best = entry;
+                }
+            }
+
+            indices |= best << (i * 3);
+        }
+
+        block[0] = static_cast<irr::u8>(highest);
+        block[1] = static_cast<irr::u8>(lowest);
+
+        for (irr::u32 b = 0; b < 6; ++b)
+        {
+            block[2 + b] = (indices >> (b * 8)) & 0xFF;
+        }
+    }
+
+    void encodeBc3(const BlockTexels& texels, irr::u8* block)
+    {
+        encodeAlpha(texels, block);
+
+        // the colors of a BC3 block are always in the 4 color mode, which encodeColors sticks to anyway
+        encodeBc1(texels, block + 8);
+    }
+
+    //! quantizes an endpoint to 7 bits a channel, with the low bit shared by all channels which lands it closest
+    void quantizeBc7Endpoint(const irr::f32* endpoint, irr::u32* quantized, irr::u32& pBit)
+    {
+        auto bestError = std::numeric_limits<irr::f32>::max();
+
+        for (irr::u32 p = 0; p < 2; ++p)
+        {
+            irr::u32 values[4];
+            irr::f32 error = 0.f;
+
+            for (irr::u32 c = 0; c < 4; ++c)
+            {
+                values[c] = static_cast<irr::u32>(irr::core::clamp(static_cast<irr::s32>(std::floor(((endpoint[c] - p) / 2.f) + 0.5f)), 0, 127));
+
+                auto difference = static_cast<irr::f32>((values[c] << 1) | p) - endpoint[c];
+
+                error += difference * difference;
+            }
+
+            if (error < bestError)
+            {
+                bestError = error;
+                pBit = p;
+                std::memcpy(quantized, values, sizeof(values));
+            }
+        }
+    }
+
+    //! writes a BC7 block in mode 6, a single RGBA line with 4 bit indices, and returns its squared error
+    /** weights receive how far the color chosen for each texel lies from the first endpoint written toward the second. */
+    irr::u32 encodeBc7Mode6(const BlockTexels& texels, const irr::f32* first, const irr::f32* second, irr::u8* block, irr::f32* weights)
+    {
+        irr::u32 endpoints[2][4];
+        irr::u32 pBits[2];
+
+        quantizeBc7Endpoint(first, endpoints[0], pBits[0]);
+        quantizeBc7Endpoint(second, endpoints[1], pBits[1]);
+
+        irr::s32 palette[16][4];
+
+        for (irr::u32 entry = 0; entry < 16; ++entry)
+        {
+            for (irr::u32 c = 0; c < 4; ++c)
+            {
+                auto value0 = static_cast<irr::s32>((endpoints[0][c] << 1) | pBits[0]);
+                auto value1 = static_cast<irr::s32>((endpoints[1][c] << 1) | pBits[1]);
+
+                palette[entry][c] = (((64 - BC7_WEIGHTS[entry]) * value0) + (BC7_WEIGHTS[entry] * value1) + 32) >> 6;
+            }
+        }
+
+        irr::u32 indices[16];
+        irr::u32 error = 0;
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            auto bestDistance = std::numeric_limits<irr::u32>::max();
+
+            for (irr::u32 entry = 0; entry < 16; ++entry)
+            {
+                irr::u32 distance = 0;
+
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    auto difference = texels[i][c] - palette[entry][c];
+
+                    distance += static_cast<irr::u32>(difference * difference);
+                }
+
+                if (distance < bestDistance)
+                {
+                    indices[i] = entry;
+                    bestDistance = distance;
+                }
+            }
+
+            error += bestDistance;
+        }
+
+        // the index of the first texel is stored without its top bit, so the endpoints are swapped to keep it in the lower half
+        if (indices[0] >= 8)
+        {
+            std::swap(endpoints[0], endpoints[1]);
+            std::swap(pBits[0], pBits[1]);
+
+            for (auto& index : indices)
+            {
+                index = 15 - index;
+            }
+        }
+
+        std::memset(block, 0, 16);
+
+        irr::u32 position = 0;
+
+        auto writeBits = [block, &position](irr::u32 value, irr::u32 count) {
+            for (irr::u32 bit = 0; bit < count; ++bit, ++position)
+            {
+                block[position / 8] |= ((value >> bit) & 1) << (position % 8);
+            }
+        };
+
+        // mode 6 is marked by six zero bits and a one
+        writeBits(1 << 6, 7);
+
+        for (irr::u32 c = 0; c < 4; ++c)
+        {
+            writeBits(endpoints[0][c], 7);
+            writeBits(endpoints[1][c], 7);
+        }
+
+        writeBits(pBits[0], 1);
+        writeBits(pBits[1], 1);
+
+        writeBits(indices[0], 3);
+
+        for (irr::u32 i = 1; i < 16; ++i)
+        {
+            writeBits(indices[i], 4);
+        }
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            weights[i] = BC7_WEIGHTS[indices[i]] / 64.f;
+        }
+
+        return error;
+    }
+
+    void encodeBc7(const BlockTexels& texels, irr::u8* block)
+    {
+        irr::f32 first[4], second[4], weights[16];
+
+        findEndpoints(texels, 4, first, second);
+
+        auto error = encodeBc7Mode6(texels, first, second, block, weights);
+
+        irr::u8 refinedBlock[16];
+
+        if (error != 0 && fitEndpoints(texels, 4, weights, first, second) && encodeBc7Mode6(texels, first, second, refinedBlock, weights) < error)
+        {
+            std::memcpy(block, refinedBlock, sizeof(refinedBlock));
+        }
+    }
+
+    //! the DDS header, followed by the extended one for BC7
+    irr::u32 getHeaderSize(BlockFormat format)
+    {
+        return format == BlockFormat::BC7 ? 148 : 128;
+    }
+
+    irr::u32 getU32(const std::vector<irr::u8>& data, std::size_t offset)
+    {
+        return data[offset] | (data[offset + 1] << 8) | (data[offset + 2] << 16) | (static_cast<irr::u32>(data[offset + 3]) << 24);
+    }
+
+    //! decodes a BC1 color block into the first three channels, in the 3 color mode where BC1 asks for it
+    void decodeColors(const irr::u8* block, bool hasFourColors, BlockTexels& texels)
+    {
+        auto color0 = static_cast<irr::u16>(block[0] | (block[1] << 8));
+        auto color1 = static_cast<irr::u16>(block[2] | (block[3] << 8));
+
+        irr::s32 palette[4][3];
+
+        unpackRgb565(color0, palette[0]);
+        unpackRgb565(color1, palette[1]);
+
+        // BC1 blocks whose first color is not the larger one hold 3 colors and transparent black, BC3 blocks never do
+        hasFourColors = hasFourColors || color0 > color1;
+
+        for (irr::u32 c = 0; c < 3; ++c)
+        {
+            palette[2][c] = hasFourColors ? ((2 * palette[0][c]) + palette[1][c]) / 3 : (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = hasFourColors ? (palette[0][c] + (2 * palette[1][c])) / 3 : 0;
+        }
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            auto index = (block[4 + (i / 4)] >> ((i % 4) * 2)) & 3;
+
+            for (irr::u32 c = 0; c < 3; ++c)
+            {
+                texels[i][c] = static_cast<irr::u8>(palette[index][c]);
+            }
+
+            texels[i][3] = hasFourColors || index != 3 ? 255 : 0;
+        }
+    }
+
+    void decodeAlpha(const irr::u8* block, BlockTexels& texels)
+    {
+        irr::s32 palette[8] = { block[0], block[1] };
+
+        if (block[0] > block[1])
+        {
+            for (irr::s32 i = 1; i <= 6; ++i)
+            {
+                palette[i + 1] = (((7 - i) * block[0]) + (i * block[1])) / 7;
+            }
+        }
+        else
+        {
+            for (irr::s32 i = 1; i <= 4; ++i)
+            {
+                palette[i + 1] = (((5 - i) * block[0]) + (i * block[1])) / 5;
+            }
+
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        irr::u64 indices = 0;
+
+        for (irr::u32 b = 0; b < 6; ++b)
+        {
+            indices |= static_cast<irr::u64>(block[2 + b]) << (b * 8);
+        }
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            texels[i][3] = static_cast<irr::u8>(palette[(indices >> (i * 3)) & 7]);
+        }
+    }
+
+    //! returns false for blocks in any other mode than 6, the only one encodeBc7 writes
+    bool decodeBc7Mode6(const irr::u8* block, BlockTexels& texels)
+    {
+        irr::u32 position = 0;
+
+        auto getBits = [block, &position](irr::u32 count) {
+            irr::u32 value = 0;
+
+            for (irr::u32 i = 0; i < count; ++i, ++position)
+            {
+                value |= ((block[position / 8] >> (position % 8)) & 1) << i;
+            }
+
+            return value;
+        };
+
+        if (getBits(7) != 64)
+        {
+            return false;
+        }
+
+        irr::u32 endpoints[2][4];
+
+        for (irr::u32 c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = getBits(7);
+            endpoints[1][c] = getBits(7);
+        }
+
+        auto pBit0 = getBits(1);
+        auto pBit1 = getBits(1);
+
+        for (irr::u32 c = 0; c < 4; ++c)
+        {
+            endpoints[0][c] = (endpoints[0][c] << 1) | pBit0;
+            endpoints[1][c] = (endpoints[1][c] << 1) | pBit1;
+        }
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            // the index of the first texel has its top bit left out
+            auto weight = BC7_WEIGHTS[getBits(i == 0 ? 3 : 4)];
+
+            for (irr::u32 c = 0; c < 4; ++c)
+            {
+                texels[i][c] = static_cast<irr::u8>((((64 - weight) * endpoints[0][c]) + (weight * endpoints[1][c]) + 32) >> 6);
+            }
+        }
+
+        return true;
+    }
+}
+
+DdsExporter::DdsExporter() :
+    format(BlockFormat::BC1),
+    filter(MipFilter::Box),
+    margin(0),
+    encodedBlockCount(0)
+{
+}
+
+void DdsExporter::setMargin(irr::u32 _margin)
+{
+    if (margin == _margin)
+    {
+        return;
+    }
+
+    margin = _margin;
+
+    markAllDirty();
+}
+
+void DdsExporter::markDirty(const irr::core::recti& rect)
+{
+    // before the first export everything is going to be encoded anyway
+    if (levels.empty() || rect.getArea() == 0)
+    {
+        return;
+    }
+
+    auto grownMargin = static_cast<irr::s32>(margin);
+
+    markTiles(0, irr::core::recti(
+        rect.UpperLeftCorner.X - grownMargin,
+        rect.UpperLeftCorner.Y - grownMargin,
+        rect.LowerRightCorner.X + grownMargin,
+        rect.LowerRightCorner.Y + grownMargin));
+}
+
+void DdsExporter::markAllDirty()
+{
+    for (auto& level : levels)
+    {
+        std::fill(level.dirtyTiles.begin(), level.dirtyTiles.end(), 1);
+    }
+}
+
+bool DdsExporter::write(ThreadPool& threadPool, irr::video::IImage* image, BlockFormat _format, MipFilter _filter, irr::io::IWriteFile* file)
+{
+    const auto size = image->getDimension();
+
+    if (levels.empty() || levels[0].size != size)
+    {
+        createLevels(size);
+    }
+
+    if (_format != format || _filter != filter)
+    {
+        format = _format;
+        filter = _filter;
+
+        markAllDirty();
+    }
+
+    auto blockBytes = getBlockBytes(format);
+
+    for (auto& level : levels)
+    {
+        level.blocks.resize(std::max(1u, (level.size.Width + 3) / 4) * std::max(1u, (level.size.Height + 3) / 4) * blockBytes);
+    }
+
+    // other formats go through getPixel
+    auto imageTexels = image->getColorFormat() == irr::video::ECF_A8R8G8B8 ? static_cast<const irr::u8*>(image->lock()) : nullptr;
+
+    encodedBlockCount = 0;
+
+    auto reach = filter == MipFilter::Kaiser ? KAISER_REACH : BOX_REACH;
+
+    for (irr::u32 levelIndex = 0; levelIndex < levels.size(); ++levelIndex)
+    {
+        auto& level = levels[levelIndex];
+
+        // a coarser texel is refiltered when any texel under its filter footprint changed
+        if (levelIndex > 0)
+        {
+            auto& previousLevel = levels[levelIndex - 1];
+
+            for (irr::u32 tileIndex = 0; tileIndex < previousLevel.dirtyTiles.size(); ++tileIndex)
+            {
+                if (previousLevel.dirtyTiles[tileIndex] == 0)
+                {
+                    continue;
+                }
+
+                auto rect = getTileRect(levelIndex - 1, tileIndex);
+
+                markTiles(levelIndex, irr::core::recti(
+                    (rect.UpperLeftCorner.X / 2) - reach,
+                    (rect.UpperLeftCorner.Y / 2) - reach,
+                    ((rect.LowerRightCorner.X + 1) / 2) + reach,
+                    ((rect.LowerRightCorner.Y + 1) / 2) + reach));
+
+                previousLevel.dirtyTiles[tileIndex] = 0;
+            }
+        }
+
+        std::vector<irr::u32> dirtyTiles;
+
+        for (irr::u32 tileIndex = 0; tileIndex < level.dirtyTiles.size(); ++tileIndex)
+        {
+            if (level.dirtyTiles[tileIndex] != 0)
+            {
+                dirtyTiles.push_back(tileIndex);
+
+                auto rect = getTileRect(levelIndex, tileIndex);
+
+                encodedBlockCount += ((rect.getWidth() + 3) / 4) * ((rect.getHeight() + 3) / 4);
+            }
+        }
+
+        // tiles of one level neither read nor write each other's texels or blocks
+        threadPool.parallelFor(dirtyTiles.size(), [&](std::size_t i) {
+            auto rect = getTileRect(levelIndex, dirtyTiles[i]);
+
+            if (levelIndex == 0)
+            {
+                copyTile(image, imageTexels, rect);
+            }
+            else
+            {
+                filterTile(levelIndex, rect);
+            }
+
+            encodeTile(levelIndex, rect);
+        });
+    }
+
+    std::fill(levels.back().dirtyTiles.begin(), levels.back().dirtyTiles.end(), 0);
+
+    if (imageTexels != nullptr)
+    {
+        image->unlock();
+    }
+
+    const irr::u32 DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000, DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+    const irr::u32 DDPF_FOURCC = 0x4;
+    const irr::u32 DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+    std::vector<irr::u8> header;
+
+    auto putU32 = [&header](irr::u32 value) {
+        for (irr::u32 b = 0; b < 4; ++b)
+        {
+            header.push_back((value >> (b * 8)) & 0xFF);
+        }
+    };
+
+    putU32(makeFourCc('D', 'D', 'S', ' '));
+    putU32(124);
+    putU32(DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+    putU32(size.Height);
+    putU32(size.Width);
+    putU32(levels[0].blocks.size());
+    putU32(0);
+    putU32(levels.size());
+
+    for (irr::u32 i = 0; i < 11; ++i)
+    {
+        putU32(0);
+    }
+
+    // pixel format
+    putU32(32);
+    putU32(DDPF_FOURCC);
+
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        putU32(makeFourCc('D', 'X', 'T', '1'));
+        break;
+    case BlockFormat::BC3:
+        putU32(makeFourCc('D', 'X', 'T', '5'));
+        break;
+    default:
+        putU32(makeFourCc('D', 'X', '1', '0'));
+        break;
+    }
+
+    for (irr::u32 i = 0; i < 5; ++i)
+    {
+        putU32(0);
+    }
+
+    putU32(DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+
+    for (irr::u32 i = 0; i < 4; ++i)
+    {
+        putU32(0);
+    }
+
+    // BC7 has no four character code, so its format is given in the extended header
+    if (format == BlockFormat::BC7)
+    {
+        putU32(DXGI_FORMAT_BC7_UNORM);
+        // a 2D texture
+        putU32(3);
+        putU32(0);
+        // array size
+        putU32(1);
+        putU32(0);
+    }
+
+    if (file->write(header.data(), header.size()) != static_cast<irr::s32>(header.size()))
+    {
+        return false;
+    }
+
+    for (const auto& level : levels)
+    {
+        if (file->write(level.blocks.data(), level.blocks.size()) != static_cast<irr::s32>(level.blocks.size()))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+irr::u32 DdsExporter::getEncodedBlockCount() const
+{
+    return encodedBlockCount;
+}
+
+irr::u32 DdsExporter::getBlockCount() const
+{
+    irr::u32 blockCount = 0;
+
+    for (const auto& level : levels)
+    {
+        blockCount += std::max(1u, (level.size.Width + 3) / 4) * std::max(1u, (level.size.Height + 3) / 4);
+    }
+
+    return blockCount;
+}
+
+void DdsExporter::createLevels(const irr::core::dimension2du& size)
+{
+    levels.clear();
+
+    auto levelSize = size;
+
+    while (true)
+    {
+        Level level;
+
+        level.size = levelSize;
+        level.tileCountX = (levelSize.Width + TILE_SIZE - 1) / TILE_SIZE;
+        level.tileCountY = (levelSize.Height + TILE_SIZE - 1) / TILE_SIZE;
+        level.texels.resize(levelSize.Width * levelSize.Height * 4);
+        level.dirtyTiles.assign(level.tileCountX * level.tileCountY, 1);
+
+        levels.push_back(std::move(level));
+
+        if (levelSize.Width == 1 && levelSize.Height == 1)
+        {
+            break;
+        }
+
+        levelSize = irr::core::dimension2du(std::max(1u, levelSize.Width / 2), std::max(1u, levelSize.Height / 2));
+    }
+}
+
+irr::core::recti DdsExporter::getTileRect(irr::u32 level, irr::u32 tileIndex) const
+{
+    const auto& size = levels[level].size;
+
+    auto x0 = (tileIndex % levels[level].tileCountX) * TILE_SIZE;
+    auto y0 = (tileIndex / levels[level].tileCountX) * TILE_SIZE;
+
+    return irr::core::recti(x0, y0, std::min(x0 + TILE_SIZE, size.Width), std::min(y0 + TILE_SIZE, size.Height));
+}
+
+void DdsExporter::markTiles(irr::u32 level, const irr::core::recti& rect)
+{
+    auto& target = levels[level];
+
+    auto clippedRect = rect;
+    clippedRect.clipAgainst(irr::core::recti(0, 0, target.size.Width, target.size.Height));
+
+    if (clippedRect.getArea() == 0)
+    {
+        return;
+    }
+
+    for (auto tileY = clippedRect.UpperLeftCorner.Y / TILE_SIZE; tileY <= (clippedRect.LowerRightCorner.Y - 1) / TILE_SIZE; ++tileY)
+    {
+        for (auto tileX = clippedRect.UpperLeftCorner.X / TILE_SIZE; tileX <= (clippedRect.LowerRightCorner.X - 1) / TILE_SIZE; ++tileX)
+        {
+            target.dirtyTiles[(tileY * target.tileCountX) + tileX] = 1;
+        }
+    }
+}
+
+void DdsExporter::copyTile(irr::video::IImage* image, const irr::u8* imageTexels, const irr::core::recti& rect)
+{
+    auto& level = levels[0];
+
+    auto pitch = image->getPitch();
+
+    for (auto y = rect.UpperLeftCorner.Y; y < rect.LowerRightCorner.Y; ++y)
+    {
+        auto row = level.texels.data() + (y * level.size.Width * 4);
+
+        for (auto x = rect.UpperLeftCorner.X; x < rect.LowerRightCorner.X; ++x)
+        {
+            auto texel = row + (x * 4);
+
+            if (imageTexels != nullptr)
+            {
+                // A8R8G8B8 is stored B, G, R, A in memory
+                auto source = imageTexels + (y * pitch) + (x * 4);
+
+                texel[0] = source[2];
+                texel[1] = source[1];
+                texel[2] = source[0];
+                texel[3] = source[3];
+            }
+            else
+            {
+                auto color = image->getPixel(x, y);
+
+                texel[0] = color.getRed();
+                texel[1] = color.getGreen();
+                texel[2] = color.getBlue();
+                texel[3] = color.getAlpha();
+            }
+        }
+    }
+}
+
+void DdsExporter::filterTile(irr::u32 level, const irr::core::recti& rect)
+{
+    const auto& source = levels[level - 1];
+    auto& target = levels[level];
+
+    auto sourceWidth = static_cast<irr::s32>(source.size.Width);
+    auto sourceHeight = static_cast<irr::s32>(source.size.Height);
+
+    // odd sized levels repeat their last row or column
+    auto getSourceTexel = [&source, sourceWidth, sourceHeight](irr::s32 x, irr::s32 y) {
+        x = irr::core::clamp(x, 0, sourceWidth - 1);
+        y = irr::core::clamp(y, 0, sourceHeight - 1);
+
+        return source.texels.data() + (((y * sourceWidth) + x) * 4);
+    };
+
+    auto getTargetTexel = [&target](irr::s32 x, irr::s32 y) {
+        return target.texels.data() + (((y * target.size.Width) + x) * 4);
+    };
+
+    if (filter == MipFilter::Box)
+    {
+        for (auto y = rect.UpperLeftCorner.Y; y < rect.LowerRightCorner.Y; ++y)
+        {
+            for (auto x = rect.UpperLeftCorner.X; x < rect.LowerRightCorner.X; ++x)
+            {
+                const irr::u8* samples[4] = {
+                    getSourceTexel(x * 2, y * 2),
+                    getSourceTexel((x * 2) + 1, y * 2),
+                    getSourceTexel(x * 2, (y * 2) + 1),
+                    getSourceTexel((x * 2) + 1, (y * 2) + 1)
+                };
+
+                auto texel = getTargetTexel(x, y);
+
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    texel[c] = static_cast<irr::u8>((samples[0][c] + samples[1][c] + samples[2][c] + samples[3][c] + 2) / 4);
+                }
+            }
+        }
+
+        return;
+    }
+
+    auto weights = getKaiserWeights();
+
+    auto width = rect.getWidth();
+    auto firstRow = (rect.UpperLeftCorner.Y * 2) - 2;
+    auto rowCount = (rect.getHeight() * 2) + 4;
+
+    // the filter is separable, so the source rows under the tile are filtered horizontally first
+    std::vector<irr::f32> rows(rowCount * width * 4);
+
+    for (irr::s32 row = 0; row < rowCount; ++row)
+    {
+        for (irr::s32 x = 0; x < width; ++x)
+        {
+            auto filtered = rows.data() + (((row * width) + x) * 4);
+
+            for (irr::u32 tap = 0; tap < KAISER_TAP_COUNT; ++tap)
+            {
+                auto sample = getSourceTexel(((rect.UpperLeftCorner.X + x) * 2) - 2 + static_cast<irr::s32>(tap), firstRow + row);
+
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    filtered[c] += weights[tap] * sample[c];
+                }
+            }
+        }
+    }
+
+    for (irr::s32 y = 0; y < rect.getHeight(); ++y)
+    {
+        for (irr::s32 x = 0; x < width; ++x)
+        {
+            irr::f32 filtered[4] = {};
+
+            for (irr::u32 tap = 0; tap < KAISER_TAP_COUNT; ++tap)
+            {
+                auto sample = rows.data() + ((((y * 2) + tap) * width + x) * 4);
+
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    filtered[c] += weights[tap] * sample[c];
+                }
+            }
+
+            auto texel = getTargetTexel(rect.UpperLeftCorner.X + x, rect.UpperLeftCorner.Y + y);
+
+            // the negative lobes of the sinc can overshoot
+            for (irr::u32 c = 0; c < 4; ++c)
+            {
+                texel[c] = static_cast<irr::u8>(irr::core::clamp(filtered[c] + 0.5f, 0.f, 255.f));
+            }
+        }
+    }
+}
+
+void DdsExporter::encodeTile(irr::u32 level, const irr::core::recti& rect)
+{
+    auto& target = levels[level];
+
+    auto blockBytes = getBlockBytes(format);
+    auto blockCountX = std::max(1u, (target.size.Width + 3) / 4);
+
+    for (auto blockY = rect.UpperLeftCorner.Y / 4; blockY < (rect.LowerRightCorner.Y + 3) / 4; ++blockY)
+    {
+        for (auto blockX = rect.UpperLeftCorner.X / 4; blockX < (rect.LowerRightCorner.X + 3) / 4; ++blockX)
+        {
+            BlockTexels texels;
+
+            // blocks reaching past the edge of a level repeat its last row or column
+            for (irr::u32 i = 0; i < 16; ++i)
+            {
+                auto x = std::min<irr::u32>((blockX * 4) + (i % 4), target.size.Width - 1);
+                auto y = std::min<irr::u32>((blockY * 4) + (i / 4), target.size.Height - 1);
+
+                std::memcpy(texels[i], target.texels.data() + (((y * target.size.Width) + x) * 4), 4);
+            }
+
+            auto block = target.blocks.data() + (((blockY * blockCountX) + blockX) * blockBytes);
+
+            switch (format)
+            {
+            case BlockFormat::BC1:
+                encodeBc1(texels, block);
+                break;
+            case BlockFormat::BC3:
+                encodeBc3(texels, block);
+                break;
+            default:
+                encodeBc7(texels, block);
+                break;
+            }
+        }
+    }
+}
+
+TestDdsExporter::TestDdsExporter() :
+    driver(nullptr),
+    fileSystem(nullptr),
+    failureCount(0)
+{
+    std::cerr << "TestDdsExporter..." << std::flush;
+
+    // the null driver keeps the test away from any window
+    auto device = irr::createDevice(irr::video::EDT_NULL);
+
+    if (device == nullptr)
+    {
+        std::cerr << std::endl
+                  << "The test could not create a null device" << std::endl;
+
+        ++failureCount;
+    }
+    else
+    {
+        driver = device->getVideoDriver();
+        fileSystem = device->getFileSystem();
+
+        irr::u32 solid[16];
+        irr::u32 gradient[16];
+
+        for (irr::u32 i = 0; i < 16; ++i)
+        {
+            solid[i] = irr::video::SColor(128, 200, 100, 50).color;
+
+            // four colors on a line through RGBA, one per column, which even the four colors of BC1 span
+            auto x = i % 4;
+
+            gradient[i] = irr::video::SColor(64 + (x * 60), 255 - (x * 60), 20 + (x * 60), 200 - (x * 40)).color;
+        }
+
+        ThreadPool threadPool;
+
+        // 565 colors are off by up to 4, and BC3's alpha, spread over 8 steps between its extremes, by up to a fourteenth of their distance
+        testBlock(threadPool, BlockFormat::BC1, solid, 4, "largest channel error of a solid BC1 block");
+        testBlock(threadPool, BlockFormat::BC1, gradient, 8, "largest channel error of a gradient BC1 block");
+        testBlock(threadPool, BlockFormat::BC3, solid, 4, "largest channel error of a solid BC3 block");
+        testBlock(threadPool, BlockFormat::BC3, gradient, 12, "largest channel error of a gradient BC3 block");
+        testBlock(threadPool, BlockFormat::BC7, solid, 1, "largest channel error of a solid BC7 block");
+        testBlock(threadPool, BlockFormat::BC7, gradient, 2, "largest channel error of a gradient BC7 block");
+
+        testHeader(threadPool, BlockFormat::BC1);
+        testHeader(threadPool, BlockFormat::BC3);
+        testHeader(threadPool, BlockFormat::BC7);
+
+        device->drop();
+    }
+
+    std::cerr << (hasPassed() ? "OK" : "FAILED") << std::endl;
+}
+
+bool TestDdsExporter::hasPassed() const
+{
+    return failureCount == 0;
+}
+
+void TestDdsExporter::testBlock(ThreadPool& threadPool, BlockFormat format, const irr::u32* colors, irr::u32 tolerance, const char* description)
+{
+    auto image = driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(4, 4));
+
+    for (irr::u32 i = 0; i < 16; ++i)
+    {
+        image->setPixel(i % 4, i / 4, irr::video::SColor(colors[i]));
+    }
+
+    auto data = exportImage(threadPool, image, format);
+
+    image->drop();
+
+    if (data.size() < getHeaderSize(format) + getBlockBytes(format))
+    {
+        assertEqual(static_cast<irr::u32>(data.size()), getHeaderSize(format) + getBlockBytes(format), "bytes written at least");
+        return;
+    }
+
+    auto block = data.data() + getHeaderSize(format);
+
+    BlockTexels texels;
+
+    switch (format)
+    {
+    case BlockFormat::BC1:
+        decodeColors(block, false, texels);
+        break;
+    case BlockFormat::BC3:
+        decodeColors(block + 8, true, texels);
+        decodeAlpha(block, texels);
+        break;
+    default:
+        if (!decodeBc7Mode6(block, texels))
+        {
+            assertEqual(block[0] & 0x7F, 64, "BC7 mode 6 bits");
+            return;
+        }
+        break;
+    }
+
+    irr::u32 largestError = 0;
+
+    for (irr::u32 i = 0; i < 16; ++i)
+    {
+        irr::video::SColor color(colors[i]);
+
+        const irr::s32 expectedTexel[4] = { static_cast<irr::s32>(color.getRed()), static_cast<irr::s32>(color.getGreen()), static_cast<irr::s32>(color.getBlue()), static_cast<irr::s32>(color.getAlpha()) };
+
+        for (irr::u32 c = 0; c < (format == BlockFormat::BC1 ? 3u : 4u); ++c)
+        {
+            largestError = std::max<irr::u32>(largestError, std::abs(expectedTexel[c] - texels[i][c]));
+        }
+    }
+
+    if (largestError > tolerance)
+    {
+        assertEqual(largestError, tolerance, description);
+    }
+}
+
+void TestDdsExporter::testHeader(ThreadPool& threadPool, BlockFormat format)
+{
+    const irr::u32 WIDTH = 37;
+    const irr::u32 HEIGHT = 13;
+
+    auto image = driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(WIDTH, HEIGHT));
+
+    std::mt19937 random(WIDTH);
+
+    for (irr::u32 y = 0; y < HEIGHT; ++y)
+    {
+        for (irr::u32 x = 0; x < WIDTH; ++x)
+        {
+            image->setPixel(x, y, irr::video::SColor(random()));
+        }
+    }
+
+    auto data = exportImage(threadPool, image, format);
+
+    image->drop();
+
+    if (data.size() < getHeaderSize(format))
+    {
+        assertEqual(static_cast<irr::u32>(data.size()), getHeaderSize(format), "header bytes written at least");
+        return;
+    }
+
+    // every level halves the one before, rounding down, until both sides are 1
+    irr::u32 levelCount = 0;
+    std::size_t blockBytes = 0;
+
+    for (irr::core::dimension2du levelSize(WIDTH, HEIGHT); ; levelSize = irr::core::dimension2du(std::max(1u, levelSize.Width / 2), std::max(1u, levelSize.Height / 2)))
+    {
+        ++levelCount;
+        blockBytes += ((levelSize.Width + 3) / 4) * ((levelSize.Height + 3) / 4) * getBlockBytes(format);
+
+        if (levelSize.Width == 1 && levelSize.Height == 1)
+        {
+            break;
+        }
+    }
+
+    const irr::u32 FOURCC_DDS = 0x20534444, FOURCC_DXT1 = 0x31545844, FOURCC_DXT5 = 0x35545844, FOURCC_DX10 = 0x30315844;
+    const irr::u32 DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+
+    assertEqual(getU32(data, 0), FOURCC_DDS, "DDS magic");
+    assertEqual(getU32(data, 4), 124, "header size");
+    assertEqual(getU32(data, 12), HEIGHT, "height");
+    assertEqual(getU32(data, 16), WIDTH, "width");
+    assertEqual(getU32(data, 20), ((WIDTH + 3) / 4) * ((HEIGHT + 3) / 4) * getBlockBytes(format), "linear size");
+    assertEqual(getU32(data, 28), levelCount, "mip count");
+    assertEqual(getU32(data, 76), 32, "pixel format size");
+    assertEqual(getU32(data, 84), format == BlockFormat::BC1 ? FOURCC_DXT1 : format == BlockFormat::BC3 ? FOURCC_DXT5 : FOURCC_DX10, "four character code");
+    assertEqual(getU32(data, 108), DDSCAPS_COMPLEX | DDSCAPS_TEXTURE | DDSCAPS_MIPMAP, "caps");
+
+    if (format == BlockFormat::BC7)
+    {
+        assertEqual(getU32(data, 128), DXGI_FORMAT_BC7_UNORM, "DXGI format");
+        assertEqual(getU32(data, 140), 1, "array size");
+    }
+
+    assertEqual(static_cast<irr::u32>(data.size()), static_cast<irr::u32>(getHeaderSize(format) + blockBytes), "file size");
+}
+
+std::vector<irr::u8> TestDdsExporter::exportImage(ThreadPool& threadPool, irr::video::IImage* image, BlockFormat format)
+{
+    auto size = image->getDimension();
+
+    // the chain of levels takes a third more than the first, and every level at least one block
+    std::vector<irr::u8> data((static_cast<std::size_t>(size.Width + 4) * (size.Height + 4) * 2) + 1024);
+
+    auto file = fileSystem->createMemoryWriteFile(data.data(), static_cast<irr::s32>(data.size()), "test.dds", false);
+
+    if (file == nullptr)
+    {
+        return std::vector<irr::u8>();
+    }
+
+    DdsExporter exporter;
+
+    auto isWritten = exporter.write(threadPool, image, format, MipFilter::Kaiser, file);
+
+    data.resize(isWritten ? static_cast<std::size_t>(file->getPos()) : 0);
+
+    file->drop();
+
+    return data;
+}
+
+void TestDdsExporter::assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description)
+{
+    if (subject != expectedResult)
+    {
+        std::cerr << std::endl
+                  << "The test expected " << description << " " << std::hex << expectedResult << " but got " << subject << std::dec << std::endl;
+
+        ++failureCount;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+
+enum class BlockFormat
+{
+    //! opaque colors in 4 bits a texel, alpha is dropped
+    BC1,
+    //! BC1 colors with interpolated alpha, 8 bits a texel
+    BC3,
+    //! RGBA in 8 bits a texel, encoded in mode 6 only
+    BC7
+};
+
+enum class MipFilter
+{
+    //! averages 2x2 texels, like the thumbnail pyramid
+    Box,
+    //! a Kaiser windowed sinc over 6x6 texels, which keeps distant levels sharper
+    Kaiser
+};
+
+//! Writes an image as a DDS file with a full, block compressed mip chain, keeping every level and block for the next export.
+/** The image is tracked in tiles. Only tiles marked dirty since the last export, and the tiles their filter footprint reaches
+    on each coarser level, are refiltered and re-encoded, so re-exporting after a few strokes costs about as much as the
+    strokes covered. Tiles are filtered and encoded on the thread pool, one level after the other. */
+class DdsExporter
+{
+public:
+    //! texels on a side of the tiles tracked on each level
+    static const irr::u32 TILE_SIZE = 64;
+
+    DdsExporter();
+
+    DdsExporter(const DdsExporter&) = delete;
+    DdsExporter& operator=(const DdsExporter&) = delete;
+
+    //! texels further than this from a dirty rectangle are changed too when it is exported, such as by edge padding
+    /** Changing the margin marks everything dirty, as the kept levels were made with the previous one. */
+    void setMargin(irr::u32 margin);
+
+    //! queues a rectangle of the image, given in texels, which has been changed since the last export
+    void markDirty(const irr::core::recti& rect);
+
+    void markAllDirty();
+
+    //! brings the kept levels up to date with the image and writes all of them
+    /** A format, filter or size other than the last export's re-encodes everything. */
+    bool write(ThreadPool& threadPool, irr::video::IImage* image, BlockFormat format, MipFilter filter, irr::io::IWriteFile* file);
+
+    //! blocks re-encoded by the last write, over all levels
+    irr::u32 getEncodedBlockCount() const;
+
+    irr::u32 getBlockCount() const;
+
+private:
+    //! a level as RGBA texels, its blocks as written, and which of its tiles are out of date
+    struct Level
+    {
+        irr::core::dimension2du size;
+
+        irr::u32 tileCountX;
+        irr::u32 tileCountY;
+
+        std::vector<irr::u8> texels;
+        std::vector<irr::u8> blocks;
+        std::vector<irr::u8> dirtyTiles;
+    };
+
+    void createLevels(const irr::core::dimension2du& size);
+
+    irr::core::recti getTileRect(irr::u32 level, irr::u32 tileIndex) const;
+
+    //! marks the tiles of a level overlapping a rectangle of it
+    void markTiles(irr::u32 level, const irr::core::recti& rect);
+
+    void copyTile(irr::video::IImage* image, const irr::u8* imageTexels, const irr::core::recti& rect);
+
+    void filterTile(irr::u32 level, const irr::core::recti& rect);
+
+    void encodeTile(irr::u32 level, const irr::core::recti& rect);
+
+    std::vector<Level> levels;
+
+    BlockFormat format;
+    MipFilter filter;
+
+    irr::u32 margin;
+
+    irr::u32 encodedBlockCount;
+};
+
+//! Encodes blocks and images in every block format, decoding what comes back and checking the DDS header written.
+class TestDdsExporter
+{
+public:
+    TestDdsExporter();
+
+    bool hasPassed() const;
+
+private:
+    //! a 4x4 image of the given A8R8G8B8 texels has to decode to within tolerance of them, alpha aside in BC1
+    void testBlock(ThreadPool& threadPool, BlockFormat format, const irr::u32* colors, irr::u32 tolerance, const char* description);
+
+    //! the header of an image whose sides are not powers of two has to give its size, its format and every level of its mip chain
+    void testHeader(ThreadPool& threadPool, BlockFormat format);
+
+    //! exports an image into memory, empty where the exporter fails
+    std::vector<irr::u8> exportImage(ThreadPool& threadPool, irr::video::IImage* image, BlockFormat format);
+
+    void assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description);
+
+    irr::video::IVideoDriver* driver;
+    irr::io::IFileSystem* fileSystem;
+
+    irr::u32 failureCount;
+};
@@ -0,0 +1,192 @@
+#include "EdgePadding.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "ThreadPool.h"
+#include "UvIslands.h"
+
+namespace {
+    //! texels on a side of the tiles padded by one task, not counting the apron
+    const irr::u32 PADDING_TILE_SIZE = 256;
+
+    //! keeps the coordinates of seeds and their squared distances within 32 bits
+    const irr::u32 MAX_PADDING_WIDTH = 1024;
+
+    //! a texel whose nearest covered texel is not known yet, placed so far away that any seed is nearer
+    const irr::u32 NO_SEED = 0x7FFF7FFF;
+
+    irr::u32 packSeed(irr::u32 x, irr::u32 y)
+    {
+        return x | (y << 16);
+    }
+
+    irr::u32 getSquaredDistance(irr::u32 seed, irr::s32 x, irr::s32 y)
+    {
+        auto dx = static_cast<irr::s32>(seed & 0xFFFF) - x;
+        auto dy = static_cast<irr::s32>(seed >> 16) - y;
+
+        return static_cast<irr::u32>((dx * dx) + (dy * dy));
+    }
+}
+
+void padUvIslands(ThreadPool& threadPool, const UvIslandMap& islands, irr::video::IImage* image, irr::u32 width)
+{
+    if (width == 0)
+    {
+        return;
+    }
+
+    const auto size = image->getDimension();
+
+    width = std::min(width, MAX_PADDING_WIDTH);
+
+    irr::u32 firstStep = 1;
+
+    while (firstStep * 2 <= width)
+    {
+        firstStep *= 2;
+    }
+
+    auto texels = static_cast<irr::u8*>(image->lock());
+    auto pitch = image->getPitch();
+    auto bytesPerTexel = image->getBytesPerPixel();
+
+    auto tileCountX = (size.Width + PADDING_TILE_SIZE - 1) / PADDING_TILE_SIZE;
+    auto tileCountY = (size.Height + PADDING_TILE_SIZE - 1) / PADDING_TILE_SIZE;
+
+    // only uncovered texels are written, and seeds are always covered texels, so tiles never read what another one writes
+    threadPool.parallelFor(tileCountX * tileCountY, [&](std::size_t tileIndex) {
+        auto tileX0 = static_cast<irr::u32>(tileIndex % tileCountX) * PADDING_TILE_SIZE;
+        auto tileY0 = static_cast<irr::u32>(tileIndex / tileCountX) * PADDING_TILE_SIZE;
+        auto tileX1 = std::min(tileX0 + PADDING_TILE_SIZE, size.Width);
+        auto tileY1 = std::min(tileY0 + PADDING_TILE_SIZE, size.Height);
+
+        // the apron holds every covered texel close enough to pad a texel of the tile
+        auto x0 = tileX0 > width ? tileX0 - width : 0;
+        auto y0 = tileY0 > width ? tileY0 - width : 0;
+        auto x1 = std::min(tileX1 + width, size.Width);
+        auto y1 = std::min(tileY1 + width, size.Height);
+
+        auto regionWidth = x1 - x0;
+        auto regionHeight = y1 - y0;
+
+        // a margin of seedless texels around the region lets every pass look at its neighbours without bounds checks
+        auto stride = regionWidth + (firstStep * 2);
+
+        std::vector<irr::u32> seeds(stride * (regionHeight + (firstStep * 2)), NO_SEED);
+
+        auto getIndex = [stride, firstStep](irr::u32 x, irr::u32 y) {
+            return ((y + firstStep) * stride) + x + firstStep;
+        };
+
+        auto coveredCount = 0u;
+        auto tileCoveredCount = 0u;
+
+        for (irr::u32 y = 0; y < regionHeight; ++y)
+        {
+            auto islandRow = islands.isFullResolution() ? islands.getRow(y0 + y) + x0 : nullptr;
+
+            for (irr::u32 x = 0; x < regionWidth; ++x)
+            {
+                if ((islandRow != nullptr ? islandRow[x] : islands.getIsland(x0 + x, y0 + y)) == 0)
+                {
+                    continue;
+                }
+
+                seeds[getIndex(x, y)] = packSeed(x, y);
+
+                ++coveredCount;
+
+                if (x0 + x >= tileX0 && x0 + x < tileX1 && y0 + y >= tileY0 && y0 + y < tileY1)
+                {
+                    ++tileCoveredCount;
+                }
+            }
+        }
+
+        // nothing to bleed from, or nothing to bleed into
+        if (coveredCount == 0 || tileCoveredCount == (tileX1 - tileX0) * (tileY1 - tileY0))
+        {
+            return;
+        }
+
+        auto nextSeeds = seeds;
+
+        // each pass lets a texel take the nearest seed among its neighbours step texels away, halving the step every time
+        for (auto step = firstStep; step > 0; step /= 2)
+        {
+            irr::s32 offsets[8];
+            irr::u32 offsetCount = 0;
+
+            for (irr::s32 dy = -1; dy <= 1; ++dy)
+            {
+                for (irr::s32 dx = -1; dx <= 1; ++dx)
+                {
+                    if (dx != 0 || dy != 0)
+                    {
+                        offsets[offsetCount++] = ((dy * static_cast<irr::s32>(stride)) + dx) * static_cast<irr::s32>(step);
+                    }
+                }
+            }
+
+            for (irr::u32 y = 0; y < regionHeight; ++y)
+            {
+                auto index = getIndex(0, y);
+
+                for (irr::u32 x = 0; x < regionWidth; ++x, ++index)
+                {
+                    auto best = seeds[index];
+
+                    // covered texels are their own nearest seed
+                    if (best == packSeed(x, y))
+                    {
+                        continue;
+                    }
+
+                    auto bestDistance = getSquaredDistance(best, x, y);
+
+                    for (auto offset : offsets)
+                    {
+                        auto seed = seeds[index + offset];
+                        auto distance = getSquaredDistance(seed, x, y);
+
+                        if (distance < bestDistance)
+                        {
+                            best = seed;
+                            bestDistance = distance;
+                        }
+                    }
+
+                    nextSeeds[index] = best;
+                }
+            }
+
+            seeds.swap(nextSeeds);
+        }
+
+        auto maxDistance = width * width;
+
+        for (auto y = tileY0; y < tileY1; ++y)
+        {
+            auto row = texels + (y * pitch);
+
+            for (auto x = tileX0; x < tileX1; ++x)
+            {
+                auto seed = seeds[getIndex(x - x0, y - y0)];
+
+                if (seed == packSeed(x - x0, y - y0) || getSquaredDistance(seed, x - x0, y - y0) > maxDistance)
+                {
+                    continue;
+                }
+
+                auto seedTexel = texels + (((seed >> 16) + y0) * pitch) + (((seed & 0xFFFF) + x0) * bytesPerTexel);
+
+                std::memcpy(row + (x * bytesPerTexel), seedTexel, bytesPerTexel);
+            }
+        }
+    });
+
+    image->unlock();
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+class UvIslandMap;
+
+//! bleeds the colors of the UV islands outward into the texels no island covers, up to a distance of width texels
+/** Every uncovered texel within the width of an island takes the color of the nearest covered texel, so sampling a mip
+    map across a seam does not pull in whatever lies outside the island. The nearest texels are found with a jump flood
+    over tiles of the image, each with an apron of the padding width, so tiles are padded in parallel and in little memory. */
+void padUvIslands(ThreadPool& threadPool, const UvIslandMap& islands, irr::video::IImage* image, irr::u32 width);
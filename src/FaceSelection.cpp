@@ -0,0 +1,273 @@
+#include "FaceSelection.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "MeshAccess.h"
+#include "ThreadPool.h"
+
+static_assert(TexelMask::TILE_SIZE == 64, "a row of a mask tile is one 64 bit word");
+
+namespace {
+    irr::f32 getEdgeFunction(const irr::core::vector2df& a, const irr::core::vector2df& b, irr::f32 x, irr::f32 y)
+    {
+        return ((b.X - a.X) * (y - a.Y)) - ((b.Y - a.Y) * (x - a.X));
+    }
+}
+
+FaceSelection::FaceSelection(irr::scene::IMesh* mesh) :
+    selectedCount(0),
+    version(0)
+{
+    irr::u32 triangleCount = 0;
+
+    for (irr::u32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+    {
+        meshBuffers.push_back(mesh->getMeshBuffer(i));
+        triangleOffsets.push_back(triangleCount);
+
+        triangleCount += mesh->getMeshBuffer(i)->getIndexCount() / 3;
+    }
+
+    triangleOffsets.push_back(triangleCount);
+
+    bits.assign((triangleCount + 63) / 64, 0);
+}
+
+bool FaceSelection::isEmpty() const
+{
+    return selectedCount == 0;
+}
+
+irr::u32 FaceSelection::getSelectedCount() const
+{
+    return selectedCount;
+}
+
+irr::u32 FaceSelection::getVersion() const
+{
+    return version;
+}
+
+bool FaceSelection::isSelected(irr::u32 triangle) const
+{
+    return triangle < triangleOffsets.back() && (bits[triangle / 64] & (1ull << (triangle % 64))) != 0;
+}
+
+void FaceSelection::setSelected(irr::u32 triangle, bool selected)
+{
+    // going over a face which already is as asked leaves the masks as they are
+    if (triangle >= triangleOffsets.back() || isSelected(triangle) == selected)
+    {
+        return;
+    }
+
+    bits[triangle / 64] ^= 1ull << (triangle % 64);
+
+    if (selected)
+    {
+        ++selectedCount;
+    }
+    else
+    {
+        --selectedCount;
+    }
+
+    ++version;
+}
+
+void FaceSelection::setMeshBufferSelected(irr::u32 meshBuffer, bool selected)
+{
+    if (meshBuffer >= meshBuffers.size())
+    {
+        return;
+    }
+
+    for (auto triangle = triangleOffsets[meshBuffer]; triangle < triangleOffsets[meshBuffer + 1]; ++triangle)
+    {
+        setSelected(triangle, selected);
+    }
+}
+
+void FaceSelection::clear()
+{
+    if (selectedCount == 0)
+    {
+        return;
+    }
+
+    std::fill(bits.begin(), bits.end(), 0);
+
+    selectedCount = 0;
+
+    ++version;
+}
+
+irr::u32 FaceSelection::getMeshBufferIndex(irr::u32 triangle) const
+{
+    return static_cast<irr::u32>(std::upper_bound(triangleOffsets.begin(), triangleOffsets.end(), triangle) - triangleOffsets.begin()) - 1;
+}
+
+irr::s32 FaceSelection::getFirstTriangle(const irr::scene::IMeshBuffer* meshBuffer) const
+{
+    auto found = std::find(meshBuffers.begin(), meshBuffers.end(), meshBuffer);
+
+    if (found == meshBuffers.end())
+    {
+        return -1;
+    }
+
+    return static_cast<irr::s32>(triangleOffsets[found - meshBuffers.begin()]);
+}
+
+TexelMask::TexelMask(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const FaceSelection& selection, const irr::core::dimension2du& _textureSize) :
+    textureSize(_textureSize),
+    tileCountX((_textureSize.Width + TILE_SIZE - 1) / TILE_SIZE),
+    version(selection.getVersion())
+{
+    auto tileCountY = (textureSize.Height + TILE_SIZE - 1) / TILE_SIZE;
+
+    rows.assign(static_cast<std::size_t>(tileCountX) * tileCountY * TILE_SIZE, 0);
+
+    // the corners of the selected triangles, in texels
+    std::vector<irr::core::vector2df> corners;
+
+    for (auto meshBuffer : meshBuffers)
+    {
+        auto firstTriangle = selection.getFirstTriangle(meshBuffer);
+
+        if (firstTriangle < 0)
+        {
+            continue;
+        }
+
+        visitMeshBuffer(meshBuffer, [&](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                if (!selection.isSelected(static_cast<irr::u32>(firstTriangle) + triangle))
+                {
+                    continue;
+                }
+
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    const auto& uv = view.getCorner(triangle, corner).TCoords;
+
+                    corners.push_back(irr::core::vector2df(uv.X * textureSize.Width, uv.Y * textureSize.Height));
+                }
+            }
+        });
+    }
+
+    // triangles are binned by the rows of tiles they reach, so every row of tiles is rasterized by one task without locking
+    std::vector<std::vector<irr::u32>> bands(tileCountY);
+
+    for (irr::u32 triangle = 0; triangle < corners.size() / 3; ++triangle)
+    {
+        auto top = std::min({ corners[triangle * 3].Y, corners[(triangle * 3) + 1].Y, corners[(triangle * 3) + 2].Y });
+        auto bottom = std::max({ corners[triangle * 3].Y, corners[(triangle * 3) + 1].Y, corners[(triangle * 3) + 2].Y });
+
+        auto firstRow = std::max(0.f, std::floor(top));
+        auto lastRow = std::min(static_cast<irr::f32>(textureSize.Height) - 1.f, std::floor(bottom));
+
+        if (firstRow > lastRow)
+        {
+            continue;
+        }
+
+        for (auto band = static_cast<irr::u32>(firstRow) / TILE_SIZE; band <= static_cast<irr::u32>(lastRow) / TILE_SIZE; ++band)
+        {
+            bands[band].push_back(triangle);
+        }
+    }
+
+    threadPool.parallelFor(tileCountY, [&](std::size_t band) {
+        auto bandTop = static_cast<irr::s32>(band * TILE_SIZE);
+        auto bandBottom = std::min<irr::s32>(bandTop + TILE_SIZE, textureSize.Height);
+
+        for (auto triangle : bands[band])
+        {
+            const auto& a = corners[triangle * 3];
+            const auto& b = corners[(triangle * 3) + 1];
+            const auto& c = corners[(triangle * 3) + 2];
+
+            auto area = getEdgeFunction(a, b, c.X, c.Y);
+
+            if (area == 0.f)
+            {
+                continue;
+            }
+
+            auto x0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(std::min({ a.X, b.X, c.X }))));
+            auto x1 = std::min<irr::s32>(textureSize.Width - 1, static_cast<irr::s32>(std::floor(std::max({ a.X, b.X, c.X }))));
+            auto y0 = std::max<irr::s32>(bandTop, static_cast<irr::s32>(std::floor(std::min({ a.Y, b.Y, c.Y }))));
+            auto y1 = std::min<irr::s32>(bandBottom - 1, static_cast<irr::s32>(std::floor(std::max({ a.Y, b.Y, c.Y }))));
+
+            auto sign = area > 0.f ? 1.f : -1.f;
+
+            for (auto y = y0; y <= y1; ++y)
+            {
+                auto tileRows = rows.data() + ((static_cast<std::size_t>(band) * tileCountX) * TILE_SIZE) + (y - bandTop);
+
+                // texel centres on an edge count as inside, so selected triangles sharing it leave no gap
+                for (auto x = x0; x <= x1; ++x)
+                {
+                    auto centreX = x + 0.5f;
+                    auto centreY = y + 0.5f;
+
+                    if (sign * getEdgeFunction(a, b, centreX, centreY) >= 0.f
+                        && sign * getEdgeFunction(b, c, centreX, centreY) >= 0.f
+                        && sign * getEdgeFunction(c, a, centreX, centreY) >= 0.f)
+                    {
+                        tileRows[(x / TILE_SIZE) * TILE_SIZE] |= 1ull << (x % TILE_SIZE);
+                    }
+                }
+            }
+        }
+    });
+}
+
+irr::u32 TexelMask::getVersion() const
+{
+    return version;
+}
+
+std::size_t TexelMask::getMemoryUsage() const
+{
+    return rows.size() * sizeof(irr::u64);
+}
+
+irr::u64 TexelMask::getRow(irr::u32 tileX, irr::u32 tileY, irr::u32 y) const
+{
+    return rows[((static_cast<std::size_t>(tileY) * tileCountX) + tileX) * TILE_SIZE + y];
+}
+
+void TexelMask::maskImage(irr::video::IImage* source, irr::video::IImage* target, const irr::core::vector2di& position) const
+{
+    const auto& size = source->getDimension();
+
+    auto sourceTexels = static_cast<const irr::u8*>(source->lock());
+    auto targetTexels = static_cast<irr::u8*>(target->lock());
+
+    for (irr::u32 y = 0; y < size.Height; ++y)
+    {
+        auto sourceRow = reinterpret_cast<const irr::u32*>(sourceTexels + (y * source->getPitch()));
+        auto targetRow = reinterpret_cast<irr::u32*>(targetTexels + (y * target->getPitch()));
+
+        auto textureY = position.Y + static_cast<irr::s32>(y);
+
+        for (irr::u32 x = 0; x < size.Width; ++x)
+        {
+            auto textureX = position.X + static_cast<irr::s32>(x);
+
+            // texels off the texture are clipped when the image is blended anyway
+            auto isInside = textureX >= 0 && textureY >= 0 && textureX < static_cast<irr::s32>(textureSize.Width) && textureY < static_cast<irr::s32>(textureSize.Height)
+                && (getRow(textureX / TILE_SIZE, textureY / TILE_SIZE, textureY % TILE_SIZE) & (1ull << (textureX % TILE_SIZE))) != 0;
+
+            targetRow[x] = isInside ? sourceRow[x] : (sourceRow[x] & 0x00FFFFFF);
+        }
+    }
+
+    target->unlock();
+    source->unlock();
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+
+//! The triangles of a mesh painting is kept to, one bit each, numbered across the mesh buffers in order.
+/** Nothing selected means painting is not restricted at all. Every change bumps the version, which is how the masks built
+    from the selection know they are out of date. */
+class FaceSelection
+{
+public:
+    explicit FaceSelection(irr::scene::IMesh* mesh);
+
+    FaceSelection(const FaceSelection&) = delete;
+    FaceSelection& operator=(const FaceSelection&) = delete;
+
+    bool isEmpty() const;
+
+    irr::u32 getSelectedCount() const;
+
+    irr::u32 getVersion() const;
+
+    bool isSelected(irr::u32 triangle) const;
+
+    void setSelected(irr::u32 triangle, bool selected);
+
+    //! selects or deselects every triangle of a mesh buffer, as whole materials are
+    void setMeshBufferSelected(irr::u32 meshBuffer, bool selected);
+
+    void clear();
+
+    irr::u32 getMeshBufferIndex(irr::u32 triangle) const;
+
+    //! the number of the first triangle of a mesh buffer of the mesh, -1 for any other mesh buffer
+    irr::s32 getFirstTriangle(const irr::scene::IMeshBuffer* meshBuffer) const;
+
+private:
+    std::vector<irr::scene::IMeshBuffer*> meshBuffers;
+
+    //! the first triangle of each mesh buffer, and the triangle count past the last
+    std::vector<irr::u32> triangleOffsets;
+
+    std::vector<irr::u64> bits;
+
+    irr::u32 selectedCount;
+    irr::u32 version;
+};
+
+//! The texels of a texture inside the selected triangles of the mesh buffers showing it, one bit each.
+/** Built once per change of the selection by rasterizing the selected triangles in UV space, like the UV islands are.
+    The bits are kept by tile, one word per row of a tile, so masking a span of a stroke tile takes a single load. */
+class TexelMask
+{
+public:
+    //! tiles line up with the tiles of the layers and of strokes
+    static const irr::u32 TILE_SIZE = 64;
+
+    TexelMask(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const FaceSelection& selection, const irr::core::dimension2du& textureSize);
+
+    TexelMask(const TexelMask&) = delete;
+    TexelMask& operator=(const TexelMask&) = delete;
+
+    //! the version of the selection the mask was built from
+    irr::u32 getVersion() const;
+
+    std::size_t getMemoryUsage() const;
+
+    //! bit x is set where texel x of a row of a tile is inside the selection
+    irr::u64 getRow(irr::u32 tileX, irr::u32 tileY, irr::u32 y) const;
+
+    //! copies an A8R8G8B8 image into another of its size, with the alpha cleared where the copy would fall outside the mask
+    /** position is where the top left corner of the image lands on the texture. */
+    void maskImage(irr::video::IImage* source, irr::video::IImage* target, const irr::core::vector2di& position) const;
+
+private:
+    irr::core::dimension2du textureSize;
+
+    irr::u32 tileCountX;
+
+    irr::u32 version;
+
+    //! TILE_SIZE words per tile, tile by tile along rows of tiles
+    std::vector<irr::u64> rows;
+};
@@ -0,0 +1,448 @@
+#include "FilterBrush.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FaceSelection.h"
+#include "LayerStack.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FILTER_BRUSH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX__)
+#define FILTER_BRUSH_AVX
+#include <immintrin.h>
+#endif
+
+static_assert(Layer::TILE_SIZE == TexelMask::TILE_SIZE, "layer tiles have to line up with mask tiles");
+
+namespace {
+    const irr::f32 INV_255 = 1.f / 255.f;
+
+    //! copies a row of a layer out, a span per tile it crosses
+    void readLayerRow(const Layer& layer, irr::u32 x, irr::u32 y, irr::u32 count, irr::u32* texels)
+    {
+        while (count > 0)
+        {
+            auto spanCount = std::min(count, Layer::TILE_SIZE - (x % Layer::TILE_SIZE));
+
+            layer.readSpan(x, y, texels, spanCount);
+
+            x += spanCount;
+            texels += spanCount;
+            count -= spanCount;
+        }
+    }
+
+    void writeLayerRow(Layer& layer, irr::u32 x, irr::u32 y, irr::u32 count, const irr::u32* texels)
+    {
+        while (count > 0)
+        {
+            auto spanCount = std::min(count, Layer::TILE_SIZE - (x % Layer::TILE_SIZE));
+
+            layer.writeSpan(x, y, texels, spanCount);
+
+            x += spanCount;
+            texels += spanCount;
+            count -= spanCount;
+        }
+    }
+
+    //! widens A8R8G8B8 texels to blue, green, red and alpha floats of 0 - 255, with the colors premultiplied by alpha
+    void premultiplyRow(const irr::u32* texels, irr::f32* colors, irr::u32 count)
+    {
+        for (irr::u32 i = 0; i < count; ++i)
+        {
+            auto texel = texels[i];
+            auto alpha = static_cast<irr::f32>(texel >> 24);
+            auto scale = alpha * INV_255;
+
+            colors[(i * 4)] = (texel & 0xFF) * scale;
+            colors[(i * 4) + 1] = ((texel >> 8) & 0xFF) * scale;
+            colors[(i * 4) + 2] = ((texel >> 16) & 0xFF) * scale;
+            colors[(i * 4) + 3] = alpha;
+        }
+    }
+
+    irr::u32 unpremultiply(const irr::f32* color)
+    {
+        auto alpha = std::min(std::max(color[3], 0.f), 255.f);
+
+        if (alpha < 0.5f)
+        {
+            return 0;
+        }
+
+        auto scale = 255.f / alpha;
+
+        auto toByte = [scale](irr::f32 value) {
+            return static_cast<irr::u32>(std::min(std::max(value * scale, 0.f), 255.f) + 0.5f);
+        };
+
+        return (static_cast<irr::u32>(alpha + 0.5f) << 24) | (toByte(color[2]) << 16) | (toByte(color[1]) << 8) | toByte(color[0]);
+    }
+
+    //! whether a texel of the layer takes the dab, which it does everywhere without a mask
+    bool isInMask(const TexelMask* mask, irr::u32 x, irr::u32 y)
+    {
+        return mask == nullptr || (mask->getRow(x / TexelMask::TILE_SIZE, y / TexelMask::TILE_SIZE, y % TexelMask::TILE_SIZE) & (1ull << (x % TexelMask::TILE_SIZE))) != 0;
+    }
+
+    //! sums[x] = the sum over k of weights[k] * colors[x + k], four floats per texel
+    void blurRow(const irr::f32* weights, irr::u32 taps, const irr::f32* colors, irr::f32* sums, irr::u32 count)
+    {
+        irr::u32 x = 0;
+
+#if defined(FILTER_BRUSH_AVX)
+        // two texels of output at a time, each tap loading the two texels next to each other it weighs
+        for (; x + 2 <= count; x += 2)
+        {
+            auto sum = _mm256_setzero_ps();
+
+            for (irr::u32 k = 0; k < taps; ++k)
+            {
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(colors + ((x + k) * 4))));
+            }
+
+            _mm256_storeu_ps(sums + (x * 4), sum);
+        }
+#endif
+
+#if defined(FILTER_BRUSH_SSE2)
+        for (; x < count; ++x)
+        {
+            auto sum = _mm_setzero_ps();
+
+            for (irr::u32 k = 0; k < taps; ++k)
+            {
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(colors + ((x + k) * 4))));
+            }
+
+            _mm_storeu_ps(sums + (x * 4), sum);
+        }
+#else
+        for (; x < count; ++x)
+        {
+            irr::f32 sum[4] = { 0.f, 0.f, 0.f, 0.f };
+
+            for (irr::u32 k = 0; k < taps; ++k)
+            {
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    sum[c] += weights[k] * colors[((x + k) * 4) + c];
+                }
+            }
+
+            std::copy(sum, sum + 4, sums + (x * 4));
+        }
+#endif
+    }
+
+    //! sums[i] = the sum over k of weights[k] * rows[(k * stride) + i], for count floats
+    void blurColumn(const irr::f32* weights, irr::u32 taps, const irr::f32* rows, std::size_t stride, irr::f32* sums, irr::u32 count)
+    {
+        std::fill(sums, sums + count, 0.f);
+
+        // a tap at a time over the whole row, which stays in cache, rather than a column at a time down the rows
+        for (irr::u32 k = 0; k < taps; ++k)
+        {
+            auto row = rows + (k * stride);
+            auto weight = weights[k];
+
+            irr::u32 i = 0;
+
+#if defined(FILTER_BRUSH_AVX)
+            auto weights8 = _mm256_set1_ps(weight);
+
+            for (; i + 8 <= count; i += 8)
+            {
+                _mm256_storeu_ps(sums + i, _mm256_add_ps(_mm256_loadu_ps(sums + i), _mm256_mul_ps(weights8, _mm256_loadu_ps(row + i))));
+            }
+#endif
+
+#if defined(FILTER_BRUSH_SSE2)
+            auto weights4 = _mm_set1_ps(weight);
+
+            for (; i + 4 <= count; i += 4)
+            {
+                _mm_storeu_ps(sums + i, _mm_add_ps(_mm_loadu_ps(sums + i), _mm_mul_ps(weights4, _mm_loadu_ps(row + i))));
+            }
+#endif
+
+            for (; i < count; ++i)
+            {
+                sums[i] += weight * row[i];
+            }
+        }
+    }
+}
+
+FilterBrush::FilterBrush() :
+    weightsRadius(0)
+{
+}
+
+const std::vector<irr::f32>& FilterBrush::getWeights(irr::u32 radius)
+{
+    if (radius == weightsRadius && !weights.empty())
+    {
+        return weights;
+    }
+
+    // the kernel ends two standard deviations out, where what is left of the curve no longer shows in 8 bits of a soft dab
+    auto sigma = std::max(0.5f, radius * 0.5f);
+
+    weights.resize((2 * radius) + 1);
+
+    irr::f32 sum = 0.f;
+
+    for (irr::u32 k = 0; k < weights.size(); ++k)
+    {
+        auto distance = static_cast<irr::f32>(k) - static_cast<irr::f32>(radius);
+
+        weights[k] = std::exp(-(distance * distance) / (2.f * sigma * sigma));
+        sum += weights[k];
+    }
+
+    for (auto& weight : weights)
+    {
+        weight /= sum;
+    }
+
+    weightsRadius = radius;
+
+    return weights;
+}
+
+irr::core::recti FilterBrush::blurDab(ThreadPool& threadPool, Layer& layer, irr::video::IImage* brush, const irr::core::vector2di& position, irr::u32 radius, bool sharpens, irr::f32 opacity, const TexelMask* mask)
+{
+    const auto& layerSize = layer.getSize();
+    const auto& brushSize = brush->getDimension();
+
+    auto dabRect = irr::core::recti(position, brushSize);
+    dabRect.clipAgainst(irr::core::recti(0, 0, layerSize.Width, layerSize.Height));
+
+    if (dabRect.getArea() == 0 || opacity <= 0.f)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    radius = irr::core::clamp<irr::u32>(radius, 1, MAX_RADIUS);
+
+    const auto& kernel = getWeights(radius);
+    auto taps = static_cast<irr::u32>(kernel.size());
+
+    auto width = static_cast<irr::u32>(dabRect.getWidth());
+    auto height = static_cast<irr::u32>(dabRect.getHeight());
+
+    // the source reaches radius texels past the dab on every side, with the texels along the edges of the layer repeated beyond them
+    auto sourceLeft = dabRect.UpperLeftCorner.X - static_cast<irr::s32>(radius);
+    auto sourceTop = dabRect.UpperLeftCorner.Y - static_cast<irr::s32>(radius);
+    auto sourceWidth = width + (2 * radius);
+    auto sourceHeight = height + (2 * radius);
+
+    auto readLeft = std::max(sourceLeft, 0);
+    auto readRight = std::min<irr::s32>(sourceLeft + sourceWidth, layerSize.Width);
+
+    sourceTexels.resize(static_cast<std::size_t>(sourceWidth) * sourceHeight);
+    sourceColors.resize(sourceTexels.size() * 4);
+    rowSums.resize(static_cast<std::size_t>(width) * sourceHeight * 4);
+    blurredColors.resize(static_cast<std::size_t>(width) * height * 4);
+
+    // every source row is read and blurred across by a task of its own
+    threadPool.parallelFor(sourceHeight, [&](std::size_t row) {
+        auto y = irr::core::clamp<irr::s32>(sourceTop + static_cast<irr::s32>(row), 0, layerSize.Height - 1);
+
+        auto texels = sourceTexels.data() + (row * sourceWidth);
+        auto readOffset = readLeft - sourceLeft;
+        auto readCount = readRight - readLeft;
+
+        readLayerRow(layer, readLeft, y, readCount, texels + readOffset);
+
+        std::fill(texels, texels + readOffset, texels[readOffset]);
+        std::fill(texels + readOffset + readCount, texels + sourceWidth, texels[readOffset + readCount - 1]);
+
+        auto colors = sourceColors.data() + (row * sourceWidth * 4);
+
+        premultiplyRow(texels, colors, sourceWidth);
+
+        blurRow(kernel.data(), taps, colors, rowSums.data() + (row * width * 4), width);
+    });
+
+    auto brushTexels = static_cast<const irr::u8*>(brush->lock());
+    auto brushPitch = brush->getPitch();
+
+    // the rows going down are blurred and written back by one task per row of tiles, which is what writing spans allows
+    auto firstBand = dabRect.UpperLeftCorner.Y / static_cast<irr::s32>(Layer::TILE_SIZE);
+    auto lastBand = (dabRect.LowerRightCorner.Y - 1) / static_cast<irr::s32>(Layer::TILE_SIZE);
+
+    threadPool.parallelFor(lastBand - firstBand + 1, [&](std::size_t band) {
+        auto bandTop = std::max<irr::s32>(dabRect.UpperLeftCorner.Y, (firstBand + static_cast<irr::s32>(band)) * Layer::TILE_SIZE);
+        auto bandBottom = std::min<irr::s32>(dabRect.LowerRightCorner.Y, (firstBand + static_cast<irr::s32>(band) + 1) * Layer::TILE_SIZE);
+
+        for (auto y = bandTop; y < bandBottom; ++y)
+        {
+            auto row = static_cast<std::size_t>(y - dabRect.UpperLeftCorner.Y);
+
+            auto blurred = blurredColors.data() + (row * width * 4);
+
+            blurColumn(kernel.data(), taps, rowSums.data() + (row * width * 4), static_cast<std::size_t>(width) * 4, blurred, width * 4);
+
+            // the source row under the dab is overwritten with the result, no other task reads it any more
+            auto texels = sourceTexels.data() + ((row + radius) * sourceWidth) + radius;
+            auto colors = sourceColors.data() + ((((row + radius) * sourceWidth) + radius) * 4);
+
+            auto brushRow = reinterpret_cast<const irr::u32*>(brushTexels + ((y - position.Y) * brushPitch)) + (dabRect.UpperLeftCorner.X - position.X);
+
+            for (irr::u32 x = 0; x < width; ++x)
+            {
+                auto layerX = dabRect.UpperLeftCorner.X + static_cast<irr::s32>(x);
+                auto coverage = (brushRow[x] >> 24) * INV_255 * opacity;
+
+                if (coverage <= 0.f || !isInMask(mask, layerX, y))
+                {
+                    continue;
+                }
+
+                auto original = colors + (x * 4);
+                auto target = blurred + (x * 4);
+
+                // unsharp masking pushes the texel as far away from its blurred surroundings as they are from it
+                if (sharpens)
+                {
+                    auto alpha = irr::core::clamp((2.f * original[3]) - target[3], 0.f, 255.f);
+
+                    for (irr::u32 c = 0; c < 3; ++c)
+                    {
+                        target[c] = irr::core::clamp((2.f * original[c]) - target[c], 0.f, alpha);
+                    }
+
+                    target[3] = alpha;
+                }
+
+                for (irr::u32 c = 0; c < 4; ++c)
+                {
+                    target[c] = original[c] + ((target[c] - original[c]) * coverage);
+                }
+
+                texels[x] = unpremultiply(target);
+            }
+
+            writeLayerRow(layer, dabRect.UpperLeftCorner.X, y, width, texels);
+        }
+    });
+
+    brush->unlock();
+
+    return dabRect;
+}
+
+irr::core::recti FilterBrush::smudgeDab(Layer& layer, irr::video::IImage* brush, const irr::core::vector2di& position, irr::u32 strand, irr::f32 strength, const TexelMask* mask)
+{
+    const auto& layerSize = layer.getSize();
+    const auto& brushSize = brush->getDimension();
+
+    auto dabRect = irr::core::recti(position, brushSize);
+    dabRect.clipAgainst(irr::core::recti(0, 0, layerSize.Width, layerSize.Height));
+
+    if (dabRect.getArea() == 0)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    if (strands.size() <= strand)
+    {
+        strands.resize(strand + 1);
+    }
+
+    auto& smudgeStrand = strands[strand];
+
+    auto brushArea = static_cast<std::size_t>(brushSize.Width) * brushSize.Height;
+
+    if (!smudgeStrand.isCarrying || smudgeStrand.held.size() != brushArea)
+    {
+        smudgeStrand.colors.assign(brushArea * 4, 0.f);
+        smudgeStrand.held.assign(brushArea, 0);
+        smudgeStrand.isCarrying = true;
+    }
+
+    auto width = static_cast<irr::u32>(dabRect.getWidth());
+
+    sourceTexels.resize(width);
+    sourceColors.resize(static_cast<std::size_t>(width) * 4);
+
+    auto brushTexels = static_cast<const irr::u8*>(brush->lock());
+    auto brushPitch = brush->getPitch();
+
+    auto hasPainted = false;
+
+    for (auto y = dabRect.UpperLeftCorner.Y; y < dabRect.LowerRightCorner.Y; ++y)
+    {
+        readLayerRow(layer, dabRect.UpperLeftCorner.X, y, width, sourceTexels.data());
+        premultiplyRow(sourceTexels.data(), sourceColors.data(), width);
+
+        auto brushY = y - position.Y;
+        auto brushRow = reinterpret_cast<const irr::u32*>(brushTexels + (brushY * brushPitch));
+
+        auto hasPaintedRow = false;
+
+        for (irr::u32 x = 0; x < width; ++x)
+        {
+            auto layerX = dabRect.UpperLeftCorner.X + static_cast<irr::s32>(x);
+            auto brushX = layerX - position.X;
+            auto brushIndex = (static_cast<std::size_t>(brushY) * brushSize.Width) + brushX;
+
+            auto under = sourceColors.data() + (x * 4);
+            auto carried = smudgeStrand.colors.data() + (brushIndex * 4);
+
+            // the first dab picks up, and so does a later one wherever it reaches texels the strand has not been over yet
+            if (!smudgeStrand.held[brushIndex])
+            {
+                std::copy(under, under + 4, carried);
+                smudgeStrand.held[brushIndex] = 1;
+                continue;
+            }
+
+            auto coverage = (brushRow[brushX] >> 24) * INV_255;
+
+            if (coverage <= 0.f || !isInMask(mask, layerX, y))
+            {
+                continue;
+            }
+
+            auto laid = coverage * strength;
+
+            irr::f32 result[4];
+
+            for (irr::u32 c = 0; c < 4; ++c)
+            {
+                result[c] = under[c] + ((carried[c] - under[c]) * laid);
+                carried[c] += (result[c] - carried[c]) * coverage;
+            }
+
+            sourceTexels[x] = unpremultiply(result);
+            hasPaintedRow = true;
+        }
+
+        if (hasPaintedRow)
+        {
+            writeLayerRow(layer, dabRect.UpperLeftCorner.X, y, width, sourceTexels.data());
+            hasPainted = true;
+        }
+    }
+
+    brush->unlock();
+
+    return hasPainted ? dabRect : irr::core::recti(0, 0, 0, 0);
+}
+
+void FilterBrush::endSmudge()
+{
+    for (auto& smudgeStrand : strands)
+    {
+        smudgeStrand.isCarrying = false;
+    }
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class Layer;
+class TexelMask;
+class ThreadPool;
+
+//! what the brush tool paints with
+enum class BrushType
+{
+    Color,
+    Blur,
+    Sharpen,
+    Smudge
+};
+
+const irr::u32 BRUSH_TYPE_COUNT = 4;
+
+//! Brushes which repaint the texels already in a layer instead of adding a color, reading and writing only around a dab.
+/** Unlike color dabs, which build up a stroke first, filter dabs go straight into the layer, each one working on what the dabs
+    before it left. The alpha of the brush image is how strongly each texel is affected. Colors are filtered premultiplied by
+    their alpha, so transparent texels do not darken their neighbours. The scratch memory is kept from one dab to the next. */
+class FilterBrush
+{
+public:
+    //! the widest blur, in texels to either side
+    static const irr::u32 MAX_RADIUS = 32;
+
+    FilterBrush();
+
+    FilterBrush(const FilterBrush&) = delete;
+    FilterBrush& operator=(const FilterBrush&) = delete;
+
+    //! blurs, or sharpens by unsharp masking, the texels under an A8R8G8B8 brush image with its top left corner at a position
+    /** The blur is a separable Gaussian reaching radius texels out, computed only for the brush's rectangle plus the radius.
+        Texels outside the mask, if there is one, are left as they are. Returns the rectangle painted into. */
+    irr::core::recti blurDab(ThreadPool& threadPool, Layer& layer, irr::video::IImage* brush, const irr::core::vector2di& position, irr::u32 radius, bool sharpens, irr::f32 opacity, const TexelMask* mask);
+
+    //! lays the colors a strand carries over the texels under the brush, and carries on with what it left there
+    /** The first dab of a strand only picks colors up. Mirrored dabs are strands of their own, so they do not drag each other's
+        colors along. strength is how much of the carried color is laid down. Returns the rectangle painted into. */
+    irr::core::recti smudgeDab(Layer& layer, irr::video::IImage* brush, const irr::core::vector2di& position, irr::u32 strand, irr::f32 strength, const TexelMask* mask);
+
+    //! lets go of the colors the strands carry, so the next smudge picks up afresh
+    void endSmudge();
+
+private:
+    struct SmudgeStrand
+    {
+        //! four premultiplied floats per texel of the brush image
+        std::vector<irr::f32> colors;
+
+        //! one byte per texel of the brush image, set once a color has been picked up there
+        std::vector<irr::u8> held;
+
+        bool isCarrying = false;
+    };
+
+    //! 2 * radius + 1 weights of a Gaussian, adding up to 1
+    const std::vector<irr::f32>& getWeights(irr::u32 radius);
+
+    std::vector<irr::f32> weights;
+    irr::u32 weightsRadius;
+
+    // scratch memory, grown as needed and reused by the next dab
+
+    //! the texels of the dab's rectangle plus the radius, A8R8G8B8 and as premultiplied floats
+    std::vector<irr::u32> sourceTexels;
+    std::vector<irr::f32> sourceColors;
+
+    //! the source rows blurred across, as wide as the dab
+    std::vector<irr::f32> rowSums;
+
+    //! the dab's rectangle blurred both ways
+    std::vector<irr::f32> blurredColors;
+
+    std::vector<SmudgeStrand> strands;
+};
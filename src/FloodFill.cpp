@@ -0,0 +1,342 @@
+#include "FloodFill.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "LayerStack.h"
+#include "ThreadPool.h"
+#include "UvIslands.h"
+
+namespace {
+    const irr::u8 MATCHED = 1;
+    const irr::u8 FILLED = 2;
+
+    //! per texel state of the fill, in tiles matching the layer's which are only allocated where something matched
+    struct FillMask
+    {
+        FillMask(const Layer& layer) :
+            width(layer.getSize().Width),
+            height(layer.getSize().Height),
+            tileCountX(layer.getTileCountX()),
+            tiles(layer.getTileCountX() * layer.getTileCountY())
+        {
+        }
+
+        //! row y of the tile column tileX, nullptr where nothing matched in the tile
+        irr::u8* getRow(irr::u32 tileX, irr::u32 y) const
+        {
+            auto& tile = tiles[((y / Layer::TILE_SIZE) * tileCountX) + tileX];
+
+            return tile != nullptr ? tile.get() + ((y % Layer::TILE_SIZE) * Layer::TILE_SIZE) : nullptr;
+        }
+
+        irr::u32 width;
+        irr::u32 height;
+        irr::u32 tileCountX;
+
+        std::vector<std::unique_ptr<irr::u8[]>> tiles;
+    };
+
+    //! the range of each channel a texel has to be in to match the seed
+    struct ColorRange
+    {
+        ColorRange(irr::u32 seedColor, irr::u32 tolerance)
+        {
+            for (irr::u32 channel = 0; channel < 4; ++channel)
+            {
+                auto value = (seedColor >> (channel * 8)) & 0xFF;
+
+                low[channel] = value > tolerance ? value - tolerance : 0;
+                high[channel] = std::min<irr::u32>(value + tolerance, 0xFF);
+            }
+        }
+
+        bool contains(irr::u32 color) const
+        {
+            for (irr::u32 channel = 0; channel < 4; ++channel)
+            {
+                auto value = (color >> (channel * 8)) & 0xFF;
+
+                if (value < low[channel] || value > high[channel])
+                {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        irr::u32 low[4];
+        irr::u32 high[4];
+    };
+
+    //! start of the run of matched texels in row y which ends at x
+    irr::u32 findRunStart(const FillMask& mask, irr::u32 x, irr::u32 y)
+    {
+        while (x > 0)
+        {
+            auto tileX = (x - 1) / Layer::TILE_SIZE;
+            auto tileStart = tileX * Layer::TILE_SIZE;
+            auto row = mask.getRow(tileX, y);
+
+            if (row == nullptr)
+            {
+                break;
+            }
+
+            while (x > tileStart && row[x - 1 - tileStart] == MATCHED)
+            {
+                --x;
+            }
+
+            if (x > tileStart)
+            {
+                break;
+            }
+        }
+
+        return x;
+    }
+
+    //! end, exclusive, of the run of matched texels in row y which starts at x
+    irr::u32 findRunEnd(const FillMask& mask, irr::u32 x, irr::u32 y)
+    {
+        while (x < mask.width)
+        {
+            auto tileX = x / Layer::TILE_SIZE;
+            auto tileStart = tileX * Layer::TILE_SIZE;
+            auto tileEnd = std::min(tileStart + Layer::TILE_SIZE, mask.width);
+            auto row = mask.getRow(tileX, y);
+
+            if (row == nullptr)
+            {
+                break;
+            }
+
+            while (x < tileEnd && row[x - tileStart] == MATCHED)
+            {
+                ++x;
+            }
+
+            if (x < tileEnd)
+            {
+                break;
+            }
+        }
+
+        return x;
+    }
+}
+
+irr::core::recti floodFill(ThreadPool& threadPool, Layer& layer, const UvIslandMap* islands, const irr::core::vector2di& seed,
+    irr::u32 tolerance, const irr::video::SColor& color, irr::f32 opacity)
+{
+    const auto& size = layer.getSize();
+
+    if (seed.X < 0 || seed.Y < 0 || seed.X >= static_cast<irr::s32>(size.Width) || seed.Y >= static_cast<irr::s32>(size.Height))
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    // texels painted in high precision are matched by what they show
+    layer.resolve();
+
+    ColorRange range(layer.getPixel(seed.X, seed.Y).color, tolerance);
+
+    auto seedIsland = islands != nullptr ? islands->getIsland(seed.X, seed.Y) : 0;
+    auto islandRows = seedIsland != 0 && islands->isFullResolution();
+
+    FillMask mask(layer);
+
+    auto tileCount = layer.getTileCountX() * layer.getTileCountY();
+
+    // every texel is matched against the seed on its own, so tiles are matched in parallel
+    threadPool.parallelFor(tileCount, [&](std::size_t tileIndex) {
+        auto tileX = static_cast<irr::u32>(tileIndex % layer.getTileCountX());
+        auto tileY = static_cast<irr::u32>(tileIndex / layer.getTileCountX());
+
+        auto x0 = tileX * Layer::TILE_SIZE;
+        auto y0 = tileY * Layer::TILE_SIZE;
+        auto width = std::min(Layer::TILE_SIZE, size.Width - x0);
+        auto height = std::min(Layer::TILE_SIZE, size.Height - y0);
+
+        auto tile = layer.getTile(tileX, tileY);
+
+        // an unallocated tile is fully transparent, so it matches as a whole or not at all
+        if (tile == nullptr && !range.contains(0))
+        {
+            return;
+        }
+
+        std::unique_ptr<irr::u8[]> maskTile;
+
+        if (tile == nullptr && seedIsland == 0)
+        {
+            maskTile.reset(new irr::u8[Layer::TILE_SIZE * Layer::TILE_SIZE]);
+            std::fill(maskTile.get(), maskTile.get() + (Layer::TILE_SIZE * Layer::TILE_SIZE), MATCHED);
+
+            mask.tiles[tileIndex] = std::move(maskTile);
+            return;
+        }
+
+        irr::u32 texels[Layer::TILE_SIZE] = {};
+
+        for (irr::u32 y = 0; y < height; ++y)
+        {
+            if (tile != nullptr)
+            {
+                readRow(layer.getColorFormat(), tile + (y * Layer::TILE_SIZE * layer.getBytesPerTexel()), texels, width);
+            }
+
+            auto islandRow = islandRows ? islands->getRow(y0 + y) + x0 : nullptr;
+
+            for (irr::u32 x = 0; x < width; ++x)
+            {
+                if (seedIsland != 0 && (islandRow != nullptr ? islandRow[x] : islands->getIsland(x0 + x, y0 + y)) != seedIsland)
+                {
+                    continue;
+                }
+
+                if (tile != nullptr && !range.contains(texels[x]))
+                {
+                    continue;
+                }
+
+                if (maskTile == nullptr)
+                {
+                    maskTile.reset(new irr::u8[Layer::TILE_SIZE * Layer::TILE_SIZE]());
+                }
+
+                maskTile[(y * Layer::TILE_SIZE) + x] = MATCHED;
+            }
+        }
+
+        mask.tiles[tileIndex] = std::move(maskTile);
+    });
+
+    // the region connected to the seed is found run by run, which only touches the mask
+    std::vector<irr::u8> filledTiles(tileCount, 0);
+    irr::core::recti filledRect(seed, seed);
+
+    std::vector<std::pair<irr::u32, irr::u32>> seeds;
+    seeds.emplace_back(seed.X, seed.Y);
+
+    while (!seeds.empty())
+    {
+        auto x = seeds.back().first;
+        auto y = seeds.back().second;
+
+        seeds.pop_back();
+
+        auto seedRow = mask.getRow(x / Layer::TILE_SIZE, y);
+
+        if (seedRow == nullptr || seedRow[x % Layer::TILE_SIZE] != MATCHED)
+        {
+            continue;
+        }
+
+        auto runStart = findRunStart(mask, x, y);
+        auto runEnd = findRunEnd(mask, x, y);
+
+        for (auto tileX = runStart / Layer::TILE_SIZE; tileX <= (runEnd - 1) / Layer::TILE_SIZE; ++tileX)
+        {
+            auto tileStart = tileX * Layer::TILE_SIZE;
+            auto from = std::max(runStart, tileStart);
+            auto to = std::min(runEnd, tileStart + Layer::TILE_SIZE);
+
+            std::fill(mask.getRow(tileX, y) + (from - tileStart), mask.getRow(tileX, y) + (to - tileStart), FILLED);
+
+            filledTiles[((y / Layer::TILE_SIZE) * mask.tileCountX) + tileX] = 1;
+        }
+
+        filledRect.addInternalPoint(runStart, y);
+        filledRect.addInternalPoint(runEnd, y + 1);
+
+        // one seed per run of matched texels in the rows above and below
+        for (auto neighbourY : { y - 1, y + 1 })
+        {
+            if (neighbourY >= mask.height)
+            {
+                continue;
+            }
+
+            auto isInRun = false;
+
+            for (auto tileX = runStart / Layer::TILE_SIZE; tileX <= (runEnd - 1) / Layer::TILE_SIZE; ++tileX)
+            {
+                auto tileStart = tileX * Layer::TILE_SIZE;
+                auto row = mask.getRow(tileX, neighbourY);
+
+                if (row == nullptr)
+                {
+                    isInRun = false;
+                    continue;
+                }
+
+                for (auto neighbourX = std::max(runStart, tileStart); neighbourX < std::min(runEnd, tileStart + Layer::TILE_SIZE); ++neighbourX)
+                {
+                    auto isMatched = row[neighbourX - tileStart] == MATCHED;
+
+                    if (isMatched && !isInRun)
+                    {
+                        seeds.emplace_back(neighbourX, neighbourY);
+                    }
+
+                    isInRun = isMatched;
+                }
+            }
+        }
+    }
+
+    std::vector<irr::u32> tilesToFill;
+
+    for (irr::u32 i = 0; i < tileCount; ++i)
+    {
+        if (filledTiles[i] != 0)
+        {
+            tilesToFill.push_back(i);
+        }
+    }
+
+    irr::u32 fillTexels[Layer::TILE_SIZE];
+    std::fill(fillTexels, fillTexels + Layer::TILE_SIZE, color.color | 0xFF000000);
+
+    // the runs of filled texels in different tiles are blended from different threads
+    threadPool.parallelFor(tilesToFill.size(), [&](std::size_t i) {
+        auto tileIndex = tilesToFill[i];
+
+        auto x0 = (tileIndex % mask.tileCountX) * Layer::TILE_SIZE;
+        auto y0 = (tileIndex / mask.tileCountX) * Layer::TILE_SIZE;
+        auto width = std::min(Layer::TILE_SIZE, size.Width - x0);
+        auto height = std::min(Layer::TILE_SIZE, size.Height - y0);
+
+        auto maskTile = mask.tiles[tileIndex].get();
+
+        for (irr::u32 y = 0; y < height; ++y)
+        {
+            auto maskRow = maskTile + (y * Layer::TILE_SIZE);
+
+            for (irr::u32 x = 0; x < width;)
+            {
+                if (maskRow[x] != FILLED)
+                {
+                    ++x;
+                    continue;
+                }
+
+                auto runStart = x;
+
+                while (x < width && maskRow[x] == FILLED)
+                {
+                    ++x;
+                }
+
+                layer.blendSpan(x0 + runStart, y0 + y, fillTexels, x - runStart, BlendMode::Normal, opacity);
+            }
+        }
+    });
+
+    return filledRect;
+}
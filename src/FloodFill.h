@@ -0,0 +1,15 @@
+#pragma once
+
+#include <irrlicht/irrlicht.h>
+
+class Layer;
+class ThreadPool;
+class UvIslandMap;
+
+//! fills the texels of a layer which are connected to a seed texel and within a tolerance of its color, without leaving its UV island
+/** The tolerance is the largest difference allowed in any channel, alpha included. Without an island map, or where the seed
+    lies on no island, the fill is only bounded by color.
+    Texels are matched against the seed tile by tile in parallel, the connected region is found with a scanline span fill over
+    those matches, and the tiles it reaches are painted in parallel again. Returns the rectangle which was filled. */
+irr::core::recti floodFill(ThreadPool& threadPool, Layer& layer, const UvIslandMap* islands, const irr::core::vector2di& seed,
+    irr::u32 tolerance, const irr::video::SColor& color, irr::f32 opacity);
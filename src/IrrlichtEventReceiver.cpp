@@ -14,6 +14,18 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
             applicationDelegate->saveTexture();
         }
 
+        // ESC cancels loading a model
+        if (event.KeyInput.Key == irr::KEY_ESCAPE && event.KeyInput.PressedDown)
+        {
+            applicationDelegate->cancelLoadingModel();
+        }
+
+        // F3 shows or hides the live resource counts
+        if (event.KeyInput.Key == irr::KEY_F3 && event.KeyInput.PressedDown)
+        {
+            applicationDelegate->toggleResourceWindow();
+        }
+
         return false;
     }
 
@@ -33,6 +45,18 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
             {
                 applicationDelegate->loadModel(dialog->getFileName());
             }
+            else if (dialogName == "saveProjectDialog")
+            {
+                applicationDelegate->saveProject(dialog->getFileName());
+            }
+            else if (dialogName == "loadProjectDialog")
+            {
+                applicationDelegate->loadProject(dialog->getFileName());
+            }
+            else if (dialogName == "loadStencilDialog")
+            {
+                applicationDelegate->loadStencil(dialog->getFileName());
+            }
 
             return false;
         }
@@ -51,6 +75,18 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
             {
                 applicationDelegate->closeLoadModelDialog();
             }
+            else if (dialogName == "saveProjectDialog")
+            {
+                applicationDelegate->closeSaveProjectDialog();
+            }
+            else if (dialogName == "loadProjectDialog")
+            {
+                applicationDelegate->closeLoadProjectDialog();
+            }
+            else if (dialogName == "loadStencilDialog")
+            {
+                applicationDelegate->closeLoadStencilDialog();
+            }
 
             return false;
         }
@@ -69,6 +105,34 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
             {
                 applicationDelegate->openLoadModelDialog();
             }
+            else if (buttonName == "saveProjectButton")
+            {
+                applicationDelegate->saveProject();
+            }
+            else if (buttonName == "openProjectButton")
+            {
+                applicationDelegate->openLoadProjectDialog();
+            }
+            else if (buttonName == "cancelLoadButton")
+            {
+                applicationDelegate->cancelLoadingModel();
+            }
+            else if (buttonName == "addLayerButton")
+            {
+                applicationDelegate->addLayer();
+            }
+            else if (buttonName == "removeLayerButton")
+            {
+                applicationDelegate->removeLayer();
+            }
+            else if (buttonName == "clearSelectionButton")
+            {
+                applicationDelegate->clearSelection();
+            }
+            else if (buttonName == "loadStencilButton")
+            {
+                applicationDelegate->openLoadStencilDialog();
+            }
 
             return false;
         }
@@ -83,7 +147,8 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
                 || sliderName == "brushFeatherSizeScroll"
                 || sliderName == "brushColorRedSlider"
                 || sliderName == "brushColorGreenSlider"
-                || sliderName == "brushColorBlueSlider")
+                || sliderName == "brushColorBlueSlider"
+                || sliderName == "brushOpacitySlider")
             {
                 applicationDelegate->updateBrushProperties();
 
@@ -100,6 +165,116 @@ bool IrrlichtEventReceiver::OnEvent(const irr::SEvent& event)
 
                 return true;
             }
+
+            if (sliderName == "fillToleranceSlider" || sliderName == "filterRadiusSlider")
+            {
+                applicationDelegate->updateToolProperties();
+
+                return true;
+            }
+
+            if (sliderName == "stencilScaleSlider" || sliderName == "stencilRotationSlider")
+            {
+                applicationDelegate->updateStencilProperties();
+
+                return true;
+            }
+
+            if (sliderName == "channelValueSlider1"
+                || sliderName == "channelValueSlider2"
+                || sliderName == "channelValueSlider3")
+            {
+                applicationDelegate->updateChannelProperties();
+
+                return true;
+            }
+
+            if (sliderName == "paddingSlider")
+            {
+                applicationDelegate->updateExportProperties();
+
+                return true;
+            }
+
+            if (sliderName == "layerOpacitySlider")
+            {
+                applicationDelegate->updateLayerProperties();
+
+                return true;
+            }
+        }
+
+        if (event.GUIEvent.EventType == irr::gui::EGET_CHECKBOX_CHANGED
+            || event.GUIEvent.EventType == irr::gui::EGET_COMBO_BOX_CHANGED)
+        {
+            std::string elementName = event.GUIEvent.Caller->getName();
+
+            if (elementName == "layerVisibleCheckBox" || elementName == "layerBlendModeComboBox")
+            {
+                applicationDelegate->updateLayerProperties();
+
+                return true;
+            }
+
+            if (elementName == "highPrecisionCheckBox")
+            {
+                applicationDelegate->updatePaintPrecision();
+
+                return true;
+            }
+
+            if (elementName == "toolComboBox"
+                || elementName == "brushTypeComboBox"
+                || elementName == "symmetryXCheckBox"
+                || elementName == "symmetryYCheckBox"
+                || elementName == "symmetryZCheckBox"
+                || elementName == "selectionModeComboBox"
+                || elementName == "deselectCheckBox")
+            {
+                applicationDelegate->updateToolProperties();
+
+                return true;
+            }
+
+            if (elementName == "channelCheckBox1"
+                || elementName == "channelCheckBox2"
+                || elementName == "channelCheckBox3")
+            {
+                applicationDelegate->updateChannelProperties();
+
+                return true;
+            }
+
+            if (elementName == "ddsFormatComboBox" || elementName == "ddsMipFilterComboBox")
+            {
+                applicationDelegate->updateExportProperties();
+
+                return true;
+            }
+        }
+
+        if (event.GUIEvent.EventType == irr::gui::EGET_LISTBOX_CHANGED)
+        {
+            std::string elementName = event.GUIEvent.Caller->getName();
+
+            if (elementName == "layerList")
+            {
+                applicationDelegate->selectLayer();
+
+                return true;
+            }
+        }
+
+        if (event.GUIEvent.EventType == irr::gui::EGET_TAB_CHANGED)
+        {
+            std::string elementName = event.GUIEvent.Caller->getName();
+
+            if (elementName == "texturePreviewTabControl")
+            {
+                applicationDelegate->updateLayersWindow();
+            }
+
+            return false;
         }
     }
 
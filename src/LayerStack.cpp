@@ -0,0 +1,977 @@
+#include "LayerStack.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "ThreadPool.h"
+
+static_assert(StrokeBuffer::TILE_SIZE == Layer::TILE_SIZE, "stroke tiles have to line up with layer tiles");
+
+Layer::Layer(const std::wstring& _name, const irr::core::dimension2du& _size, irr::video::ECOLOR_FORMAT _format) :
+    name(_name),
+    opacity(1.f),
+    visible(true),
+    blendMode(BlendMode::Normal),
+    size(_size),
+    format(_format),
+    bytesPerTexel(getBlendFormatBytesPerTexel(_format)),
+    tileCountX((_size.Width + TILE_SIZE - 1) / TILE_SIZE),
+    tileCountY((_size.Height + TILE_SIZE - 1) / TILE_SIZE),
+    highPrecision(false),
+    hasUnresolvedTiles(false)
+{
+    tiles.resize(tileCountX * tileCountY);
+    linearTiles.resize(tileCountX * tileCountY);
+    unresolvedTiles.resize(tileCountX * tileCountY, 0);
+    unsavedTiles.resize(tileCountX * tileCountY, 0);
+}
+
+const std::wstring& Layer::getName() const
+{
+    return name;
+}
+
+irr::f32 Layer::getOpacity() const
+{
+    return opacity;
+}
+
+bool Layer::isVisible() const
+{
+    return visible;
+}
+
+BlendMode Layer::getBlendMode() const
+{
+    return blendMode;
+}
+
+const irr::core::dimension2du& Layer::getSize() const
+{
+    return size;
+}
+
+irr::video::ECOLOR_FORMAT Layer::getColorFormat() const
+{
+    return format;
+}
+
+irr::u32 Layer::getBytesPerTexel() const
+{
+    return bytesPerTexel;
+}
+
+irr::u32 Layer::getTileCountX() const
+{
+    return tileCountX;
+}
+
+irr::u32 Layer::getTileCountY() const
+{
+    return tileCountY;
+}
+
+const irr::u8* Layer::getTile(irr::u32 tileX, irr::u32 tileY) const
+{
+    return tiles[(tileY * tileCountX) + tileX].get();
+}
+
+irr::u8* Layer::getOrCreateTile(irr::u32 tileX, irr::u32 tileY)
+{
+    auto& tile = tiles[(tileY * tileCountX) + tileX];
+
+    if (tile == nullptr)
+    {
+        tile.reset(new irr::u8[TILE_SIZE * TILE_SIZE * bytesPerTexel]());
+    }
+
+    // every write into a tile starts here, apart from resolving
+    unsavedTiles[(tileY * tileCountX) + tileX] = 1;
+
+    return tile.get();
+}
+
+irr::video::SColor Layer::getPixel(irr::u32 x, irr::u32 y) const
+{
+    if (x >= size.Width || y >= size.Height)
+    {
+        return irr::video::SColor(0);
+    }
+
+    auto tile = getTile(x / TILE_SIZE, y / TILE_SIZE);
+
+    if (tile == nullptr)
+    {
+        return irr::video::SColor(0);
+    }
+
+    irr::u32 color;
+
+    // the linear-light copy is ahead of a tile which has not been resolved yet
+    auto linearTile = linearTiles[((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE)].get();
+
+    if (linearTile != nullptr)
+    {
+        linearRowToSrgb(linearTile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * 4), &color, 1);
+
+        return irr::video::SColor(color);
+    }
+
+    readRow(format, tile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * bytesPerTexel), &color, 1);
+
+    return irr::video::SColor(color);
+}
+
+void Layer::setPixel(irr::u32 x, irr::u32 y, const irr::video::SColor& color)
+{
+    if (x >= size.Width || y >= size.Height)
+    {
+        return;
+    }
+
+    auto tile = getOrCreateTile(x / TILE_SIZE, y / TILE_SIZE);
+
+    writeRow(format, tile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * bytesPerTexel), &color.color, 1);
+
+    auto linearTile = linearTiles[((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE)].get();
+
+    if (linearTile != nullptr)
+    {
+        srgbRowToLinear(&color.color, linearTile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * 4), 1);
+    }
+}
+
+void Layer::fill(irr::video::IImage* image)
+{
+    auto texels = static_cast<const irr::u8*>(image->lock());
+    auto pitch = image->getPitch();
+
+    for (irr::u32 tileY = 0; tileY < tileCountY; ++tileY)
+    {
+        for (irr::u32 tileX = 0; tileX < tileCountX; ++tileX)
+        {
+            auto tile = getOrCreateTile(tileX, tileY);
+
+            linearTiles[(tileY * tileCountX) + tileX].reset();
+
+            auto x0 = tileX * TILE_SIZE;
+            auto y0 = tileY * TILE_SIZE;
+            auto width = std::min(TILE_SIZE, size.Width - x0);
+            auto height = std::min(TILE_SIZE, size.Height - y0);
+
+            for (irr::u32 y = 0; y < height; ++y)
+            {
+                std::memcpy(tile + (y * TILE_SIZE * bytesPerTexel), texels + ((y0 + y) * pitch) + (x0 * bytesPerTexel), width * bytesPerTexel);
+            }
+        }
+    }
+
+    image->unlock();
+}
+
+void Layer::blend(irr::video::IImage* image, const irr::core::vector2di& position, BlendMode blendMode, irr::f32 opacity)
+{
+    const auto& imageSize = image->getDimension();
+
+    auto x0 = std::max(0, position.X);
+    auto y0 = std::max(0, position.Y);
+    auto x1 = std::min<irr::s32>(size.Width, position.X + static_cast<irr::s32>(imageSize.Width));
+    auto y1 = std::min<irr::s32>(size.Height, position.Y + static_cast<irr::s32>(imageSize.Height));
+
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    auto texels = static_cast<const irr::u8*>(image->lock());
+    auto pitch = image->getPitch();
+
+    // one row segment per tile, so each goes through a single kernel call
+    for (auto y = y0; y < y1; ++y)
+    {
+        auto imageRow = reinterpret_cast<const irr::u32*>(texels + ((y - position.Y) * pitch));
+
+        for (auto x = x0; x < x1;)
+        {
+            auto tileEnd = std::min<irr::s32>(((x / TILE_SIZE) + 1) * TILE_SIZE, x1);
+
+            blendSpan(x, y, imageRow + (x - position.X), tileEnd - x, blendMode, opacity);
+
+            x = tileEnd;
+        }
+    }
+
+    image->unlock();
+}
+
+void Layer::readRect(const irr::core::recti& rect, LayerBackup& backup) const
+{
+    backup.rect = rect;
+
+    backup.texels.clear();
+    backup.texels.reserve(rect.getArea());
+
+    backup.linearTexels.clear();
+
+    if (highPrecision)
+    {
+        backup.linearTexels.reserve(rect.getArea() * 4);
+    }
+
+    for (auto y = rect.UpperLeftCorner.Y; y < rect.LowerRightCorner.Y; ++y)
+    {
+        for (auto x = rect.UpperLeftCorner.X; x < rect.LowerRightCorner.X; ++x)
+        {
+            auto color = getPixel(x, y).color;
+
+            backup.texels.push_back(color);
+
+            if (!highPrecision)
+            {
+                continue;
+            }
+
+            auto linearTile = linearTiles[((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE)].get();
+
+            irr::u16 linearTexel[4];
+
+            if (linearTile != nullptr)
+            {
+                std::memcpy(linearTexel, linearTile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * 4), sizeof(linearTexel));
+            }
+            else
+            {
+                srgbRowToLinear(&color, linearTexel, 1);
+            }
+
+            backup.linearTexels.insert(backup.linearTexels.end(), linearTexel, linearTexel + 4);
+        }
+    }
+}
+
+void Layer::writeRect(const LayerBackup& backup)
+{
+    const auto& rect = backup.rect;
+
+    auto texel = backup.texels.begin();
+    auto linearTexel = backup.linearTexels.begin();
+
+    auto restoresLinear = highPrecision && !backup.linearTexels.empty();
+
+    for (auto y = rect.UpperLeftCorner.Y; y < rect.LowerRightCorner.Y; ++y)
+    {
+        for (auto x = rect.UpperLeftCorner.X; x < rect.LowerRightCorner.X; ++x)
+        {
+            // writing transparency back into a tile which was never allocated would only allocate it
+            if (*texel != 0 || getTile(x / TILE_SIZE, y / TILE_SIZE) != nullptr)
+            {
+                setPixel(x, y, irr::video::SColor(*texel));
+
+                if (restoresLinear)
+                {
+                    auto linearTile = getOrCreateLinearTile(x / TILE_SIZE, y / TILE_SIZE);
+
+                    std::copy(linearTexel, linearTexel + 4, linearTile + ((((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE)) * 4));
+                }
+            }
+
+            ++texel;
+
+            if (restoresLinear)
+            {
+                linearTexel += 4;
+            }
+        }
+    }
+}
+
+void Layer::blendSpan(irr::u32 x, irr::u32 y, const irr::u32* texels, irr::u32 count, BlendMode blendMode, irr::f32 opacity)
+{
+    auto tileTexel = ((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE);
+
+    if (highPrecision)
+    {
+        auto linearTile = getOrCreateLinearTile(x / TILE_SIZE, y / TILE_SIZE);
+
+        blendRowLinear(blendMode, opacity, linearTile + (tileTexel * 4), texels, count);
+
+        unresolvedTiles[((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE)] = 1;
+        hasUnresolvedTiles = true;
+    }
+    else
+    {
+        auto tile = getOrCreateTile(x / TILE_SIZE, y / TILE_SIZE);
+
+        blendRow(blendMode, format, opacity, tile + (tileTexel * bytesPerTexel), texels, count);
+    }
+}
+
+void Layer::readSpan(irr::u32 x, irr::u32 y, irr::u32* texels, irr::u32 count) const
+{
+    auto tileIndex = ((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE);
+    auto tileTexel = ((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE);
+
+    auto tile = tiles[tileIndex].get();
+
+    if (tile == nullptr)
+    {
+        std::fill(texels, texels + count, 0);
+    }
+    else if (linearTiles[tileIndex] != nullptr)
+    {
+        linearRowToSrgb(linearTiles[tileIndex].get() + (tileTexel * 4), texels, count);
+    }
+    else
+    {
+        readRow(format, tile + (tileTexel * bytesPerTexel), texels, count);
+    }
+}
+
+void Layer::writeSpan(irr::u32 x, irr::u32 y, const irr::u32* texels, irr::u32 count)
+{
+    auto tileIndex = ((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE);
+    auto tileTexel = ((y % TILE_SIZE) * TILE_SIZE) + (x % TILE_SIZE);
+
+    // writing transparency into a tile which was never allocated would only allocate it
+    if (tiles[tileIndex] == nullptr && std::all_of(texels, texels + count, [](irr::u32 texel) { return texel == 0; }))
+    {
+        return;
+    }
+
+    auto tile = getOrCreateTile(x / TILE_SIZE, y / TILE_SIZE);
+
+    writeRow(format, tile + (tileTexel * bytesPerTexel), texels, count);
+
+    if (linearTiles[tileIndex] != nullptr)
+    {
+        srgbRowToLinear(texels, linearTiles[tileIndex].get() + (tileTexel * 4), count);
+    }
+}
+
+bool Layer::isHighPrecision() const
+{
+    return highPrecision;
+}
+
+void Layer::setHighPrecision(bool _highPrecision)
+{
+    if (highPrecision == _highPrecision)
+    {
+        return;
+    }
+
+    if (!_highPrecision)
+    {
+        resolve();
+
+        for (auto& linearTile : linearTiles)
+        {
+            linearTile.reset();
+        }
+    }
+
+    // linear-light tiles are only created once a tile is painted into
+    highPrecision = _highPrecision;
+}
+
+void Layer::resolve()
+{
+    if (!hasUnresolvedTiles)
+    {
+        return;
+    }
+
+    irr::u32 texels[TILE_SIZE];
+
+    for (std::size_t i = 0; i < unresolvedTiles.size(); ++i)
+    {
+        if (!unresolvedTiles[i])
+        {
+            continue;
+        }
+
+        auto tile = tiles[i].get();
+        auto linearTile = linearTiles[i].get();
+
+        for (irr::u32 y = 0; y < TILE_SIZE; ++y)
+        {
+            linearRowToSrgb(linearTile + (y * TILE_SIZE * 4), texels, TILE_SIZE);
+            writeRow(format, tile + (y * TILE_SIZE * bytesPerTexel), texels, TILE_SIZE);
+        }
+
+        unresolvedTiles[i] = 0;
+        unsavedTiles[i] = 1;
+    }
+
+    hasUnresolvedTiles = false;
+}
+
+std::size_t Layer::getMemoryUsage() const
+{
+    std::size_t memoryUsage = 0;
+
+    for (std::size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (tiles[i] != nullptr)
+        {
+            memoryUsage += TILE_SIZE * TILE_SIZE * bytesPerTexel;
+        }
+
+        if (linearTiles[i] != nullptr)
+        {
+            memoryUsage += TILE_SIZE * TILE_SIZE * 4 * sizeof(irr::u16);
+        }
+    }
+
+    return memoryUsage;
+}
+
+bool Layer::isTileUnsaved(irr::u32 tileX, irr::u32 tileY) const
+{
+    return unsavedTiles[(tileY * tileCountX) + tileX] != 0;
+}
+
+void Layer::markSaved()
+{
+    std::fill(unsavedTiles.begin(), unsavedTiles.end(), 0);
+}
+
+irr::u16* Layer::getOrCreateLinearTile(irr::u32 tileX, irr::u32 tileY)
+{
+    auto& linearTile = linearTiles[(tileY * tileCountX) + tileX];
+
+    if (linearTile == nullptr)
+    {
+        // the tile itself is allocated too, so the stack sees content there
+        auto tile = getOrCreateTile(tileX, tileY);
+
+        linearTile.reset(new irr::u16[TILE_SIZE * TILE_SIZE * 4]);
+
+        irr::u32 texels[TILE_SIZE];
+
+        for (irr::u32 y = 0; y < TILE_SIZE; ++y)
+        {
+            readRow(format, tile + (y * TILE_SIZE * bytesPerTexel), texels, TILE_SIZE);
+            srgbRowToLinear(texels, linearTile.get() + (y * TILE_SIZE * 4), TILE_SIZE);
+        }
+    }
+
+    return linearTile.get();
+}
+
+LayerStack::LayerStack(irr::video::IVideoDriver* driver, irr::video::IImage* base, irr::video::IImage* _composite) :
+    compositeImage(_composite),
+    compositeFormat(_composite->getColorFormat()),
+    activeLayerIndex(0),
+    highPrecision(false),
+    strokeLayerIndex(0),
+    strokeColor(0)
+{
+    compositeImage->grab();
+
+    auto background = std::make_unique<Layer>(L"Background", base->getDimension(), compositeFormat);
+
+    if (base->getColorFormat() == compositeFormat)
+    {
+        background->fill(base);
+    }
+    else
+    {
+        // converted once here, painting and compositing stay in the composite's format
+        auto convertedBase = driver->createImage(compositeFormat, base->getDimension());
+
+        base->copyTo(convertedBase);
+        background->fill(convertedBase);
+
+        convertedBase->drop();
+    }
+
+    dirtyTiles.resize(background->getTileCountX() * background->getTileCountY(), true);
+
+    layers.push_back(std::move(background));
+}
+
+LayerStack::~LayerStack()
+{
+    compositeImage->drop();
+}
+
+irr::u32 LayerStack::getLayerCount() const
+{
+    return layers.size();
+}
+
+const Layer& LayerStack::getLayer(irr::u32 index) const
+{
+    return *layers[index];
+}
+
+Layer& LayerStack::getLayer(irr::u32 index)
+{
+    return *layers[index];
+}
+
+Layer& LayerStack::getActiveLayer()
+{
+    return *layers[activeLayerIndex];
+}
+
+irr::u32 LayerStack::getActiveLayerIndex() const
+{
+    return activeLayerIndex;
+}
+
+void LayerStack::setActiveLayerIndex(irr::u32 index)
+{
+    endStroke();
+
+    activeLayerIndex = std::min<irr::u32>(index, layers.size() - 1);
+}
+
+void LayerStack::addLayer(const std::wstring& name)
+{
+    endStroke();
+
+    // an empty layer does not change the composite
+    layers.insert(layers.begin() + activeLayerIndex + 1, std::make_unique<Layer>(name, layers[0]->getSize()));
+
+    layers[activeLayerIndex + 1]->setHighPrecision(highPrecision);
+
+    ++activeLayerIndex;
+}
+
+void LayerStack::removeLayer(irr::u32 index)
+{
+    if (layers.size() < 2 || index >= layers.size())
+    {
+        return;
+    }
+
+    endStroke();
+
+    markLayerDirty(*layers[index]);
+
+    layers.erase(layers.begin() + index);
+
+    if (activeLayerIndex >= index && activeLayerIndex > 0)
+    {
+        --activeLayerIndex;
+    }
+}
+
+void LayerStack::setLayerOpacity(irr::u32 index, irr::f32 opacity)
+{
+    auto& layer = *layers[index];
+
+    if (layer.opacity == opacity)
+    {
+        return;
+    }
+
+    layer.opacity = opacity;
+
+    if (layer.visible)
+    {
+        markLayerDirty(layer);
+    }
+}
+
+void LayerStack::setLayerVisible(irr::u32 index, bool visible)
+{
+    auto& layer = *layers[index];
+
+    if (layer.visible == visible)
+    {
+        return;
+    }
+
+    layer.visible = visible;
+
+    markLayerDirty(layer);
+}
+
+void LayerStack::setLayerBlendMode(irr::u32 index, BlendMode blendMode)
+{
+    auto& layer = *layers[index];
+
+    if (layer.blendMode == blendMode)
+    {
+        return;
+    }
+
+    layer.blendMode = blendMode;
+
+    if (layer.visible)
+    {
+        markLayerDirty(layer);
+    }
+}
+
+bool LayerStack::isHighPrecision() const
+{
+    return highPrecision;
+}
+
+void LayerStack::setHighPrecision(bool _highPrecision)
+{
+    highPrecision = _highPrecision;
+
+    // both buffers hold the same texels until the next dab, so the composite does not change
+    for (auto& layer : layers)
+    {
+        layer->setHighPrecision(highPrecision);
+    }
+}
+
+std::size_t LayerStack::getMemoryUsage() const
+{
+    std::size_t memoryUsage = 0;
+
+    for (const auto& layer : layers)
+    {
+        memoryUsage += layer->getMemoryUsage();
+    }
+
+    return memoryUsage;
+}
+
+void LayerStack::beginStroke(const irr::video::SColor& color, irr::f32 opacity, BlendMode blendMode, const TexelMask* mask)
+{
+    joinStroke(std::make_shared<StrokeBuffer>(layers[0]->getSize(), opacity, blendMode, mask), color);
+}
+
+void LayerStack::joinStroke(const std::shared_ptr<StrokeBuffer>& sharedStroke, const irr::video::SColor& color)
+{
+    endStroke();
+
+    stroke = sharedStroke;
+    strokeLayerIndex = activeLayerIndex;
+    strokeColor = color.color & 0x00FFFFFF;
+}
+
+bool LayerStack::isStroking() const
+{
+    return stroke != nullptr;
+}
+
+const std::shared_ptr<StrokeBuffer>& LayerStack::getStroke() const
+{
+    return stroke;
+}
+
+irr::core::recti LayerStack::addStrokeDab(irr::video::IImage* brush, const irr::core::vector2di& position)
+{
+    if (stroke == nullptr)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    // the tiles are recomposited once per frame however many dabs of the stroke landed on them
+    auto dabRect = stroke->addDab(brush, position);
+    markDirty(dabRect);
+
+    return dabRect;
+}
+
+irr::core::recti LayerStack::addStrokeCoverage(irr::u32 tileX, irr::u32 tileY, const irr::u8* coverage)
+{
+    if (stroke == nullptr)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    auto tileRect = stroke->addCoverage(tileX, tileY, coverage);
+    markDirty(tileRect);
+
+    return tileRect;
+}
+
+void LayerStack::endStroke()
+{
+    if (stroke == nullptr)
+    {
+        return;
+    }
+
+    const auto& layer = *layers[strokeLayerIndex];
+
+    for (irr::u32 tileY = 0; tileY < layer.getTileCountY(); ++tileY)
+    {
+        for (irr::u32 tileX = 0; tileX < layer.getTileCountX(); ++tileX)
+        {
+            if (stroke->getTile(tileX, tileY) != nullptr)
+            {
+                blendStrokeTile(tileX, tileY);
+            }
+        }
+    }
+
+    releaseStroke();
+}
+
+void LayerStack::endSharedStroke(ThreadPool& threadPool, const std::vector<LayerStack*>& stacks)
+{
+    if (stacks.empty() || stacks[0]->stroke == nullptr)
+    {
+        return;
+    }
+
+    auto sharedStroke = stacks[0]->stroke;
+    const auto& layer = *stacks[0]->layers[0];
+
+    std::vector<std::pair<irr::u32, irr::u32>> strokeTiles;
+
+    for (irr::u32 tileY = 0; tileY < layer.getTileCountY(); ++tileY)
+    {
+        for (irr::u32 tileX = 0; tileX < layer.getTileCountX(); ++tileX)
+        {
+            if (sharedStroke->getTile(tileX, tileY) != nullptr)
+            {
+                strokeTiles.push_back(std::make_pair(tileX, tileY));
+            }
+        }
+    }
+
+    // every tile is blended by one task into all the stacks, whose layers are different images
+    threadPool.parallelFor(strokeTiles.size(), [&](std::size_t t) {
+        for (auto stack : stacks)
+        {
+            if (stack->stroke == sharedStroke)
+            {
+                stack->blendStrokeTile(strokeTiles[t].first, strokeTiles[t].second);
+            }
+        }
+    });
+
+    for (auto stack : stacks)
+    {
+        if (stack->stroke == sharedStroke)
+        {
+            stack->releaseStroke();
+        }
+    }
+}
+
+void LayerStack::blendStrokeTile(irr::u32 tileX, irr::u32 tileY)
+{
+    auto& layer = *layers[strokeLayerIndex];
+    const auto& size = layer.getSize();
+
+    auto x0 = tileX * Layer::TILE_SIZE;
+    auto y0 = tileY * Layer::TILE_SIZE;
+    auto width = std::min(Layer::TILE_SIZE, size.Width - x0);
+    auto height = std::min(Layer::TILE_SIZE, size.Height - y0);
+
+    irr::u32 texels[Layer::TILE_SIZE];
+
+    for (irr::u32 y = 0; y < height; ++y)
+    {
+        stroke->getTexels(tileX, tileY, y, strokeColor, texels, width);
+
+        layer.blendSpan(x0, y0 + y, texels, width, stroke->getBlendMode(), stroke->getOpacity());
+    }
+}
+
+void LayerStack::releaseStroke()
+{
+    // the composite already shows the stroke, but the layer's own rounding may differ slightly from compositing it on the fly
+    markDirty(stroke->getRect());
+
+    stroke.reset();
+}
+
+void LayerStack::markDirty(const irr::core::recti& rect)
+{
+    const auto& size = layers[0]->getSize();
+
+    auto x0 = std::max(0, rect.UpperLeftCorner.X);
+    auto y0 = std::max(0, rect.UpperLeftCorner.Y);
+    auto x1 = std::min<irr::s32>(size.Width, rect.LowerRightCorner.X);
+    auto y1 = std::min<irr::s32>(size.Height, rect.LowerRightCorner.Y);
+
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return;
+    }
+
+    auto tileCountX = layers[0]->getTileCountX();
+
+    for (irr::u32 tileY = y0 / Layer::TILE_SIZE; tileY <= (y1 - 1) / Layer::TILE_SIZE; ++tileY)
+    {
+        for (irr::u32 tileX = x0 / Layer::TILE_SIZE; tileX <= (x1 - 1) / Layer::TILE_SIZE; ++tileX)
+        {
+            dirtyTiles[(tileY * tileCountX) + tileX] = true;
+        }
+    }
+}
+
+void LayerStack::markLayerDirty(const Layer& layer)
+{
+    for (std::size_t i = 0; i < layer.tiles.size(); ++i)
+    {
+        if (layer.tiles[i] != nullptr)
+        {
+            dirtyTiles[i] = true;
+        }
+    }
+}
+
+irr::core::recti LayerStack::composite(std::vector<irr::core::recti>* tileRects)
+{
+    irr::core::recti compositedRect(0, 0, 0, 0);
+
+    // only tiles painted in high precision since the last call are converted back
+    for (auto& layer : layers)
+    {
+        layer->resolve();
+    }
+
+    auto tileCountX = layers[0]->getTileCountX();
+    auto tileCountY = layers[0]->getTileCountY();
+    const auto& size = layers[0]->getSize();
+
+    irr::u8* compositeData = nullptr;
+
+    for (irr::u32 tileY = 0; tileY < tileCountY; ++tileY)
+    {
+        for (irr::u32 tileX = 0; tileX < tileCountX; ++tileX)
+        {
+            auto isDirty = dirtyTiles[(tileY * tileCountX) + tileX];
+
+            if (!isDirty)
+            {
+                continue;
+            }
+
+            if (compositeData == nullptr)
+            {
+                compositeData = static_cast<irr::u8*>(compositeImage->lock());
+            }
+
+            compositeTile(tileX, tileY, compositeData, compositeImage->getPitch());
+
+            dirtyTiles[(tileY * tileCountX) + tileX] = false;
+
+            irr::core::recti tileRect(
+                tileX * Layer::TILE_SIZE,
+                tileY * Layer::TILE_SIZE,
+                std::min((tileX + 1) * Layer::TILE_SIZE, size.Width),
+                std::min((tileY + 1) * Layer::TILE_SIZE, size.Height));
+
+            if (tileRects != nullptr)
+            {
+                tileRects->push_back(tileRect);
+            }
+
+            if (compositedRect.getArea() == 0)
+            {
+                compositedRect = tileRect;
+            }
+            else
+            {
+                compositedRect.addInternalPoint(tileRect.UpperLeftCorner);
+                compositedRect.addInternalPoint(tileRect.LowerRightCorner);
+            }
+        }
+    }
+
+    if (compositeData != nullptr)
+    {
+        compositeImage->unlock();
+    }
+
+    return compositedRect;
+}
+
+void LayerStack::compositeTile(irr::u32 tileX, irr::u32 tileY, irr::u8* compositeData, irr::u32 compositePitch)
+{
+    const auto& size = layers[0]->getSize();
+
+    auto x0 = tileX * Layer::TILE_SIZE;
+    auto y0 = tileY * Layer::TILE_SIZE;
+    auto width = std::min(Layer::TILE_SIZE, size.Width - x0);
+    auto height = std::min(Layer::TILE_SIZE, size.Height - y0);
+
+    auto bytesPerTexel = getBlendFormatBytesPerTexel(compositeFormat);
+
+    // blending over nothing gives back the texels themselves, so an opaque background in the composite's format is just copied
+    const auto& background = *layers[0];
+    auto backgroundTile = background.getTile(tileX, tileY);
+    auto hasStroke = stroke != nullptr && stroke->getTile(tileX, tileY) != nullptr;
+    auto copiesBackground = backgroundTile != nullptr && background.visible && background.opacity >= 1.f
+        && background.blendMode != BlendMode::Erase && background.format == compositeFormat
+        && !(hasStroke && strokeLayerIndex == 0);
+
+    for (irr::u32 y = 0; y < height; ++y)
+    {
+        auto row = compositeData + ((y0 + y) * compositePitch) + (x0 * bytesPerTexel);
+
+        if (copiesBackground)
+        {
+            std::memcpy(row, backgroundTile + (y * Layer::TILE_SIZE * bytesPerTexel), width * bytesPerTexel);
+        }
+        else
+        {
+            std::memset(row, 0, width * bytesPerTexel);
+        }
+
+        for (auto i = copiesBackground ? 1u : 0u; i < layers.size(); ++i)
+        {
+            const auto& layer = *layers[i];
+
+            auto tile = layer.getTile(tileX, tileY);
+            auto tileRow = tile != nullptr ? tile + (y * Layer::TILE_SIZE * layer.bytesPerTexel) : nullptr;
+
+            if (!layer.visible || layer.opacity <= 0.f)
+            {
+                continue;
+            }
+
+            if (hasStroke && i == strokeLayerIndex)
+            {
+                compositeStrokeRow(layer, tileRow, tileX, tileY, y, row, width);
+            }
+            else if (tile != nullptr)
+            {
+                compositeRow(layer, tileRow, row, width);
+            }
+        }
+    }
+}
+
+void LayerStack::compositeRow(const Layer& layer, const irr::u8* tileRow, irr::u8* row, irr::u32 width)
+{
+    if (layer.format == irr::video::ECF_A8R8G8B8)
+    {
+        blendRow(layer.blendMode, compositeFormat, layer.opacity, row, reinterpret_cast<const irr::u32*>(tileRow), width);
+        return;
+    }
+
+    // only a background which has to be blended rather than copied gets here
+    irr::u32 texels[Layer::TILE_SIZE];
+
+    readRow(layer.format, tileRow, texels, width);
+
+    blendRow(layer.blendMode, compositeFormat, layer.opacity, row, texels, width);
+}
+
+void LayerStack::compositeStrokeRow(const Layer& layer, const irr::u8* tileRow, irr::u32 tileX, irr::u32 tileY, irr::u32 y, irr::u8* row, irr::u32 width)
+{
+    irr::u32 texels[Layer::TILE_SIZE];
+    irr::u32 strokeTexels[Layer::TILE_SIZE];
+
+    if (tileRow != nullptr)
+    {
+        readRow(layer.format, tileRow, texels, width);
+    }
+    else
+    {
+        std::fill(texels, texels + width, 0u);
+    }
+
+    stroke->getTexels(tileX, tileY, y, strokeColor, strokeTexels, width);
+
+    blendRow(stroke->getBlendMode(), irr::video::ECF_A8R8G8B8, stroke->getOpacity(), texels, strokeTexels, width);
+
+    blendRow(layer.blendMode, compositeFormat, layer.opacity, row, texels, width);
+}
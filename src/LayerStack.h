@@ -0,0 +1,256 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "BlendKernels.h"
+#include "StrokeBuffer.h"
+
+class ThreadPool;
+
+//! A rectangle of a layer copied out by readRect, at the precision the layer was painted at.
+struct LayerBackup
+{
+    irr::core::recti rect;
+
+    std::vector<irr::u32> texels;
+
+    //! four words per texel, only kept when the layer is painted in high precision
+    std::vector<irr::u16> linearTexels;
+};
+
+//! A paintable layer stored as tiles which are only allocated once something is painted into them.
+/** Tiles are kept in the layer's color format, which is any format the blend kernels can write into. Only the background
+    uses the format of the texture it came from; layers added on top need alpha and are A8R8G8B8.
+    In high precision, painted tiles also keep a 16 bit linear-light copy which dabs are blended into. The 8 bit tiles are
+    only brought up to date from it by resolve, one tile at a time, for those painted since. */
+class Layer
+{
+public:
+    static const irr::u32 TILE_SIZE = 64;
+
+    Layer(const std::wstring& name, const irr::core::dimension2du& size, irr::video::ECOLOR_FORMAT format = irr::video::ECF_A8R8G8B8);
+
+    Layer(const Layer&) = delete;
+    Layer& operator=(const Layer&) = delete;
+
+    const std::wstring& getName() const;
+
+    irr::f32 getOpacity() const;
+
+    bool isVisible() const;
+
+    BlendMode getBlendMode() const;
+
+    const irr::core::dimension2du& getSize() const;
+
+    irr::video::ECOLOR_FORMAT getColorFormat() const;
+
+    irr::u32 getBytesPerTexel() const;
+
+    irr::u32 getTileCountX() const;
+    irr::u32 getTileCountY() const;
+
+    //! returns nullptr for a tile nothing has been painted into; rows are TILE_SIZE texels apart
+    const irr::u8* getTile(irr::u32 tileX, irr::u32 tileY) const;
+
+    irr::u8* getOrCreateTile(irr::u32 tileX, irr::u32 tileY);
+
+    //! a texel outside of the layer or in an unallocated tile is fully transparent
+    irr::video::SColor getPixel(irr::u32 x, irr::u32 y) const;
+
+    void setPixel(irr::u32 x, irr::u32 y, const irr::video::SColor& color);
+
+    //! copies every texel of an image in the layer's color format into the layer, allocating all tiles
+    void fill(irr::video::IImage* image);
+
+    //! blends an A8R8G8B8 image into the layer with its top left corner at a position, clipped to the layer
+    void blend(irr::video::IImage* image, const irr::core::vector2di& position, BlendMode blendMode, irr::f32 opacity);
+
+    //! copies a rectangle of the layer out, row by row
+    void readRect(const irr::core::recti& rect, LayerBackup& backup) const;
+
+    //! puts back a rectangle copied out by readRect
+    void writeRect(const LayerBackup& backup);
+
+    bool isHighPrecision() const;
+
+    //! turning high precision off resolves the layer and frees its linear-light tiles
+    void setHighPrecision(bool highPrecision);
+
+    //! converts the linear-light tiles painted since the last call back into the layer's own tiles
+    void resolve();
+
+    //! bytes held by allocated tiles, linear-light ones included
+    std::size_t getMemoryUsage() const;
+
+    //! whether a tile has been handed out for writing, or resolved, since the last markSaved
+    bool isTileUnsaved(irr::u32 tileX, irr::u32 tileY) const;
+
+    //! forgets which tiles have been written into, once they have been saved
+    void markSaved();
+
+    //! blends A8R8G8B8 texels into a span of a row which does not leave its tile
+    /** Spans in different tiles may be blended from different threads at the same time. */
+    void blendSpan(irr::u32 x, irr::u32 y, const irr::u32* texels, irr::u32 count, BlendMode blendMode, irr::f32 opacity);
+
+    //! copies a span of a row which does not leave its tile out as A8R8G8B8, from the linear-light copy where there is one
+    void readSpan(irr::u32 x, irr::u32 y, irr::u32* texels, irr::u32 count) const;
+
+    //! replaces a span of a row which does not leave its tile, keeping the linear-light copy, if any, in step
+    /** Like blendSpan, spans in different tiles may be written from different threads at the same time. */
+    void writeSpan(irr::u32 x, irr::u32 y, const irr::u32* texels, irr::u32 count);
+
+private:
+    friend class LayerStack;
+
+    //! creates the linear-light copy of a tile from the tile itself on first use
+    irr::u16* getOrCreateLinearTile(irr::u32 tileX, irr::u32 tileY);
+
+    std::wstring name;
+    irr::f32 opacity;
+    bool visible;
+    BlendMode blendMode;
+
+    irr::core::dimension2du size;
+
+    irr::video::ECOLOR_FORMAT format;
+    irr::u32 bytesPerTexel;
+
+    irr::u32 tileCountX;
+    irr::u32 tileCountY;
+
+    std::vector<std::unique_ptr<irr::u8[]>> tiles;
+
+    bool highPrecision;
+
+    std::vector<std::unique_ptr<irr::u16[]>> linearTiles;
+    //! one byte per tile rather than a bit, so tiles can be marked from different threads
+    std::vector<irr::u8> unresolvedTiles;
+    std::atomic<bool> hasUnresolvedTiles;
+
+    //! one byte per tile rather than a bit, so tiles can be marked from different threads
+    std::vector<irr::u8> unsavedTiles;
+};
+
+//! The layers of one material, flattened into a composite image one tile at a time.
+/** The composite doubles as the cache of the flattened stack: a tile is only recomposited once painting or a change to a layer
+    covering it has marked it dirty, so toggling a small layer does not touch the rest of the image. */
+class LayerStack
+{
+public:
+    //! starts with a background layer holding the base image
+    /** The composite has to be an image of the same size in a format the blend kernels support. The background is kept in
+        the same format, so an opaque background is composited by copying its rows. */
+    LayerStack(irr::video::IVideoDriver* driver, irr::video::IImage* base, irr::video::IImage* composite);
+
+    ~LayerStack();
+
+    LayerStack(const LayerStack&) = delete;
+    LayerStack& operator=(const LayerStack&) = delete;
+
+    irr::u32 getLayerCount() const;
+
+    //! layers are ordered bottom to top
+    const Layer& getLayer(irr::u32 index) const;
+
+    //! painting into a layer has to be followed by markDirty
+    Layer& getLayer(irr::u32 index);
+
+    Layer& getActiveLayer();
+
+    irr::u32 getActiveLayerIndex() const;
+
+    void setActiveLayerIndex(irr::u32 index);
+
+    //! adds an empty layer above the active one and makes it active
+    void addLayer(const std::wstring& name);
+
+    //! removes a layer unless it is the only one left
+    void removeLayer(irr::u32 index);
+
+    void setLayerOpacity(irr::u32 index, irr::f32 opacity);
+
+    void setLayerVisible(irr::u32 index, bool visible);
+
+    void setLayerBlendMode(irr::u32 index, BlendMode blendMode);
+
+    bool isHighPrecision() const;
+
+    //! paints every layer, including ones added later, through a 16 bit linear-light buffer
+    void setHighPrecision(bool highPrecision);
+
+    std::size_t getMemoryUsage() const;
+
+    //! starts a stroke into the active layer, ending any stroke still going on
+    /** Only the texels inside the mask take the stroke; mask may be nullptr, and has to stay alive as long as the stroke. */
+    void beginStroke(const irr::video::SColor& color, irr::f32 opacity, BlendMode blendMode, const TexelMask* mask = nullptr);
+
+    //! starts a stroke into the active layer whose coverage is shared with other stacks, painted here in a color of its own
+    /** Dabs added through any of the stacks land in all of them; the others only have to mark the tiles they cover. */
+    void joinStroke(const std::shared_ptr<StrokeBuffer>& sharedStroke, const irr::video::SColor& color);
+
+    bool isStroking() const;
+
+    //! nullptr without a stroke
+    const std::shared_ptr<StrokeBuffer>& getStroke() const;
+
+    //! adds the coverage of an A8R8G8B8 brush image to the stroke and marks the tiles it covers, which it returns
+    irr::core::recti addStrokeDab(irr::video::IImage* brush, const irr::core::vector2di& position);
+
+    //! adds the coverage of a whole tile, as a ProjectionPainter leaves it, to the stroke and marks the tile, which it returns
+    irr::core::recti addStrokeCoverage(irr::u32 tileX, irr::u32 tileY, const irr::u8* coverage);
+
+    //! blends the stroke into its layer at the stroke opacity; does nothing without a stroke
+    void endStroke();
+
+    //! ends the stroke the stacks share, blending every tile of it into the layers of all of them before moving to the next
+    /** The tiles are split across the thread pool, so the coverage of a tile is read while it is still in cache. */
+    static void endSharedStroke(ThreadPool& threadPool, const std::vector<LayerStack*>& stacks);
+
+    //! marks the tiles covering a rectangle which has been painted into
+    void markDirty(const irr::core::recti& rect);
+
+    //! resolves the layers, recomposites every dirty tile and returns the rectangle they cover, an empty one if there were none
+    /** tileRects, if given, receives the rectangle of each tile recomposited as well. */
+    irr::core::recti composite(std::vector<irr::core::recti>* tileRects = nullptr);
+
+private:
+    //! marks every tile the layer has content in, which are the only ones a change to its properties can affect
+    void markLayerDirty(const Layer& layer);
+
+    void compositeTile(irr::u32 tileX, irr::u32 tileY, irr::u8* compositeData, irr::u32 compositePitch);
+
+    //! blends one row of a layer's tile into a row of the composite
+    void compositeRow(const Layer& layer, const irr::u8* tileRow, irr::u8* row, irr::u32 width);
+
+    //! blends one tile of the stroke into its layer
+    void blendStrokeTile(irr::u32 tileX, irr::u32 tileY);
+
+    //! lets go of the stroke once it has been blended, leaving the tiles it covers to be recomposited
+    void releaseStroke();
+
+    //! blends one row of the stroke layer into a row of the composite, with the stroke blended into a copy of the layer's row first
+    void compositeStrokeRow(const Layer& layer, const irr::u8* tileRow, irr::u32 tileX, irr::u32 tileY, irr::u32 y, irr::u8* row, irr::u32 width);
+
+    irr::video::IImage* compositeImage;
+    irr::video::ECOLOR_FORMAT compositeFormat;
+
+    std::vector<std::unique_ptr<Layer>> layers;
+
+    irr::u32 activeLayerIndex;
+
+    bool highPrecision;
+
+    std::shared_ptr<StrokeBuffer> stroke;
+    irr::u32 strokeLayerIndex;
+
+    //! the color the stroke is painted here in, without alpha
+    irr::u32 strokeColor;
+
+    std::vector<bool> dirtyTiles;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <irrlicht/irrlicht.h>
+
+//! The vertices and indices of a mesh buffer, read as the types the mesh buffer actually holds.
+/** Views are handed out by visitMeshBuffer, which picks the types once per mesh buffer, so loops over the vertices or triangles
+    of a buffer do not branch on them. Every vertex type starts with the members of S3DVertex, so code only reading those works
+    with any view. */
+template <typename VertexType, typename IndexType>
+class MeshBufferView
+{
+public:
+    typedef VertexType Vertex;
+
+    explicit MeshBufferView(irr::scene::IMeshBuffer* meshBuffer) :
+        vertices(static_cast<VertexType*>(meshBuffer->getVertices())),
+        indices(reinterpret_cast<const IndexType*>(meshBuffer->getIndices())),
+        vertexCount(meshBuffer->getVertexCount()),
+        indexCount(meshBuffer->getIndexCount())
+    {
+    }
+
+    irr::u32 getVertexCount() const
+    {
+        return vertexCount;
+    }
+
+    //! whole triangles only; indices past the last of them are left out
+    irr::u32 getTriangleCount() const
+    {
+        return indexCount / 3;
+    }
+
+    VertexType& getVertex(irr::u32 vertex) const
+    {
+        return vertices[vertex];
+    }
+
+    //! the vertex at one of the three corners of a triangle
+    irr::u32 getIndex(irr::u32 triangle, irr::u32 corner) const
+    {
+        return static_cast<irr::u32>(indices[(triangle * 3) + corner]);
+    }
+
+    VertexType& getCorner(irr::u32 triangle, irr::u32 corner) const
+    {
+        return vertices[indices[(triangle * 3) + corner]];
+    }
+
+private:
+    VertexType* vertices;
+    const IndexType* indices;
+
+    irr::u32 vertexCount;
+    irr::u32 indexCount;
+};
+
+//! calls visitor with the view of a mesh buffer whose index type is known, picking its vertex type; used by visitMeshBuffer
+template <typename IndexType, typename Visitor>
+auto visitMeshBufferVertices(irr::scene::IMeshBuffer* meshBuffer, Visitor&& visitor) -> decltype(visitor(MeshBufferView<irr::video::S3DVertex, IndexType>(meshBuffer)))
+{
+    switch (meshBuffer->getVertexType())
+    {
+    case irr::video::EVT_2TCOORDS:
+        return visitor(MeshBufferView<irr::video::S3DVertex2TCoords, IndexType>(meshBuffer));
+    case irr::video::EVT_TANGENTS:
+        return visitor(MeshBufferView<irr::video::S3DVertexTangents, IndexType>(meshBuffer));
+    default:
+        return visitor(MeshBufferView<irr::video::S3DVertex, IndexType>(meshBuffer));
+    }
+}
+
+//! calls visitor with a MeshBufferView of the vertex and index types of a mesh buffer, and returns what it returns
+/** visitor is usually a generic lambda, instantiated once per combination of types, whatever it returns being the same for all. */
+template <typename Visitor>
+auto visitMeshBuffer(irr::scene::IMeshBuffer* meshBuffer, Visitor&& visitor) -> decltype(visitor(MeshBufferView<irr::video::S3DVertex, irr::u16>(meshBuffer)))
+{
+    if (meshBuffer->getIndexType() == irr::video::EIT_32BIT)
+    {
+        return visitMeshBufferVertices<irr::u32>(meshBuffer, visitor);
+    }
+
+    return visitMeshBufferVertices<irr::u16>(meshBuffer, visitor);
+}
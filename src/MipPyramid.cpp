@@ -0,0 +1,216 @@
+#include "MipPyramid.h"
+
+#include <algorithm>
+
+MipPyramid::MipPyramid(irr::video::IVideoDriver* driver, irr::video::IImage* base, irr::u32 minimumSize)
+{
+    // the base level belongs to whoever created it
+    levels.push_back(ResourceHandle<irr::video::IImage>::share(base));
+
+    auto size = base->getDimension();
+
+    while (size.Width > minimumSize || size.Height > minimumSize)
+    {
+        size = irr::core::dimension2du(std::max(1u, size.Width / 2), std::max(1u, size.Height / 2));
+
+        levels.emplace_back(driver->createImage(irr::video::ECF_A8R8G8B8, size));
+
+        downsample(levels.size() - 1, irr::core::recti(0, 0, size.Width, size.Height));
+    }
+
+    changedRects.resize(levels.size());
+}
+
+irr::u32 MipPyramid::getLevelCount() const
+{
+    return levels.size();
+}
+
+irr::video::IImage* MipPyramid::getLevel(irr::u32 level) const
+{
+    return levels[level].get();
+}
+
+irr::core::recti MipPyramid::getLevelRect(const irr::core::recti& baseRect, irr::u32 level)
+{
+    // round outwards, a texel on a coarser level depends on every base texel it covers
+    auto scale = 1 << level;
+
+    return irr::core::recti(
+        baseRect.UpperLeftCorner.X / scale,
+        baseRect.UpperLeftCorner.Y / scale,
+        (baseRect.LowerRightCorner.X + scale - 1) / scale,
+        (baseRect.LowerRightCorner.Y + scale - 1) / scale);
+}
+
+void MipPyramid::markDirty(const irr::core::recti& baseRect)
+{
+    auto baseSize = levels[0]->getDimension();
+
+    auto rect = baseRect;
+    rect.clipAgainst(irr::core::recti(0, 0, baseSize.Width, baseSize.Height));
+
+    if (rect.getArea() == 0)
+    {
+        return;
+    }
+
+    addChangedRect(0, rect);
+
+    if (levels.size() == 1)
+    {
+        return;
+    }
+
+    // dabs of one stroke overlap, so they are merged into a queued rectangle as long as refiltering it has not started
+    for (auto& pendingUpdate : pendingUpdates)
+    {
+        auto isStarted = pendingUpdate.level != 1 || pendingUpdate.row != getLevelRect(pendingUpdate.baseRect, 1).UpperLeftCorner.Y;
+
+        if (!isStarted && pendingUpdate.baseRect.isRectCollided(rect))
+        {
+            pendingUpdate.baseRect.addInternalPoint(rect.UpperLeftCorner);
+            pendingUpdate.baseRect.addInternalPoint(rect.LowerRightCorner);
+            pendingUpdate.row = getLevelRect(pendingUpdate.baseRect, 1).UpperLeftCorner.Y;
+            return;
+        }
+    }
+
+    pendingUpdates.push_back(PendingUpdate { rect, 1, getLevelRect(rect, 1).UpperLeftCorner.Y });
+}
+
+void MipPyramid::update(std::chrono::steady_clock::time_point deadline)
+{
+    while (!pendingUpdates.empty())
+    {
+        step();
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            break;
+        }
+    }
+}
+
+void MipPyramid::flush()
+{
+    while (!pendingUpdates.empty())
+    {
+        step();
+    }
+}
+
+bool MipPyramid::isUpToDate() const
+{
+    return pendingUpdates.empty();
+}
+
+irr::core::recti MipPyramid::takeChangedRect(irr::u32 level)
+{
+    auto rect = changedRects[level];
+
+    changedRects[level] = irr::core::recti(0, 0, 0, 0);
+
+    return rect;
+}
+
+void MipPyramid::step()
+{
+    auto& pendingUpdate = pendingUpdates.front();
+
+    auto levelSize = levels[pendingUpdate.level]->getDimension();
+
+    auto levelRect = getLevelRect(pendingUpdate.baseRect, pendingUpdate.level);
+    levelRect.clipAgainst(irr::core::recti(0, 0, levelSize.Width, levelSize.Height));
+
+    auto rowCount = std::max<irr::s32>(1, TEXELS_PER_BAND / std::max(1, levelRect.getWidth()));
+
+    irr::core::recti band(
+        levelRect.UpperLeftCorner.X,
+        pendingUpdate.row,
+        levelRect.LowerRightCorner.X,
+        std::min(pendingUpdate.row + rowCount, levelRect.LowerRightCorner.Y));
+
+    if (band.getArea() != 0)
+    {
+        downsample(pendingUpdate.level, band);
+        addChangedRect(pendingUpdate.level, band);
+    }
+
+    pendingUpdate.row = band.LowerRightCorner.Y;
+
+    if (pendingUpdate.row < levelRect.LowerRightCorner.Y)
+    {
+        return;
+    }
+
+    // a level is only refiltered once the one below it is done
+    ++pendingUpdate.level;
+
+    if (pendingUpdate.level == levels.size())
+    {
+        pendingUpdates.pop_front();
+        return;
+    }
+
+    pendingUpdate.row = getLevelRect(pendingUpdate.baseRect, pendingUpdate.level).UpperLeftCorner.Y;
+}
+
+void MipPyramid::addChangedRect(irr::u32 level, const irr::core::recti& rect)
+{
+    if (changedRects[level].getArea() == 0)
+    {
+        changedRects[level] = rect;
+    }
+    else
+    {
+        changedRects[level].addInternalPoint(rect.UpperLeftCorner);
+        changedRects[level].addInternalPoint(rect.LowerRightCorner);
+    }
+}
+
+void MipPyramid::downsample(irr::u32 level, const irr::core::recti& rect)
+{
+    auto source = levels[level - 1].get();
+    auto target = levels[level].get();
+
+    auto sourceSize = source->getDimension();
+    auto targetSize = target->getDimension();
+
+    auto x0 = std::max(0, rect.UpperLeftCorner.X);
+    auto y0 = std::max(0, rect.UpperLeftCorner.Y);
+    auto x1 = std::min<irr::s32>(targetSize.Width, rect.LowerRightCorner.X);
+    auto y1 = std::min<irr::s32>(targetSize.Height, rect.LowerRightCorner.Y);
+
+    for (auto y = y0; y < y1; ++y)
+    {
+        // odd sized levels repeat their last row or column
+        auto sourceY0 = std::min<irr::u32>(y * 2, sourceSize.Height - 1);
+        auto sourceY1 = std::min<irr::u32>(y * 2 + 1, sourceSize.Height - 1);
+
+        for (auto x = x0; x < x1; ++x)
+        {
+            auto sourceX0 = std::min<irr::u32>(x * 2, sourceSize.Width - 1);
+            auto sourceX1 = std::min<irr::u32>(x * 2 + 1, sourceSize.Width - 1);
+
+            irr::video::SColor samples[4] = {
+                source->getPixel(sourceX0, sourceY0),
+                source->getPixel(sourceX1, sourceY0),
+                source->getPixel(sourceX0, sourceY1),
+                source->getPixel(sourceX1, sourceY1)
+            };
+
+            irr::u32 a = 0, r = 0, g = 0, b = 0;
+
+            for (const auto& sample : samples)
+            {
+                a += sample.getAlpha();
+                r += sample.getRed();
+                g += sample.getGreen();
+                b += sample.getBlue();
+            }
+
+            target->setPixel(x, y, irr::video::SColor((a + 2) / 4, (r + 2) / 4, (g + 2) / 4, (b + 2) / 4));
+        }
+    }
+}
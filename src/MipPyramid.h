@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "ResourceHandle.h"
+
+//! CPU mip chain of an image which is kept in sync with it one dirty rectangle at a time.
+/** Level 0 is the image itself; every other level is an A8R8G8B8 2x2 box-filtered copy of the previous one.
+    Changed rectangles are queued and refiltered a band of rows at a time, so the work can be spread over several frames. */
+class MipPyramid
+{
+public:
+    //! builds levels until both dimensions of the last one are at most minimumSize
+    MipPyramid(irr::video::IVideoDriver* driver, irr::video::IImage* base, irr::u32 minimumSize = 1);
+
+    MipPyramid(const MipPyramid&) = delete;
+    MipPyramid& operator=(const MipPyramid&) = delete;
+
+    irr::u32 getLevelCount() const;
+
+    irr::video::IImage* getLevel(irr::u32 level) const;
+
+    //! queues a rectangle of the base level, given in texels, which has been changed
+    void markDirty(const irr::core::recti& baseRect);
+
+    //! refilters queued rectangles until the deadline has passed
+    /** At least one band of rows is refiltered per call, so the pyramid always makes progress. */
+    void update(std::chrono::steady_clock::time_point deadline);
+
+    //! refilters everything which is queued
+    void flush();
+
+    bool isUpToDate() const;
+
+    //! returns the rectangle of a level changed since the last call for that level, an empty one if nothing changed
+    irr::core::recti takeChangedRect(irr::u32 level);
+
+    //! returns the rectangle on a level which is affected by a rectangle on the base level
+    static irr::core::recti getLevelRect(const irr::core::recti& baseRect, irr::u32 level);
+
+private:
+    //! a queued rectangle and how far refiltering it has got
+    struct PendingUpdate
+    {
+        irr::core::recti baseRect;
+        irr::u32 level;
+        irr::s32 row;
+    };
+
+    //! roughly how many texels are refiltered between two deadline checks
+    static const irr::u32 TEXELS_PER_BAND = 16384;
+
+    //! refilters the next band of rows of the first queued rectangle
+    void step();
+
+    void addChangedRect(irr::u32 level, const irr::core::recti& rect);
+
+    void downsample(irr::u32 level, const irr::core::recti& rect);
+
+    std::vector<ResourceHandle<irr::video::IImage>> levels;
+
+    std::deque<PendingUpdate> pendingUpdates;
+
+    std::vector<irr::core::recti> changedRects;
+};
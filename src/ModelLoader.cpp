@@ -0,0 +1,445 @@
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+//! Reads the images a mesh loader asks for into memory and hands out a 1x1 placeholder instead of decoding them.
+/** External image loaders are asked before the built-in ones, so this intercepts every texture the mesh loader requests
+    while deferring is on. With it off, the built-in loaders decode the images read before. */
+class DeferredImageLoader : public irr::video::IImageLoader
+{
+public:
+    //! the bytes of an image file as the mesh loader found it, under the name it asked for
+    struct ImageFile
+    {
+        irr::io::path filename;
+        std::vector<irr::u8> data;
+    };
+
+    explicit DeferredImageLoader(irr::video::IVideoDriver* _driver) : driver(_driver), deferring(false)
+    {
+    }
+
+    bool isALoadableFileExtension(const irr::io::path& /*filename*/) const override
+    {
+        return deferring;
+    }
+
+    bool isALoadableFileFormat(irr::io::IReadFile* /*file*/) const override
+    {
+        return false;
+    }
+
+    irr::video::IImage* loadImage(irr::io::IReadFile* file) const override
+    {
+        ImageFile imageFile;
+        imageFile.filename = file->getFileName();
+        imageFile.data.resize(static_cast<std::size_t>(std::max(file->getSize(), 0L)));
+
+        file->seek(0);
+
+        if (imageFile.data.empty() || file->read(imageFile.data.data(), static_cast<irr::u32>(imageFile.data.size())) != static_cast<irr::s32>(imageFile.data.size()))
+        {
+            std::cerr << "Could not read texture " << irr::core::stringc(imageFile.filename).c_str() << std::endl;
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(imageFilesMutex);
+
+            imageFiles.push_back(std::move(imageFile));
+        }
+
+        return driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(1, 1));
+    }
+
+    //! starts recording the images asked for, forgetting the ones recorded before
+    void beginDeferring()
+    {
+        std::lock_guard<std::mutex> lock(imageFilesMutex);
+
+        imageFiles.clear();
+        deferring = true;
+    }
+
+    void endDeferring()
+    {
+        deferring = false;
+    }
+
+    std::vector<ImageFile> takeImageFiles()
+    {
+        std::lock_guard<std::mutex> lock(imageFilesMutex);
+
+        return std::move(imageFiles);
+    }
+
+private:
+    irr::video::IVideoDriver* driver;
+
+    std::atomic<bool> deferring;
+
+    mutable std::mutex imageFilesMutex;
+    mutable std::vector<ImageFile> imageFiles;
+};
+
+namespace {
+    //! the JPEG loader keeps the name of the file it decodes in a static member, so only one JPEG is decoded at a time
+    std::mutex jpegDecodeMutex;
+
+    long long millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+LoadedModel::~LoadedModel()
+{
+    for (auto& image : images)
+    {
+        image.second->drop();
+    }
+
+    if (triangleSelector != nullptr)
+    {
+        triangleSelector->drop();
+    }
+
+    if (mesh != nullptr)
+    {
+        mesh->drop();
+    }
+}
+
+ModelLoader::ModelLoader(ThreadPool& _threadPool, irr::IrrlichtDevice* _loaderDevice, bool _isProfiling) :
+    threadPool(_threadPool),
+    loaderDevice(_loaderDevice),
+    isProfiling(_isProfiling),
+    imageLoader(nullptr),
+    stage(Stage::Idle),
+    progress(0.f),
+    cancelRequested(false)
+{
+    if (loaderDevice == nullptr)
+    {
+        return;
+    }
+
+    imageLoader = new DeferredImageLoader(loaderDevice->getVideoDriver());
+    loaderDevice->getVideoDriver()->addExternalImageLoader(imageLoader);
+    imageLoader->drop();
+}
+
+ModelLoader::~ModelLoader()
+{
+    cancel();
+    join();
+}
+
+void ModelLoader::start(const std::wstring& filename)
+{
+    // the mesh loaders cannot be interrupted, so this blocks until the previous parse step returns
+    cancel();
+    join();
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result.reset();
+    }
+
+    cancelRequested = false;
+    progress = 0.f;
+    stage = Stage::Parsing;
+
+    worker = std::thread(&ModelLoader::run, this, filename);
+}
+
+void ModelLoader::cancel()
+{
+    cancelRequested = true;
+}
+
+bool ModelLoader::isLoading() const
+{
+    auto currentStage = getStage();
+
+    return currentStage == Stage::Parsing
+        || currentStage == Stage::DecodingTextures
+        || currentStage == Stage::BuildingSelector
+        || currentStage == Stage::BuildingSymmetryMap;
+}
+
+ModelLoader::Stage ModelLoader::getStage() const
+{
+    return stage;
+}
+
+float ModelLoader::getProgress() const
+{
+    return progress;
+}
+
+std::unique_ptr<LoadedModel> ModelLoader::takeResult()
+{
+    join();
+
+    stage = Stage::Idle;
+
+    std::lock_guard<std::mutex> lock(resultMutex);
+
+    return std::move(result);
+}
+
+void ModelLoader::join()
+{
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+bool ModelLoader::isCancelRequested(std::unique_ptr<LoadedModel>& model)
+{
+    if (!cancelRequested)
+    {
+        return false;
+    }
+
+    model.reset();
+
+    stage = Stage::Cancelled;
+
+    return true;
+}
+
+std::size_t ModelLoader::decodeImages(LoadedModel& model)
+{
+    auto imageFiles = imageLoader->takeImageFiles();
+    auto loaderDriver = loaderDevice->getVideoDriver();
+    auto loaderFileSystem = loaderDevice->getFileSystem();
+
+    std::vector<irr::video::IImage*> images(imageFiles.size(), nullptr);
+
+    std::atomic<std::size_t> decodedImageCount(0);
+
+    // the built-in image loaders keep no state between images, apart from the JPEG one, so the files are decoded in parallel
+    threadPool.parallelFor(imageFiles.size(), [&](std::size_t i) {
+        if (cancelRequested)
+        {
+            return;
+        }
+
+        auto& imageFile = imageFiles[i];
+        auto file = loaderFileSystem->createMemoryReadFile(imageFile.data.data(), static_cast<irr::s32>(imageFile.data.size()), imageFile.filename, false);
+
+        if (file != nullptr)
+        {
+            if (irr::core::hasFileExtension(imageFile.filename, "jpg", "jpeg"))
+            {
+                std::lock_guard<std::mutex> lock(jpegDecodeMutex);
+
+                images[i] = loaderDriver->createImageFromFile(file);
+            }
+            else
+            {
+                images[i] = loaderDriver->createImageFromFile(file);
+            }
+
+            file->drop();
+        }
+
+        if (images[i] == nullptr)
+        {
+            std::cerr << "Could not decode texture " << irr::core::stringc(imageFile.filename).c_str() << std::endl;
+        }
+
+        progress = 0.3f + (0.5f * ++decodedImageCount / imageFiles.size());
+    });
+
+    for (std::size_t i = 0; i < imageFiles.size(); ++i)
+    {
+        if (images[i] == nullptr)
+        {
+            continue;
+        }
+
+        auto existingImage = model.images.find(imageFiles[i].filename);
+
+        // a mesh loader may ask for the same file more than once
+        if (existingImage != model.images.end())
+        {
+            images[i]->drop();
+            continue;
+        }
+
+        model.images[imageFiles[i].filename] = images[i];
+    }
+
+    return imageFiles.size();
+}
+
+void ModelLoader::mapIslands(LoadedModel& model)
+{
+    for (irr::u32 i = 0; i < model.mesh->getMeshBufferCount(); ++i)
+    {
+        auto meshBuffer = model.mesh->getMeshBuffer(i);
+        auto placeholder = meshBuffer->getMaterial().getTexture(0);
+
+        if (placeholder != nullptr && model.images.find(placeholder->getName()) != model.images.end())
+        {
+            model.islands[placeholder->getName()].meshBuffers.push_back(meshBuffer);
+        }
+    }
+
+    for (auto& loadedIslands : model.islands)
+    {
+        if (cancelRequested)
+        {
+            return;
+        }
+
+        auto textureSize = model.images[loadedIslands.first]->getDimension();
+
+        loadedIslands.second.islands = std::make_unique<UvIslandMap>(threadPool, loadedIslands.second.meshBuffers, textureSize);
+    }
+}
+
+void ModelLoader::run(const std::wstring& filename)
+{
+    auto model = std::make_unique<LoadedModel>();
+
+    model->filename = filename;
+
+    if (loaderDevice == nullptr)
+    {
+        std::cerr << "Could not load a model without a loader device" << std::endl;
+        stage = Stage::Failed;
+        return;
+    }
+
+    // the null device never opens a window, it only provides the file system, the mesh loaders and the image decoders to this thread
+    auto loaderSceneManager = loaderDevice->getSceneManager();
+
+    // the placeholders of the previous load have all been swapped out on the main thread by now;
+    // the same file names must be asked for again rather than found in the texture cache
+    loaderDevice->getVideoDriver()->removeAllTextures();
+
+    progress = 0.05f;
+
+    auto parseStart = std::chrono::steady_clock::now();
+
+    imageLoader->beginDeferring();
+
+    model->mesh = loaderSceneManager->getMesh(filename.c_str());
+
+    imageLoader->endDeferring();
+
+    if (model->mesh == nullptr)
+    {
+        std::wcerr << L"Could not load model " << filename << std::endl;
+        stage = Stage::Failed;
+        return;
+    }
+
+    // loading the same file again parses it again, since the cached mesh is handed over to the main thread
+    model->mesh->grab();
+    loaderSceneManager->getMeshCache()->removeMesh(model->mesh);
+
+    auto parseTime = millisecondsSince(parseStart);
+
+    if (isCancelRequested(model))
+    {
+        return;
+    }
+
+    stage = Stage::DecodingTextures;
+    progress = 0.3f;
+
+    auto decodeStart = std::chrono::steady_clock::now();
+
+    auto imageFileCount = decodeImages(*model);
+
+    auto decodeTime = millisecondsSince(decodeStart);
+
+    if (isCancelRequested(model))
+    {
+        return;
+    }
+
+    stage = Stage::BuildingSelector;
+    progress = 0.8f;
+
+    auto selectorStart = std::chrono::steady_clock::now();
+
+    // the animation speed is always zero, so the first frame is the one being painted on;
+    // the selector is not bound to a scene node since the node is only created on the main thread
+    model->triangleSelector = loaderSceneManager->createOctreeTriangleSelector(model->mesh->getMesh(0), nullptr);
+
+    if (isCancelRequested(model))
+    {
+        return;
+    }
+
+    auto selectorTime = millisecondsSince(selectorStart);
+
+    stage = Stage::BuildingSymmetryMap;
+    progress = 0.9f;
+
+    auto symmetryStart = std::chrono::steady_clock::now();
+
+    model->symmetryMap = std::make_unique<SymmetryMap>(threadPool, model->mesh->getMesh(0));
+
+    if (isCancelRequested(model))
+    {
+        return;
+    }
+
+    auto symmetryTime = millisecondsSince(symmetryStart);
+
+    auto projectionStart = std::chrono::steady_clock::now();
+
+    model->projectionPainter = std::make_unique<ProjectionPainter>(threadPool, model->mesh->getMesh(0));
+
+    auto projectionTime = millisecondsSince(projectionStart);
+
+    auto vertexStart = std::chrono::steady_clock::now();
+
+    model->vertexPainter = std::make_unique<VertexPainter>(model->mesh->getMesh(0));
+
+    auto vertexTime = millisecondsSince(vertexStart);
+
+    stage = Stage::MappingIslands;
+    progress = 0.95f;
+
+    auto islandStart = std::chrono::steady_clock::now();
+
+    mapIslands(*model);
+
+    if (isCancelRequested(model))
+    {
+        return;
+    }
+
+    auto islandTime = millisecondsSince(islandStart);
+
+    if (isProfiling)
+    {
+        std::cout << "Loaded model in " << (parseTime + decodeTime + selectorTime + symmetryTime + projectionTime + vertexTime + islandTime) << " ms: "
+                  << "parsing " << parseTime << " ms, "
+                  << "decoding " << model->images.size() << " of " << imageFileCount << " images on " << threadPool.getThreadCount() << " threads " << decodeTime << " ms, "
+                  << "building triangle selector " << selectorTime << " ms, "
+                  << "building symmetry map " << symmetryTime << " ms, "
+                  << "building projection painter " << projectionTime << " ms, "
+                  << "hashing " << model->vertexPainter->getVertexCount() << " vertices " << vertexTime << " ms, "
+                  << "mapping the UV islands of " << model->islands.size() << " textures " << islandTime << " ms" << std::endl;
+    }
+
+    progress = 1.f;
+
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        result = std::move(model);
+    }
+
+    stage = Stage::Finished;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "ProjectionPainter.h"
+#include "SymmetryMap.h"
+#include "ThreadPool.h"
+#include "UvIslands.h"
+#include "VertexPainter.h"
+
+class DeferredImageLoader;
+
+//! The UV islands of a decoded texture, with the mesh buffers showing it in their first texture layer, which they were mapped from.
+struct LoadedIslands
+{
+    std::vector<irr::scene::IMeshBuffer*> meshBuffers;
+
+    std::unique_ptr<UvIslandMap> islands;
+};
+
+//! Everything the loader thread produced for a single model.
+/** The mesh materials still point to the loader device's placeholder textures, which stay valid until the next load starts;
+    ApplicationDelegate::finishLoadingModel swaps them for real textures on the main thread. */
+struct LoadedModel
+{
+    ~LoadedModel();
+
+    std::wstring filename;
+
+    irr::scene::IAnimatedMesh* mesh = nullptr;
+
+    irr::scene::ITriangleSelector* triangleSelector = nullptr;
+
+    std::unique_ptr<SymmetryMap> symmetryMap;
+
+    std::unique_ptr<ProjectionPainter> projectionPainter;
+
+    std::unique_ptr<VertexPainter> vertexPainter;
+
+    //! decoded texture images, keyed by the texture name the mesh loader used
+    std::map<irr::io::path, irr::video::IImage*> images;
+
+    //! keyed like images
+    std::map<irr::io::path, LoadedIslands> islands;
+};
+
+//! Loads a model on a worker thread so that rendering is never blocked by parsing or decoding.
+/** Only CPU work happens off the main thread: mesh parsing, image decoding, mapping UV islands and building the triangle selector, the symmetry map, the projection painter and the vertex hash.
+    The worker parses through a windowless EDT_NULL device of its own, so the main device's driver and scene manager are never touched from it.
+    That device is created once, before the main device, and shared by every load: creating a device replaces Irrlicht's global logger,
+    which must not happen on a worker thread while the main device is logging.
+    Images are not decoded while the mesh is parsed; their files are read into memory and decoded in parallel on the thread pool afterwards. */
+class ModelLoader
+{
+public:
+    enum class Stage
+    {
+        Idle,
+        Parsing,
+        DecodingTextures,
+        BuildingSelector,
+        BuildingSymmetryMap,
+        MappingIslands,
+        Finished,
+        Failed,
+        Cancelled
+    };
+
+    //! loaderDevice has to be an EDT_NULL device which outlives the loader and is used by nothing else
+    /** With isProfiling, every load prints how long each of its stages took. */
+    ModelLoader(ThreadPool& threadPool, irr::IrrlichtDevice* loaderDevice, bool isProfiling);
+
+    ~ModelLoader();
+
+    //! starts loading a model; a load which is still running is cancelled first
+    void start(const std::wstring& filename);
+
+    void cancel();
+
+    bool isLoading() const;
+
+    Stage getStage() const;
+
+    //! returns the progress of the current load in range [0, 1]
+    float getProgress() const;
+
+    //! returns the loaded model once the stage is Finished, nullptr after a failed or cancelled load
+    /** Resets the loader to Idle. */
+    std::unique_ptr<LoadedModel> takeResult();
+
+private:
+    void run(const std::wstring& filename);
+
+    bool isCancelRequested(std::unique_ptr<LoadedModel>& model);
+
+    //! decodes the image files read while parsing into model.images, returning how many there were
+    std::size_t decodeImages(LoadedModel& model);
+
+    //! maps the UV islands of every decoded texture into model.islands
+    void mapIslands(LoadedModel& model);
+
+    void join();
+
+    ThreadPool& threadPool;
+
+    irr::IrrlichtDevice* loaderDevice;
+
+    bool isProfiling;
+
+    //! owned by the loader device's driver, which asks it before its own image loaders
+    DeferredImageLoader* imageLoader;
+
+    std::thread worker;
+
+    std::atomic<Stage> stage;
+    std::atomic<float> progress;
+    std::atomic<bool> cancelRequested;
+
+    std::mutex resultMutex;
+    std::unique_ptr<LoadedModel> result;
+};
@@ -0,0 +1,380 @@
+#include "PaintSurface.h"
+
+#include <iostream>
+#include <sstream>
+
+namespace {
+    irr::io::path getPreviewTextureName(const void* owner)
+    {
+        std::ostringstream name;
+
+        name << "__paintSurfacePreview__" << owner;
+
+        return irr::io::path(name.str().c_str());
+    }
+
+    //! copies an image into a texture of the same size
+    /** The texture is locked write only, so the driver never reads it back first. What the locked memory holds is undefined
+        then, which is why all of the image is copied rather than what changed; Irrlicht uploads all of it on unlock anyway. */
+    void copyToTexture(irr::video::IVideoDriver* driver, irr::video::IImage* image, irr::video::ITexture* texture)
+    {
+        auto textureData = texture->lock(irr::video::ETLM_WRITE_ONLY);
+
+        if (textureData == nullptr)
+        {
+            return;
+        }
+
+        // the locked memory is wrapped rather than copied, so the image is converted straight into it
+        auto target = driver->createImageFromData(texture->getColorFormat(), texture->getSize(), textureData, true, false);
+
+        if (texture->getSize() == image->getDimension())
+        {
+            image->copyTo(target, irr::core::position2di(0, 0));
+        }
+        else
+        {
+            // the driver resized a texture it could not hold at its original size
+            image->copyToScaling(target);
+        }
+
+        target->drop();
+
+        texture->unlock();
+    }
+
+    //! the composite is kept in the format it is shown in, so uploads copy rows instead of converting texels
+    irr::video::ECOLOR_FORMAT getPaintFormat(irr::video::ECOLOR_FORMAT format)
+    {
+        return isBlendFormatSupported(format) ? format : irr::video::ECF_A8R8G8B8;
+    }
+
+    irr::video::ITexture* createPreviewTexture(irr::video::IVideoDriver* driver, irr::video::IImage* image, const void* owner)
+    {
+        // the thumbnail changes with every dab, regenerating its mip maps each time is not worth it
+        auto createMipMaps = driver->getTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS);
+        driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, false);
+
+        auto texture = driver->addTexture(getPreviewTextureName(owner), image);
+
+        driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, createMipMaps);
+
+        return texture;
+    }
+}
+
+PaintSurface::PaintSurface(irr::video::IVideoDriver* _driver, irr::video::IImage* base, irr::video::ITexture* _texture) :
+    driver(_driver),
+    image(_driver->createImage(getPaintFormat(_texture->getColorFormat()), base->getDimension())),
+    layers(std::make_unique<LayerStack>(_driver, base, image.get())),
+    texture(_texture),
+    previewTexture(_texture),
+    previewLevel(0),
+    isDirty(false),
+    previewCount(0),
+    previewLayerIndex(0)
+{
+    // the texture already shows the base image, which is all the stack holds so far
+    layers->composite();
+
+    auto size = image->getDimension();
+
+    if (size.Width > PREVIEW_SIZE || size.Height > PREVIEW_SIZE)
+    {
+        pyramid = std::make_unique<MipPyramid>(driver, image.get(), PREVIEW_SIZE);
+
+        previewLevel = pyramid->getLevelCount() - 1;
+        thumbnailTexture = TextureHandle(driver, createPreviewTexture(driver, pyramid->getLevel(previewLevel), this));
+        previewTexture = thumbnailTexture.get();
+    }
+}
+
+PaintSurface::PaintSurface(irr::video::IVideoDriver* _driver, irr::video::IImage* base) :
+    driver(_driver),
+    image(_driver->createImage(getPaintFormat(base->getColorFormat()), base->getDimension())),
+    layers(std::make_unique<LayerStack>(_driver, base, image.get())),
+    texture(nullptr),
+    previewTexture(nullptr),
+    previewLevel(0),
+    isDirty(false),
+    previewCount(0),
+    previewLayerIndex(0)
+{
+    layers->composite();
+
+    // the coarsest level has to fit into a single page
+    pyramid = std::make_unique<MipPyramid>(driver, image.get(), VirtualTexture::PAGE_SIZE);
+    virtualTexture = std::make_unique<VirtualTexture>(driver, *pyramid);
+
+    for (irr::u32 level = 0; level < pyramid->getLevelCount(); ++level)
+    {
+        auto levelSize = pyramid->getLevel(level)->getDimension();
+
+        if (levelSize.Width <= PREVIEW_SIZE && levelSize.Height <= PREVIEW_SIZE)
+        {
+            previewLevel = level;
+            thumbnailTexture = TextureHandle(driver, createPreviewTexture(driver, pyramid->getLevel(level), this));
+            previewTexture = thumbnailTexture.get();
+            break;
+        }
+    }
+}
+
+PaintSurface::~PaintSurface()
+{
+    virtualTexture.reset();
+    pyramid.reset();
+    layers.reset();
+}
+
+bool PaintSurface::needsVirtualTexture(irr::video::IVideoDriver* driver, const irr::core::dimension2du& size)
+{
+    auto maxTextureSize = driver->getMaxTextureSize();
+
+    auto tooLarge = size.Width > VIRTUAL_TEXTURE_THRESHOLD || size.Height > VIRTUAL_TEXTURE_THRESHOLD
+        || size.Width > maxTextureSize.Width || size.Height > maxTextureSize.Height;
+
+    if (!tooLarge)
+    {
+        return false;
+    }
+
+    if (!VirtualTexture::isSupported(driver))
+    {
+        std::cerr << "Texture of " << size.Width << "x" << size.Height << " needs virtual texturing, which this driver does not support" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool PaintSurface::isVirtual() const
+{
+    return virtualTexture != nullptr;
+}
+
+irr::video::IImage* PaintSurface::getImage() const
+{
+    return image.get();
+}
+
+LayerStack& PaintSurface::getLayers()
+{
+    return *layers;
+}
+
+irr::video::ITexture* PaintSurface::getPreviewTexture() const
+{
+    return previewTexture;
+}
+
+void PaintSurface::applyTo(irr::video::SMaterial& material) const
+{
+    if (isVirtual())
+    {
+        virtualTexture->applyTo(material);
+    }
+    else
+    {
+        material.setTexture(0, texture);
+    }
+}
+
+void PaintSurface::addMeshBuffer(irr::scene::IMeshBuffer* meshBuffer)
+{
+    meshBuffers.push_back(meshBuffer);
+}
+
+void PaintSurface::updateResidency(irr::scene::ICameraSceneNode* camera, const irr::core::matrix4& world)
+{
+    if (isVirtual())
+    {
+        virtualTexture->updateResidency(camera, world, meshBuffers);
+    }
+}
+
+void PaintSurface::updateIslands(ThreadPool& threadPool)
+{
+    islands = std::make_unique<UvIslandMap>(threadPool, meshBuffers, image->getDimension());
+}
+
+bool PaintSurface::adoptIslands(const std::vector<irr::scene::IMeshBuffer*>& islandMeshBuffers, std::unique_ptr<UvIslandMap>& mappedIslands)
+{
+    if (mappedIslands == nullptr || islandMeshBuffers != meshBuffers)
+    {
+        return false;
+    }
+
+    islands = std::move(mappedIslands);
+
+    return true;
+}
+
+const UvIslandMap* PaintSurface::getIslands() const
+{
+    return islands.get();
+}
+
+void PaintSurface::updateAtlas(ThreadPool& threadPool)
+{
+    atlas = std::make_unique<SurfaceAtlas>(threadPool, meshBuffers, image->getDimension());
+}
+
+SurfaceAtlas* PaintSurface::getAtlas() const
+{
+    return atlas.get();
+}
+
+void PaintSurface::updateMask(ThreadPool& threadPool, const FaceSelection& selection)
+{
+    if (layers->isStroking())
+    {
+        return;
+    }
+
+    if (selection.isEmpty())
+    {
+        mask.reset();
+        return;
+    }
+
+    if (mask == nullptr || mask->getVersion() != selection.getVersion())
+    {
+        mask = std::make_unique<TexelMask>(threadPool, meshBuffers, selection, image->getDimension());
+    }
+}
+
+const TexelMask* PaintSurface::getMask() const
+{
+    return mask.get();
+}
+
+void PaintSurface::markDirty(const irr::core::recti& rect)
+{
+    layers->markDirty(rect);
+}
+
+void PaintSurface::composite()
+{
+    std::lock_guard<std::mutex> lock(compositeMutex);
+
+    compositedTiles.clear();
+
+    auto compositedRect = layers->composite(exporter != nullptr ? &compositedTiles : nullptr);
+
+    for (const auto& tileRect : compositedTiles)
+    {
+        exporter->markDirty(tileRect);
+    }
+
+    if (compositedRect.getArea() == 0)
+    {
+        return;
+    }
+
+    if (isDirty)
+    {
+        dirtyRect.addInternalPoint(compositedRect.UpperLeftCorner);
+        dirtyRect.addInternalPoint(compositedRect.LowerRightCorner);
+    }
+    else
+    {
+        dirtyRect = compositedRect;
+        isDirty = true;
+    }
+}
+
+DdsExporter& PaintSurface::getExporter()
+{
+    if (exporter == nullptr)
+    {
+        exporter = std::make_unique<DdsExporter>();
+    }
+
+    return *exporter;
+}
+
+void PaintSurface::upload(std::chrono::steady_clock::time_point previewDeadline)
+{
+    std::lock_guard<std::mutex> lock(compositeMutex);
+
+    if (isDirty)
+    {
+        auto imageSize = image->getDimension();
+
+        dirtyRect.clipAgainst(irr::core::recti(0, 0, imageSize.Width, imageSize.Height));
+
+        if (pyramid != nullptr)
+        {
+            pyramid->markDirty(dirtyRect);
+        }
+
+        if (texture != nullptr && dirtyRect.getArea() != 0)
+        {
+            copyToTexture(driver, image.get(), texture);
+        }
+
+        isDirty = false;
+    }
+
+    if (pyramid != nullptr)
+    {
+        pyramid->update(previewDeadline);
+
+        for (irr::u32 level = 0; level < pyramid->getLevelCount(); ++level)
+        {
+            auto changedRect = pyramid->takeChangedRect(level);
+
+            if (isVirtual())
+            {
+                virtualTexture->markDirty(level, changedRect);
+            }
+
+            if (level == previewLevel && level != 0 && changedRect.getArea() != 0)
+            {
+                copyToTexture(driver, pyramid->getLevel(level), previewTexture);
+            }
+        }
+    }
+
+    if (isVirtual())
+    {
+        virtualTexture->upload();
+    }
+}
+
+void PaintSurface::beginPreview(const irr::core::recti& rect)
+{
+    if (rect.getArea() == 0)
+    {
+        return;
+    }
+
+    // the previewed rectangles all belong to one layer
+    if (previewCount > 0 && previewLayerIndex != layers->getActiveLayerIndex())
+    {
+        restorePreview();
+    }
+
+    previewLayerIndex = layers->getActiveLayerIndex();
+
+    if (previewBackups.size() == previewCount)
+    {
+        previewBackups.emplace_back();
+    }
+
+    layers->getLayer(previewLayerIndex).readRect(rect, previewBackups[previewCount++]);
+}
+
+void PaintSurface::restorePreview()
+{
+    // in reverse, so where rectangles overlap, what was there before the first dab is what is left
+    while (previewCount > 0)
+    {
+        const auto& backup = previewBackups[--previewCount];
+
+        layers->getLayer(previewLayerIndex).writeRect(backup);
+
+        markDirty(backup.rect);
+    }
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "DdsExporter.h"
+#include "FaceSelection.h"
+#include "LayerStack.h"
+#include "MipPyramid.h"
+#include "ResourceHandle.h"
+#include "SurfaceAtlas.h"
+#include "UvIslands.h"
+#include "VirtualTexture.h"
+
+class ThreadPool;
+
+//! The layers of a texture being painted on together with whatever shows their composite on the GPU.
+/** The composite and the background layer keep the color format of the texture, or of the base image when virtually textured,
+    as long as the blend kernels can write into it, so 24 and 16 bit textures are neither widened in memory nor converted on upload.
+    Small images are shown through a single texture; only the rectangle changed since the last upload is copied into it.
+    Images too large for one texture are shown through a VirtualTexture instead.
+    The material tab shows a thumbnail taken from a MipPyramid, which catches up with the image within a time budget per frame. */
+class PaintSurface
+{
+public:
+    //! images with a side longer than this are virtually textured, even where the driver could hold them in one texture
+    static const irr::u32 VIRTUAL_TEXTURE_THRESHOLD = 8192;
+
+    //! the thumbnail shown in the material tab is at most this large
+    static const irr::u32 PREVIEW_SIZE = 512;
+
+    //! starts a layer stack on the base image and shows its composite through an existing texture
+    PaintSurface(irr::video::IVideoDriver* driver, irr::video::IImage* base, irr::video::ITexture* texture);
+
+    //! starts a layer stack on the base image and shows its composite through a virtual texture
+    PaintSurface(irr::video::IVideoDriver* driver, irr::video::IImage* base);
+
+    ~PaintSurface();
+
+    PaintSurface(const PaintSurface&) = delete;
+    PaintSurface& operator=(const PaintSurface&) = delete;
+
+    static bool needsVirtualTexture(irr::video::IVideoDriver* driver, const irr::core::dimension2du& size);
+
+    bool isVirtual() const;
+
+    //! the composite of all layers, as of the last composite call
+    irr::video::IImage* getImage() const;
+
+    //! layer changes have to be followed by markDirty, unless they go through the stack's own setters
+    LayerStack& getLayers();
+
+    //! texture to show in the material tab
+    irr::video::ITexture* getPreviewTexture() const;
+
+    //! sets up a material to show this surface
+    void applyTo(irr::video::SMaterial& material) const;
+
+    //! remembers a mesh buffer showing this surface, so its virtual texture knows which pages the view needs
+    void addMeshBuffer(irr::scene::IMeshBuffer* meshBuffer);
+
+    void updateResidency(irr::scene::ICameraSceneNode* camera, const irr::core::matrix4& world);
+
+    //! maps the UV islands of the mesh buffers added so far
+    void updateIslands(ThreadPool& threadPool);
+
+    //! takes islands mapped elsewhere from the given mesh buffers, if those are the mesh buffers added so far
+    /** Returns false and leaves mappedIslands alone otherwise. */
+    bool adoptIslands(const std::vector<irr::scene::IMeshBuffer*>& islandMeshBuffers, std::unique_ptr<UvIslandMap>& mappedIslands);
+
+    //! nullptr until updateIslands was called or islands were adopted
+    const UvIslandMap* getIslands() const;
+
+    //! maps every texel of the mesh buffers added so far to its position on them
+    /** Only sphere brushes need the atlas, which takes several times the memory of the texture, so it is built on their first dab. */
+    void updateAtlas(ThreadPool& threadPool);
+
+    //! nullptr until updateAtlas was called
+    SurfaceAtlas* getAtlas() const;
+
+    //! rasterizes the selected faces of the mesh buffers added so far, unless the selection did not change since
+    /** The mask of a stroke going on is kept until the stroke ends. */
+    void updateMask(ThreadPool& threadPool, const FaceSelection& selection);
+
+    //! the texels painting is kept to as of the last updateMask, nullptr while no face is selected
+    const TexelMask* getMask() const;
+
+    //! marks a rectangle which has been painted into one of the layers
+    void markDirty(const irr::core::recti& rect);
+
+    //! brings the composite up to date with the layers, publishing what changed for the next upload
+    /** May run on the paint thread while the main thread uploads what an earlier call published. */
+    void composite();
+
+    //! the exporter writing this surface as a DDS file, which follows the tiles recomposited from the first call on
+    DdsExporter& getExporter();
+
+    //! uploads what composite published since the last call; thumbnail updates stop at the deadline and carry on in the next call
+    void upload(std::chrono::steady_clock::time_point previewDeadline);
+
+    //! backs up a rectangle which is about to be painted over only to preview the brush
+    /** Several rectangles, like those of mirrored dabs, may be backed up before they are restored together. */
+    void beginPreview(const irr::core::recti& rect);
+
+    //! puts back the rectangles backed up by beginPreview, if any
+    void restorePreview();
+
+private:
+    irr::video::IVideoDriver* driver;
+
+    ResourceHandle<irr::video::IImage> image;
+
+    std::unique_ptr<LayerStack> layers;
+
+    irr::video::ITexture* texture;
+    irr::video::ITexture* previewTexture;
+
+    //! the thumbnail texture, when the preview is not the texture itself
+    TextureHandle thumbnailTexture;
+
+    //! pyramid level the thumbnail is taken from
+    irr::u32 previewLevel;
+
+    std::unique_ptr<MipPyramid> pyramid;
+    std::unique_ptr<VirtualTexture> virtualTexture;
+
+    std::vector<irr::scene::IMeshBuffer*> meshBuffers;
+
+    std::unique_ptr<UvIslandMap> islands;
+
+    std::unique_ptr<SurfaceAtlas> atlas;
+
+    std::unique_ptr<TexelMask> mask;
+
+    std::unique_ptr<DdsExporter> exporter;
+
+    //! tiles recomposited by the last composite, kept allocated for the next one
+    std::vector<irr::core::recti> compositedTiles;
+
+    //! rectangle of the composite which changed since the last upload
+    irr::core::recti dirtyRect;
+    bool isDirty;
+
+    //! held while the composite image is written or read for an upload, which may happen on different threads
+    std::mutex compositeMutex;
+
+    //! backups of the rectangles previewed since the last restore, kept allocated for the next preview
+    irr::u32 previewCount;
+    irr::u32 previewLayerIndex;
+    std::vector<LayerBackup> previewBackups;
+};
@@ -0,0 +1,148 @@
+#include "PaintThread.h"
+
+PaintThread::PaintThread(std::function<void()> _compositor) :
+    compositor(std::move(_compositor)),
+    pushedCount(0),
+    publishedCount(0),
+    stopping(false),
+    isSleeping(false),
+    latencyCount(0),
+    latencySum(0),
+    latencyLongest(0)
+{
+    thread = std::thread(&PaintThread::threadLoop, this);
+}
+
+PaintThread::~PaintThread()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+
+    commandQueued.notify_one();
+
+    thread.join();
+}
+
+void PaintThread::push(std::function<void()> command)
+{
+    Command queuedCommand { std::move(command), std::chrono::steady_clock::now() };
+
+    // a full queue means the paint thread is far behind, which only the main thread waiting lets it catch up from
+    while (!commands.push(queuedCommand))
+    {
+        std::this_thread::yield();
+    }
+
+    ++pushedCount;
+
+    // pairs with the fence in threadLoop: either the paint thread sees the command, or this sees it going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (isSleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        commandQueued.notify_one();
+    }
+}
+
+void PaintThread::finish()
+{
+    if (isIdle())
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(idleMutex);
+
+    idle.wait(lock, [this]() { return isIdle(); });
+}
+
+bool PaintThread::isIdle() const
+{
+    return publishedCount.load(std::memory_order_acquire) == pushedCount;
+}
+
+std::size_t PaintThread::getQueueDepth() const
+{
+    return commands.size();
+}
+
+PaintThread::Latency PaintThread::takeLatency()
+{
+    Latency latency;
+
+    latency.commandCount = latencyCount.exchange(0);
+
+    auto sum = latencySum.exchange(0);
+    auto longest = latencyLongest.exchange(0);
+
+    latency.averageMilliseconds = latency.commandCount > 0 ? (sum / 1e6f) / latency.commandCount : 0.f;
+    latency.longestMilliseconds = longest / 1e6f;
+
+    return latency;
+}
+
+void PaintThread::threadLoop()
+{
+    const auto COMPOSITE_INTERVAL = std::chrono::milliseconds(COMPOSITE_INTERVAL_MS);
+
+    std::size_t runCount = 0;
+    auto compositeTime = std::chrono::steady_clock::now();
+
+    Command command;
+
+    while (!stopping)
+    {
+        if (!commands.pop(command))
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+
+            isSleeping = true;
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            commandQueued.wait(lock, [this]() { return stopping || commands.size() > 0; });
+
+            isSleeping = false;
+
+            continue;
+        }
+
+        command.run();
+        command.run = nullptr;
+
+        ++runCount;
+
+        auto now = std::chrono::steady_clock::now();
+        auto latency = static_cast<irr::u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - command.queueTime).count());
+
+        latencySum += latency;
+        ++latencyCount;
+
+        auto longest = latencyLongest.load();
+
+        while (latency > longest && !latencyLongest.compare_exchange_weak(longest, latency))
+        {
+        }
+
+        // while commands keep coming, the regions they painted are still shown every so often
+        if (commands.size() > 0 && now - compositeTime < COMPOSITE_INTERVAL)
+        {
+            continue;
+        }
+
+        compositor();
+
+        compositeTime = std::chrono::steady_clock::now();
+
+        publishedCount.store(runCount, std::memory_order_release);
+
+        {
+            std::lock_guard<std::mutex> lock(idleMutex);
+        }
+
+        idle.notify_all();
+    }
+}
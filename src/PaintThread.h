@@ -0,0 +1,150 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <irrlicht/irrlicht.h>
+
+//! A ring of a fixed number of slots between exactly one producing and one consuming thread, neither of which ever waits on the other.
+template <typename T, std::size_t CAPACITY>
+class SpscQueue
+{
+public:
+    SpscQueue() :
+        head(0),
+        tail(0)
+    {
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    //! producer only; leaves value as it is and returns false when the queue is full
+    bool push(T& value)
+    {
+        auto currentTail = tail.load(std::memory_order_relaxed);
+
+        if (currentTail - head.load(std::memory_order_acquire) == CAPACITY)
+        {
+            return false;
+        }
+
+        slots[currentTail % CAPACITY] = std::move(value);
+
+        tail.store(currentTail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //! consumer only; returns false when the queue is empty
+    bool pop(T& value)
+    {
+        auto currentHead = head.load(std::memory_order_relaxed);
+
+        if (currentHead == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        value = std::move(slots[currentHead % CAPACITY]);
+
+        head.store(currentHead + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    //! exact from either end's own side, a snapshot from the other
+    std::size_t size() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+private:
+    std::array<T, CAPACITY> slots;
+
+    //! kept on cache lines of their own, so the two threads do not keep taking the line from each other
+    alignas(64) std::atomic<std::size_t> head;
+    alignas(64) std::atomic<std::size_t> tail;
+};
+
+//! The thread strokes are painted on, so a heavy dab holds up neither drawing the frame nor handling input.
+/** The main thread queues commands, which run in order. Whenever the queue runs dry, and at least every
+    COMPOSITE_INTERVAL while it does not, the compositor runs on this thread, publishing the regions painted so far for
+    the main thread to upload. The main thread only touches the layers itself once finish returned, or while isIdle holds. */
+class PaintThread
+{
+public:
+    static const std::size_t QUEUE_CAPACITY = 1024;
+
+    //! the longest the painted regions wait to be published while commands keep coming
+    static const irr::u32 COMPOSITE_INTERVAL_MS = 16;
+
+    //! how long commands waited from being queued to having run, since the last call to takeLatency
+    struct Latency
+    {
+        irr::u32 commandCount;
+        irr::f32 averageMilliseconds;
+        irr::f32 longestMilliseconds;
+    };
+
+    //! compositor runs on the paint thread after commands
+    explicit PaintThread(std::function<void()> compositor);
+
+    //! commands still queued are dropped
+    ~PaintThread();
+
+    PaintThread(const PaintThread&) = delete;
+    PaintThread& operator=(const PaintThread&) = delete;
+
+    //! queues a command, yielding for as long as the queue is full
+    void push(std::function<void()> command);
+
+    //! waits until every command queued so far has run and its regions are published
+    void finish();
+
+    //! whether every command queued so far has run and its regions are published; main thread only
+    bool isIdle() const;
+
+    std::size_t getQueueDepth() const;
+
+    Latency takeLatency();
+
+private:
+    struct Command
+    {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point queueTime;
+    };
+
+    void threadLoop();
+
+    std::function<void()> compositor;
+
+    SpscQueue<Command, QUEUE_CAPACITY> commands;
+
+    //! commands queued, counted on the main thread, and commands run and published, counted on the paint thread
+    std::size_t pushedCount;
+    std::atomic<std::size_t> publishedCount;
+
+    std::atomic<bool> stopping;
+
+    //! only for sleeping while there is nothing to do, never taken while a command is queued or taken off the queue
+    std::mutex wakeMutex;
+    std::condition_variable commandQueued;
+    std::atomic<bool> isSleeping;
+
+    std::mutex idleMutex;
+    std::condition_variable idle;
+
+    std::atomic<irr::u32> latencyCount;
+    std::atomic<irr::u64> latencySum;
+    std::atomic<irr::u64> latencyLongest;
+
+    std::thread thread;
+};
@@ -0,0 +1,149 @@
+#include "Payload.h"
+
+#include <cstring>
+
+PayloadWriter::PayloadWriter(std::vector<irr::u8>& _bytes) : bytes(_bytes)
+{
+}
+
+void PayloadWriter::putU8(irr::u8 value)
+{
+    bytes.push_back(value);
+}
+
+void PayloadWriter::putU32(irr::u32 value)
+{
+    for (irr::u32 b = 0; b < 4; ++b)
+    {
+        bytes.push_back((value >> (b * 8)) & 0xFF);
+    }
+}
+
+void PayloadWriter::putU64(irr::u64 value)
+{
+    putU32(static_cast<irr::u32>(value & 0xFFFFFFFF));
+    putU32(static_cast<irr::u32>(value >> 32));
+}
+
+void PayloadWriter::putF32(irr::f32 value)
+{
+    irr::u32 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    putU32(bits);
+}
+
+void PayloadWriter::putVector(const irr::core::vector3df& value)
+{
+    putF32(value.X);
+    putF32(value.Y);
+    putF32(value.Z);
+}
+
+void PayloadWriter::putString(const std::wstring& value)
+{
+    putU32(static_cast<irr::u32>(value.size()));
+
+    for (auto character : value)
+    {
+        putU32(static_cast<irr::u32>(character));
+    }
+}
+
+PayloadReader::PayloadReader(const std::vector<irr::u8>& _bytes) : bytes(_bytes), position(0), valid(true)
+{
+}
+
+bool PayloadReader::isValid() const
+{
+    return valid;
+}
+
+bool PayloadReader::isAtEnd() const
+{
+    return position == bytes.size();
+}
+
+irr::u8 PayloadReader::getU8()
+{
+    if (!canRead(1))
+    {
+        return 0;
+    }
+
+    return bytes[position++];
+}
+
+irr::u32 PayloadReader::getU32()
+{
+    if (!canRead(4))
+    {
+        return 0;
+    }
+
+    irr::u32 value = 0;
+
+    for (irr::u32 b = 0; b < 4; ++b)
+    {
+        value |= static_cast<irr::u32>(bytes[position++]) << (b * 8);
+    }
+
+    return value;
+}
+
+irr::u64 PayloadReader::getU64()
+{
+    auto low = getU32();
+    auto high = getU32();
+
+    return low | (static_cast<irr::u64>(high) << 32);
+}
+
+irr::f32 PayloadReader::getF32()
+{
+    auto bits = getU32();
+
+    irr::f32 value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+irr::core::vector3df PayloadReader::getVector()
+{
+    auto x = getF32();
+    auto y = getF32();
+    auto z = getF32();
+
+    return irr::core::vector3df(x, y, z);
+}
+
+std::wstring PayloadReader::getString()
+{
+    auto length = getU32();
+
+    // a corrupt length must not allocate more than the payload could hold
+    if (!canRead(static_cast<std::size_t>(length) * 4))
+    {
+        return std::wstring();
+    }
+
+    std::wstring value;
+
+    for (irr::u32 i = 0; i < length; ++i)
+    {
+        value.push_back(static_cast<wchar_t>(getU32()));
+    }
+
+    return value;
+}
+
+bool PayloadReader::canRead(std::size_t count)
+{
+    if (position + count > bytes.size())
+    {
+        valid = false;
+    }
+
+    return valid;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+//! four characters read as a little endian word, which tag what a file or a chunk of it holds
+constexpr irr::u32 makeTag(char a, char b, char c, char d)
+{
+    return static_cast<irr::u32>(a) | (static_cast<irr::u32>(b) << 8) | (static_cast<irr::u32>(c) << 16) | (static_cast<irr::u32>(d) << 24);
+}
+
+//! Serializes what goes into a file of the application, little endian whatever the machine.
+class PayloadWriter
+{
+public:
+    explicit PayloadWriter(std::vector<irr::u8>& bytes);
+
+    void putU8(irr::u8 value);
+
+    void putU32(irr::u32 value);
+
+    void putU64(irr::u64 value);
+
+    void putF32(irr::f32 value);
+
+    void putVector(const irr::core::vector3df& value);
+
+    //! characters are stored as 32 bit code units, whatever the size of wchar_t
+    void putString(const std::wstring& value);
+
+private:
+    std::vector<irr::u8>& bytes;
+};
+
+//! Reads what PayloadWriter wrote; reading past the end gives zeros and makes the reader invalid.
+class PayloadReader
+{
+public:
+    explicit PayloadReader(const std::vector<irr::u8>& bytes);
+
+    bool isValid() const;
+
+    //! whether everything was read, which a well formed payload ends with
+    bool isAtEnd() const;
+
+    irr::u8 getU8();
+
+    irr::u32 getU32();
+
+    irr::u64 getU64();
+
+    irr::f32 getF32();
+
+    irr::core::vector3df getVector();
+
+    std::wstring getString();
+
+private:
+    bool canRead(std::size_t count);
+
+    const std::vector<irr::u8>& bytes;
+    std::size_t position;
+    bool valid;
+};
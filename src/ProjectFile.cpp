@@ -0,0 +1,1442 @@
+#include "ProjectFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "PaintSurface.h"
+#include "Payload.h"
+#include "ThreadPool.h"
+
+namespace {
+    const char FILE_MAGIC[8] = { 'I', 'R', 'R', 'P', 'A', 'I', 'N', 'T' };
+
+    const irr::u32 FORMAT_VERSION = 1;
+
+    //! the magic, the version and a reserved word
+    const irr::u32 HEADER_SIZE = 16;
+
+    //! a tag and the size of the payload following it
+    const irr::u32 CHUNK_HEADER_SIZE = 8;
+
+    //! the tail chunk holds the offset and the size of the index
+    const irr::u32 TAIL_SIZE = CHUNK_HEADER_SIZE + 12;
+
+    const irr::u32 TAG_TILE = makeTag('T', 'I', 'L', 'E');
+    const irr::u32 TAG_SETTINGS = makeTag('S', 'E', 'T', 'S');
+    const irr::u32 TAG_INDEX = makeTag('I', 'N', 'D', 'X');
+    const irr::u32 TAG_TAIL = makeTag('T', 'A', 'I', 'L');
+
+    //! a file with less garbage than this is not worth compacting, however much of it is garbage
+    const std::size_t COMPACTION_MINIMUM_GARBAGE = 4 << 20;
+
+    //! the shortest repetition the tile compression refers back to
+    const irr::u32 MINIMUM_MATCH = 4;
+
+    const irr::u32 MATCH_HASH_BITS = 12;
+
+    //! the narrow name a file is opened under, converted character by character the way Irrlicht converts paths
+    std::string getNarrowPath(const std::wstring& filename)
+    {
+        std::string path;
+
+        for (auto character : filename)
+        {
+            path.push_back(static_cast<char>(character));
+        }
+
+        return path;
+    }
+
+    std::wstring getCompactionFilename(const std::wstring& filename)
+    {
+        return filename + L".compacting";
+    }
+
+    //! where a project written from scratch goes until it is complete
+    std::wstring getSavingFilename(const std::wstring& filename)
+    {
+        return filename + L".saving";
+    }
+
+    //! moves a file over another one, which stays as it was wherever the move fails
+    bool replaceFile(const std::string& sourcePath, const std::string& targetPath)
+    {
+        // POSIX rename replaces the target in a single step
+        if (std::rename(sourcePath.c_str(), targetPath.c_str()) == 0)
+        {
+            return true;
+        }
+
+#ifdef _WIN32
+        // the C runtime on Windows refuses to rename over an existing file
+        return MoveFileExA(sourcePath.c_str(), targetPath.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        return false;
+#endif
+    }
+
+    //! cuts a file back to a size, dropping whatever was written past it
+    bool truncateFile(const std::string& path, std::size_t size)
+    {
+#ifdef _WIN32
+        auto file = std::fopen(path.c_str(), "r+b");
+
+        if (file == nullptr)
+        {
+            return false;
+        }
+
+        auto isTruncated = _chsize_s(_fileno(file), static_cast<__int64>(size)) == 0;
+
+        return std::fclose(file) == 0 && isTruncated;
+#else
+        return truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+#endif
+    }
+
+    irr::u32 getTileBytes(irr::u32 bytesPerTexel)
+    {
+        return Layer::TILE_SIZE * Layer::TILE_SIZE * bytesPerTexel;
+    }
+
+    //! compresses a layer tile with LZ77 in the manner of LZ4
+    /** Each sequence is a token holding the literal count and the match length, 4 bits each with 255 valued bytes extending
+        them, the literals, and the 16 bit offset of the match. The last sequence has literals only. */
+    void compressTile(const irr::u8* texels, irr::u32 bytesPerTexel, std::vector<irr::u8>& output)
+    {
+        const auto size = getTileBytes(bytesPerTexel);
+        const auto rowBytes = Layer::TILE_SIZE * bytesPerTexel;
+
+        // neighbouring texels are alike, so each byte is stored as its difference to the same channel of the texel on its left
+        std::vector<irr::u8> input(size);
+
+        for (irr::u32 i = 0; i < size; ++i)
+        {
+            input[i] = static_cast<irr::u8>(texels[i] - ((i % rowBytes) >= bytesPerTexel ? texels[i - bytesPerTexel] : 0));
+        }
+
+        output.clear();
+
+        auto putLength = [&output](irr::u32 length) {
+            while (length >= 255)
+            {
+                output.push_back(255);
+                length -= 255;
+            }
+
+            output.push_back(static_cast<irr::u8>(length));
+        };
+
+        auto putLiterals = [&](irr::u32 start, irr::u32 count, irr::u32 matchNibble) {
+            output.push_back(static_cast<irr::u8>((std::min(count, 15u) << 4) | matchNibble));
+
+            if (count >= 15)
+            {
+                putLength(count - 15);
+            }
+
+            output.insert(output.end(), input.begin() + start, input.begin() + start + count);
+        };
+
+        std::vector<irr::s32> table(1 << MATCH_HASH_BITS, -1);
+
+        irr::u32 literalStart = 0;
+        irr::u32 position = 0;
+
+        while (position + MINIMUM_MATCH <= size)
+        {
+            irr::u32 word;
+            std::memcpy(&word, input.data() + position, sizeof(word));
+
+            auto& entry = table[(word * 2654435761u) >> (32 - MATCH_HASH_BITS)];
+            auto candidate = entry;
+
+            entry = static_cast<irr::s32>(position);
+
+            if (candidate < 0 || position - candidate > 0xFFFF || std::memcmp(input.data() + candidate, input.data() + position, MINIMUM_MATCH) != 0)
+            {
+                ++position;
+                continue;
+            }
+
+            auto length = MINIMUM_MATCH;
+
+            while (position + length < size && input[candidate + length] == input[position + length])
+            {
+                ++length;
+            }
+
+            auto offset = position - static_cast<irr::u32>(candidate);
+
+            putLiterals(literalStart, position - literalStart, std::min(length - MINIMUM_MATCH, 15u));
+
+            output.push_back(offset & 0xFF);
+            output.push_back(static_cast<irr::u8>(offset >> 8));
+
+            if (length - MINIMUM_MATCH >= 15)
+            {
+                putLength(length - MINIMUM_MATCH - 15);
+            }
+
+            position += length;
+            literalStart = position;
+        }
+
+        putLiterals(literalStart, size - literalStart, 0);
+    }
+
+    //! returns false for data which does not decompress into exactly one tile
+    bool decompressTile(const std::vector<irr::u8>& input, irr::u32 bytesPerTexel, irr::u8* texels)
+    {
+        const auto size = getTileBytes(bytesPerTexel);
+        const auto rowBytes = Layer::TILE_SIZE * bytesPerTexel;
+
+        std::size_t in = 0;
+        irr::u32 out = 0;
+
+        auto getLength = [&input, &in](irr::u32& length) {
+            irr::u8 extension;
+
+            do
+            {
+                if (in == input.size())
+                {
+                    return false;
+                }
+
+                extension = input[in++];
+                length += extension;
+            } while (extension == 255);
+
+            return true;
+        };
+
+        while (in < input.size())
+        {
+            auto token = input[in++];
+
+            irr::u32 literalCount = token >> 4;
+
+            if (literalCount == 15 && !getLength(literalCount))
+            {
+                return false;
+            }
+
+            if (in + literalCount > input.size() || out + literalCount > size)
+            {
+                return false;
+            }
+
+            std::memcpy(texels + out, input.data() + in, literalCount);
+
+            in += literalCount;
+            out += literalCount;
+
+            if (in == input.size())
+            {
+                break;
+            }
+
+            if (in + 2 > input.size())
+            {
+                return false;
+            }
+
+            irr::u32 offset = input[in] | (input[in + 1] << 8);
+            in += 2;
+
+            irr::u32 matchLength = token & 15;
+
+            if (matchLength == 15 && !getLength(matchLength))
+            {
+                return false;
+            }
+
+            matchLength += MINIMUM_MATCH;
+
+            if (offset == 0 || offset > out || out + matchLength > size)
+            {
+                return false;
+            }
+
+            // matches may overlap what they copy, so they go byte by byte
+            for (irr::u32 i = 0; i < matchLength; ++i, ++out)
+            {
+                texels[out] = texels[out - offset];
+            }
+        }
+
+        if (out != size)
+        {
+            return false;
+        }
+
+        for (irr::u32 row = 0; row < size; row += rowBytes)
+        {
+            for (auto i = bytesPerTexel; i < rowBytes; ++i)
+            {
+                texels[row + i] = static_cast<irr::u8>(texels[row + i] + texels[row + i - bytesPerTexel]);
+            }
+        }
+
+        return true;
+    }
+
+    bool writeBytes(std::FILE* file, const void* bytes, std::size_t count)
+    {
+        return count == 0 || std::fwrite(bytes, 1, count, file) == count;
+    }
+
+    bool writeHeader(std::FILE* file)
+    {
+        std::vector<irr::u8> header(FILE_MAGIC, FILE_MAGIC + sizeof(FILE_MAGIC));
+
+        PayloadWriter writer(header);
+        writer.putU32(FORMAT_VERSION);
+        writer.putU32(0);
+
+        return writeBytes(file, header.data(), header.size());
+    }
+
+    const std::wstring TEST_FILENAME = L"TestProjectFile.irrpaint";
+
+    //! one layer of noise this large is enough garbage to compact
+    const irr::u32 TEST_SURFACE_SIZE = 1024;
+
+    void removeTestFiles()
+    {
+        std::remove(getNarrowPath(TEST_FILENAME).c_str());
+        std::remove(getNarrowPath(getSavingFilename(TEST_FILENAME)).c_str());
+        std::remove(getNarrowPath(getCompactionFilename(TEST_FILENAME)).c_str());
+    }
+
+    std::size_t getFileSize(const std::wstring& filename)
+    {
+        auto file = std::fopen(getNarrowPath(filename).c_str(), "rb");
+
+        if (file == nullptr)
+        {
+            return 0;
+        }
+
+        std::fseek(file, 0, SEEK_END);
+
+        auto size = std::ftell(file);
+
+        std::fclose(file);
+
+        return size < 0 ? 0 : static_cast<std::size_t>(size);
+    }
+
+    //! noise does not compress, so every tile it covers is as large as a tile can be
+    void fillWithNoise(Layer& layer, std::mt19937& random, const irr::core::recti& rect)
+    {
+        for (auto y = rect.UpperLeftCorner.Y; y < rect.LowerRightCorner.Y; ++y)
+        {
+            for (auto x = rect.UpperLeftCorner.X; x < rect.LowerRightCorner.X; ++x)
+            {
+                layer.setPixel(x, y, irr::video::SColor(random()));
+            }
+        }
+    }
+
+    ProjectSettings getTestSettings()
+    {
+        ProjectSettings settings;
+
+        settings.modelFilename = L"model.b3d";
+        settings.cameraPosition = irr::core::vector3df(1.f, 2.f, 3.f);
+        settings.cameraTarget = irr::core::vector3df(0.f, 1.f, 0.f);
+        settings.brushPresets.push_back(BrushPreset { L"Current", 12, 3, irr::video::SColor(255, 10, 20, 30), 0.5f });
+
+        return settings;
+    }
+
+    //! tiles which are missing from only one of the layers differ as well
+    irr::u32 countDifferentTiles(const Layer& subject, const Layer& expected)
+    {
+        irr::u32 count = 0;
+
+        for (irr::u32 tileY = 0; tileY < expected.getTileCountY(); ++tileY)
+        {
+            for (irr::u32 tileX = 0; tileX < expected.getTileCountX(); ++tileX)
+            {
+                auto subjectTile = subject.getTile(tileX, tileY);
+                auto expectedTile = expected.getTile(tileX, tileY);
+
+                if ((subjectTile == nullptr) != (expectedTile == nullptr)
+                    || (subjectTile != nullptr && std::memcmp(subjectTile, expectedTile, getTileBytes(expected.getBytesPerTexel())) != 0))
+                {
+                    ++count;
+                }
+            }
+        }
+
+        return count;
+    }
+}
+
+ProjectFile::ProjectFile(ThreadPool& _threadPool) :
+    threadPool(_threadPool),
+    fileSize(0),
+    liveSize(0),
+    settingsLocation { 0, 0 },
+    lastSaveSize(0),
+    lastSavedTileCount(0),
+    saveCount(0),
+    isCompactionDone(false),
+    compactionSaveCount(0),
+    isCompactionSuccessful(false),
+    compactedFileSize(0)
+{
+}
+
+ProjectFile::~ProjectFile()
+{
+    cancelCompaction();
+}
+
+bool ProjectFile::save(const std::wstring& _filename, const ProjectSettings& settings, const std::vector<PaintSurface*>& surfaces)
+{
+    // a compaction which finished since the last update goes in first, as the locations below may refer to it
+    update();
+
+    auto isNewFile = _filename != filename;
+
+    auto path = getNarrowPath(_filename);
+    auto writePath = path;
+
+    std::FILE* file = nullptr;
+
+    if (!isNewFile)
+    {
+        file = std::fopen(path.c_str(), "r+b");
+
+        // the file was taken away since the last save, so it is written anew
+        isNewFile = file == nullptr;
+    }
+
+    if (isNewFile)
+    {
+        cancelCompaction();
+
+        tileLocations.clear();
+
+        // a file already there under the name is only replaced once the new one is complete
+        writePath = getNarrowPath(getSavingFilename(_filename));
+
+        file = std::fopen(writePath.c_str(), "wb");
+
+        if (file == nullptr)
+        {
+            std::cerr << "Could not open project file for writing" << std::endl;
+
+            filename.clear();
+            return false;
+        }
+
+        if (!writeHeader(file))
+        {
+            std::fclose(file);
+            std::remove(writePath.c_str());
+
+            filename.clear();
+            return false;
+        }
+
+        fileSize = HEADER_SIZE;
+    }
+    else
+    {
+        std::fseek(file, 0, SEEK_END);
+
+        fileSize = static_cast<std::size_t>(std::ftell(file));
+    }
+
+    filename = _filename;
+
+    auto saveStart = fileSize;
+
+    //! a tile which was written into since it was saved, or has never been saved
+    struct PendingTile
+    {
+        const Layer* layer;
+        TileEntry entry;
+        std::vector<irr::u8> data;
+    };
+
+    std::vector<PendingTile> pendingTiles;
+    std::vector<TileEntry> tiles;
+
+    std::map<std::pair<const Layer*, irr::u32>, ChunkLocation> savedLocations;
+
+    std::vector<irr::u8> settingsPayload;
+    PayloadWriter writer(settingsPayload);
+
+    writer.putU32(FORMAT_VERSION);
+    writer.putString(settings.modelFilename);
+    writer.putVector(settings.cameraPosition);
+    writer.putVector(settings.cameraTarget);
+
+    writer.putU32(static_cast<irr::u32>(settings.brushPresets.size()));
+
+    for (const auto& preset : settings.brushPresets)
+    {
+        writer.putString(preset.name);
+        writer.putU32(preset.size);
+        writer.putU32(preset.featherRadius);
+        writer.putU32(preset.color.color);
+        writer.putF32(preset.opacity);
+    }
+
+    writer.putU32(static_cast<irr::u32>(surfaces.size()));
+
+    for (irr::u32 material = 0; material < surfaces.size(); ++material)
+    {
+        auto& layers = surfaces[material]->getLayers();
+        auto size = surfaces[material]->getImage()->getDimension();
+
+        writer.putU32(size.Width);
+        writer.putU32(size.Height);
+        writer.putU32(layers.getActiveLayerIndex());
+        writer.putU8(layers.isHighPrecision() ? 1 : 0);
+        writer.putU32(layers.getLayerCount());
+
+        for (irr::u32 layerIndex = 0; layerIndex < layers.getLayerCount(); ++layerIndex)
+        {
+            const auto& layer = layers.getLayer(layerIndex);
+
+            writer.putString(layer.getName());
+            writer.putF32(layer.getOpacity());
+            writer.putU8(layer.isVisible() ? 1 : 0);
+            writer.putU32(static_cast<irr::u32>(layer.getBlendMode()));
+            writer.putU32(static_cast<irr::u32>(layer.getColorFormat()));
+
+            for (irr::u32 tile = 0; tile < layer.getTileCountX() * layer.getTileCountY(); ++tile)
+            {
+                auto tileX = tile % layer.getTileCountX();
+                auto tileY = tile / layer.getTileCountX();
+
+                if (layer.getTile(tileX, tileY) == nullptr)
+                {
+                    continue;
+                }
+
+                TileEntry entry { material, layerIndex, tile, { 0, 0 } };
+
+                auto savedLocation = tileLocations.find(std::make_pair(&layer, tile));
+
+                if (savedLocation != tileLocations.end() && !layer.isTileUnsaved(tileX, tileY))
+                {
+                    entry.location = savedLocation->second;
+                    tiles.push_back(entry);
+                    savedLocations[std::make_pair(&layer, tile)] = entry.location;
+                }
+                else
+                {
+                    pendingTiles.push_back(PendingTile { &layer, entry, std::vector<irr::u8>() });
+                }
+            }
+        }
+    }
+
+    // tiles are compressed independently of each other
+    threadPool.parallelFor(pendingTiles.size(), [&](std::size_t i) {
+        auto& pendingTile = pendingTiles[i];
+
+        auto tileX = pendingTile.entry.tile % pendingTile.layer->getTileCountX();
+        auto tileY = pendingTile.entry.tile / pendingTile.layer->getTileCountX();
+
+        compressTile(pendingTile.layer->getTile(tileX, tileY), pendingTile.layer->getBytesPerTexel(), pendingTile.data);
+    });
+
+    auto isWritten = true;
+
+    for (auto& pendingTile : pendingTiles)
+    {
+        isWritten = isWritten && appendChunk(file, TAG_TILE, pendingTile.data, pendingTile.entry.location);
+
+        tiles.push_back(pendingTile.entry);
+        savedLocations[std::make_pair(pendingTile.layer, pendingTile.entry.tile)] = pendingTile.entry.location;
+    }
+
+    ChunkLocation newSettingsLocation;
+
+    isWritten = isWritten
+        && appendChunk(file, TAG_SETTINGS, settingsPayload, newSettingsLocation)
+        && appendIndex(file, newSettingsLocation, tiles);
+
+    if (isWritten)
+    {
+        std::fflush(file);
+
+        fileSize = static_cast<std::size_t>(std::ftell(file));
+    }
+
+    isWritten = std::fclose(file) == 0 && isWritten;
+
+    if (isWritten && isNewFile && !replaceFile(writePath, path))
+    {
+        isWritten = false;
+    }
+
+    if (!isWritten)
+    {
+        std::cerr << "Could not write project file" << std::endl;
+
+        if (isNewFile)
+        {
+            // the file under the name, if any, was never touched
+            std::remove(writePath.c_str());
+
+            filename.clear();
+        }
+        else if (!truncateFile(path, saveStart))
+        {
+            // the file no longer ends with a tail, so the next save writes it anew beside it
+            filename.clear();
+        }
+
+        // otherwise the file ends with the tail of the last good save again, and the next save appends to it as before
+        return false;
+    }
+
+    // layers which were removed since the last save drop out here
+    tileLocations = std::move(savedLocations);
+
+    indexedTiles = std::move(tiles);
+    settingsLocation = newSettingsLocation;
+
+    liveSize = fileSize - saveStart + HEADER_SIZE;
+
+    for (const auto& tile : indexedTiles)
+    {
+        // tiles from earlier saves
+        if (tile.location.offset < saveStart)
+        {
+            liveSize += CHUNK_HEADER_SIZE + tile.location.size;
+        }
+    }
+
+    for (auto surface : surfaces)
+    {
+        auto& layers = surface->getLayers();
+
+        for (irr::u32 layerIndex = 0; layerIndex < layers.getLayerCount(); ++layerIndex)
+        {
+            layers.getLayer(layerIndex).markSaved();
+        }
+    }
+
+    lastSaveSize = fileSize - saveStart;
+    lastSavedTileCount = static_cast<irr::u32>(pendingTiles.size());
+
+    ++saveCount;
+
+    startCompaction();
+
+    return true;
+}
+
+bool ProjectFile::open(const std::wstring& _filename, ProjectSettings& settings)
+{
+    auto file = std::fopen(getNarrowPath(_filename).c_str(), "rb");
+
+    if (file == nullptr)
+    {
+        std::cerr << "Could not open project file" << std::endl;
+        return false;
+    }
+
+    char magic[sizeof(FILE_MAGIC)];
+
+    std::fseek(file, 0, SEEK_END);
+
+    auto size = static_cast<std::size_t>(std::ftell(file));
+
+    std::fseek(file, 0, SEEK_SET);
+
+    std::vector<irr::u8> tail;
+    std::vector<irr::u8> indexPayload;
+    std::vector<irr::u8> settingsPayload;
+
+    auto isRead = size >= HEADER_SIZE + TAIL_SIZE
+        && std::fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+        && std::memcmp(magic, FILE_MAGIC, sizeof(magic)) == 0
+        && readChunk(file, ChunkLocation { size - TAIL_SIZE + CHUNK_HEADER_SIZE, TAIL_SIZE - CHUNK_HEADER_SIZE }, tail);
+
+    // the tail's own chunk header is checked by readChunk, which points at the index, which points at the settings
+    ChunkLocation indexLocation { 0, 0 };
+
+    if (isRead)
+    {
+        PayloadReader tailReader(tail);
+
+        indexLocation.offset = tailReader.getU64();
+        indexLocation.size = tailReader.getU32();
+
+        isRead = readChunk(file, indexLocation, indexPayload);
+    }
+
+    PayloadReader indexReader(indexPayload);
+
+    ChunkLocation newSettingsLocation { 0, 0 };
+    std::vector<TileEntry> tiles;
+
+    if (isRead)
+    {
+        newSettingsLocation.offset = indexReader.getU64();
+        newSettingsLocation.size = indexReader.getU32();
+
+        auto tileCount = indexReader.getU32();
+
+        for (irr::u32 i = 0; i < tileCount && indexReader.isValid(); ++i)
+        {
+            TileEntry entry;
+
+            entry.material = indexReader.getU32();
+            entry.layer = indexReader.getU32();
+            entry.tile = indexReader.getU32();
+            entry.location.offset = indexReader.getU64();
+            entry.location.size = indexReader.getU32();
+
+            tiles.push_back(entry);
+        }
+
+        isRead = indexReader.isValid() && readChunk(file, newSettingsLocation, settingsPayload);
+    }
+
+    std::fclose(file);
+
+    PayloadReader reader(settingsPayload);
+
+    ProjectSettings newSettings;
+    std::vector<MaterialRecord> materials;
+
+    if (isRead && reader.getU32() == FORMAT_VERSION)
+    {
+        newSettings.modelFilename = reader.getString();
+        newSettings.cameraPosition = reader.getVector();
+        newSettings.cameraTarget = reader.getVector();
+
+        auto presetCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < presetCount && reader.isValid(); ++i)
+        {
+            BrushPreset preset;
+
+            preset.name = reader.getString();
+            preset.size = reader.getU32();
+            preset.featherRadius = reader.getU32();
+            preset.color = irr::video::SColor(reader.getU32());
+            preset.opacity = reader.getF32();
+
+            newSettings.brushPresets.push_back(preset);
+        }
+
+        auto materialCount = reader.getU32();
+
+        for (irr::u32 i = 0; i < materialCount && reader.isValid(); ++i)
+        {
+            MaterialRecord material;
+
+            auto width = reader.getU32();
+            auto height = reader.getU32();
+
+            material.size = irr::core::dimension2du(width, height);
+            material.activeLayer = reader.getU32();
+            material.highPrecision = reader.getU8() != 0;
+
+            auto layerCount = reader.getU32();
+
+            for (irr::u32 j = 0; j < layerCount && reader.isValid(); ++j)
+            {
+                LayerRecord layer;
+
+                layer.name = reader.getString();
+                layer.opacity = reader.getF32();
+                layer.visible = reader.getU8() != 0;
+                layer.blendMode = reader.getU32();
+                layer.format = reader.getU32();
+
+                material.layers.push_back(layer);
+            }
+
+            materials.push_back(std::move(material));
+        }
+
+        isRead = reader.isValid();
+    }
+    else
+    {
+        isRead = false;
+    }
+
+    if (!isRead)
+    {
+        std::cerr << "Could not read project file - it is not a project or it is damaged" << std::endl;
+        return false;
+    }
+
+    cancelCompaction();
+
+    filename = _filename;
+    fileSize = size;
+
+    settings = std::move(newSettings);
+
+    settingsLocation = newSettingsLocation;
+    indexedTiles = std::move(tiles);
+    openedMaterials = std::move(materials);
+
+    // the layers the tiles belong to only exist once loadLayers created them
+    tileLocations.clear();
+
+    liveSize = HEADER_SIZE + (CHUNK_HEADER_SIZE * 2) + settingsLocation.size + indexLocation.size + TAIL_SIZE;
+
+    for (const auto& tile : indexedTiles)
+    {
+        liveSize += CHUNK_HEADER_SIZE + tile.location.size;
+    }
+
+    return true;
+}
+
+bool ProjectFile::loadLayers(const std::vector<PaintSurface*>& surfaces)
+{
+    if (openedMaterials.empty())
+    {
+        return false;
+    }
+
+    if (surfaces.size() != openedMaterials.size())
+    {
+        std::cerr << "The model has " << surfaces.size() << " painted materials, the project " << openedMaterials.size() << " - layers are matched by position" << std::endl;
+    }
+
+    // the layer each saved layer is loaded into, nullptr where it cannot be
+    std::vector<std::vector<Layer*>> targetLayers(openedMaterials.size());
+
+    for (irr::u32 material = 0; material < std::min<std::size_t>(surfaces.size(), openedMaterials.size()); ++material)
+    {
+        const auto& record = openedMaterials[material];
+
+        auto surface = surfaces[material];
+        auto& layers = surface->getLayers();
+
+        if (surface->getImage()->getDimension() != record.size || record.layers.empty())
+        {
+            std::cerr << "Could not load the layers of material " << material + 1 << " - its texture changed size" << std::endl;
+            continue;
+        }
+
+        // the background is kept, the layers above it are replaced
+        while (layers.getLayerCount() > 1)
+        {
+            layers.removeLayer(layers.getLayerCount() - 1);
+        }
+
+        for (irr::u32 layerIndex = 0; layerIndex < record.layers.size(); ++layerIndex)
+        {
+            const auto& layerRecord = record.layers[layerIndex];
+
+            if (layerIndex > 0)
+            {
+                layers.addLayer(layerRecord.name);
+            }
+
+            auto& layer = layers.getLayer(layerIndex);
+
+            layers.setLayerOpacity(layerIndex, layerRecord.opacity);
+            layers.setLayerVisible(layerIndex, layerRecord.visible);
+            layers.setLayerBlendMode(layerIndex, static_cast<BlendMode>(layerRecord.blendMode));
+
+            // a background saved from a texture in another format keeps the texture's texels
+            targetLayers[material].push_back(static_cast<irr::u32>(layer.getColorFormat()) == layerRecord.format ? &layer : nullptr);
+        }
+
+        layers.setActiveLayerIndex(std::min<irr::u32>(record.activeLayer, layers.getLayerCount() - 1));
+    }
+
+    std::vector<Layer*> tileLayers(indexedTiles.size(), nullptr);
+    std::vector<std::vector<irr::u8>> tileData(indexedTiles.size());
+
+    auto file = std::fopen(getNarrowPath(filename).c_str(), "rb");
+
+    if (file == nullptr)
+    {
+        std::cerr << "Could not open project file" << std::endl;
+        return false;
+    }
+
+    // reading is left to one thread, decompressing is not
+    for (std::size_t i = 0; i < indexedTiles.size(); ++i)
+    {
+        const auto& entry = indexedTiles[i];
+
+        if (entry.material >= targetLayers.size() || entry.layer >= targetLayers[entry.material].size())
+        {
+            continue;
+        }
+
+        auto layer = targetLayers[entry.material][entry.layer];
+
+        if (layer != nullptr && entry.tile < layer->getTileCountX() * layer->getTileCountY() && readChunk(file, entry.location, tileData[i]))
+        {
+            tileLayers[i] = layer;
+        }
+    }
+
+    std::fclose(file);
+
+    std::vector<irr::u8> isDecompressed(indexedTiles.size(), 0);
+
+    threadPool.parallelFor(indexedTiles.size(), [&](std::size_t i) {
+        auto layer = tileLayers[i];
+
+        if (layer == nullptr)
+        {
+            return;
+        }
+
+        auto tileX = indexedTiles[i].tile % layer->getTileCountX();
+        auto tileY = indexedTiles[i].tile / layer->getTileCountX();
+
+        // a damaged tile decodes into garbage, which is still better than refusing the whole project
+        isDecompressed[i] = decompressTile(tileData[i], layer->getBytesPerTexel(), layer->getOrCreateTile(tileX, tileY)) ? 1 : 0;
+    });
+
+    irr::u32 damagedTileCount = 0;
+
+    for (std::size_t i = 0; i < indexedTiles.size(); ++i)
+    {
+        if (tileLayers[i] != nullptr && isDecompressed[i] == 0)
+        {
+            ++damagedTileCount;
+        }
+    }
+
+    if (damagedTileCount != 0)
+    {
+        std::cerr << damagedTileCount << " tiles of the project are damaged" << std::endl;
+    }
+
+    for (irr::u32 material = 0; material < targetLayers.size(); ++material)
+    {
+        if (targetLayers[material].empty())
+        {
+            continue;
+        }
+
+        auto surface = surfaces[material];
+
+        for (auto layer : targetLayers[material])
+        {
+            if (layer != nullptr)
+            {
+                layer->markSaved();
+            }
+        }
+
+        surface->getLayers().setHighPrecision(openedMaterials[material].highPrecision);
+        surface->markDirty(irr::core::recti(irr::core::vector2di(0, 0), surface->getImage()->getDimension()));
+    }
+
+    // the next save only appends tiles painted from now on
+    for (std::size_t i = 0; i < indexedTiles.size(); ++i)
+    {
+        if (isDecompressed[i] != 0)
+        {
+            tileLocations[std::make_pair(static_cast<const Layer*>(tileLayers[i]), indexedTiles[i].tile)] = indexedTiles[i].location;
+        }
+    }
+
+    openedMaterials.clear();
+
+    return true;
+}
+
+void ProjectFile::update()
+{
+    if (!compactionWorker.joinable() || !isCompactionDone)
+    {
+        return;
+    }
+
+    compactionWorker.join();
+
+    auto compactionPath = getNarrowPath(getCompactionFilename(filename));
+
+    // a save since the compaction started appended to the old file, which the compacted one knows nothing of
+    if (!isCompactionSuccessful || compactionSaveCount != saveCount)
+    {
+        std::remove(compactionPath.c_str());
+        return;
+    }
+
+    auto path = getNarrowPath(filename);
+
+    if (!replaceFile(compactionPath, path))
+    {
+        std::cerr << "Could not replace the project file with its compacted copy, which is left as " << compactionPath << std::endl;
+
+        filename.clear();
+        return;
+    }
+
+    auto getCompactedLocation = [this](const ChunkLocation& location) {
+        return compactedLocations[location.offset];
+    };
+
+    for (auto& tileLocation : tileLocations)
+    {
+        tileLocation.second = getCompactedLocation(tileLocation.second);
+    }
+
+    for (auto& tile : indexedTiles)
+    {
+        tile.location = getCompactedLocation(tile.location);
+    }
+
+    settingsLocation = getCompactedLocation(settingsLocation);
+
+    fileSize = compactedFileSize;
+    liveSize = compactedFileSize;
+
+    compactedLocations.clear();
+}
+
+std::size_t ProjectFile::getLastSaveSize() const
+{
+    return lastSaveSize;
+}
+
+irr::u32 ProjectFile::getLastSavedTileCount() const
+{
+    return lastSavedTileCount;
+}
+
+bool ProjectFile::appendChunk(std::FILE* file, irr::u32 tag, const std::vector<irr::u8>& payload, ChunkLocation& location)
+{
+    std::vector<irr::u8> header;
+
+    PayloadWriter writer(header);
+    writer.putU32(tag);
+    writer.putU32(static_cast<irr::u32>(payload.size()));
+
+    auto offset = std::ftell(file);
+
+    if (offset < 0)
+    {
+        return false;
+    }
+
+    location.offset = static_cast<irr::u64>(offset) + CHUNK_HEADER_SIZE;
+    location.size = static_cast<irr::u32>(payload.size());
+
+    return writeBytes(file, header.data(), header.size()) && writeBytes(file, payload.data(), payload.size());
+}
+
+bool ProjectFile::readChunk(std::FILE* file, const ChunkLocation& location, std::vector<irr::u8>& payload)
+{
+    if (location.offset < HEADER_SIZE + CHUNK_HEADER_SIZE)
+    {
+        return false;
+    }
+
+    std::vector<irr::u8> header(CHUNK_HEADER_SIZE);
+
+    if (std::fseek(file, static_cast<long>(location.offset - CHUNK_HEADER_SIZE), SEEK_SET) != 0
+        || std::fread(header.data(), 1, header.size(), file) != header.size())
+    {
+        return false;
+    }
+
+    PayloadReader reader(header);
+    reader.getU32();
+
+    // the chunk's own size guards against an index pointing into the middle of another chunk
+    if (reader.getU32() != location.size)
+    {
+        return false;
+    }
+
+    payload.resize(location.size);
+
+    return location.size == 0 || std::fread(payload.data(), 1, payload.size(), file) == payload.size();
+}
+
+bool ProjectFile::appendIndex(std::FILE* file, const ChunkLocation& settingsLocation, const std::vector<TileEntry>& tiles)
+{
+    std::vector<irr::u8> indexPayload;
+
+    PayloadWriter indexWriter(indexPayload);
+    indexWriter.putU64(settingsLocation.offset);
+    indexWriter.putU32(settingsLocation.size);
+    indexWriter.putU32(static_cast<irr::u32>(tiles.size()));
+
+    for (const auto& tile : tiles)
+    {
+        indexWriter.putU32(tile.material);
+        indexWriter.putU32(tile.layer);
+        indexWriter.putU32(tile.tile);
+        indexWriter.putU64(tile.location.offset);
+        indexWriter.putU32(tile.location.size);
+    }
+
+    ChunkLocation indexLocation;
+
+    if (!appendChunk(file, TAG_INDEX, indexPayload, indexLocation))
+    {
+        return false;
+    }
+
+    std::vector<irr::u8> tailPayload;
+
+    PayloadWriter tailWriter(tailPayload);
+    tailWriter.putU64(indexLocation.offset);
+    tailWriter.putU32(indexLocation.size);
+
+    ChunkLocation tailLocation;
+
+    return appendChunk(file, TAG_TAIL, tailPayload, tailLocation);
+}
+
+void ProjectFile::startCompaction()
+{
+    if (compactionWorker.joinable() || fileSize - liveSize < std::max(liveSize, COMPACTION_MINIMUM_GARBAGE))
+    {
+        return;
+    }
+
+    compactionSaveCount = saveCount;
+    isCompactionDone = false;
+
+    compactionWorker = std::thread(&ProjectFile::compact, this, filename, settingsLocation, indexedTiles);
+}
+
+void ProjectFile::compact(const std::wstring& sourceFilename, ChunkLocation sourceSettingsLocation, std::vector<TileEntry> sourceTiles)
+{
+    auto source = std::fopen(getNarrowPath(sourceFilename).c_str(), "rb");
+    auto target = std::fopen(getNarrowPath(getCompactionFilename(sourceFilename)).c_str(), "wb");
+
+    auto isCompacted = source != nullptr && target != nullptr && writeHeader(target);
+
+    std::map<irr::u64, ChunkLocation> locations;
+
+    std::vector<irr::u8> payload;
+
+    // chunks are copied as they are, nothing is decompressed
+    auto copyChunk = [&](irr::u32 tag, const ChunkLocation& location) {
+        ChunkLocation newLocation;
+
+        if (!readChunk(source, location, payload) || !appendChunk(target, tag, payload, newLocation))
+        {
+            return false;
+        }
+
+        locations[location.offset] = newLocation;
+
+        return true;
+    };
+
+    isCompacted = isCompacted && copyChunk(TAG_SETTINGS, sourceSettingsLocation);
+
+    for (auto& tile : sourceTiles)
+    {
+        isCompacted = isCompacted && copyChunk(TAG_TILE, tile.location);
+
+        if (isCompacted)
+        {
+            tile.location = locations[tile.location.offset];
+        }
+    }
+
+    isCompacted = isCompacted && appendIndex(target, locations[sourceSettingsLocation.offset], sourceTiles);
+
+    std::size_t size = 0;
+
+    if (isCompacted)
+    {
+        size = static_cast<std::size_t>(std::ftell(target));
+    }
+
+    if (source != nullptr)
+    {
+        std::fclose(source);
+    }
+
+    if (target != nullptr)
+    {
+        isCompacted = std::fclose(target) == 0 && isCompacted;
+    }
+
+    compactedLocations = std::move(locations);
+    compactedFileSize = size;
+    isCompactionSuccessful = isCompacted;
+
+    isCompactionDone = true;
+}
+
+void ProjectFile::cancelCompaction()
+{
+    if (!compactionWorker.joinable())
+    {
+        return;
+    }
+
+    compactionWorker.join();
+
+    std::remove(getNarrowPath(getCompactionFilename(filename)).c_str());
+
+    compactedLocations.clear();
+}
+
+TestProjectFile::TestProjectFile() :
+    driver(nullptr),
+    base(nullptr),
+    texture(nullptr),
+    failureCount(0)
+{
+    std::cerr << "TestProjectFile..." << std::flush;
+
+    testCompression(4);
+    testCompression(3);
+    testCompression(2);
+
+    // the null driver keeps the test away from any window
+    auto device = irr::createDevice(irr::video::EDT_NULL);
+
+    if (device == nullptr)
+    {
+        std::cerr << std::endl
+                  << "The test could not create a null device" << std::endl;
+
+        ++failureCount;
+    }
+    else
+    {
+        driver = device->getVideoDriver();
+
+        base = driver->createImage(irr::video::ECF_A8R8G8B8, irr::core::dimension2du(TEST_SURFACE_SIZE, TEST_SURFACE_SIZE));
+
+        // a gradient compresses well, so the background hardly counts towards the garbage needed for a compaction
+        for (irr::u32 y = 0; y < TEST_SURFACE_SIZE; ++y)
+        {
+            for (irr::u32 x = 0; x < TEST_SURFACE_SIZE; ++x)
+            {
+                base->setPixel(x, y, irr::video::SColor(255, x * 255 / TEST_SURFACE_SIZE, y * 255 / TEST_SURFACE_SIZE, 128));
+            }
+        }
+
+        texture = driver->addTexture("__testProjectFile__", base);
+
+        {
+            ThreadPool threadPool;
+
+            testRoundTrip(threadPool);
+            testCompaction(threadPool);
+        }
+
+        removeTestFiles();
+
+        driver->removeTexture(texture);
+        base->drop();
+        device->drop();
+    }
+
+    std::cerr << (hasPassed() ? "OK" : "FAILED") << std::endl;
+}
+
+bool TestProjectFile::hasPassed() const
+{
+    return failureCount == 0;
+}
+
+void TestProjectFile::testCompression(irr::u32 bytesPerTexel)
+{
+    auto size = getTileBytes(bytesPerTexel);
+
+    std::mt19937 random(bytesPerTexel);
+
+    std::vector<irr::u8> noise(size);
+    std::vector<irr::u8> constant(size);
+
+    for (irr::u32 i = 0; i < size; ++i)
+    {
+        noise[i] = static_cast<irr::u8>(random());
+        constant[i] = static_cast<irr::u8>(0x40 + (i % bytesPerTexel) * 0x30);
+    }
+
+    std::vector<irr::u8> compressed;
+    std::vector<irr::u8> result(size);
+
+    for (const auto& tile : { noise, constant })
+    {
+        compressTile(tile.data(), bytesPerTexel, compressed);
+
+        auto isDecompressed = decompressTile(compressed, bytesPerTexel, result.data());
+
+        assertEqual(isDecompressed ? 1 : 0, 1, "decompressed tile");
+        assertEqual(isDecompressed && result == tile ? 1 : 0, 1, "tile equal to the one compressed");
+
+        // cut off halfway, the data ends before the tile does
+        compressed.resize(compressed.size() / 2);
+
+        assertEqual(decompressTile(compressed, bytesPerTexel, result.data()) ? 1 : 0, 0, "truncated tile refused");
+    }
+
+    compressTile(constant.data(), bytesPerTexel, compressed);
+
+    assertEqual(compressed.size() < size / 16 ? 1 : 0, 1, "constant tile compressed to a sixteenth");
+}
+
+void TestProjectFile::testRoundTrip(ThreadPool& threadPool)
+{
+    removeTestFiles();
+
+    PaintSurface surface(driver, base, texture);
+    auto& layers = surface.getLayers();
+
+    layers.addLayer(L"Paint");
+    layers.setLayerOpacity(1, 0.75f);
+    layers.setLayerBlendMode(1, BlendMode::Multiply);
+
+    std::mt19937 random(1);
+
+    fillWithNoise(layers.getLayer(1), random, irr::core::recti(100, 100, 600, 400));
+
+    surface.composite();
+
+    ProjectFile projectFile(threadPool);
+
+    assertEqual(projectFile.save(TEST_FILENAME, getTestSettings(), { &surface }) ? 1 : 0, 1, "saved project");
+
+    auto firstSaveSize = projectFile.getLastSaveSize();
+
+    layers.getLayer(1).setPixel(300, 200, irr::video::SColor(255, 1, 2, 3));
+
+    surface.composite();
+
+    assertEqual(projectFile.save(TEST_FILENAME, getTestSettings(), { &surface }) ? 1 : 0, 1, "appended to project");
+    assertEqual(projectFile.getLastSavedTileCount(), 1, "tiles appended after a small edit");
+    assertEqual(static_cast<irr::u32>(getFileSize(TEST_FILENAME)), static_cast<irr::u32>(HEADER_SIZE + firstSaveSize + projectFile.getLastSaveSize()), "file size after appending");
+
+    testReopen(threadPool, surface);
+
+    removeTestFiles();
+}
+
+void TestProjectFile::testCompaction(ThreadPool& threadPool)
+{
+    removeTestFiles();
+
+    PaintSurface surface(driver, base, texture);
+    auto& layers = surface.getLayers();
+
+    layers.addLayer(L"Rewritten");
+    layers.addLayer(L"Kept");
+
+    std::mt19937 random(2);
+
+    // the kept half makes the first rewrite too little garbage, so the compaction only starts with the second
+    fillWithNoise(layers.getLayer(2), random, irr::core::recti(0, 0, TEST_SURFACE_SIZE, TEST_SURFACE_SIZE / 2));
+
+    ProjectFile projectFile(threadPool);
+
+    for (irr::u32 save = 0; save < 3; ++save)
+    {
+        fillWithNoise(layers.getLayer(1), random, irr::core::recti(0, 0, TEST_SURFACE_SIZE, TEST_SURFACE_SIZE));
+
+        surface.composite();
+
+        assertEqual(projectFile.save(TEST_FILENAME, getTestSettings(), { &surface }) ? 1 : 0, 1, "saved rewritten layer");
+    }
+
+    auto uncompactedSize = getFileSize(TEST_FILENAME);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+
+    while (getFileSize(TEST_FILENAME) >= uncompactedSize && std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        projectFile.update();
+    }
+
+    assertEqual(getFileSize(TEST_FILENAME) < uncompactedSize ? 1 : 0, 1, "compacted project");
+
+    // the append refers to tiles where the compaction moved them
+    layers.getLayer(2).setPixel(10, 10, irr::video::SColor(255, 1, 2, 3));
+
+    surface.composite();
+
+    assertEqual(projectFile.save(TEST_FILENAME, getTestSettings(), { &surface }) ? 1 : 0, 1, "appended to compacted project");
+    assertEqual(projectFile.getLastSavedTileCount(), 1, "tiles appended to compacted project");
+
+    testReopen(threadPool, surface);
+
+    removeTestFiles();
+}
+
+void TestProjectFile::testReopen(ThreadPool& threadPool, PaintSurface& savedSurface)
+{
+    ProjectFile projectFile(threadPool);
+    ProjectSettings settings;
+
+    assertEqual(projectFile.open(TEST_FILENAME, settings) ? 1 : 0, 1, "opened project");
+
+    auto expectedSettings = getTestSettings();
+
+    assertEqual(settings.modelFilename == expectedSettings.modelFilename ? 1 : 0, 1, "model filename");
+    assertEqual(settings.cameraPosition == expectedSettings.cameraPosition ? 1 : 0, 1, "camera position");
+    assertEqual(static_cast<irr::u32>(settings.brushPresets.size()), 1, "brush presets");
+
+    if (!settings.brushPresets.empty())
+    {
+        assertEqual(settings.brushPresets[0].color.color, expectedSettings.brushPresets[0].color.color, "brush preset colour");
+    }
+
+    PaintSurface surface(driver, base, texture);
+
+    assertEqual(projectFile.loadLayers({ &surface }) ? 1 : 0, 1, "loaded layers");
+
+    auto& layers = surface.getLayers();
+    auto& savedLayers = savedSurface.getLayers();
+
+    assertEqual(layers.getLayerCount(), savedLayers.getLayerCount(), "layer count");
+
+    for (irr::u32 layerIndex = 0; layerIndex < std::min(layers.getLayerCount(), savedLayers.getLayerCount()); ++layerIndex)
+    {
+        const auto& layer = layers.getLayer(layerIndex);
+        const auto& savedLayer = savedLayers.getLayer(layerIndex);
+
+        assertEqual(layer.getName() == savedLayer.getName() ? 1 : 0, 1, "layer name");
+        assertEqual(static_cast<irr::u32>(layer.getBlendMode()), static_cast<irr::u32>(savedLayer.getBlendMode()), "layer blend mode");
+        assertEqual(layer.getOpacity() == savedLayer.getOpacity() ? 1 : 0, 1, "layer opacity");
+        assertEqual(countDifferentTiles(layer, savedLayer), 0, "different tiles in reopened layer");
+    }
+}
+
+void TestProjectFile::assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description)
+{
+    if (subject != expectedResult)
+    {
+        std::cerr << std::endl
+                  << "The test expected " << description << " " << std::hex << expectedResult << " but got " << subject << std::dec << std::endl;
+
+        ++failureCount;
+    }
+}
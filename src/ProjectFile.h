@@ -0,0 +1,193 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class Layer;
+class PaintSurface;
+class ThreadPool;
+
+//! Brush settings kept in a project.
+struct BrushPreset
+{
+    std::wstring name;
+
+    irr::u32 size;
+    irr::u32 featherRadius;
+    irr::video::SColor color;
+    irr::f32 opacity;
+};
+
+//! What a project holds besides the layers of its materials.
+struct ProjectSettings
+{
+    std::wstring modelFilename;
+
+    irr::core::vector3df cameraPosition;
+    irr::core::vector3df cameraTarget;
+
+    std::vector<BrushPreset> brushPresets;
+};
+
+//! A project saved as a sequence of chunks, which later saves only append to.
+/** Every layer tile is a chunk of its own, compressed independently of the others. A save appends the tiles written since
+    the previous save, a chunk with the settings and the layer properties, and an index of the live tiles, followed by a
+    fixed size tail pointing at the index. Tiles which did not change keep their chunks from earlier saves, so a save takes
+    time in proportion to what was painted since.
+    Chunks which no index refers to any more pile up at the start of the file. Once they outweigh the live ones, the live
+    chunks are copied into a new file on a worker thread, which replaces the old one unless another save came first. */
+class ProjectFile
+{
+public:
+    explicit ProjectFile(ThreadPool& threadPool);
+
+    ~ProjectFile();
+
+    ProjectFile(const ProjectFile&) = delete;
+    ProjectFile& operator=(const ProjectFile&) = delete;
+
+    //! appends what changed since the last save to the project file, or writes it anew under a different filename
+    /** surfaces are the materials in a fixed order, and their layers have to be resolved, which composite does. */
+    bool save(const std::wstring& filename, const ProjectSettings& settings, const std::vector<PaintSurface*>& surfaces);
+
+    //! reads the settings and the index of a project; tiles are only read by loadLayers, once the model is loaded
+    bool open(const std::wstring& filename, ProjectSettings& settings);
+
+    //! replaces the layers of the surfaces with those of the project opened last, material by material
+    bool loadLayers(const std::vector<PaintSurface*>& surfaces);
+
+    //! puts a compacted file in place of the project once the worker has finished it
+    void update();
+
+    //! bytes appended by the last save
+    std::size_t getLastSaveSize() const;
+
+    //! tiles compressed and appended by the last save
+    irr::u32 getLastSavedTileCount() const;
+
+private:
+    //! where a chunk's payload is in the file
+    struct ChunkLocation
+    {
+        irr::u64 offset;
+        irr::u32 size;
+    };
+
+    //! a tile of a layer as listed in the index
+    struct TileEntry
+    {
+        irr::u32 material;
+        irr::u32 layer;
+        irr::u32 tile;
+        ChunkLocation location;
+    };
+
+    //! a layer's properties as saved in the settings chunk
+    struct LayerRecord
+    {
+        std::wstring name;
+        irr::f32 opacity;
+        bool visible;
+        irr::u32 blendMode;
+        irr::u32 format;
+    };
+
+    struct MaterialRecord
+    {
+        irr::core::dimension2du size;
+        irr::u32 activeLayer;
+        bool highPrecision;
+        std::vector<LayerRecord> layers;
+    };
+
+    //! appends a chunk and returns where its payload went
+    static bool appendChunk(std::FILE* file, irr::u32 tag, const std::vector<irr::u8>& payload, ChunkLocation& location);
+
+    static bool readChunk(std::FILE* file, const ChunkLocation& location, std::vector<irr::u8>& payload);
+
+    //! appends the index of the tiles and the tail pointing at it
+    static bool appendIndex(std::FILE* file, const ChunkLocation& settingsLocation, const std::vector<TileEntry>& tiles);
+
+    //! starts copying the live chunks into a new file, if enough of the file is garbage and no copy is running yet
+    void startCompaction();
+
+    //! copies the live chunks into the compaction file, run on the worker thread
+    void compact(const std::wstring& sourceFilename, ChunkLocation sourceSettingsLocation, std::vector<TileEntry> sourceTiles);
+
+    //! waits for a running compaction and throws its file away
+    void cancelCompaction();
+
+    ThreadPool& threadPool;
+
+    //! the file saves append to, empty until a project was saved or opened
+    std::wstring filename;
+
+    std::size_t fileSize;
+
+    //! bytes of the file which its last index refers to, including the header, the index and the tail
+    std::size_t liveSize;
+
+    //! where each tile saved so far is, by the layer it belongs to and its index in the layer
+    std::map<std::pair<const Layer*, irr::u32>, ChunkLocation> tileLocations;
+
+    //! the tiles listed by the last index written or read, and the settings chunk it refers to
+    std::vector<TileEntry> indexedTiles;
+    ChunkLocation settingsLocation;
+
+    //! the materials of the project opened last, until loadLayers takes them
+    std::vector<MaterialRecord> openedMaterials;
+
+    std::size_t lastSaveSize;
+    irr::u32 lastSavedTileCount;
+
+    //! counts saves, so a compaction which started before the last one is thrown away
+    irr::u32 saveCount;
+
+    std::thread compactionWorker;
+    std::atomic<bool> isCompactionDone;
+
+    //! written by the worker before it sets isCompactionDone
+    irr::u32 compactionSaveCount;
+    bool isCompactionSuccessful;
+    std::size_t compactedFileSize;
+
+    //! where each chunk went in the compacted file, by its offset in the old one
+    std::map<irr::u64, ChunkLocation> compactedLocations;
+};
+
+//! Saves, appends to, compacts and reopens projects in the working directory, comparing the layers which come back.
+class TestProjectFile
+{
+public:
+    TestProjectFile();
+
+    bool hasPassed() const;
+
+private:
+    //! a tile of noise has to come back unchanged, a tile of a single colour has to shrink as well
+    void testCompression(irr::u32 bytesPerTexel);
+
+    //! a save, an append after a small edit, and reopening what was saved
+    void testRoundTrip(ThreadPool& threadPool);
+
+    //! rewrites a layer until the file is compacted, then appends to and reopens the compacted file
+    void testCompaction(ThreadPool& threadPool);
+
+    //! opens the test project into a fresh surface, whose layers have to equal those of the surface saved
+    void testReopen(ThreadPool& threadPool, PaintSurface& savedSurface);
+
+    void assertEqual(irr::u32 subject, irr::u32 expectedResult, const char* description);
+
+    irr::video::IVideoDriver* driver;
+    irr::video::IImage* base;
+    irr::video::ITexture* texture;
+
+    irr::u32 failureCount;
+};
@@ -0,0 +1,657 @@
+#include "ProjectionPainter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "MeshAccess.h"
+#include "ThreadPool.h"
+
+namespace {
+    //! triangles or vertices handled by one task
+    const irr::u32 TRIANGLES_PER_TASK = 4096;
+    const irr::u32 VERTICES_PER_TASK = 16384;
+
+    //! side of the square cells of the screen triangles are binned by, in pixels
+    const irr::u32 CELL_SIZE = 32;
+
+    //! how much farther than the depth buffer a point may be and still count as visible, relative to its distance
+    /** The buffer holds the surface at the centre of each pixel, so a slanted triangle may be a little farther at its own point. */
+    const irr::f32 DEPTH_TOLERANCE = 0.01f;
+
+    //! points this close to the eye or behind it are not projected
+    const irr::f32 MINIMUM_W = 1e-6f;
+
+    //! texel centres this little outside a triangle still belong to it, so shared edges leave no gaps
+    const irr::f32 EDGE_TOLERANCE = 1e-4f;
+
+    irr::u32 getFloatBits(irr::f32 value)
+    {
+        irr::u32 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        return bits;
+    }
+
+    irr::f32 getBitsFloat(irr::u32 bits)
+    {
+        irr::f32 value;
+        std::memcpy(&value, &bits, sizeof(value));
+
+        return value;
+    }
+
+    //! twice the signed area of the triangle a, b, p
+    irr::f32 getEdge(irr::f32 ax, irr::f32 ay, irr::f32 bx, irr::f32 by, irr::f32 px, irr::f32 py)
+    {
+        return ((bx - ax) * (py - ay)) - ((by - ay) * (px - ax));
+    }
+
+    //! even-odd rule, so a lasso crossing itself leaves out what it went around twice
+    bool isInsidePolygon(const std::vector<irr::core::vector2df>& polygon, irr::f32 x, irr::f32 y)
+    {
+        auto isInside = false;
+
+        for (std::size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+        {
+            const auto& a = polygon[i];
+            const auto& b = polygon[j];
+
+            if ((a.Y > y) != (b.Y > y) && x < a.X + ((b.X - a.X) * (y - a.Y) / (b.Y - a.Y)))
+            {
+                isInside = !isInside;
+            }
+        }
+
+        return isInside;
+    }
+}
+
+ProjectionPainter::ProjectionPainter(ThreadPool& _threadPool, irr::scene::IMesh* mesh) :
+    threadPool(_threadPool),
+    hasView(false),
+    cellCountX(0),
+    cellCountY(0)
+{
+    for (irr::u32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+    {
+        auto firstVertex = static_cast<irr::u32>(positions.size());
+
+        visitMeshBuffer(mesh->getMeshBuffer(i), [this, firstVertex](const auto& view) {
+            for (irr::u32 v = 0; v < view.getVertexCount(); ++v)
+            {
+                positions.push_back(view.getVertex(v).Pos);
+                textureCoords.push_back(view.getVertex(v).TCoords);
+            }
+
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    corners.push_back(firstVertex + view.getIndex(triangle, corner));
+                }
+            }
+        });
+
+        triangleMeshBuffers.resize(corners.size() / 3, i);
+    }
+}
+
+void ProjectionPainter::setView(const irr::core::matrix4& _transform, const irr::core::dimension2du& _viewportSize)
+{
+    if (hasView && _viewportSize == viewportSize && std::memcmp(_transform.pointer(), transform.pointer(), sizeof(irr::f32) * 16) == 0)
+    {
+        return;
+    }
+
+    hasView = true;
+    transform = _transform;
+    viewportSize = _viewportSize;
+
+    auto vertexCount = static_cast<irr::u32>(positions.size());
+    auto triangleCount = static_cast<irr::u32>(triangleMeshBuffers.size());
+
+    clipVertices.resize(vertexCount);
+
+    threadPool.parallelFor((vertexCount + VERTICES_PER_TASK - 1) / VERTICES_PER_TASK, [&](std::size_t task) {
+        auto firstVertex = static_cast<irr::u32>(task) * VERTICES_PER_TASK;
+        auto lastVertex = std::min(firstVertex + VERTICES_PER_TASK, vertexCount);
+
+        for (auto v = firstVertex; v < lastVertex; ++v)
+        {
+            irr::f32 clip[4];
+            transform.transformVect(clip, positions[v]);
+
+            clipVertices[v] = ClipVertex { clip[0], clip[1], clip[3] };
+        }
+    });
+
+    auto pixelCount = static_cast<std::size_t>(viewportSize.Width) * viewportSize.Height;
+
+    depth.reset(new std::atomic<irr::u32>[pixelCount]);
+
+    const auto farthest = getFloatBits(std::numeric_limits<irr::f32>::max());
+
+    for (std::size_t i = 0; i < pixelCount; ++i)
+    {
+        depth[i].store(farthest, std::memory_order_relaxed);
+    }
+
+    cellCountX = (viewportSize.Width + CELL_SIZE - 1) / CELL_SIZE;
+    cellCountY = (viewportSize.Height + CELL_SIZE - 1) / CELL_SIZE;
+
+    auto cellCount = cellCountX * cellCountY;
+    auto taskCount = (triangleCount + TRIANGLES_PER_TASK - 1) / TRIANGLES_PER_TASK;
+
+    triangleCells.resize(triangleCount);
+
+    // each task counts the triangles of its batch per cell, so the bins are filled in a fixed order without locking
+    std::vector<irr::u32> taskCellCounts(static_cast<std::size_t>(taskCount) * cellCount, 0);
+
+    threadPool.parallelFor(taskCount, [&](std::size_t task) {
+        auto firstTriangle = static_cast<irr::u32>(task) * TRIANGLES_PER_TASK;
+        auto lastTriangle = std::min(firstTriangle + TRIANGLES_PER_TASK, triangleCount);
+        auto cellCounts = taskCellCounts.data() + (task * cellCount);
+
+        for (auto triangle = firstTriangle; triangle < lastTriangle; ++triangle)
+        {
+            auto& cells = triangleCells[triangle];
+            cells = CellRect { 0, 0, -1, -1 };
+
+            irr::f32 bounds[4];
+
+            if (!getScreenBounds(triangle, bounds) || bounds[2] < 0.f || bounds[3] < 0.f || bounds[0] >= viewportSize.Width || bounds[1] >= viewportSize.Height)
+            {
+                continue;
+            }
+
+            cells.x0 = std::max(0, static_cast<irr::s32>(bounds[0]) / static_cast<irr::s32>(CELL_SIZE));
+            cells.y0 = std::max(0, static_cast<irr::s32>(bounds[1]) / static_cast<irr::s32>(CELL_SIZE));
+            cells.x1 = std::min<irr::s32>(cellCountX - 1, static_cast<irr::s32>(bounds[2]) / static_cast<irr::s32>(CELL_SIZE));
+            cells.y1 = std::min<irr::s32>(cellCountY - 1, static_cast<irr::s32>(bounds[3]) / static_cast<irr::s32>(CELL_SIZE));
+
+            for (auto cellY = cells.y0; cellY <= cells.y1; ++cellY)
+            {
+                for (auto cellX = cells.x0; cellX <= cells.x1; ++cellX)
+                {
+                    ++cellCounts[(cellY * cellCountX) + cellX];
+                }
+            }
+
+            rasterizeDepth(triangle);
+        }
+    });
+
+    // the counts become where each task starts writing into each bin
+    cellStarts.assign(cellCount + 1, 0);
+
+    irr::u32 offset = 0;
+
+    for (irr::u32 cell = 0; cell < cellCount; ++cell)
+    {
+        cellStarts[cell] = offset;
+
+        for (irr::u32 task = 0; task < taskCount; ++task)
+        {
+            auto& count = taskCellCounts[(static_cast<std::size_t>(task) * cellCount) + cell];
+            auto taskOffset = offset;
+
+            offset += count;
+            count = taskOffset;
+        }
+    }
+
+    cellStarts[cellCount] = offset;
+    cellTriangles.resize(offset);
+
+    threadPool.parallelFor(taskCount, [&](std::size_t task) {
+        auto firstTriangle = static_cast<irr::u32>(task) * TRIANGLES_PER_TASK;
+        auto lastTriangle = std::min(firstTriangle + TRIANGLES_PER_TASK, triangleCount);
+        auto cellOffsets = taskCellCounts.data() + (task * cellCount);
+
+        for (auto triangle = firstTriangle; triangle < lastTriangle; ++triangle)
+        {
+            const auto& cells = triangleCells[triangle];
+
+            for (auto cellY = cells.y0; cellY <= cells.y1; ++cellY)
+            {
+                for (auto cellX = cells.x0; cellX <= cells.x1; ++cellX)
+                {
+                    cellTriangles[cellOffsets[(cellY * cellCountX) + cellX]++] = triangle;
+                }
+            }
+        }
+    });
+}
+
+void ProjectionPainter::projectDab(irr::video::IImage* brush, const irr::core::vector2di& position, const std::vector<irr::s32>& targets, const std::vector<irr::core::dimension2du>& targetSizes, std::vector<ProjectedTile>& tiles)
+{
+    tiles.clear();
+
+    if (!hasView || viewportSize.Width == 0 || viewportSize.Height == 0)
+    {
+        return;
+    }
+
+    auto dabRect = irr::core::recti(position, irr::core::dimension2di(brush->getDimension()));
+    dabRect.clipAgainst(irr::core::recti(0, 0, viewportSize.Width, viewportSize.Height));
+
+    if (dabRect.getArea() <= 0)
+    {
+        return;
+    }
+
+    irr::s32 dabCells[4] = {
+        dabRect.UpperLeftCorner.X / static_cast<irr::s32>(CELL_SIZE),
+        dabRect.UpperLeftCorner.Y / static_cast<irr::s32>(CELL_SIZE),
+        (dabRect.LowerRightCorner.X - 1) / static_cast<irr::s32>(CELL_SIZE),
+        (dabRect.LowerRightCorner.Y - 1) / static_cast<irr::s32>(CELL_SIZE)
+    };
+
+    // a triangle in several cells of the dab is only taken from the first of them
+    candidates.clear();
+
+    for (auto cellY = dabCells[1]; cellY <= dabCells[3]; ++cellY)
+    {
+        for (auto cellX = dabCells[0]; cellX <= dabCells[2]; ++cellX)
+        {
+            auto cell = (cellY * cellCountX) + cellX;
+
+            for (auto i = cellStarts[cell]; i < cellStarts[cell + 1]; ++i)
+            {
+                auto triangle = cellTriangles[i];
+                const auto& cells = triangleCells[triangle];
+
+                if (cellX == std::max(cells.x0, dabCells[0]) && cellY == std::max(cells.y0, dabCells[1]))
+                {
+                    candidates.push_back(triangle);
+                }
+            }
+        }
+    }
+
+    auto candidateCount = static_cast<irr::u32>(candidates.size());
+    auto taskCount = (candidateCount + TRIANGLES_PER_TASK - 1) / TRIANGLES_PER_TASK;
+
+    if (taskEntries.size() < taskCount)
+    {
+        taskEntries.resize(taskCount);
+    }
+
+    // every triangle is listed under each texture tile its texture coordinates reach
+    threadPool.parallelFor(taskCount, [&](std::size_t task) {
+        auto firstCandidate = static_cast<irr::u32>(task) * TRIANGLES_PER_TASK;
+        auto lastCandidate = std::min(firstCandidate + TRIANGLES_PER_TASK, candidateCount);
+        auto& taskTileEntries = taskEntries[task];
+
+        taskTileEntries.clear();
+
+        for (auto c = firstCandidate; c < lastCandidate; ++c)
+        {
+            auto triangle = candidates[c];
+            auto meshBuffer = triangleMeshBuffers[triangle];
+
+            if (meshBuffer >= targets.size() || targets[meshBuffer] < 0)
+            {
+                continue;
+            }
+
+            auto target = static_cast<irr::u32>(targets[meshBuffer]);
+            const auto& textureSize = targetSizes[target];
+
+            irr::f32 bounds[4];
+
+            if (textureSize.Width == 0 || textureSize.Height == 0 || !getScreenBounds(triangle, bounds))
+            {
+                continue;
+            }
+
+            if (bounds[2] < dabRect.UpperLeftCorner.X || bounds[0] >= dabRect.LowerRightCorner.X || bounds[3] < dabRect.UpperLeftCorner.Y || bounds[1] >= dabRect.LowerRightCorner.Y)
+            {
+                continue;
+            }
+
+            irr::f32 minX = std::numeric_limits<irr::f32>::max();
+            irr::f32 minY = minX;
+            irr::f32 maxX = -minX;
+            irr::f32 maxY = -minX;
+
+            for (irr::u32 corner = 0; corner < 3; ++corner)
+            {
+                const auto& uv = textureCoords[corners[(triangle * 3) + corner]];
+
+                minX = std::min(minX, uv.X * textureSize.Width);
+                minY = std::min(minY, uv.Y * textureSize.Height);
+                maxX = std::max(maxX, uv.X * textureSize.Width);
+                maxY = std::max(maxY, uv.Y * textureSize.Height);
+            }
+
+            auto x0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(minX)));
+            auto y0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(minY)));
+            auto x1 = std::min<irr::s32>(textureSize.Width - 1, static_cast<irr::s32>(std::floor(maxX)));
+            auto y1 = std::min<irr::s32>(textureSize.Height - 1, static_cast<irr::s32>(std::floor(maxY)));
+
+            for (auto tileY = y0 / static_cast<irr::s32>(TILE_SIZE); tileY <= y1 / static_cast<irr::s32>(TILE_SIZE); ++tileY)
+            {
+                for (auto tileX = x0 / static_cast<irr::s32>(TILE_SIZE); tileX <= x1 / static_cast<irr::s32>(TILE_SIZE); ++tileX)
+                {
+                    auto key = (static_cast<irr::u64>(target) << 40) | (static_cast<irr::u64>(tileY) << 20) | static_cast<irr::u64>(tileX);
+
+                    taskTileEntries.push_back(TileEntry { key, triangle });
+                }
+            }
+        }
+    });
+
+    entries.clear();
+
+    for (irr::u32 task = 0; task < taskCount; ++task)
+    {
+        entries.insert(entries.end(), taskEntries[task].begin(), taskEntries[task].end());
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    std::vector<irr::u32> tileStarts;
+
+    for (irr::u32 i = 0; i < entries.size(); ++i)
+    {
+        if (i == 0 || entries[i].key != entries[i - 1].key)
+        {
+            tileStarts.push_back(i);
+
+            ProjectedTile tile;
+            tile.target = static_cast<irr::u32>(entries[i].key >> 40);
+            tile.tileX = static_cast<irr::u32>(entries[i].key & 0xFFFFF);
+            tile.tileY = static_cast<irr::u32>((entries[i].key >> 20) & 0xFFFFF);
+
+            tiles.push_back(std::move(tile));
+        }
+    }
+
+    tileStarts.push_back(static_cast<irr::u32>(entries.size()));
+
+    auto brushTexels = static_cast<const irr::u8*>(brush->lock());
+    auto brushPitch = brush->getPitch();
+
+    threadPool.parallelFor(tiles.size(), [&](std::size_t t) {
+        auto& tile = tiles[t];
+
+        tile.coverage.assign(TILE_SIZE * TILE_SIZE, 0);
+
+        for (auto i = tileStarts[t]; i < tileStarts[t + 1]; ++i)
+        {
+            rasterizeTile(entries[i].triangle, targetSizes[tile.target], tile, brushTexels, brushPitch, position, dabRect);
+        }
+    });
+
+    brush->unlock();
+
+    // tiles the dab only grazed with texels it did not reach are of no use
+    tiles.erase(std::remove_if(tiles.begin(), tiles.end(), [](const ProjectedTile& tile) {
+        return std::all_of(tile.coverage.begin(), tile.coverage.end(), [](irr::u8 coverage) { return coverage == 0; });
+    }), tiles.end());
+}
+
+void ProjectionPainter::getTrianglesInPolygon(const std::vector<irr::core::vector2df>& polygon, std::vector<irr::u32>& triangles) const
+{
+    triangles.clear();
+
+    if (!hasView || polygon.size() < 3)
+    {
+        return;
+    }
+
+    irr::core::rectf bounds(polygon[0], polygon[0]);
+
+    for (const auto& point : polygon)
+    {
+        bounds.addInternalPoint(point);
+    }
+
+    auto triangleCount = static_cast<irr::u32>(triangleMeshBuffers.size());
+    auto taskCount = (triangleCount + TRIANGLES_PER_TASK - 1) / TRIANGLES_PER_TASK;
+
+    std::vector<std::vector<irr::u32>> taskTriangles(taskCount);
+
+    threadPool.parallelFor(taskCount, [&](std::size_t task) {
+        auto firstTriangle = static_cast<irr::u32>(task) * TRIANGLES_PER_TASK;
+        auto lastTriangle = std::min(firstTriangle + TRIANGLES_PER_TASK, triangleCount);
+
+        for (auto triangle = firstTriangle; triangle < lastTriangle; ++triangle)
+        {
+            // the centre of the triangle in clip space projects to the centre of the triangle on the screen
+            ClipVertex centre { 0.f, 0.f, 0.f };
+
+            for (irr::u32 corner = 0; corner < 3; ++corner)
+            {
+                const auto& vertex = clipVertices[corners[(triangle * 3) + corner]];
+
+                centre.x += vertex.x / 3.f;
+                centre.y += vertex.y / 3.f;
+                centre.w += vertex.w / 3.f;
+            }
+
+            irr::f32 x;
+            irr::f32 y;
+
+            if (!getScreenPosition(centre, x, y) || x < 0.f || y < 0.f || x >= viewportSize.Width || y >= viewportSize.Height)
+            {
+                continue;
+            }
+
+            if (!bounds.isPointInside(irr::core::vector2df(x, y)) || !isInsidePolygon(polygon, x, y))
+            {
+                continue;
+            }
+
+            auto nearest = getBitsFloat(depth[(static_cast<std::size_t>(y) * viewportSize.Width) + static_cast<std::size_t>(x)].load(std::memory_order_relaxed));
+
+            if (centre.w <= nearest * (1.f + DEPTH_TOLERANCE))
+            {
+                taskTriangles[task].push_back(triangle);
+            }
+        }
+    });
+
+    for (const auto& selected : taskTriangles)
+    {
+        triangles.insert(triangles.end(), selected.begin(), selected.end());
+    }
+}
+
+bool ProjectionPainter::getScreenPosition(const ClipVertex& vertex, irr::f32& x, irr::f32& y) const
+{
+    if (vertex.w < MINIMUM_W)
+    {
+        return false;
+    }
+
+    // the way the scene collision manager maps to the screen, with y pointing down
+    auto halfWidth = viewportSize.Width * 0.5f;
+    auto halfHeight = viewportSize.Height * 0.5f;
+
+    x = halfWidth + (halfWidth * (vertex.x / vertex.w));
+    y = halfHeight - (halfHeight * (vertex.y / vertex.w));
+
+    return true;
+}
+
+bool ProjectionPainter::getScreenBounds(irr::u32 triangle, irr::f32* bounds) const
+{
+    for (irr::u32 corner = 0; corner < 3; ++corner)
+    {
+        irr::f32 x;
+        irr::f32 y;
+
+        // triangles reaching behind the eye are not painted on, rather than clipped
+        if (!getScreenPosition(clipVertices[corners[(triangle * 3) + corner]], x, y))
+        {
+            return false;
+        }
+
+        if (corner == 0)
+        {
+            bounds[0] = bounds[2] = x;
+            bounds[1] = bounds[3] = y;
+        }
+        else
+        {
+            bounds[0] = std::min(bounds[0], x);
+            bounds[1] = std::min(bounds[1], y);
+            bounds[2] = std::max(bounds[2], x);
+            bounds[3] = std::max(bounds[3], y);
+        }
+    }
+
+    return true;
+}
+
+void ProjectionPainter::rasterizeDepth(irr::u32 triangle)
+{
+    irr::f32 x[3];
+    irr::f32 y[3];
+    irr::f32 inverseW[3];
+
+    for (irr::u32 corner = 0; corner < 3; ++corner)
+    {
+        const auto& vertex = clipVertices[corners[(triangle * 3) + corner]];
+
+        getScreenPosition(vertex, x[corner], y[corner]);
+        inverseW[corner] = 1.f / vertex.w;
+    }
+
+    auto area = getEdge(x[0], y[0], x[1], y[1], x[2], y[2]);
+
+    if (area == 0.f)
+    {
+        return;
+    }
+
+    auto inverseArea = 1.f / area;
+
+    auto x0 = std::max(0, static_cast<irr::s32>(std::floor(std::min({ x[0], x[1], x[2] }))));
+    auto y0 = std::max(0, static_cast<irr::s32>(std::floor(std::min({ y[0], y[1], y[2] }))));
+    auto x1 = std::min<irr::s32>(viewportSize.Width - 1, static_cast<irr::s32>(std::floor(std::max({ x[0], x[1], x[2] }))));
+    auto y1 = std::min<irr::s32>(viewportSize.Height - 1, static_cast<irr::s32>(std::floor(std::max({ y[0], y[1], y[2] }))));
+
+    for (auto py = y0; py <= y1; ++py)
+    {
+        for (auto px = x0; px <= x1; ++px)
+        {
+            auto centerX = px + 0.5f;
+            auto centerY = py + 0.5f;
+
+            auto weight0 = getEdge(x[1], y[1], x[2], y[2], centerX, centerY) * inverseArea;
+            auto weight1 = getEdge(x[2], y[2], x[0], y[0], centerX, centerY) * inverseArea;
+            auto weight2 = 1.f - weight0 - weight1;
+
+            if (weight0 < 0.f || weight1 < 0.f || weight2 < 0.f)
+            {
+                continue;
+            }
+
+            // 1 / w is linear on the screen, w itself is not
+            auto distance = 1.f / ((weight0 * inverseW[0]) + (weight1 * inverseW[1]) + (weight2 * inverseW[2]));
+            auto bits = getFloatBits(distance);
+
+            // positive floats order the same as their bits
+            auto& pixel = depth[(static_cast<std::size_t>(py) * viewportSize.Width) + px];
+            auto current = pixel.load(std::memory_order_relaxed);
+
+            while (bits < current && !pixel.compare_exchange_weak(current, bits, std::memory_order_relaxed))
+            {
+            }
+        }
+    }
+}
+
+void ProjectionPainter::rasterizeTile(irr::u32 triangle, const irr::core::dimension2du& textureSize, ProjectedTile& tile, const irr::u8* brush, irr::u32 brushPitch, const irr::core::vector2di& brushPosition, const irr::core::recti& dabRect) const
+{
+    irr::f32 u[3];
+    irr::f32 v[3];
+    ClipVertex clip[3];
+
+    for (irr::u32 corner = 0; corner < 3; ++corner)
+    {
+        auto vertex = corners[(triangle * 3) + corner];
+
+        u[corner] = textureCoords[vertex].X * textureSize.Width;
+        v[corner] = textureCoords[vertex].Y * textureSize.Height;
+        clip[corner] = clipVertices[vertex];
+    }
+
+    auto area = getEdge(u[0], v[0], u[1], v[1], u[2], v[2]);
+
+    if (std::fabs(area) < 1e-12f)
+    {
+        return;
+    }
+
+    auto inverseArea = 1.f / area;
+
+    auto tileLeft = static_cast<irr::s32>(tile.tileX * TILE_SIZE);
+    auto tileTop = static_cast<irr::s32>(tile.tileY * TILE_SIZE);
+
+    auto x0 = std::max(tileLeft, static_cast<irr::s32>(std::floor(std::min({ u[0], u[1], u[2] }))));
+    auto y0 = std::max(tileTop, static_cast<irr::s32>(std::floor(std::min({ v[0], v[1], v[2] }))));
+    auto x1 = std::min({ tileLeft + static_cast<irr::s32>(TILE_SIZE) - 1, static_cast<irr::s32>(textureSize.Width) - 1, static_cast<irr::s32>(std::floor(std::max({ u[0], u[1], u[2] }))) });
+    auto y1 = std::min({ tileTop + static_cast<irr::s32>(TILE_SIZE) - 1, static_cast<irr::s32>(textureSize.Height) - 1, static_cast<irr::s32>(std::floor(std::max({ v[0], v[1], v[2] }))) });
+
+    for (auto ty = y0; ty <= y1; ++ty)
+    {
+        auto coverageRow = tile.coverage.data() + ((ty - tileTop) * TILE_SIZE);
+
+        for (auto tx = x0; tx <= x1; ++tx)
+        {
+            auto centerU = tx + 0.5f;
+            auto centerV = ty + 0.5f;
+
+            auto weight0 = getEdge(u[1], v[1], u[2], v[2], centerU, centerV) * inverseArea;
+            auto weight1 = getEdge(u[2], v[2], u[0], v[0], centerU, centerV) * inverseArea;
+            auto weight2 = 1.f - weight0 - weight1;
+
+            if (weight0 < -EDGE_TOLERANCE || weight1 < -EDGE_TOLERANCE || weight2 < -EDGE_TOLERANCE)
+            {
+                continue;
+            }
+
+            // texture coordinates are linear on the triangle in space, so the weights carry over to its projection before the division
+            ClipVertex point = {
+                (weight0 * clip[0].x) + (weight1 * clip[1].x) + (weight2 * clip[2].x),
+                (weight0 * clip[0].y) + (weight1 * clip[1].y) + (weight2 * clip[2].y),
+                (weight0 * clip[0].w) + (weight1 * clip[1].w) + (weight2 * clip[2].w)
+            };
+
+            irr::f32 screenX;
+            irr::f32 screenY;
+
+            if (!getScreenPosition(point, screenX, screenY))
+            {
+                continue;
+            }
+
+            auto px = static_cast<irr::s32>(std::floor(screenX));
+            auto py = static_cast<irr::s32>(std::floor(screenY));
+
+            if (px < dabRect.UpperLeftCorner.X || py < dabRect.UpperLeftCorner.Y || px >= dabRect.LowerRightCorner.X || py >= dabRect.LowerRightCorner.Y)
+            {
+                continue;
+            }
+
+            auto nearest = getBitsFloat(depth[(static_cast<std::size_t>(py) * viewportSize.Width) + px].load(std::memory_order_relaxed));
+
+            if (point.w > nearest * (1.f + DEPTH_TOLERANCE))
+            {
+                continue;
+            }
+
+            auto brushRow = reinterpret_cast<const irr::u32*>(brush + ((py - brushPosition.Y) * brushPitch));
+            auto alpha = static_cast<irr::u8>(brushRow[px - brushPosition.X] >> 24);
+
+            auto& coverage = coverageRow[tx - tileLeft];
+            coverage = std::max(coverage, alpha);
+        }
+    }
+}
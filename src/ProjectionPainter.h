@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+
+//! The coverage a projected dab leaves in one tile of a texture, lined up with the tiles of its layers.
+struct ProjectedTile
+{
+    //! the target, as passed to projectDab, whose texture the tile belongs to
+    irr::u32 target;
+
+    irr::u32 tileX;
+    irr::u32 tileY;
+
+    //! one byte per texel, rows TILE_SIZE texels apart
+    std::vector<irr::u8> coverage;
+};
+
+//! Paints dabs defined on the screen onto every visible triangle under them, in the texture space of each triangle.
+/** For a view, the vertices are projected once, the triangles are rasterized into a depth buffer holding the distance of
+    the nearest surface at every pixel, and binned by the cells of the screen they overlap. A dab takes the triangles of
+    the cells it covers and rasterizes them in texture space. A texel gets the brush's alpha at the point its position on
+    the triangle projects to, unless the depth buffer has something nearer there.
+    The depth buffer, the bins and the sorting of triangles into texture tiles are split across triangles on the thread
+    pool; the texture tiles are then filled in parallel, each by one task, so no two threads write the same texel. */
+class ProjectionPainter
+{
+public:
+    static const irr::u32 TILE_SIZE = 64;
+
+    //! copies the positions and texture coordinates of the mesh, which may be released afterwards
+    ProjectionPainter(ThreadPool& threadPool, irr::scene::IMesh* mesh);
+
+    ProjectionPainter(const ProjectionPainter&) = delete;
+    ProjectionPainter& operator=(const ProjectionPainter&) = delete;
+
+    //! projects the mesh with the projection, view and world matrices combined, unless it already is
+    void setView(const irr::core::matrix4& transform, const irr::core::dimension2du& viewportSize);
+
+    //! the coverage of an A8R8G8B8 brush image with its top left corner at a position on the screen, by texture tile
+    /** targets holds the target of each mesh buffer, -1 for those not painted on, and targetSizes the texture size of
+        each target. Mesh buffers sharing a texture should share a target, so their coverage ends up in the same tiles. */
+    void projectDab(irr::video::IImage* brush, const irr::core::vector2di& position, const std::vector<irr::s32>& targets, const std::vector<irr::core::dimension2du>& targetSizes, std::vector<ProjectedTile>& tiles);
+
+    //! the triangles, numbered across the mesh buffers in order, whose centre is visible inside a polygon on the screen
+    void getTrianglesInPolygon(const std::vector<irr::core::vector2df>& polygon, std::vector<irr::u32>& triangles) const;
+
+private:
+    //! a vertex after the projection, before the division by w
+    struct ClipVertex
+    {
+        irr::f32 x;
+        irr::f32 y;
+        irr::f32 w;
+    };
+
+    //! the cells of the screen a triangle's bounding box overlaps, inclusive; empty if the triangle is not on screen
+    struct CellRect
+    {
+        irr::s32 x0;
+        irr::s32 y0;
+        irr::s32 x1;
+        irr::s32 y1;
+    };
+
+    //! a triangle which reaches a texture tile, by the target and the tile packed into one key
+    struct TileEntry
+    {
+        irr::u64 key;
+        irr::u32 triangle;
+
+        //! by tile, then by triangle, so a tile reads the mesh in order
+        bool operator<(const TileEntry& other) const
+        {
+            return key < other.key || (key == other.key && triangle < other.triangle);
+        }
+    };
+
+    //! where a projected point is on the screen, false if it is behind the eye
+    bool getScreenPosition(const ClipVertex& vertex, irr::f32& x, irr::f32& y) const;
+
+    //! the screen bounding box of a triangle, false if a corner is behind the eye
+    bool getScreenBounds(irr::u32 triangle, irr::f32* bounds) const;
+
+    void rasterizeDepth(irr::u32 triangle);
+
+    //! adds the coverage of a triangle in one tile of its target's texture
+    void rasterizeTile(irr::u32 triangle, const irr::core::dimension2du& textureSize, ProjectedTile& tile, const irr::u8* brush, irr::u32 brushPitch, const irr::core::vector2di& brushPosition, const irr::core::recti& dabRect) const;
+
+    ThreadPool& threadPool;
+
+    std::vector<irr::core::vector3df> positions;
+    std::vector<irr::core::vector2df> textureCoords;
+
+    //! three vertices per triangle, and the mesh buffer each triangle came from
+    std::vector<irr::u32> corners;
+    std::vector<irr::u32> triangleMeshBuffers;
+
+    bool hasView;
+    irr::core::matrix4 transform;
+    irr::core::dimension2du viewportSize;
+
+    std::vector<ClipVertex> clipVertices;
+
+    //! the distance of the nearest surface at each pixel, as the bits of a float so it can be lowered atomically
+    std::unique_ptr<std::atomic<irr::u32>[]> depth;
+
+    irr::u32 cellCountX;
+    irr::u32 cellCountY;
+
+    std::vector<CellRect> triangleCells;
+
+    //! the triangles of cell c are cellTriangles[cellStarts[c]] up to cellStarts[c + 1]
+    std::vector<irr::u32> cellStarts;
+    std::vector<irr::u32> cellTriangles;
+
+    //! kept allocated from one dab to the next
+    std::vector<irr::u32> candidates;
+    std::vector<std::vector<TileEntry>> taskEntries;
+    std::vector<TileEntry> entries;
+};
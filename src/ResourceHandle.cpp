@@ -0,0 +1,150 @@
+#include "ResourceHandle.h"
+
+#include <atomic>
+
+namespace {
+    const std::size_t CATEGORY_COUNT = static_cast<std::size_t>(ResourceCategory::Count);
+
+    std::atomic<irr::u32> resourceCounts[CATEGORY_COUNT];
+    std::atomic<std::size_t> resourceBytes[CATEGORY_COUNT];
+
+    std::size_t getTextureBytes(const irr::video::ITexture* texture)
+    {
+        auto bytes = static_cast<std::size_t>(texture->getPitch()) * texture->getSize().Height;
+
+        // a full mip chain adds a third
+        return texture->hasMipMaps() ? bytes + (bytes / 3) : bytes;
+    }
+}
+
+ResourceUsage getResourceUsage(ResourceCategory category)
+{
+    auto index = static_cast<std::size_t>(category);
+
+    return ResourceUsage { resourceCounts[index].load(), resourceBytes[index].load() };
+}
+
+void trackResource(ResourceCategory category, std::size_t bytes)
+{
+    auto index = static_cast<std::size_t>(category);
+
+    ++resourceCounts[index];
+    resourceBytes[index] += bytes;
+}
+
+void untrackResource(ResourceCategory category, std::size_t bytes)
+{
+    auto index = static_cast<std::size_t>(category);
+
+    --resourceCounts[index];
+    resourceBytes[index] -= bytes;
+}
+
+ResourceCategory getResourceCategory(const irr::video::IImage* /*image*/)
+{
+    return ResourceCategory::CpuImages;
+}
+
+ResourceCategory getResourceCategory(const irr::scene::IMesh* /*mesh*/)
+{
+    return ResourceCategory::MeshData;
+}
+
+ResourceCategory getResourceCategory(const irr::scene::ITriangleSelector* /*selector*/)
+{
+    return ResourceCategory::MeshData;
+}
+
+std::size_t getResourceBytes(const irr::video::IImage* image)
+{
+    return image->getImageDataSizeInBytes();
+}
+
+std::size_t getResourceBytes(const irr::scene::IMesh* mesh)
+{
+    std::size_t bytes = 0;
+
+    for (irr::u32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+    {
+        auto meshBuffer = mesh->getMeshBuffer(i);
+
+        bytes += static_cast<std::size_t>(meshBuffer->getVertexCount()) * irr::video::getVertexPitchFromType(meshBuffer->getVertexType());
+        bytes += static_cast<std::size_t>(meshBuffer->getIndexCount()) * (meshBuffer->getIndexType() == irr::video::EIT_16BIT ? 2 : 4);
+    }
+
+    return bytes;
+}
+
+std::size_t getResourceBytes(const irr::scene::ITriangleSelector* selector)
+{
+    return static_cast<std::size_t>(selector->getTriangleCount()) * sizeof(irr::core::triangle3df);
+}
+
+TextureHandle::TextureHandle() : driver(nullptr), texture(nullptr), trackedBytes(0)
+{
+}
+
+TextureHandle::TextureHandle(irr::video::IVideoDriver* _driver, irr::video::ITexture* _texture) :
+    driver(_driver),
+    texture(_texture),
+    trackedBytes(0)
+{
+    if (texture != nullptr)
+    {
+        trackedBytes = getTextureBytes(texture);
+        trackResource(ResourceCategory::GpuTextures, trackedBytes);
+    }
+}
+
+TextureHandle::~TextureHandle()
+{
+    reset();
+}
+
+TextureHandle::TextureHandle(TextureHandle&& other) : driver(other.driver), texture(other.texture), trackedBytes(other.trackedBytes)
+{
+    other.texture = nullptr;
+}
+
+TextureHandle& TextureHandle::operator=(TextureHandle&& other)
+{
+    if (this != &other)
+    {
+        reset();
+
+        std::swap(driver, other.driver);
+        std::swap(texture, other.texture);
+        std::swap(trackedBytes, other.trackedBytes);
+    }
+
+    return *this;
+}
+
+void TextureHandle::reset()
+{
+    if (texture == nullptr)
+    {
+        return;
+    }
+
+    untrackResource(ResourceCategory::GpuTextures, trackedBytes);
+
+    driver->removeTexture(texture);
+
+    texture = nullptr;
+}
+
+irr::video::ITexture* TextureHandle::get() const
+{
+    return texture;
+}
+
+irr::video::ITexture* TextureHandle::operator->() const
+{
+    return texture;
+}
+
+TextureHandle::operator bool() const
+{
+    return texture != nullptr;
+}
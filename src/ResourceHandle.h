@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+#include <irrlicht/irrlicht.h>
+
+enum class ResourceCategory
+{
+    //! decoded and painted images in main memory
+    CpuImages,
+    //! textures the driver holds on the GPU
+    GpuTextures,
+    //! vertices and indices of meshes, and the triangles of selectors built from them
+    MeshData,
+    Count
+};
+
+//! what the handles of one category hold right now
+struct ResourceUsage
+{
+    irr::u32 count;
+    std::size_t bytes;
+};
+
+//! the resources held by handles of a category, counted when a handle takes one over and when it lets go of it
+/** Safe to call from any thread, like the handles themselves. */
+ResourceUsage getResourceUsage(ResourceCategory category);
+
+void trackResource(ResourceCategory category, std::size_t bytes);
+
+void untrackResource(ResourceCategory category, std::size_t bytes);
+
+ResourceCategory getResourceCategory(const irr::video::IImage* image);
+ResourceCategory getResourceCategory(const irr::scene::IMesh* mesh);
+ResourceCategory getResourceCategory(const irr::scene::ITriangleSelector* selector);
+
+std::size_t getResourceBytes(const irr::video::IImage* image);
+std::size_t getResourceBytes(const irr::scene::IMesh* mesh);
+std::size_t getResourceBytes(const irr::scene::ITriangleSelector* selector);
+
+//! Holds one reference to a reference counted Irrlicht object and drops it when released.
+/** A handle made from a pointer takes over the reference the pointer came with, as returned by the create functions, and
+    counts the object in its category. A handle made by share grabs a reference of its own to an object someone else created,
+    and does not count it again. */
+template <typename T>
+class ResourceHandle
+{
+public:
+    ResourceHandle() : object(nullptr), trackedBytes(0), isTracked(false)
+    {
+    }
+
+    explicit ResourceHandle(T* _object) : object(_object), trackedBytes(0), isTracked(_object != nullptr)
+    {
+        if (isTracked)
+        {
+            trackedBytes = getResourceBytes(object);
+            trackResource(getResourceCategory(object), trackedBytes);
+        }
+    }
+
+    static ResourceHandle share(T* object)
+    {
+        ResourceHandle handle;
+
+        if (object != nullptr)
+        {
+            object->grab();
+            handle.object = object;
+        }
+
+        return handle;
+    }
+
+    ~ResourceHandle()
+    {
+        reset();
+    }
+
+    ResourceHandle(const ResourceHandle&) = delete;
+    ResourceHandle& operator=(const ResourceHandle&) = delete;
+
+    ResourceHandle(ResourceHandle&& other) : object(other.object), trackedBytes(other.trackedBytes), isTracked(other.isTracked)
+    {
+        other.object = nullptr;
+        other.isTracked = false;
+    }
+
+    ResourceHandle& operator=(ResourceHandle&& other)
+    {
+        if (this != &other)
+        {
+            reset();
+
+            std::swap(object, other.object);
+            std::swap(trackedBytes, other.trackedBytes);
+            std::swap(isTracked, other.isTracked);
+        }
+
+        return *this;
+    }
+
+    void reset()
+    {
+        if (object == nullptr)
+        {
+            return;
+        }
+
+        if (isTracked)
+        {
+            untrackResource(getResourceCategory(object), trackedBytes);
+        }
+
+        object->drop();
+
+        object = nullptr;
+        isTracked = false;
+    }
+
+    T* get() const
+    {
+        return object;
+    }
+
+    T* operator->() const
+    {
+        return object;
+    }
+
+    explicit operator bool() const
+    {
+        return object != nullptr;
+    }
+
+private:
+    T* object;
+
+    //! what was counted when the handle took the object over, since a mesh may have grown by the time it is released
+    std::size_t trackedBytes;
+    bool isTracked;
+};
+
+//! Owns a texture in a driver's texture cache and removes it from the cache when released.
+/** Dropping a texture is not enough to free it, the cache keeps it alive until it is removed. Other holders of a reference,
+    such as GUI images, keep it alive until they let go. */
+class TextureHandle
+{
+public:
+    TextureHandle();
+
+    TextureHandle(irr::video::IVideoDriver* driver, irr::video::ITexture* texture);
+
+    ~TextureHandle();
+
+    TextureHandle(const TextureHandle&) = delete;
+    TextureHandle& operator=(const TextureHandle&) = delete;
+
+    TextureHandle(TextureHandle&& other);
+    TextureHandle& operator=(TextureHandle&& other);
+
+    void reset();
+
+    irr::video::ITexture* get() const;
+
+    irr::video::ITexture* operator->() const;
+
+    explicit operator bool() const;
+
+private:
+    irr::video::IVideoDriver* driver;
+    irr::video::ITexture* texture;
+
+    std::size_t trackedBytes;
+};
@@ -0,0 +1,361 @@
+#include "Stencil.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FaceSelection.h"
+#include "LayerStack.h"
+#include "ResourceHandle.h"
+#include "ThreadPool.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STENCIL_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+    const irr::f32 INV_255 = 1.f / 255.f;
+
+    //! levels stop halving once they get this small either way
+    const irr::u32 MIN_LEVEL_SIZE = 8;
+
+    //! what a texel off the edge of a level reads as
+    const irr::f32 TRANSPARENT_TEXEL[4] = { 0.f, 0.f, 0.f, 0.f };
+
+    //! the Catmull-Rom weights of the four texels around a position t of the way from the second to the third
+    void getCubicWeights(irr::f32 t, irr::f32* weights)
+    {
+        weights[0] = ((-0.5f * t + 1.f) * t - 0.5f) * t;
+        weights[1] = ((1.5f * t - 2.5f) * t * t) + 1.f;
+        weights[2] = ((-1.5f * t + 2.f) * t + 0.5f) * t;
+        weights[3] = (0.5f * t - 0.5f) * t * t;
+    }
+
+    //! clamps a premultiplied color the overshoot of the cubic took out of range, and packs it as non-premultiplied A8R8G8B8
+    irr::u32 unpremultiply(const irr::f32* color)
+    {
+        auto alpha = std::min(std::max(color[3], 0.f), 255.f);
+
+        if (alpha < 0.5f)
+        {
+            return 0;
+        }
+
+        auto scale = 255.f / alpha;
+
+        auto toByte = [scale](irr::f32 value) {
+            return static_cast<irr::u32>(std::min(std::max(value * scale, 0.f), 255.f) + 0.5f);
+        };
+
+        return (static_cast<irr::u32>(alpha + 0.5f) << 24) | (toByte(color[2]) << 16) | (toByte(color[1]) << 8) | toByte(color[0]);
+    }
+}
+
+Stencil::Stencil(irr::video::IVideoDriver* driver, irr::video::IImage* image) :
+    trackedBytes(0)
+{
+    auto converted = ResourceHandle<irr::video::IImage>(driver->createImage(irr::video::ECF_A8R8G8B8, image));
+
+    Level level;
+    level.size = converted->getDimension();
+    level.colors.resize(static_cast<std::size_t>(level.size.Width) * level.size.Height * 4);
+
+    auto texels = static_cast<const irr::u8*>(converted->lock());
+
+    for (irr::u32 y = 0; y < level.size.Height; ++y)
+    {
+        auto row = reinterpret_cast<const irr::u32*>(texels + (y * converted->getPitch()));
+        auto colors = level.colors.data() + (static_cast<std::size_t>(y) * level.size.Width * 4);
+
+        for (irr::u32 x = 0; x < level.size.Width; ++x)
+        {
+            auto alpha = static_cast<irr::f32>(row[x] >> 24);
+            auto scale = alpha * INV_255;
+
+            colors[(x * 4)] = (row[x] & 0xFF) * scale;
+            colors[(x * 4) + 1] = ((row[x] >> 8) & 0xFF) * scale;
+            colors[(x * 4) + 2] = ((row[x] >> 16) & 0xFF) * scale;
+            colors[(x * 4) + 3] = alpha;
+        }
+    }
+
+    converted->unlock();
+
+    levels.push_back(std::move(level));
+
+    // every level averages two by two texels of the one before; premultiplied, so transparent texels do not darken the edges
+    while (levels.back().size.Width >= MIN_LEVEL_SIZE * 2 && levels.back().size.Height >= MIN_LEVEL_SIZE * 2)
+    {
+        const auto& previous = levels.back();
+
+        Level halved;
+        halved.size = irr::core::dimension2du(previous.size.Width / 2, previous.size.Height / 2);
+        halved.colors.resize(static_cast<std::size_t>(halved.size.Width) * halved.size.Height * 4);
+
+        for (irr::u32 y = 0; y < halved.size.Height; ++y)
+        {
+            auto top = previous.colors.data() + (static_cast<std::size_t>(y * 2) * previous.size.Width * 4);
+            auto bottom = top + (previous.size.Width * 4);
+            auto colors = halved.colors.data() + (static_cast<std::size_t>(y) * halved.size.Width * 4);
+
+            for (irr::u32 x = 0; x < halved.size.Width * 4; ++x)
+            {
+                auto sourceX = ((x / 4) * 8) + (x % 4);
+
+                colors[x] = (top[sourceX] + top[sourceX + 4] + bottom[sourceX] + bottom[sourceX + 4]) * 0.25f;
+            }
+        }
+
+        levels.push_back(std::move(halved));
+    }
+
+    for (const auto& stencilLevel : levels)
+    {
+        trackedBytes += stencilLevel.colors.size() * sizeof(irr::f32);
+    }
+
+    trackResource(ResourceCategory::CpuImages, trackedBytes);
+}
+
+Stencil::~Stencil()
+{
+    untrackResource(ResourceCategory::CpuImages, trackedBytes);
+}
+
+const irr::core::dimension2du& Stencil::getSize() const
+{
+    return levels.front().size;
+}
+
+std::shared_ptr<const StencilImage> Stencil::getResampled(ThreadPool& threadPool, irr::f32 scale, irr::f32 rotation)
+{
+    auto cached = std::find_if(cache.begin(), cache.end(), [scale, rotation](const CacheEntry& entry) {
+        return entry.scale == scale && entry.rotation == rotation;
+    });
+
+    if (cached != cache.end())
+    {
+        auto entry = *cached;
+
+        cache.erase(cached);
+        cache.push_front(entry);
+
+        return entry.image;
+    }
+
+    auto image = resample(threadPool, scale, rotation);
+
+    if (cache.size() == CACHE_SIZE)
+    {
+        auto evictedBytes = cache.back().image->texels.size() * sizeof(irr::u32);
+
+        untrackResource(ResourceCategory::CpuImages, evictedBytes);
+        trackedBytes -= evictedBytes;
+
+        cache.pop_back();
+    }
+
+    auto addedBytes = image->texels.size() * sizeof(irr::u32);
+
+    trackResource(ResourceCategory::CpuImages, addedBytes);
+    trackedBytes += addedBytes;
+
+    cache.push_front(CacheEntry { scale, rotation, image });
+
+    return image;
+}
+
+std::shared_ptr<const StencilImage> Stencil::resample(ThreadPool& threadPool, irr::f32 scale, irr::f32 rotation) const
+{
+    const auto& size = getSize();
+
+    auto radians = rotation * irr::core::DEGTORAD;
+    auto cosine = std::cos(radians);
+    auto sine = std::sin(radians);
+
+    // the bounding box of the scaled and rotated stencil, shrunk to fit if need be
+    auto boxWidth = scale * ((size.Width * std::abs(cosine)) + (size.Height * std::abs(sine)));
+    auto boxHeight = scale * ((size.Width * std::abs(sine)) + (size.Height * std::abs(cosine)));
+
+    auto largestSide = std::max(boxWidth, boxHeight);
+
+    if (largestSide > MAX_RESAMPLED_SIZE)
+    {
+        scale *= MAX_RESAMPLED_SIZE / largestSide;
+        boxWidth *= MAX_RESAMPLED_SIZE / largestSide;
+        boxHeight *= MAX_RESAMPLED_SIZE / largestSide;
+    }
+
+    // a right angle leaves the sine or the cosine a rounding error off zero, which is not worth a column or row of its own
+    const auto SIZE_TOLERANCE = 1e-3f;
+
+    auto image = std::make_shared<StencilImage>();
+    image->size = irr::core::dimension2du(
+        std::max(1u, static_cast<irr::u32>(std::ceil(boxWidth - SIZE_TOLERANCE))),
+        std::max(1u, static_cast<irr::u32>(std::ceil(boxHeight - SIZE_TOLERANCE)))
+    );
+    image->texels.resize(static_cast<std::size_t>(image->size.Width) * image->size.Height);
+
+    // the level read is the smallest at least as large as the stencil comes out, so the cubic never shrinks by more than half
+    irr::u32 levelIndex = 0;
+    auto levelScale = scale;
+
+    while (levelScale < 0.5f && levelIndex + 1 < levels.size())
+    {
+        ++levelIndex;
+        levelScale *= 2.f;
+    }
+
+    const auto& level = levels[levelIndex];
+
+    auto levelWidth = static_cast<irr::s32>(level.size.Width);
+    auto levelHeight = static_cast<irr::s32>(level.size.Height);
+
+    auto centreX = image->size.Width * 0.5f;
+    auto centreY = image->size.Height * 0.5f;
+
+    threadPool.parallelFor(image->size.Height, [&](std::size_t y) {
+        auto row = image->texels.data() + (y * image->size.Width);
+
+        for (irr::u32 x = 0; x < image->size.Width; ++x)
+        {
+            // the centre of the output texel, rotated back and scaled into the level
+            auto offsetX = (x + 0.5f) - centreX;
+            auto offsetY = (y + 0.5f) - centreY;
+
+            auto sourceX = (((cosine * offsetX) + (sine * offsetY)) / levelScale) + (level.size.Width * 0.5f) - 0.5f;
+            auto sourceY = (((cosine * offsetY) - (sine * offsetX)) / levelScale) + (level.size.Height * 0.5f) - 0.5f;
+
+            auto texelX = static_cast<irr::s32>(std::floor(sourceX));
+            auto texelY = static_cast<irr::s32>(std::floor(sourceY));
+
+            // the corners of the bounding box lie outside the stencil
+            if (texelX < -2 || texelY < -2 || texelX > levelWidth || texelY > levelHeight)
+            {
+                row[x] = 0;
+                continue;
+            }
+
+            irr::f32 weightsX[4];
+            irr::f32 weightsY[4];
+
+            getCubicWeights(sourceX - texelX, weightsX);
+            getCubicWeights(sourceY - texelY, weightsY);
+
+            const irr::f32* taps[4][4];
+
+            for (irr::s32 j = 0; j < 4; ++j)
+            {
+                auto tapY = texelY - 1 + j;
+
+                for (irr::s32 i = 0; i < 4; ++i)
+                {
+                    auto tapX = texelX - 1 + i;
+
+                    taps[j][i] = tapX >= 0 && tapY >= 0 && tapX < levelWidth && tapY < levelHeight
+                        ? level.colors.data() + (((static_cast<std::size_t>(tapY) * level.size.Width) + tapX) * 4)
+                        : TRANSPARENT_TEXEL;
+                }
+            }
+
+            irr::f32 color[4];
+
+#if defined(STENCIL_SSE2)
+            auto sum = _mm_setzero_ps();
+
+            for (irr::u32 j = 0; j < 4; ++j)
+            {
+                auto rowSum = _mm_mul_ps(_mm_set1_ps(weightsX[0]), _mm_loadu_ps(taps[j][0]));
+
+                for (irr::u32 i = 1; i < 4; ++i)
+                {
+                    rowSum = _mm_add_ps(rowSum, _mm_mul_ps(_mm_set1_ps(weightsX[i]), _mm_loadu_ps(taps[j][i])));
+                }
+
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weightsY[j]), rowSum));
+            }
+
+            _mm_storeu_ps(color, sum);
+#else
+            std::fill(color, color + 4, 0.f);
+
+            for (irr::u32 j = 0; j < 4; ++j)
+            {
+                for (irr::u32 i = 0; i < 4; ++i)
+                {
+                    for (irr::u32 c = 0; c < 4; ++c)
+                    {
+                        color[c] += weightsY[j] * weightsX[i] * taps[j][i][c];
+                    }
+                }
+            }
+#endif
+
+            row[x] = unpremultiply(color);
+        }
+    });
+
+    return image;
+}
+
+irr::core::recti stampStencil(ThreadPool& threadPool, Layer& layer, const StencilImage& image, const irr::core::vector2di& position, irr::f32 opacity, const TexelMask* mask)
+{
+    const auto& layerSize = layer.getSize();
+
+    auto stampRect = irr::core::recti(position, image.size);
+    stampRect.clipAgainst(irr::core::recti(0, 0, layerSize.Width, layerSize.Height));
+
+    if (stampRect.getArea() == 0)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    // one task per row of tiles, since spans of different tiles are all that may be blended at the same time
+    auto firstBand = stampRect.UpperLeftCorner.Y / static_cast<irr::s32>(Layer::TILE_SIZE);
+    auto lastBand = (stampRect.LowerRightCorner.Y - 1) / static_cast<irr::s32>(Layer::TILE_SIZE);
+
+    threadPool.parallelFor(lastBand - firstBand + 1, [&](std::size_t band) {
+        auto bandTop = std::max<irr::s32>(stampRect.UpperLeftCorner.Y, (firstBand + static_cast<irr::s32>(band)) * Layer::TILE_SIZE);
+        auto bandBottom = std::min<irr::s32>(stampRect.LowerRightCorner.Y, (firstBand + static_cast<irr::s32>(band) + 1) * Layer::TILE_SIZE);
+
+        irr::u32 texels[Layer::TILE_SIZE];
+
+        for (auto y = bandTop; y < bandBottom; ++y)
+        {
+            auto imageRow = image.texels.data() + (static_cast<std::size_t>(y - position.Y) * image.size.Width);
+
+            auto x = stampRect.UpperLeftCorner.X;
+
+            while (x < stampRect.LowerRightCorner.X)
+            {
+                auto count = std::min<irr::s32>(stampRect.LowerRightCorner.X - x, Layer::TILE_SIZE - (x % Layer::TILE_SIZE));
+
+                auto hasCoverage = false;
+
+                for (irr::s32 i = 0; i < count; ++i)
+                {
+                    auto layerX = x + i;
+
+                    texels[i] = imageRow[layerX - position.X];
+
+                    if (mask != nullptr && (mask->getRow(layerX / TexelMask::TILE_SIZE, y / TexelMask::TILE_SIZE, y % TexelMask::TILE_SIZE) & (1ull << (layerX % TexelMask::TILE_SIZE))) == 0)
+                    {
+                        texels[i] &= 0x00FFFFFF;
+                    }
+
+                    hasCoverage = hasCoverage || (texels[i] >> 24) != 0;
+                }
+
+                // a span the stencil leaves clear would only allocate a tile for nothing
+                if (hasCoverage)
+                {
+                    layer.blendSpan(x, y, texels, count, BlendMode::Normal, opacity);
+                }
+
+                x += count;
+            }
+        }
+    });
+
+    return stampRect;
+}
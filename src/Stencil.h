@@ -0,0 +1,77 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class Layer;
+class TexelMask;
+class ThreadPool;
+
+//! A stencil resampled for one scale and rotation, as non-premultiplied A8R8G8B8 texels row after row.
+struct StencilImage
+{
+    irr::core::dimension2du size;
+
+    std::vector<irr::u32> texels;
+};
+
+//! A reference image, such as a logo or a detail of a photo, laid onto a texture as a decal.
+/** The image is kept as premultiplied floats in levels of halving size, so a shrunken stencil is resampled from a level no more
+    than twice as large as it comes out, and does not alias. Resampling is bicubic, with the four channels of a texel weighed at
+    once. The last few resamplings are kept by scale and rotation, so moving the stencil around the model only blends it again. */
+class Stencil
+{
+public:
+    //! resamplings kept, most recently used first
+    static const irr::u32 CACHE_SIZE = 4;
+
+    //! a resampling larger than this either way is scaled down to fit
+    static const irr::u32 MAX_RESAMPLED_SIZE = 4096;
+
+    //! takes an image of any format the driver can convert to A8R8G8B8
+    Stencil(irr::video::IVideoDriver* driver, irr::video::IImage* image);
+
+    ~Stencil();
+
+    Stencil(const Stencil&) = delete;
+    Stencil& operator=(const Stencil&) = delete;
+
+    const irr::core::dimension2du& getSize() const;
+
+    //! the stencil scaled and rotated clockwise by degrees about its centre, in an image just large enough to hold it
+    /** Only resampled if the scale and rotation are not among the cached ones; the image stays valid while it is held. */
+    std::shared_ptr<const StencilImage> getResampled(ThreadPool& threadPool, irr::f32 scale, irr::f32 rotation);
+
+private:
+    //! four premultiplied floats per texel
+    struct Level
+    {
+        irr::core::dimension2du size;
+
+        std::vector<irr::f32> colors;
+    };
+
+    struct CacheEntry
+    {
+        irr::f32 scale;
+        irr::f32 rotation;
+
+        std::shared_ptr<const StencilImage> image;
+    };
+
+    std::shared_ptr<const StencilImage> resample(ThreadPool& threadPool, irr::f32 scale, irr::f32 rotation) const;
+
+    std::vector<Level> levels;
+
+    std::deque<CacheEntry> cache;
+
+    //! bytes counted as CPU images for the levels and the cached resamplings
+    std::size_t trackedBytes;
+};
+
+//! blends a resampled stencil into a layer with its top left corner at a position, using the blend kernels
+/** Texels outside the mask, if there is one, are left as they are. Returns the rectangle painted into. */
+irr::core::recti stampStencil(ThreadPool& threadPool, Layer& layer, const StencilImage& image, const irr::core::vector2di& position, irr::f32 opacity, const TexelMask* mask);
@@ -0,0 +1,153 @@
+#include "StrokeBuffer.h"
+
+#include <algorithm>
+
+#include "FaceSelection.h"
+
+static_assert(StrokeBuffer::TILE_SIZE == TexelMask::TILE_SIZE, "stroke tiles have to line up with mask tiles");
+
+StrokeBuffer::StrokeBuffer(const irr::core::dimension2du& _size, irr::f32 _opacity, BlendMode _blendMode, const TexelMask* _mask) :
+    size(_size),
+    opacity(_opacity),
+    blendMode(_blendMode),
+    mask(_mask),
+    tileCountX((_size.Width + TILE_SIZE - 1) / TILE_SIZE),
+    rect(0, 0, 0, 0)
+{
+    tiles.resize(tileCountX * ((_size.Height + TILE_SIZE - 1) / TILE_SIZE));
+}
+
+irr::f32 StrokeBuffer::getOpacity() const
+{
+    return opacity;
+}
+
+BlendMode StrokeBuffer::getBlendMode() const
+{
+    return blendMode;
+}
+
+irr::core::recti StrokeBuffer::addDab(irr::video::IImage* brush, const irr::core::vector2di& position)
+{
+    const auto& brushSize = brush->getDimension();
+
+    auto x0 = std::max(0, position.X);
+    auto y0 = std::max(0, position.Y);
+    auto x1 = std::min<irr::s32>(size.Width, position.X + static_cast<irr::s32>(brushSize.Width));
+    auto y1 = std::min<irr::s32>(size.Height, position.Y + static_cast<irr::s32>(brushSize.Height));
+
+    if (x0 >= x1 || y0 >= y1)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    auto texels = static_cast<const irr::u8*>(brush->lock());
+    auto pitch = brush->getPitch();
+
+    for (auto y = y0; y < y1; ++y)
+    {
+        auto brushRow = reinterpret_cast<const irr::u32*>(texels + ((y - position.Y) * pitch));
+
+        for (auto x = x0; x < x1;)
+        {
+            auto tileEnd = std::min<irr::s32>(((x / TILE_SIZE) + 1) * TILE_SIZE, x1);
+
+            auto& tile = tiles[((y / TILE_SIZE) * tileCountX) + (x / TILE_SIZE)];
+
+            if (tile == nullptr)
+            {
+                tile.reset(new irr::u8[TILE_SIZE * TILE_SIZE]());
+            }
+
+            auto coverage = tile.get() + ((y % TILE_SIZE) * TILE_SIZE);
+            auto maskRow = mask != nullptr ? mask->getRow(x / TILE_SIZE, y / TILE_SIZE, y % TILE_SIZE) : ~0ull;
+
+            for (; x < tileEnd; ++x)
+            {
+                auto& texelCoverage = coverage[x % TILE_SIZE];
+
+                auto brushCoverage = (maskRow & (1ull << (x % TILE_SIZE))) != 0 ? static_cast<irr::u8>(brushRow[x - position.X] >> 24) : 0;
+
+                texelCoverage = std::max<irr::u8>(texelCoverage, brushCoverage);
+            }
+        }
+    }
+
+    brush->unlock();
+
+    irr::core::recti dabRect(x0, y0, x1, y1);
+    addRect(dabRect);
+
+    return dabRect;
+}
+
+irr::core::recti StrokeBuffer::addCoverage(irr::u32 tileX, irr::u32 tileY, const irr::u8* coverage)
+{
+    auto x0 = tileX * TILE_SIZE;
+    auto y0 = tileY * TILE_SIZE;
+
+    if (x0 >= size.Width || y0 >= size.Height)
+    {
+        return irr::core::recti(0, 0, 0, 0);
+    }
+
+    auto& tile = tiles[(tileY * tileCountX) + tileX];
+
+    if (tile == nullptr)
+    {
+        tile.reset(new irr::u8[TILE_SIZE * TILE_SIZE]());
+    }
+
+    for (irr::u32 y = 0; y < TILE_SIZE; ++y)
+    {
+        auto maskRow = mask != nullptr ? mask->getRow(tileX, tileY, y) : ~0ull;
+
+        for (irr::u32 x = 0; x < TILE_SIZE; ++x)
+        {
+            auto i = (y * TILE_SIZE) + x;
+
+            if ((maskRow & (1ull << x)) != 0)
+            {
+                tile[i] = std::max(tile[i], coverage[i]);
+            }
+        }
+    }
+
+    irr::core::recti tileRect(x0, y0, std::min(x0 + TILE_SIZE, size.Width), std::min(y0 + TILE_SIZE, size.Height));
+    addRect(tileRect);
+
+    return tileRect;
+}
+
+const irr::u8* StrokeBuffer::getTile(irr::u32 tileX, irr::u32 tileY) const
+{
+    return tiles[(tileY * tileCountX) + tileX].get();
+}
+
+void StrokeBuffer::getTexels(irr::u32 tileX, irr::u32 tileY, irr::u32 y, irr::u32 color, irr::u32* texels, irr::u32 count) const
+{
+    auto coverage = getTile(tileX, tileY) + (y * TILE_SIZE);
+
+    for (irr::u32 i = 0; i < count; ++i)
+    {
+        texels[i] = (static_cast<irr::u32>(coverage[i]) << 24) | color;
+    }
+}
+
+const irr::core::recti& StrokeBuffer::getRect() const
+{
+    return rect;
+}
+
+void StrokeBuffer::addRect(const irr::core::recti& dabRect)
+{
+    if (rect.getArea() == 0)
+    {
+        rect = dabRect;
+    }
+    else
+    {
+        rect.addInternalPoint(dabRect.UpperLeftCorner);
+        rect.addInternalPoint(dabRect.LowerRightCorner);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "BlendKernels.h"
+
+class TexelMask;
+
+//! The coverage of the stroke being painted, one byte per texel, in tiles which are only allocated once a dab reaches them.
+/** Dabs keep the larger of the stored coverage and their own, so overlapping dabs of one stroke do not build up.
+    The stroke is blended into its layer once, at its own opacity, when it ends; until then the layer stack composites it on the fly.
+    The coverage holds no color, so the layer stacks of several channels can share one stroke, each with a color of its own.
+    Texels outside the mask of the selected faces, if there is one, take no coverage, so no channel sharing the stroke gets any. */
+class StrokeBuffer
+{
+public:
+    //! tiles line up with the tiles of the layers
+    static const irr::u32 TILE_SIZE = 64;
+
+    //! mask may be nullptr to paint anywhere; it has to stay alive as long as the stroke
+    StrokeBuffer(const irr::core::dimension2du& size, irr::f32 opacity, BlendMode blendMode, const TexelMask* mask);
+
+    StrokeBuffer(const StrokeBuffer&) = delete;
+    StrokeBuffer& operator=(const StrokeBuffer&) = delete;
+
+    irr::f32 getOpacity() const;
+
+    BlendMode getBlendMode() const;
+
+    //! takes the alpha of an A8R8G8B8 brush image with its top left corner at a position as coverage; returns the rectangle it covers
+    irr::core::recti addDab(irr::video::IImage* brush, const irr::core::vector2di& position);
+
+    //! takes coverage computed elsewhere for a whole tile, rows TILE_SIZE bytes apart; returns the rectangle of the tile
+    irr::core::recti addCoverage(irr::u32 tileX, irr::u32 tileY, const irr::u8* coverage);
+
+    //! returns nullptr for a tile no dab has reached
+    const irr::u8* getTile(irr::u32 tileX, irr::u32 tileY) const;
+
+    //! writes a color with the coverage as alpha for a row of a tile, which is what gets blended into a layer
+    void getTexels(irr::u32 tileX, irr::u32 tileY, irr::u32 y, irr::u32 color, irr::u32* texels, irr::u32 count) const;
+
+    //! the rectangle every dab so far covers
+    const irr::core::recti& getRect() const;
+
+private:
+    //! grows the rectangle every dab so far covers
+    void addRect(const irr::core::recti& dabRect);
+
+    irr::core::dimension2du size;
+
+    irr::f32 opacity;
+    BlendMode blendMode;
+
+    const TexelMask* mask;
+
+    irr::u32 tileCountX;
+
+    std::vector<std::unique_ptr<irr::u8[]>> tiles;
+
+    irr::core::recti rect;
+};
@@ -0,0 +1,451 @@
+#include "SurfaceAtlas.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "MeshAccess.h"
+#include "ThreadPool.h"
+
+namespace {
+    //! marks a texel a triangle covers, on top of its packed normal
+    const irr::u32 COVERED = 1u << 24;
+
+    irr::u32 packNormal(irr::core::vector3df normal)
+    {
+        normal.normalize();
+
+        auto packComponent = [](irr::f32 value) {
+            return static_cast<irr::u32>(static_cast<irr::u8>(static_cast<irr::s8>(std::lround(std::max(-1.f, std::min(1.f, value)) * 127.f))));
+        };
+
+        return packComponent(normal.X) | (packComponent(normal.Y) << 8) | (packComponent(normal.Z) << 16) | COVERED;
+    }
+
+    irr::core::vector3df unpackNormal(irr::u32 normal)
+    {
+        return irr::core::vector3df(
+            static_cast<irr::s8>(normal & 0xFF),
+            static_cast<irr::s8>((normal >> 8) & 0xFF),
+            static_cast<irr::s8>((normal >> 16) & 0xFF)
+        );
+    }
+
+    irr::f32 getEdgeFunction(const irr::core::vector2df& a, const irr::core::vector2df& b, irr::f32 x, irr::f32 y)
+    {
+        return ((b.X - a.X) * (y - a.Y)) - ((b.Y - a.Y) * (x - a.X));
+    }
+}
+
+SurfaceAtlas::SurfaceAtlas(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const irr::core::dimension2du& _textureSize) :
+    textureSize(_textureSize),
+    cellSize(1.f),
+    stamp(0)
+{
+    std::vector<irr::core::vector2df> uvs;
+    std::vector<irr::core::vector3df> cornerPositions;
+    std::vector<irr::core::vector3df> cornerNormals;
+
+    for (auto meshBuffer : meshBuffers)
+    {
+        visitMeshBuffer(meshBuffer, [&](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    const auto& vertex = view.getCorner(triangle, corner);
+
+                    // corners are rasterized in texels
+                    uvs.push_back(irr::core::vector2df(vertex.TCoords.X * textureSize.Width, vertex.TCoords.Y * textureSize.Height));
+                    cornerPositions.push_back(vertex.Pos);
+                    cornerNormals.push_back(vertex.Normal);
+                }
+            }
+        });
+    }
+
+    auto triangleCount = static_cast<irr::u32>(uvs.size() / 3);
+
+    auto blockCountX = (textureSize.Width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    auto blockCountY = (textureSize.Height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    // a block is stored once the bounding box of a triangle reaches it, so a few blocks stay empty
+    std::vector<irr::s32> blockIndices(static_cast<std::size_t>(blockCountX) * blockCountY, -1);
+    std::vector<std::vector<irr::u32>> blockRows(blockCountY);
+
+    for (irr::u32 triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        const auto* corners = uvs.data() + (triangle * 3);
+
+        auto x0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(std::min({ corners[0].X, corners[1].X, corners[2].X }))));
+        auto y0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(std::min({ corners[0].Y, corners[1].Y, corners[2].Y }))));
+        auto x1 = std::min<irr::s32>(textureSize.Width - 1, static_cast<irr::s32>(std::floor(std::max({ corners[0].X, corners[1].X, corners[2].X }))));
+        auto y1 = std::min<irr::s32>(textureSize.Height - 1, static_cast<irr::s32>(std::floor(std::max({ corners[0].Y, corners[1].Y, corners[2].Y }))));
+
+        if (x0 > x1 || y0 > y1)
+        {
+            continue;
+        }
+
+        for (auto blockY = y0 / static_cast<irr::s32>(BLOCK_SIZE); blockY <= y1 / static_cast<irr::s32>(BLOCK_SIZE); ++blockY)
+        {
+            blockRows[blockY].push_back(triangle);
+
+            for (auto blockX = x0 / static_cast<irr::s32>(BLOCK_SIZE); blockX <= x1 / static_cast<irr::s32>(BLOCK_SIZE); ++blockX)
+            {
+                blockIndices[(blockY * blockCountX) + blockX] = 0;
+            }
+        }
+    }
+
+    const auto FAR = std::numeric_limits<irr::f32>::max();
+
+    for (irr::u32 blockY = 0; blockY < blockCountY; ++blockY)
+    {
+        for (irr::u32 blockX = 0; blockX < blockCountX; ++blockX)
+        {
+            auto& blockIndex = blockIndices[(blockY * blockCountX) + blockX];
+
+            if (blockIndex == 0)
+            {
+                blockIndex = static_cast<irr::s32>(blocks.size());
+
+                // the bounding box is inside out until a texel is found in the block
+                blocks.push_back(Block { blockX * BLOCK_SIZE, blockY * BLOCK_SIZE, irr::core::vector3df(FAR, FAR, FAR), irr::core::vector3df(-FAR, -FAR, -FAR) });
+            }
+        }
+    }
+
+    const auto BLOCK_TEXELS = BLOCK_SIZE * BLOCK_SIZE;
+
+    positions.resize(blocks.size() * BLOCK_TEXELS);
+    normals.assign(blocks.size() * BLOCK_TEXELS, 0);
+
+    // every row of blocks is rasterized by one task, so no two tasks write the same block
+    threadPool.parallelFor(blockCountY, [&](std::size_t blockY) {
+        auto rowTop = static_cast<irr::s32>(blockY * BLOCK_SIZE);
+        auto rowBottom = std::min<irr::s32>(rowTop + BLOCK_SIZE, textureSize.Height);
+
+        for (auto triangle : blockRows[blockY])
+        {
+            const auto* corners = uvs.data() + (triangle * 3);
+
+            auto area = getEdgeFunction(corners[0], corners[1], corners[2].X, corners[2].Y);
+
+            if (area == 0.f)
+            {
+                continue;
+            }
+
+            auto inverseArea = 1.f / area;
+
+            auto x0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(std::min({ corners[0].X, corners[1].X, corners[2].X }))));
+            auto x1 = std::min<irr::s32>(textureSize.Width - 1, static_cast<irr::s32>(std::floor(std::max({ corners[0].X, corners[1].X, corners[2].X }))));
+            auto y0 = std::max<irr::s32>(rowTop, static_cast<irr::s32>(std::floor(std::min({ corners[0].Y, corners[1].Y, corners[2].Y }))));
+            auto y1 = std::min<irr::s32>(rowBottom - 1, static_cast<irr::s32>(std::floor(std::max({ corners[0].Y, corners[1].Y, corners[2].Y }))));
+
+            const auto* trianglePositions = cornerPositions.data() + (triangle * 3);
+            const auto* triangleNormals = cornerNormals.data() + (triangle * 3);
+
+            for (auto y = y0; y <= y1; ++y)
+            {
+                for (auto x = x0; x <= x1; ++x)
+                {
+                    auto centreX = x + 0.5f;
+                    auto centreY = y + 0.5f;
+
+                    // texel centres on an edge count as inside, so triangles sharing it leave no gap
+                    auto weight0 = getEdgeFunction(corners[1], corners[2], centreX, centreY) * inverseArea;
+                    auto weight1 = getEdgeFunction(corners[2], corners[0], centreX, centreY) * inverseArea;
+                    auto weight2 = 1.f - weight0 - weight1;
+
+                    if (weight0 < 0.f || weight1 < 0.f || weight2 < 0.f)
+                    {
+                        continue;
+                    }
+
+                    auto block = static_cast<std::size_t>(blockIndices[(blockY * blockCountX) + (x / BLOCK_SIZE)]);
+                    auto texel = (block * BLOCK_TEXELS) + ((y % BLOCK_SIZE) * BLOCK_SIZE) + (x % BLOCK_SIZE);
+
+                    positions[texel] = (trianglePositions[0] * weight0) + (trianglePositions[1] * weight1) + (trianglePositions[2] * weight2);
+                    normals[texel] = packNormal((triangleNormals[0] * weight0) + (triangleNormals[1] * weight1) + (triangleNormals[2] * weight2));
+                }
+            }
+        }
+    });
+
+    threadPool.parallelFor(blocks.size(), [&](std::size_t block) {
+        auto& bounds = blocks[block];
+
+        for (auto texel = block * BLOCK_TEXELS; texel < (block + 1) * BLOCK_TEXELS; ++texel)
+        {
+            if (normals[texel] == 0)
+            {
+                continue;
+            }
+
+            const auto& position = positions[texel];
+
+            bounds.minEdge.X = std::min(bounds.minEdge.X, position.X);
+            bounds.minEdge.Y = std::min(bounds.minEdge.Y, position.Y);
+            bounds.minEdge.Z = std::min(bounds.minEdge.Z, position.Z);
+            bounds.maxEdge.X = std::max(bounds.maxEdge.X, position.X);
+            bounds.maxEdge.Y = std::max(bounds.maxEdge.Y, position.Y);
+            bounds.maxEdge.Z = std::max(bounds.maxEdge.Z, position.Z);
+        }
+    });
+
+    irr::f32 extentSum = 0.f;
+    irr::u32 coveredBlockCount = 0;
+
+    for (const auto& block : blocks)
+    {
+        if (block.minEdge.X <= block.maxEdge.X)
+        {
+            auto extent = block.maxEdge - block.minEdge;
+            extentSum += std::max({ extent.X, extent.Y, extent.Z });
+
+            ++coveredBlockCount;
+        }
+    }
+
+    if (coveredBlockCount == 0)
+    {
+        bucketStarts.assign(2, 0);
+        return;
+    }
+
+    // cells about as large as a block, so a block is listed under a few cells and a cell holds a few blocks
+    cellSize = std::max(extentSum / coveredBlockCount, 1e-6f);
+
+    irr::u32 bucketCount = 1;
+
+    while (bucketCount < blocks.size() * 2)
+    {
+        bucketCount <<= 1;
+    }
+
+    std::vector<std::pair<irr::u32, irr::u32>> blockBuckets;
+
+    for (irr::u32 block = 0; block < blocks.size(); ++block)
+    {
+        const auto& bounds = blocks[block];
+
+        // an empty block is never near a sphere
+        if (bounds.minEdge.X > bounds.maxEdge.X)
+        {
+            continue;
+        }
+
+        for (auto cellX = getCell(bounds.minEdge.X); cellX <= getCell(bounds.maxEdge.X); ++cellX)
+        {
+            for (auto cellY = getCell(bounds.minEdge.Y); cellY <= getCell(bounds.maxEdge.Y); ++cellY)
+            {
+                for (auto cellZ = getCell(bounds.minEdge.Z); cellZ <= getCell(bounds.maxEdge.Z); ++cellZ)
+                {
+                    blockBuckets.push_back(std::make_pair(getBucket(cellX, cellY, cellZ) & (bucketCount - 1), block));
+                }
+            }
+        }
+    }
+
+    std::sort(blockBuckets.begin(), blockBuckets.end());
+
+    // a block in several cells hashing to one bucket is listed there once
+    blockBuckets.erase(std::unique(blockBuckets.begin(), blockBuckets.end()), blockBuckets.end());
+
+    bucketStarts.assign(bucketCount + 1, 0);
+    bucketBlocks.resize(blockBuckets.size());
+
+    for (std::size_t i = 0; i < blockBuckets.size(); ++i)
+    {
+        ++bucketStarts[blockBuckets[i].first + 1];
+        bucketBlocks[i] = blockBuckets[i].second;
+    }
+
+    for (irr::u32 bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+    }
+
+    blockStamps.assign(blocks.size(), 0);
+}
+
+std::size_t SurfaceAtlas::getMemoryUsage() const
+{
+    return (blocks.size() * sizeof(Block))
+        + (positions.size() * sizeof(irr::core::vector3df))
+        + (normals.size() * sizeof(irr::u32))
+        + ((bucketStarts.size() + bucketBlocks.size() + blockStamps.size()) * sizeof(irr::u32));
+}
+
+void SurfaceAtlas::addSphereDab(ThreadPool& threadPool, irr::video::IImage* brush, const irr::core::vector3df& centre, irr::f32 radius, const irr::core::vector3df& normal, irr::u32 target, std::vector<ProjectedTile>& tiles)
+{
+    if (blocks.empty() || radius <= 0.f)
+    {
+        return;
+    }
+
+    candidates.clear();
+
+    auto isNearSphere = [&](const Block& block) {
+        // the distance from the centre to the nearest point of the box
+        auto dx = std::max({ block.minEdge.X - centre.X, 0.f, centre.X - block.maxEdge.X });
+        auto dy = std::max({ block.minEdge.Y - centre.Y, 0.f, centre.Y - block.maxEdge.Y });
+        auto dz = std::max({ block.minEdge.Z - centre.Z, 0.f, centre.Z - block.maxEdge.Z });
+
+        return (dx * dx) + (dy * dy) + (dz * dz) <= radius * radius;
+    };
+
+    irr::s32 cells[6] = {
+        getCell(centre.X - radius), getCell(centre.Y - radius), getCell(centre.Z - radius),
+        getCell(centre.X + radius), getCell(centre.Y + radius), getCell(centre.Z + radius)
+    };
+
+    auto cellCount = static_cast<irr::f64>(cells[3] - cells[0] + 1) * (cells[4] - cells[1] + 1) * (cells[5] - cells[2] + 1);
+
+    // a sphere spanning more cells than there are blocks is quicker to test against every block
+    if (cellCount > blocks.size())
+    {
+        for (irr::u32 block = 0; block < blocks.size(); ++block)
+        {
+            if (isNearSphere(blocks[block]))
+            {
+                candidates.push_back(block);
+            }
+        }
+    }
+    else
+    {
+        // stamps only need clearing once in four billion dabs
+        if (++stamp == 0)
+        {
+            std::fill(blockStamps.begin(), blockStamps.end(), 0);
+            stamp = 1;
+        }
+
+        auto bucketMask = static_cast<irr::u32>(bucketStarts.size() - 2);
+
+        for (auto cellX = cells[0]; cellX <= cells[3]; ++cellX)
+        {
+            for (auto cellY = cells[1]; cellY <= cells[4]; ++cellY)
+            {
+                for (auto cellZ = cells[2]; cellZ <= cells[5]; ++cellZ)
+                {
+                    auto bucket = getBucket(cellX, cellY, cellZ) & bucketMask;
+
+                    for (auto i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i)
+                    {
+                        auto block = bucketBlocks[i];
+
+                        if (blockStamps[block] != stamp && isNearSphere(blocks[block]))
+                        {
+                            blockStamps[block] = stamp;
+                            candidates.push_back(block);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // blocks are sorted into the tiles of the layers they fall into, each tile is then filled by one task
+    std::sort(candidates.begin(), candidates.end(), [this](irr::u32 a, irr::u32 b) {
+        auto tileA = std::make_pair(blocks[a].y / ProjectionPainter::TILE_SIZE, blocks[a].x / ProjectionPainter::TILE_SIZE);
+        auto tileB = std::make_pair(blocks[b].y / ProjectionPainter::TILE_SIZE, blocks[b].x / ProjectionPainter::TILE_SIZE);
+
+        return tileA < tileB || (tileA == tileB && a < b);
+    });
+
+    auto firstTile = tiles.size();
+    std::vector<irr::u32> tileStarts;
+
+    for (std::size_t i = 0; i < candidates.size(); ++i)
+    {
+        const auto& block = blocks[candidates[i]];
+
+        auto tileX = block.x / ProjectionPainter::TILE_SIZE;
+        auto tileY = block.y / ProjectionPainter::TILE_SIZE;
+
+        if (tiles.size() == firstTile || tiles.back().tileX != tileX || tiles.back().tileY != tileY)
+        {
+            tileStarts.push_back(static_cast<irr::u32>(i));
+
+            ProjectedTile tile;
+            tile.target = target;
+            tile.tileX = tileX;
+            tile.tileY = tileY;
+
+            tiles.push_back(std::move(tile));
+        }
+    }
+
+    tileStarts.push_back(static_cast<irr::u32>(candidates.size()));
+
+    auto brushTexels = static_cast<const irr::u8*>(brush->lock());
+    const auto& brushSize = brush->getDimension();
+
+    // the alpha of the brush from its middle to its right edge is its profile from the centre of the sphere outward
+    auto brushRow = reinterpret_cast<const irr::u32*>(brushTexels + ((brushSize.Height / 2) * brush->getPitch()));
+    auto brushMiddle = brushSize.Width / 2;
+    auto brushReach = static_cast<irr::f32>(brushSize.Width - brushMiddle);
+
+    auto radiusSquared = radius * radius;
+    auto inverseRadius = 1.f / radius;
+
+    threadPool.parallelFor(tiles.size() - firstTile, [&](std::size_t t) {
+        auto& tile = tiles[firstTile + t];
+
+        tile.coverage.assign(ProjectionPainter::TILE_SIZE * ProjectionPainter::TILE_SIZE, 0);
+
+        for (auto i = tileStarts[t]; i < tileStarts[t + 1]; ++i)
+        {
+            auto block = candidates[i];
+
+            const auto& bounds = blocks[block];
+            auto blockPositions = positions.data() + (static_cast<std::size_t>(block) * BLOCK_SIZE * BLOCK_SIZE);
+            auto blockNormals = normals.data() + (static_cast<std::size_t>(block) * BLOCK_SIZE * BLOCK_SIZE);
+
+            auto coverage = tile.coverage.data() + ((bounds.y % ProjectionPainter::TILE_SIZE) * ProjectionPainter::TILE_SIZE) + (bounds.x % ProjectionPainter::TILE_SIZE);
+
+            for (irr::u32 texel = 0; texel < BLOCK_SIZE * BLOCK_SIZE; ++texel)
+            {
+                if (blockNormals[texel] == 0)
+                {
+                    continue;
+                }
+
+                auto distanceSquared = blockPositions[texel].getDistanceFromSQ(centre);
+
+                // a sphere reaching through a thin wall leaves the far side alone
+                if (distanceSquared > radiusSquared || unpackNormal(blockNormals[texel]).dotProduct(normal) < 0.f)
+                {
+                    continue;
+                }
+
+                auto brushX = std::min<irr::u32>(brushSize.Width - 1, brushMiddle + static_cast<irr::u32>(std::sqrt(distanceSquared) * inverseRadius * brushReach));
+                auto alpha = static_cast<irr::u8>(brushRow[brushX] >> 24);
+
+                auto& texelCoverage = coverage[((texel / BLOCK_SIZE) * ProjectionPainter::TILE_SIZE) + (texel % BLOCK_SIZE)];
+                texelCoverage = std::max(texelCoverage, alpha);
+            }
+        }
+    });
+
+    brush->unlock();
+
+    tiles.erase(std::remove_if(tiles.begin() + firstTile, tiles.end(), [](const ProjectedTile& tile) {
+        return std::all_of(tile.coverage.begin(), tile.coverage.end(), [](irr::u8 coverage) { return coverage == 0; });
+    }), tiles.end());
+}
+
+irr::s32 SurfaceAtlas::getCell(irr::f32 coordinate) const
+{
+    return static_cast<irr::s32>(std::floor(coordinate / cellSize));
+}
+
+irr::u32 SurfaceAtlas::getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const
+{
+    return (static_cast<irr::u32>(cellX) * 73856093u) ^ (static_cast<irr::u32>(cellY) * 19349663u) ^ (static_cast<irr::u32>(cellZ) * 83492791u);
+}
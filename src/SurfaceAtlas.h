@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "ProjectionPainter.h"
+
+class ThreadPool;
+
+//! The position and normal on the mesh of every texel of a texture, for brushes which are spheres in object space.
+/** The mesh buffers sharing the texture are rasterized in UV space, in blocks of texels which are only stored where a
+    triangle reaches them. The blocks are put into a spatial hash by their bounding boxes, so a dab only visits the blocks
+    near its sphere, and its cost follows the area of the surface it covers rather than the size of the texture.
+    Where UVs overlap, as on mirrored islands, a texel keeps the triangle rasterized last. */
+class SurfaceAtlas
+{
+public:
+    //! side of the blocks texels are stored and looked up in
+    static const irr::u32 BLOCK_SIZE = 16;
+
+    SurfaceAtlas(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const irr::core::dimension2du& textureSize);
+
+    SurfaceAtlas(const SurfaceAtlas&) = delete;
+    SurfaceAtlas& operator=(const SurfaceAtlas&) = delete;
+
+    std::size_t getMemoryUsage() const;
+
+    //! appends the coverage of a sphere around a point of the mesh to tiles, with the given target
+    /** A texel is covered when its position is inside the sphere and its normal does not face away from the normal at the
+        centre. Its coverage is the alpha of an A8R8G8B8 brush image from the middle outward, as far out as the texel is
+        from the centre relative to the radius. */
+    void addSphereDab(ThreadPool& threadPool, irr::video::IImage* brush, const irr::core::vector3df& centre, irr::f32 radius, const irr::core::vector3df& normal, irr::u32 target, std::vector<ProjectedTile>& tiles);
+
+private:
+    struct Block
+    {
+        //! the texel at the top left corner of the block
+        irr::u32 x;
+        irr::u32 y;
+
+        irr::core::vector3df minEdge;
+        irr::core::vector3df maxEdge;
+    };
+
+    irr::s32 getCell(irr::f32 coordinate) const;
+
+    irr::u32 getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const;
+
+    irr::core::dimension2du textureSize;
+
+    std::vector<Block> blocks;
+
+    //! BLOCK_SIZE * BLOCK_SIZE texels per block, row by row
+    std::vector<irr::core::vector3df> positions;
+
+    //! three signed bytes with bit 24 set, 0 for texels no triangle covers
+    std::vector<irr::u32> normals;
+
+    irr::f32 cellSize;
+
+    //! blocks listed under the bucket of every cell their bounding box overlaps; those of bucket b start at bucketStarts[b]
+    std::vector<irr::u32> bucketStarts;
+    std::vector<irr::u32> bucketBlocks;
+
+    //! the last dab each block was taken for, so a block in several cells is only taken once
+    std::vector<irr::u32> blockStamps;
+    irr::u32 stamp;
+
+    //! kept allocated from one dab to the next
+    std::vector<irr::u32> candidates;
+};
@@ -0,0 +1,320 @@
+#include "SymmetryMap.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "MeshAccess.h"
+#include "ThreadPool.h"
+
+namespace {
+    //! triangles whose mirrors are looked up by one task
+    const irr::u32 TRIANGLES_PER_TASK = 4096;
+
+    //! positions closer than this fraction of the mesh's bounding box diagonal count as the same
+    const irr::f32 RELATIVE_TOLERANCE = 1e-5f;
+
+    irr::core::vector3df mirror(const irr::core::vector3df& position, SymmetryAxis axis)
+    {
+        switch (axis)
+        {
+        case SymmetryAxis::X:
+            return irr::core::vector3df(-position.X, position.Y, position.Z);
+        case SymmetryAxis::Y:
+            return irr::core::vector3df(position.X, -position.Y, position.Z);
+        default:
+            return irr::core::vector3df(position.X, position.Y, -position.Z);
+        }
+    }
+
+    irr::s32 getCell(irr::f32 coordinate, irr::f32 cellSize)
+    {
+        return static_cast<irr::s32>(std::floor(coordinate / cellSize));
+    }
+}
+
+SymmetryMap::SymmetryMap(ThreadPool& threadPool, irr::scene::IMesh* mesh) :
+    cellSize(1.f),
+    tolerance(0.f)
+{
+    triangleOffsets.push_back(0);
+
+    for (irr::u32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+    {
+        meshBuffers.push_back(mesh->getMeshBuffer(i));
+        triangleOffsets.push_back(triangleOffsets.back() + (mesh->getMeshBuffer(i)->getIndexCount() / 3));
+    }
+
+    auto triangleCount = triangleOffsets.back();
+    auto cornerCount = triangleCount * 3;
+
+    if (triangleCount == 0)
+    {
+        bucketStarts.assign(2, 0);
+        return;
+    }
+
+    // the corners are looked up again and again while mirrors are matched, so their positions are copied out once
+    cornerPositions.reserve(cornerCount);
+
+    for (auto meshBuffer : meshBuffers)
+    {
+        visitMeshBuffer(meshBuffer, [this](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    cornerPositions.push_back(view.getCorner(triangle, corner).Pos);
+                }
+            }
+        });
+    }
+
+    irr::core::aabbox3df bounds(cornerPositions[0], cornerPositions[0]);
+
+    for (irr::u32 corner = 1; corner < cornerCount; ++corner)
+    {
+        bounds.addInternalPoint(cornerPositions[corner]);
+    }
+
+    auto diagonal = bounds.getExtent().getLength();
+
+    // cells hold a few corners each when the triangles are spread over the surface evenly
+    tolerance = std::max(diagonal * RELATIVE_TOLERANCE, 1e-6f);
+    cellSize = std::max(diagonal / std::sqrt(static_cast<irr::f32>(triangleCount)), tolerance * 8.f);
+
+    irr::u32 bucketCount = 1;
+
+    while (bucketCount < cornerCount)
+    {
+        bucketCount *= 2;
+    }
+
+    // the corners are counting sorted into their buckets
+    std::vector<irr::u32> cornerBuckets(cornerCount);
+
+    bucketStarts.assign(bucketCount + 1, 0);
+
+    for (irr::u32 corner = 0; corner < cornerCount; ++corner)
+    {
+        const auto& position = cornerPositions[corner];
+
+        cornerBuckets[corner] = getBucket(getCell(position.X, cellSize), getCell(position.Y, cellSize), getCell(position.Z, cellSize));
+
+        ++bucketStarts[cornerBuckets[corner] + 1];
+    }
+
+    for (irr::u32 bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+    }
+
+    auto nextCorners = bucketStarts;
+
+    bucketCorners.resize(cornerCount);
+
+    for (irr::u32 corner = 0; corner < cornerCount; ++corner)
+    {
+        bucketCorners[nextCorners[cornerBuckets[corner]]++] = corner;
+    }
+
+    for (irr::u32 axis = 0; axis < AXIS_COUNT; ++axis)
+    {
+        mirroredTriangles[axis].assign(triangleCount, -1);
+        mirroredCorners[axis].assign(triangleCount, 0);
+    }
+
+    auto taskCount = (triangleCount + TRIANGLES_PER_TASK - 1) / TRIANGLES_PER_TASK;
+
+    threadPool.parallelFor(taskCount * AXIS_COUNT, [&](std::size_t task) {
+        auto axis = static_cast<irr::u32>(task % AXIS_COUNT);
+        auto firstTriangle = static_cast<irr::u32>(task / AXIS_COUNT) * TRIANGLES_PER_TASK;
+        auto lastTriangle = std::min(firstTriangle + TRIANGLES_PER_TASK, triangleCount);
+
+        for (auto triangle = firstTriangle; triangle < lastTriangle; ++triangle)
+        {
+            irr::core::vector3df positions[3];
+
+            for (irr::u32 corner = 0; corner < 3; ++corner)
+            {
+                positions[corner] = mirror(cornerPositions[(triangle * 3) + corner], static_cast<SymmetryAxis>(axis));
+            }
+
+            irr::u32 mirroredTriangle;
+            irr::u8 order[3];
+
+            if (findTriangle(positions, mirroredTriangle, order))
+            {
+                mirroredTriangles[axis][triangle] = static_cast<irr::s32>(mirroredTriangle);
+                mirroredCorners[axis][triangle] = order[0] | (order[1] << 2) | (order[2] << 4);
+            }
+        }
+    });
+}
+
+bool SymmetryMap::findPoint(const irr::core::triangle3df& hitTriangle, const irr::core::vector3df& hitPoint, SurfacePoint& point) const
+{
+    irr::core::vector3df positions[3] = { hitTriangle.pointA, hitTriangle.pointB, hitTriangle.pointC };
+
+    irr::u8 order[3];
+
+    if (!findTriangle(positions, point.triangle, order))
+    {
+        return false;
+    }
+
+    auto ab = hitTriangle.pointB - hitTriangle.pointA;
+    auto ac = hitTriangle.pointC - hitTriangle.pointA;
+    auto ap = hitPoint - hitTriangle.pointA;
+
+    auto abab = ab.dotProduct(ab);
+    auto abac = ab.dotProduct(ac);
+    auto acac = ac.dotProduct(ac);
+    auto apab = ap.dotProduct(ab);
+    auto apac = ap.dotProduct(ac);
+
+    auto denominator = (abab * acac) - (abac * abac);
+
+    if (denominator == 0.f)
+    {
+        return false;
+    }
+
+    irr::f32 hitWeights[3];
+
+    hitWeights[1] = ((acac * apab) - (abac * apac)) / denominator;
+    hitWeights[2] = ((abab * apac) - (abac * apab)) / denominator;
+    hitWeights[0] = 1.f - hitWeights[1] - hitWeights[2];
+
+    irr::f32 weights[3];
+
+    for (irr::u32 corner = 0; corner < 3; ++corner)
+    {
+        weights[order[corner]] = hitWeights[corner];
+    }
+
+    point.weights = irr::core::vector3df(weights[0], weights[1], weights[2]);
+
+    return true;
+}
+
+bool SymmetryMap::getMirroredPoint(const SurfacePoint& point, SymmetryAxis axis, SurfacePoint& mirroredPoint) const
+{
+    auto mirroredTriangle = mirroredTriangles[static_cast<irr::u32>(axis)][point.triangle];
+
+    if (mirroredTriangle < 0)
+    {
+        return false;
+    }
+
+    auto order = mirroredCorners[static_cast<irr::u32>(axis)][point.triangle];
+
+    irr::f32 weights[3] = { point.weights.X, point.weights.Y, point.weights.Z };
+    irr::f32 mirroredWeights[3];
+
+    for (irr::u32 corner = 0; corner < 3; ++corner)
+    {
+        mirroredWeights[(order >> (corner * 2)) & 3] = weights[corner];
+    }
+
+    mirroredPoint.triangle = static_cast<irr::u32>(mirroredTriangle);
+    mirroredPoint.weights = irr::core::vector3df(mirroredWeights[0], mirroredWeights[1], mirroredWeights[2]);
+
+    return true;
+}
+
+irr::u32 SymmetryMap::getMeshBufferIndex(const SurfacePoint& point) const
+{
+    return static_cast<irr::u32>(std::upper_bound(triangleOffsets.begin(), triangleOffsets.end(), point.triangle) - triangleOffsets.begin()) - 1;
+}
+
+irr::core::vector2df SymmetryMap::getTextureCoords(const SurfacePoint& point) const
+{
+    auto meshBufferIndex = getMeshBufferIndex(point);
+    auto triangle = point.triangle - triangleOffsets[meshBufferIndex];
+
+    return visitMeshBuffer(meshBuffers[meshBufferIndex], [&point, triangle](const auto& view) {
+        return view.getCorner(triangle, 0).TCoords * point.weights.X
+            + view.getCorner(triangle, 1).TCoords * point.weights.Y
+            + view.getCorner(triangle, 2).TCoords * point.weights.Z;
+    });
+}
+
+irr::core::vector3df SymmetryMap::getNormal(const SurfacePoint& point) const
+{
+    auto meshBufferIndex = getMeshBufferIndex(point);
+    auto triangle = point.triangle - triangleOffsets[meshBufferIndex];
+
+    return visitMeshBuffer(meshBuffers[meshBufferIndex], [&point, triangle](const auto& view) {
+        return view.getCorner(triangle, 0).Normal * point.weights.X
+            + view.getCorner(triangle, 1).Normal * point.weights.Y
+            + view.getCorner(triangle, 2).Normal * point.weights.Z;
+    });
+}
+
+irr::u32 SymmetryMap::getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const
+{
+    auto hash = (static_cast<irr::u32>(cellX) * 73856093u) ^ (static_cast<irr::u32>(cellY) * 19349663u) ^ (static_cast<irr::u32>(cellZ) * 83492791u);
+
+    return hash & static_cast<irr::u32>(bucketStarts.size() - 2);
+}
+
+bool SymmetryMap::findTriangle(const irr::core::vector3df* positions, irr::u32& triangle, irr::u8* order) const
+{
+    auto isAt = [this](irr::u32 corner, const irr::core::vector3df& position) {
+        const auto& cornerPosition = cornerPositions[corner];
+
+        return std::abs(cornerPosition.X - position.X) <= tolerance
+            && std::abs(cornerPosition.Y - position.Y) <= tolerance
+            && std::abs(cornerPosition.Z - position.Z) <= tolerance;
+    };
+
+    const auto& position = positions[0];
+
+    // a position close to the side of its cell is looked up in the neighbouring cell too
+    for (auto cellX = getCell(position.X - tolerance, cellSize); cellX <= getCell(position.X + tolerance, cellSize); ++cellX)
+    {
+        for (auto cellY = getCell(position.Y - tolerance, cellSize); cellY <= getCell(position.Y + tolerance, cellSize); ++cellY)
+        {
+            for (auto cellZ = getCell(position.Z - tolerance, cellSize); cellZ <= getCell(position.Z + tolerance, cellSize); ++cellZ)
+            {
+                auto bucket = getBucket(cellX, cellY, cellZ);
+
+                for (auto i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i)
+                {
+                    auto corner = bucketCorners[i];
+
+                    if (!isAt(corner, position))
+                    {
+                        continue;
+                    }
+
+                    auto candidate = corner / 3;
+                    auto next = static_cast<irr::u8>(((corner % 3) + 1) % 3);
+                    auto last = static_cast<irr::u8>(((corner % 3) + 2) % 3);
+
+                    if (isAt((candidate * 3) + next, positions[1]) && isAt((candidate * 3) + last, positions[2]))
+                    {
+                        order[1] = next;
+                        order[2] = last;
+                    }
+                    else if (isAt((candidate * 3) + last, positions[1]) && isAt((candidate * 3) + next, positions[2]))
+                    {
+                        order[1] = last;
+                        order[2] = next;
+                    }
+                    else
+                    {
+                        continue;
+                    }
+
+                    triangle = candidate;
+                    order[0] = static_cast<irr::u8>(corner % 3);
+
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+
+enum class SymmetryAxis
+{
+    X,
+    Y,
+    Z
+};
+
+//! Which triangle of a mesh mirrors which across the planes through the origin, so a mirrored dab needs no ray cast of its own.
+/** Triangle corners are put into a spatial hash by position, which finds the triangle under a hit, and the triangle at the
+    mirrored positions of its corners, without searching the mesh. Positions closer than a small fraction of the mesh's extent
+    count as the same. The mirror of every triangle is found once, on the thread pool, when the map is built. */
+class SymmetryMap
+{
+public:
+    static const irr::u32 AXIS_COUNT = 3;
+
+    //! a point on a triangle of the mesh, by the weights of the triangle's corners
+    struct SurfacePoint
+    {
+        irr::u32 triangle;
+        irr::core::vector3df weights;
+    };
+
+    SymmetryMap(ThreadPool& threadPool, irr::scene::IMesh* mesh);
+
+    SymmetryMap(const SymmetryMap&) = delete;
+    SymmetryMap& operator=(const SymmetryMap&) = delete;
+
+    //! finds the mesh triangle at the corners of a hit triangle, and where on it the hit point is
+    bool findPoint(const irr::core::triangle3df& hitTriangle, const irr::core::vector3df& hitPoint, SurfacePoint& point) const;
+
+    //! the same point on the triangle mirroring its triangle, false if no triangle of the mesh does
+    bool getMirroredPoint(const SurfacePoint& point, SymmetryAxis axis, SurfacePoint& mirroredPoint) const;
+
+    irr::u32 getMeshBufferIndex(const SurfacePoint& point) const;
+
+    irr::core::vector2df getTextureCoords(const SurfacePoint& point) const;
+
+    //! the vertex normals of the point's triangle, weighted like its corners
+    irr::core::vector3df getNormal(const SurfacePoint& point) const;
+
+private:
+    irr::u32 getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const;
+
+    //! finds a triangle whose corners are at the three positions, in any order
+    /** order receives, for each position, the corner of the triangle found there. */
+    bool findTriangle(const irr::core::vector3df* positions, irr::u32& triangle, irr::u8* order) const;
+
+    std::vector<irr::scene::IMeshBuffer*> meshBuffers;
+
+    //! the first triangle of each mesh buffer, and the triangle count past the last
+    std::vector<irr::u32> triangleOffsets;
+
+    //! the position of every corner, a triangle times 3 plus the corner's index in the triangle, whatever the vertex type
+    std::vector<irr::core::vector3df> cornerPositions;
+
+    irr::f32 cellSize;
+    irr::f32 tolerance;
+
+    //! corners sorted by the bucket their cell hashes to; the corners of bucket b start at bucketStarts[b]
+    std::vector<irr::u32> bucketStarts;
+    std::vector<irr::u32> bucketCorners;
+
+    //! per axis and triangle, the mirroring triangle or -1, and which of its corners mirrors each corner, two bits each
+    std::vector<irr::s32> mirroredTriangles[AXIS_COUNT];
+    std::vector<irr::u8> mirroredCorners[AXIS_COUNT];
+};
@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+ThreadPool::ThreadPool(unsigned int threadCount) :
+    stopping(false)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        stopping = true;
+    }
+
+    tasksAvailable.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(tasksMutex);
+        tasks.push_back(std::move(task));
+    }
+
+    tasksAvailable.notify_one();
+}
+
+void ThreadPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& task)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (count == 1)
+    {
+        task(0);
+        return;
+    }
+
+    // helpers may only get scheduled after the caller has already finished everything,
+    // so the shared state has to outlive this call
+    struct State
+    {
+        std::atomic<std::size_t> nextIndex { 0 };
+        std::size_t completed = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    auto state = std::make_shared<State>();
+
+    auto runItems = [state, count, &task]() {
+        std::size_t finished = 0;
+
+        for (auto i = state->nextIndex++; i < count; i = state->nextIndex++)
+        {
+            task(i);
+            ++finished;
+        }
+
+        if (finished > 0)
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+
+            state->completed += finished;
+
+            if (state->completed == count)
+            {
+                state->done.notify_all();
+            }
+        }
+    };
+
+    auto helperCount = std::min<std::size_t>(workers.size(), count - 1);
+
+    for (std::size_t i = 0; i < helperCount; ++i)
+    {
+        // a helper which starts after all items are taken never touches task, which is gone by then
+        enqueue(runItems);
+    }
+
+    runItems();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+
+    state->done.wait(lock, [&state, count]() { return state->completed == count; });
+}
+
+unsigned int ThreadPool::getThreadCount() const
+{
+    return static_cast<unsigned int>(workers.size());
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+
+        {
+            std::unique_lock<std::mutex> lock(tasksMutex);
+
+            tasksAvailable.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+            if (stopping && tasks.empty())
+            {
+                return;
+            }
+
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+
+        task();
+    }
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! A fixed set of worker threads shared by everything that splits CPU work into independent pieces.
+class ThreadPool
+{
+public:
+    //! creates one worker per hardware thread when threadCount is zero
+    explicit ThreadPool(unsigned int threadCount = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void enqueue(std::function<void()> task);
+
+    //! runs task(0) .. task(count - 1) on the pool and returns once all of them finished
+    /** The calling thread takes part in the work, so this may be called from within a pool task. */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    unsigned int getThreadCount() const;
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+
+    std::deque<std::function<void()>> tasks;
+
+    std::mutex tasksMutex;
+    std::condition_variable tasksAvailable;
+
+    bool stopping;
+};
@@ -0,0 +1,254 @@
+#include "UvIslands.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include "MeshAccess.h"
+#include "ThreadPool.h"
+
+namespace {
+    //! rows of the map rasterized by one task
+    const irr::u32 BAND_ROWS = 64;
+
+    //! an edge in UV space, by the exact bits of its corners, ordered so both triangles sharing it build the same key
+    struct UvEdge
+    {
+        irr::u32 corners[4];
+
+        bool operator==(const UvEdge& other) const
+        {
+            return std::equal(corners, corners + 4, other.corners);
+        }
+    };
+
+    struct UvEdgeHash
+    {
+        std::size_t operator()(const UvEdge& edge) const
+        {
+            std::size_t hash = 0;
+
+            for (auto corner : edge.corners)
+            {
+                hash = (hash * 0x9E3779B97F4A7C15ull) ^ corner;
+            }
+
+            return hash;
+        }
+    };
+
+    UvEdge getUvEdge(const irr::core::vector2df& a, const irr::core::vector2df& b)
+    {
+        irr::u32 first[2];
+        irr::u32 second[2];
+
+        std::memcpy(first, &a.X, sizeof(irr::f32));
+        std::memcpy(first + 1, &a.Y, sizeof(irr::f32));
+        std::memcpy(second, &b.X, sizeof(irr::f32));
+        std::memcpy(second + 1, &b.Y, sizeof(irr::f32));
+
+        if (std::lexicographical_compare(second, second + 2, first, first + 2))
+        {
+            std::swap(first[0], second[0]);
+            std::swap(first[1], second[1]);
+        }
+
+        return UvEdge { { first[0], first[1], second[0], second[1] } };
+    }
+
+    irr::u32 findRoot(std::vector<irr::u32>& parents, irr::u32 triangle)
+    {
+        while (parents[triangle] != triangle)
+        {
+            // path halving keeps the trees flat without recursion
+            parents[triangle] = parents[parents[triangle]];
+            triangle = parents[triangle];
+        }
+
+        return triangle;
+    }
+
+    irr::f32 getEdgeFunction(const irr::core::vector2df& a, const irr::core::vector2df& b, irr::f32 x, irr::f32 y)
+    {
+        return ((b.X - a.X) * (y - a.Y)) - ((b.Y - a.Y) * (x - a.X));
+    }
+}
+
+UvIslandMap::UvIslandMap(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const irr::core::dimension2du& _textureSize) :
+    textureSize(_textureSize),
+    size(std::min(_textureSize.Width, MAX_MAP_SIZE), std::min(_textureSize.Height, MAX_MAP_SIZE)),
+    islandCount(0)
+{
+    std::vector<irr::core::vector2df> uvs;
+
+    for (auto meshBuffer : meshBuffers)
+    {
+        visitMeshBuffer(meshBuffer, [&uvs](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    uvs.push_back(view.getCorner(triangle, corner).TCoords);
+                }
+            }
+        });
+    }
+
+    auto triangleCount = static_cast<irr::u32>(uvs.size() / 3);
+
+    // union-find over triangles sharing an edge in UV space
+    std::vector<irr::u32> parents(triangleCount);
+    std::iota(parents.begin(), parents.end(), 0u);
+
+    std::unordered_map<UvEdge, irr::u32, UvEdgeHash> edges;
+    edges.reserve(triangleCount * 3);
+
+    for (irr::u32 triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        for (irr::u32 corner = 0; corner < 3; ++corner)
+        {
+            auto edge = getUvEdge(uvs[(triangle * 3) + corner], uvs[(triangle * 3) + ((corner + 1) % 3)]);
+
+            auto otherTriangle = edges.emplace(edge, triangle);
+
+            if (!otherTriangle.second)
+            {
+                auto root = findRoot(parents, triangle);
+                auto otherRoot = findRoot(parents, otherTriangle.first->second);
+
+                parents[std::max(root, otherRoot)] = std::min(root, otherRoot);
+            }
+        }
+    }
+
+    // island ids are numbered from 1 in the order of their first triangle; the few beyond what 16 bits hold share the last id
+    std::vector<irr::u16> triangleIslands(triangleCount);
+    std::vector<irr::u16> rootIslands(triangleCount, 0);
+
+    for (irr::u32 triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        auto& island = rootIslands[findRoot(parents, triangle)];
+
+        if (island == 0)
+        {
+            island = static_cast<irr::u16>(std::min<irr::u32>(++islandCount, 0xFFFF));
+        }
+
+        triangleIslands[triangle] = island;
+    }
+
+    // the corners are rasterized in map texels
+    std::vector<irr::core::vector2df> corners(uvs.size());
+
+    for (std::size_t i = 0; i < uvs.size(); ++i)
+    {
+        corners[i] = irr::core::vector2df(uvs[i].X * size.Width, uvs[i].Y * size.Height);
+    }
+
+    rasterize(threadPool, corners, triangleIslands);
+}
+
+irr::u32 UvIslandMap::getIslandCount() const
+{
+    return islandCount;
+}
+
+irr::u16 UvIslandMap::getIsland(irr::u32 x, irr::u32 y) const
+{
+    if (x >= textureSize.Width || y >= textureSize.Height)
+    {
+        return 0;
+    }
+
+    auto mapX = static_cast<irr::u32>((static_cast<irr::u64>(x) * size.Width) / textureSize.Width);
+    auto mapY = static_cast<irr::u32>((static_cast<irr::u64>(y) * size.Height) / textureSize.Height);
+
+    return islands[(static_cast<std::size_t>(mapY) * size.Width) + mapX];
+}
+
+bool UvIslandMap::isFullResolution() const
+{
+    return size == textureSize;
+}
+
+const irr::u16* UvIslandMap::getRow(irr::u32 y) const
+{
+    return islands.data() + (static_cast<std::size_t>(y) * size.Width);
+}
+
+void UvIslandMap::rasterize(ThreadPool& threadPool, const std::vector<irr::core::vector2df>& corners, const std::vector<irr::u16>& triangleIslands)
+{
+    islands.assign(static_cast<std::size_t>(size.Width) * size.Height, 0);
+
+    auto bandCount = (size.Height + BAND_ROWS - 1) / BAND_ROWS;
+
+    // triangles are binned by the bands they reach, so every band is rasterized by one task without locking
+    std::vector<std::vector<irr::u32>> bands(bandCount);
+
+    for (irr::u32 triangle = 0; triangle < triangleIslands.size(); ++triangle)
+    {
+        auto top = std::min({ corners[triangle * 3].Y, corners[(triangle * 3) + 1].Y, corners[(triangle * 3) + 2].Y });
+        auto bottom = std::max({ corners[triangle * 3].Y, corners[(triangle * 3) + 1].Y, corners[(triangle * 3) + 2].Y });
+
+        auto firstRow = std::max(0.f, std::floor(top));
+        auto lastRow = std::min(static_cast<irr::f32>(size.Height) - 1.f, std::floor(bottom));
+
+        if (firstRow > lastRow)
+        {
+            continue;
+        }
+
+        for (auto band = static_cast<irr::u32>(firstRow) / BAND_ROWS; band <= static_cast<irr::u32>(lastRow) / BAND_ROWS; ++band)
+        {
+            bands[band].push_back(triangle);
+        }
+    }
+
+    threadPool.parallelFor(bandCount, [&](std::size_t band) {
+        auto bandTop = static_cast<irr::s32>(band * BAND_ROWS);
+        auto bandBottom = std::min<irr::s32>(bandTop + BAND_ROWS, size.Height);
+
+        for (auto triangle : bands[band])
+        {
+            const auto& a = corners[triangle * 3];
+            const auto& b = corners[(triangle * 3) + 1];
+            const auto& c = corners[(triangle * 3) + 2];
+
+            auto area = getEdgeFunction(a, b, c.X, c.Y);
+
+            if (area == 0.f)
+            {
+                continue;
+            }
+
+            auto x0 = std::max<irr::s32>(0, static_cast<irr::s32>(std::floor(std::min({ a.X, b.X, c.X }))));
+            auto x1 = std::min<irr::s32>(size.Width - 1, static_cast<irr::s32>(std::floor(std::max({ a.X, b.X, c.X }))));
+            auto y0 = std::max<irr::s32>(bandTop, static_cast<irr::s32>(std::floor(std::min({ a.Y, b.Y, c.Y }))));
+            auto y1 = std::min<irr::s32>(bandBottom - 1, static_cast<irr::s32>(std::floor(std::max({ a.Y, b.Y, c.Y }))));
+
+            auto sign = area > 0.f ? 1.f : -1.f;
+            auto island = triangleIslands[triangle];
+
+            for (auto y = y0; y <= y1; ++y)
+            {
+                auto row = islands.data() + (static_cast<std::size_t>(y) * size.Width);
+
+                // texel centres on an edge count as inside, so triangles sharing it leave no gap
+                for (auto x = x0; x <= x1; ++x)
+                {
+                    auto centreX = x + 0.5f;
+                    auto centreY = y + 0.5f;
+
+                    if (sign * getEdgeFunction(a, b, centreX, centreY) >= 0.f
+                        && sign * getEdgeFunction(b, c, centreX, centreY) >= 0.f
+                        && sign * getEdgeFunction(c, a, centreX, centreY) >= 0.f)
+                    {
+                        row[x] = island;
+                    }
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class ThreadPool;
+
+//! The UV islands of the mesh buffers sharing a texture, rasterized into a map of island ids over the texture.
+/** Triangles are joined into an island when they share an edge in UV space; triangles which only share positions,
+    like the two sides of a seam, stay apart. Texels no triangle covers have island 0. */
+class UvIslandMap
+{
+public:
+    //! the map is never larger than this on a side; larger textures are looked up at a lower resolution
+    static const irr::u32 MAX_MAP_SIZE = 8192;
+
+    UvIslandMap(ThreadPool& threadPool, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers, const irr::core::dimension2du& textureSize);
+
+    UvIslandMap(const UvIslandMap&) = delete;
+    UvIslandMap& operator=(const UvIslandMap&) = delete;
+
+    irr::u32 getIslandCount() const;
+
+    //! island of a texel of the texture
+    irr::u16 getIsland(irr::u32 x, irr::u32 y) const;
+
+    //! whether the map has one entry per texel of the texture
+    bool isFullResolution() const;
+
+    //! a row of the map, only meaningful at full resolution where map rows are texture rows
+    const irr::u16* getRow(irr::u32 y) const;
+
+private:
+    void rasterize(ThreadPool& threadPool, const std::vector<irr::core::vector2df>& corners, const std::vector<irr::u16>& triangleIslands);
+
+    irr::core::dimension2du textureSize;
+    irr::core::dimension2du size;
+
+    irr::u32 islandCount;
+
+    std::vector<irr::u16> islands;
+};
@@ -0,0 +1,311 @@
+#include "VertexPainter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "FaceSelection.h"
+#include "MeshAccess.h"
+
+namespace {
+    //! the vertices a cell holds on average when they are spread over the surface evenly
+    /** Dabs visit every cell of a cube around them, mostly empty ones off the surface; larger cells keep those few. */
+    const irr::f32 VERTICES_PER_CELL = 16.f;
+
+    irr::u32 blendChannel(irr::u32 original, irr::u32 stroke, irr::f32 amount)
+    {
+        return static_cast<irr::u32>(original + ((static_cast<irr::f32>(stroke) - original) * amount) + 0.5f);
+    }
+}
+
+VertexPainter::VertexPainter(irr::scene::IMesh* mesh) :
+    cellSize(1.f),
+    stroking(false),
+    strokeOpacity(1.f)
+{
+    vertexOffsets.push_back(0);
+
+    for (irr::u32 i = 0; i < mesh->getMeshBufferCount(); ++i)
+    {
+        meshBuffers.push_back(mesh->getMeshBuffer(i));
+        vertexOffsets.push_back(vertexOffsets.back() + mesh->getMeshBuffer(i)->getVertexCount());
+        vertexPitches.push_back(irr::video::getVertexPitchFromType(mesh->getMeshBuffer(i)->getVertexType()));
+    }
+
+    changedMeshBuffers.assign(meshBuffers.size(), 0);
+
+    auto vertexCount = vertexOffsets.back();
+
+    if (vertexCount == 0)
+    {
+        bucketStarts.assign(2, 0);
+        return;
+    }
+
+    strokeCoverage.assign(vertexCount, 0.f);
+    originalColors.resize(vertexCount);
+
+    std::vector<HashedVertex> vertices;
+    vertices.reserve(vertexCount);
+
+    for (irr::u32 meshBuffer = 0; meshBuffer < meshBuffers.size(); ++meshBuffer)
+    {
+        visitMeshBuffer(meshBuffers[meshBuffer], [&vertices, meshBuffer](const auto& view) {
+            for (irr::u32 index = 0; index < view.getVertexCount(); ++index)
+            {
+                vertices.push_back(HashedVertex { view.getVertex(index).Pos, meshBuffer, index });
+            }
+        });
+    }
+
+    irr::core::aabbox3df bounds(vertices.front().position, vertices.front().position);
+
+    for (const auto& vertex : vertices)
+    {
+        bounds.addInternalPoint(vertex.position);
+    }
+
+    cellSize = std::max(bounds.getExtent().getLength() * std::sqrt(VERTICES_PER_CELL / vertexCount), 1e-6f);
+
+    irr::u32 bucketCount = 1;
+
+    while (bucketCount < vertexCount)
+    {
+        bucketCount *= 2;
+    }
+
+    // the vertices are counting sorted into their buckets
+    std::vector<irr::u32> vertexBuckets(vertexCount);
+
+    bucketStarts.assign(bucketCount + 1, 0);
+
+    for (irr::u32 vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        const auto& position = vertices[vertex].position;
+
+        vertexBuckets[vertex] = getBucket(getCell(position.X), getCell(position.Y), getCell(position.Z));
+
+        ++bucketStarts[vertexBuckets[vertex] + 1];
+    }
+
+    for (irr::u32 bucket = 0; bucket < bucketCount; ++bucket)
+    {
+        bucketStarts[bucket + 1] += bucketStarts[bucket];
+    }
+
+    auto nextVertices = bucketStarts;
+
+    bucketVertices.resize(vertexCount);
+
+    for (irr::u32 vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        bucketVertices[nextVertices[vertexBuckets[vertex]]++] = vertices[vertex];
+    }
+}
+
+irr::u32 VertexPainter::getVertexCount() const
+{
+    return vertexOffsets.back();
+}
+
+void VertexPainter::beginStroke(const irr::video::SColor& color, irr::f32 opacity, const FaceSelection* selection)
+{
+    endStroke();
+
+    stroking = true;
+    strokeColor = color;
+    strokeOpacity = opacity;
+
+    selectedVertices.clear();
+
+    if (selection != nullptr && !selection->isEmpty())
+    {
+        selectVertices(*selection);
+    }
+}
+
+bool VertexPainter::isStroking() const
+{
+    return stroking;
+}
+
+irr::u32 VertexPainter::addDab(const irr::core::vector3df& centre, irr::f32 radius, irr::f32 featherRadius)
+{
+    if (!stroking || bucketVertices.empty())
+    {
+        return 0;
+    }
+
+    auto reach = radius + featherRadius;
+    auto reachSquared = reach * reach;
+
+    irr::u32 paintedCount = 0;
+
+    auto paintIfInReach = [&](const HashedVertex& vertex) {
+        auto distanceSquared = vertex.position.getDistanceFromSQ(centre);
+
+        if (distanceSquared > reachSquared)
+        {
+            return;
+        }
+
+        auto distance = std::sqrt(distanceSquared);
+        auto coverage = distance <= radius ? 1.f : 1.f - ((distance - radius) / featherRadius);
+
+        if (paintVertex(vertex, coverage))
+        {
+            ++paintedCount;
+        }
+    };
+
+    auto minCellX = getCell(centre.X - reach);
+    auto minCellY = getCell(centre.Y - reach);
+    auto minCellZ = getCell(centre.Z - reach);
+    auto maxCellX = getCell(centre.X + reach);
+    auto maxCellY = getCell(centre.Y + reach);
+    auto maxCellZ = getCell(centre.Z + reach);
+
+    auto cellCount = static_cast<irr::u64>(maxCellX - minCellX + 1) * static_cast<irr::u64>(maxCellY - minCellY + 1) * static_cast<irr::u64>(maxCellZ - minCellZ + 1);
+
+    // a dab reaching over more cells than there are buckets visits every vertex anyway, so it does so once each
+    if (cellCount >= bucketStarts.size() - 1)
+    {
+        for (const auto& vertex : bucketVertices)
+        {
+            paintIfInReach(vertex);
+        }
+    }
+    else
+    {
+        for (auto cellZ = minCellZ; cellZ <= maxCellZ; ++cellZ)
+        {
+            for (auto cellY = minCellY; cellY <= maxCellY; ++cellY)
+            {
+                for (auto cellX = minCellX; cellX <= maxCellX; ++cellX)
+                {
+                    auto bucket = getBucket(cellX, cellY, cellZ);
+
+                    for (auto i = bucketStarts[bucket]; i < bucketStarts[bucket + 1]; ++i)
+                    {
+                        const auto& vertex = bucketVertices[i];
+
+                        // other cells hashing to the same bucket are visited for their own vertices
+                        if (getCell(vertex.position.X) != cellX || getCell(vertex.position.Y) != cellY || getCell(vertex.position.Z) != cellZ)
+                        {
+                            continue;
+                        }
+
+                        paintIfInReach(vertex);
+                    }
+                }
+            }
+        }
+    }
+
+    // only the vertex buffers are uploaded again, and only of the mesh buffers the dab changed
+    for (irr::u32 meshBuffer = 0; meshBuffer < meshBuffers.size(); ++meshBuffer)
+    {
+        if (changedMeshBuffers[meshBuffer] != 0)
+        {
+            meshBuffers[meshBuffer]->setDirty(irr::scene::EBT_VERTEX);
+
+            changedMeshBuffers[meshBuffer] = 0;
+        }
+    }
+
+    return paintedCount;
+}
+
+void VertexPainter::endStroke()
+{
+    for (auto vertex : strokeVertices)
+    {
+        strokeCoverage[vertex] = 0.f;
+    }
+
+    strokeVertices.clear();
+
+    stroking = false;
+}
+
+irr::s32 VertexPainter::getCell(irr::f32 coordinate) const
+{
+    return static_cast<irr::s32>(std::floor(coordinate / cellSize));
+}
+
+irr::u32 VertexPainter::getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const
+{
+    auto hash = (static_cast<irr::u32>(cellX) * 73856093u) ^ (static_cast<irr::u32>(cellY) * 19349663u) ^ (static_cast<irr::u32>(cellZ) * 83492791u);
+
+    return hash & static_cast<irr::u32>(bucketStarts.size() - 2);
+}
+
+irr::video::SColor& VertexPainter::getColor(irr::u32 meshBuffer, irr::u32 index)
+{
+    auto vertices = static_cast<irr::u8*>(meshBuffers[meshBuffer]->getVertices());
+
+    return reinterpret_cast<irr::video::S3DVertex*>(vertices + (static_cast<std::size_t>(index) * vertexPitches[meshBuffer]))->Color;
+}
+
+void VertexPainter::selectVertices(const FaceSelection& selection)
+{
+    selectedVertices.assign(vertexOffsets.back(), 0);
+
+    irr::u32 firstTriangle = 0;
+
+    for (irr::u32 meshBuffer = 0; meshBuffer < meshBuffers.size(); ++meshBuffer)
+    {
+        auto vertexOffset = vertexOffsets[meshBuffer];
+
+        firstTriangle += visitMeshBuffer(meshBuffers[meshBuffer], [this, &selection, firstTriangle, vertexOffset](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                if (!selection.isSelected(firstTriangle + triangle))
+                {
+                    continue;
+                }
+
+                for (irr::u32 corner = 0; corner < 3; ++corner)
+                {
+                    selectedVertices[vertexOffset + view.getIndex(triangle, corner)] = 1;
+                }
+            }
+
+            return view.getTriangleCount();
+        });
+    }
+}
+
+bool VertexPainter::paintVertex(const HashedVertex& vertex, irr::f32 coverage)
+{
+    auto number = vertexOffsets[vertex.meshBuffer] + vertex.index;
+
+    if (coverage <= strokeCoverage[number] || (!selectedVertices.empty() && selectedVertices[number] == 0))
+    {
+        return false;
+    }
+
+    auto& color = getColor(vertex.meshBuffer, vertex.index);
+
+    if (strokeCoverage[number] == 0.f)
+    {
+        originalColors[number] = color;
+        strokeVertices.push_back(number);
+    }
+
+    strokeCoverage[number] = coverage;
+
+    // the vertex's alpha is left as it was, only its color is painted
+    const auto& original = originalColors[number];
+    auto amount = coverage * strokeOpacity;
+
+    color.set(
+        original.getAlpha(),
+        blendChannel(original.getRed(), strokeColor.getRed(), amount),
+        blendChannel(original.getGreen(), strokeColor.getGreen(), amount),
+        blendChannel(original.getBlue(), strokeColor.getBlue(), amount)
+    );
+
+    changedMeshBuffers[vertex.meshBuffer] = 1;
+
+    return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+class FaceSelection;
+
+//! Paints the vertex colors of a mesh with a round brush, for models which are colored by their vertices rather than a texture.
+/** Vertices are put into a uniform spatial hash by position when the painter is built, so a dab only visits the cells its sphere
+    overlaps instead of every vertex of the mesh. Like texture strokes, a stroke never goes over its opacity however often its
+    dabs overlap: each vertex keeps its color from before the stroke and the strongest coverage a dab gave it. Only the mesh
+    buffers a dab changed are marked dirty, and only their vertices. */
+class VertexPainter
+{
+public:
+    explicit VertexPainter(irr::scene::IMesh* mesh);
+
+    VertexPainter(const VertexPainter&) = delete;
+    VertexPainter& operator=(const VertexPainter&) = delete;
+
+    irr::u32 getVertexCount() const;
+
+    //! starts a stroke in a color, ending any stroke still going on
+    /** Only the vertices of the selected faces take the stroke, unless nothing is selected; selection may be nullptr. */
+    void beginStroke(const irr::video::SColor& color, irr::f32 opacity, const FaceSelection* selection);
+
+    bool isStroking() const;
+
+    //! paints the vertices within radius plus featherRadius of a centre, the ones past radius fading out linearly
+    /** Returns the number of vertices whose color changed. */
+    irr::u32 addDab(const irr::core::vector3df& centre, irr::f32 radius, irr::f32 featherRadius);
+
+    //! keeps the colors the stroke left and forgets what the vertices were before it
+    void endStroke();
+
+private:
+    //! a vertex as kept in the hash, with its position copied out so a query reads the buckets only
+    struct HashedVertex
+    {
+        irr::core::vector3df position;
+
+        irr::u32 meshBuffer;
+        irr::u32 index;
+    };
+
+    irr::s32 getCell(irr::f32 coordinate) const;
+
+    irr::u32 getBucket(irr::s32 cellX, irr::s32 cellY, irr::s32 cellZ) const;
+
+    //! the color of a vertex, whatever the vertex type of its mesh buffer, which every vertex type keeps where S3DVertex does
+    irr::video::SColor& getColor(irr::u32 meshBuffer, irr::u32 index);
+
+    //! marks the vertices used by the selected faces, which are the only ones a stroke may paint
+    void selectVertices(const FaceSelection& selection);
+
+    //! blends the stroke color into a vertex at a coverage, unless a dab before covered it as much already
+    bool paintVertex(const HashedVertex& vertex, irr::f32 coverage);
+
+    std::vector<irr::scene::IMeshBuffer*> meshBuffers;
+
+    //! the first vertex of each mesh buffer, and the vertex count past the last
+    std::vector<irr::u32> vertexOffsets;
+
+    //! the bytes from one vertex of each mesh buffer to the next, looked up once rather than for every vertex painted
+    std::vector<irr::u32> vertexPitches;
+
+    irr::f32 cellSize;
+
+    //! vertices sorted by the bucket their cell hashes to; the vertices of bucket b start at bucketStarts[b]
+    std::vector<irr::u32> bucketStarts;
+    std::vector<HashedVertex> bucketVertices;
+
+    bool stroking;
+    irr::video::SColor strokeColor;
+    irr::f32 strokeOpacity;
+
+    //! per vertex, the strongest coverage of the stroke so far, 0 where it has not been painted
+    std::vector<irr::f32> strokeCoverage;
+
+    //! per vertex, its color from before the stroke, only meaningful where it has been painted
+    std::vector<irr::video::SColor> originalColors;
+
+    //! the vertices painted by the stroke, whose coverage is cleared again when it ends
+    std::vector<irr::u32> strokeVertices;
+
+    //! one byte per vertex, set where a selected face uses it; empty while the stroke may paint anywhere
+    std::vector<irr::u8> selectedVertices;
+
+    //! one byte per mesh buffer, set while a dab changes one of its vertices
+    std::vector<irr::u8> changedMeshBuffers;
+};
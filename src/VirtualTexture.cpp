@@ -0,0 +1,526 @@
+#include "VirtualTexture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+#include "MeshAccess.h"
+
+namespace {
+    const char* VIRTUAL_TEXTURE_VERTEX_SHADER = R"(
+void main()
+{
+    gl_TexCoord[0] = gl_MultiTexCoord0;
+    gl_Position = ftransform();
+}
+)";
+
+    const char* VIRTUAL_TEXTURE_PIXEL_SHADER = R"(
+uniform sampler2D pageCache;
+uniform sampler2D pageTable;
+uniform vec2 textureSize;
+uniform float pageSize;
+uniform float pageBorder;
+uniform float cacheSize;
+
+void main()
+{
+    vec2 uv = fract(gl_TexCoord[0].xy);
+
+    // r, g: slot of the page in the cache, b: mip level of the page
+    vec4 entry = floor(texture2D(pageTable, uv) * 255.0 + 0.5);
+
+    vec2 levelSize = max(floor(textureSize / exp2(entry.b)), vec2(1.0));
+    vec2 texel = uv * levelSize;
+    vec2 texelInPage = texel - floor(texel / pageSize) * pageSize;
+
+    vec2 cacheTexel = entry.rg * (pageSize + 2.0 * pageBorder) + pageBorder + texelInPage;
+
+    gl_FragColor = texture2D(pageCache, cacheTexel / cacheSize);
+}
+)";
+
+    irr::io::path getUniqueTextureName(const char* prefix, const void* owner)
+    {
+        std::ostringstream name;
+
+        name << prefix << owner;
+
+        return irr::io::path(name.str().c_str());
+    }
+}
+
+class VirtualTexture::ShaderCallback : public irr::video::IShaderConstantSetCallBack
+{
+public:
+    ShaderCallback(const irr::core::dimension2du& _textureSize, irr::u32 _cacheSize) :
+        textureSize(_textureSize),
+        cacheSize(_cacheSize)
+    {
+    }
+
+    void OnSetConstants(irr::video::IMaterialRendererServices* services, irr::s32 /*userData*/) override
+    {
+        irr::s32 pageCacheLayer = 0;
+        irr::s32 pageTableLayer = 1;
+
+        services->setPixelShaderConstant("pageCache", &pageCacheLayer, 1);
+        services->setPixelShaderConstant("pageTable", &pageTableLayer, 1);
+
+        irr::f32 size[2] = { static_cast<irr::f32>(textureSize.Width), static_cast<irr::f32>(textureSize.Height) };
+        irr::f32 pageSize = PAGE_SIZE;
+        irr::f32 pageBorder = PAGE_BORDER;
+        irr::f32 cache = static_cast<irr::f32>(cacheSize);
+
+        services->setPixelShaderConstant("textureSize", size, 2);
+        services->setPixelShaderConstant("pageSize", &pageSize, 1);
+        services->setPixelShaderConstant("pageBorder", &pageBorder, 1);
+        services->setPixelShaderConstant("cacheSize", &cache, 1);
+    }
+
+private:
+    irr::core::dimension2du textureSize;
+    irr::u32 cacheSize;
+};
+
+bool VirtualTexture::Page::operator<(const Page& other) const
+{
+    if (level != other.level)
+    {
+        return level < other.level;
+    }
+
+    if (y != other.y)
+    {
+        return y < other.y;
+    }
+
+    return x < other.x;
+}
+
+VirtualTexture::VirtualTexture(irr::video::IVideoDriver* _driver, const MipPyramid& _pyramid) :
+    driver(_driver),
+    pyramid(_pyramid),
+    materialType(irr::video::EMT_SOLID),
+    hasPendingPages(false),
+    pageTableChanged(true)
+{
+    const auto slotSize = PAGE_SIZE + (2 * PAGE_BORDER);
+    const auto cacheSize = std::min(CACHE_SIZE, driver->getMaxTextureSize().Width);
+
+    slotsPerRow = cacheSize / slotSize;
+
+    slotPages.resize(slotsPerRow * slotsPerRow);
+    slotUsed.resize(slotsPerRow * slotsPerRow, false);
+
+    // neither texture may be mip mapped: the page table has to be sampled exactly and the cache is mip mapped by its pages
+    auto createMipMaps = driver->getTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS);
+    driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, false);
+
+    pageCache = TextureHandle(driver, driver->addTexture(irr::core::dimension2du(cacheSize, cacheSize), getUniqueTextureName("__pageCache__", this), irr::video::ECF_A8R8G8B8));
+    pageTable = TextureHandle(driver, driver->addTexture(irr::core::dimension2du(getPageCountX(0), getPageCountY(0)), getUniqueTextureName("__pageTable__", this), irr::video::ECF_A8R8G8B8));
+
+    driver->setTextureCreationFlag(irr::video::ETCF_CREATE_MIP_MAPS, createMipMaps);
+
+    auto callback = new ShaderCallback(pyramid.getLevel(0)->getDimension(), cacheSize);
+
+    materialType = driver->getGPUProgrammingServices()->addHighLevelShaderMaterial(
+        VIRTUAL_TEXTURE_VERTEX_SHADER, "main", irr::video::EVST_VS_1_1,
+        VIRTUAL_TEXTURE_PIXEL_SHADER, "main", irr::video::EPST_PS_1_1,
+        callback, irr::video::EMT_SOLID);
+
+    callback->drop();
+
+    // the coarsest level covers the whole image with a single page, every lookup falls back to it
+    Page coarsestPage = { pyramid.getLevelCount() - 1, 0, 0 };
+
+    makeResident(coarsestPage, std::set<Page> { coarsestPage });
+}
+
+bool VirtualTexture::isSupported(irr::video::IVideoDriver* driver)
+{
+    return driver->queryFeature(irr::video::EVDF_ARB_GLSL) && driver->getGPUProgrammingServices() != nullptr;
+}
+
+void VirtualTexture::applyTo(irr::video::SMaterial& material) const
+{
+    material.MaterialType = static_cast<irr::video::E_MATERIAL_TYPE>(materialType);
+
+    material.TextureLayer[0].Texture = pageCache.get();
+    material.TextureLayer[0].BilinearFilter = true;
+    material.TextureLayer[0].TrilinearFilter = false;
+
+    material.TextureLayer[1].Texture = pageTable.get();
+    material.TextureLayer[1].BilinearFilter = false;
+    material.TextureLayer[1].TrilinearFilter = false;
+}
+
+irr::u32 VirtualTexture::getPageCountX(irr::u32 level) const
+{
+    return (pyramid.getLevel(level)->getDimension().Width + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+irr::u32 VirtualTexture::getPageCountY(irr::u32 level) const
+{
+    return (pyramid.getLevel(level)->getDimension().Height + PAGE_SIZE - 1) / PAGE_SIZE;
+}
+
+void VirtualTexture::requestPages(irr::u32 level, const irr::core::rectf& uvRect, std::set<Page>& pages) const
+{
+    auto levelSize = pyramid.getLevel(level)->getDimension();
+
+    auto pageCountX = getPageCountX(level);
+    auto pageCountY = getPageCountY(level);
+
+    auto pageX0 = std::min<irr::u32>(pageCountX - 1, static_cast<irr::u32>(irr::core::clamp(uvRect.UpperLeftCorner.X, 0.f, 1.f) * levelSize.Width) / PAGE_SIZE);
+    auto pageY0 = std::min<irr::u32>(pageCountY - 1, static_cast<irr::u32>(irr::core::clamp(uvRect.UpperLeftCorner.Y, 0.f, 1.f) * levelSize.Height) / PAGE_SIZE);
+    auto pageX1 = std::min<irr::u32>(pageCountX - 1, static_cast<irr::u32>(irr::core::clamp(uvRect.LowerRightCorner.X, 0.f, 1.f) * levelSize.Width) / PAGE_SIZE);
+    auto pageY1 = std::min<irr::u32>(pageCountY - 1, static_cast<irr::u32>(irr::core::clamp(uvRect.LowerRightCorner.Y, 0.f, 1.f) * levelSize.Height) / PAGE_SIZE);
+
+    for (auto y = pageY0; y <= pageY1; ++y)
+    {
+        for (auto x = pageX0; x <= pageX1; ++x)
+        {
+            pages.insert(Page { level, x, y });
+        }
+    }
+}
+
+void VirtualTexture::updateTriangleUvs(const std::vector<irr::scene::IMeshBuffer*>& meshBuffers)
+{
+    const auto baseSize = pyramid.getLevel(0)->getDimension();
+
+    triangleUvs.clear();
+
+    for (auto meshBuffer : meshBuffers)
+    {
+        visitMeshBuffer(meshBuffer, [&](const auto& view) {
+            for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle)
+            {
+                const auto& uv0 = view.getCorner(triangle, 0).TCoords;
+                const auto& uv1 = view.getCorner(triangle, 1).TCoords;
+                const auto& uv2 = view.getCorner(triangle, 2).TCoords;
+
+                auto uvEdge1 = uv1 - uv0;
+                auto uvEdge2 = uv2 - uv0;
+
+                TriangleUvs uvs;
+                uvs.uvRect = irr::core::rectf(uv0, uv0);
+                uvs.uvRect.addInternalPoint(uv1);
+                uvs.uvRect.addInternalPoint(uv2);
+                uvs.texelArea = std::fabs((uvEdge1.X * uvEdge2.Y) - (uvEdge1.Y * uvEdge2.X)) * 0.5f * baseSize.Width * baseSize.Height;
+
+                triangleUvs.push_back(uvs);
+            }
+        });
+    }
+}
+
+void VirtualTexture::updateResidency(irr::scene::ICameraSceneNode* camera, const irr::core::matrix4& world, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers)
+{
+    const auto coarsestLevel = pyramid.getLevelCount() - 1;
+    const auto screenSize = driver->getScreenSize();
+
+    irr::core::matrix4 transform = camera->getProjectionMatrix();
+    transform *= camera->getViewMatrix();
+    transform *= world;
+
+    auto meshBuffersChanged = meshBuffers != requestedMeshBuffers;
+
+    if (meshBuffersChanged)
+    {
+        updateTriangleUvs(meshBuffers);
+
+        requestedMeshBuffers = meshBuffers;
+    }
+
+    // a still view needs the same pages as the frame before, so only loading what the upload limit held back is left
+    if (!meshBuffersChanged && transform == requestedTransform && screenSize == requestedScreenSize)
+    {
+        if (!hasPendingPages)
+        {
+            return;
+        }
+    }
+    else
+    {
+        requestedTransform = transform;
+        requestedScreenSize = screenSize;
+
+        requestedPages = std::set<Page> { Page { coarsestLevel, 0, 0 } };
+
+        auto triangleUv = triangleUvs.begin();
+
+        for (auto meshBuffer : meshBuffers)
+        {
+            visitMeshBuffer(meshBuffer, [&](const auto& view) {
+                for (irr::u32 triangle = 0; triangle < view.getTriangleCount(); ++triangle, ++triangleUv)
+                {
+                    irr::core::vector2df screen[3];
+
+                    auto behindCamera = 0;
+                    auto outsideLeft = 0, outsideRight = 0, outsideTop = 0, outsideBottom = 0;
+
+                    for (auto corner = 0; corner < 3; ++corner)
+                    {
+                        const auto& vertex = view.getCorner(triangle, corner);
+
+                        irr::f32 position[4] = { vertex.Pos.X, vertex.Pos.Y, vertex.Pos.Z, 1.f };
+
+                        transform.multiplyWith1x4Matrix(position);
+
+                        if (position[3] <= 0.f)
+                        {
+                            ++behindCamera;
+                            position[3] = 0.001f;
+                        }
+
+                        outsideLeft += position[0] < -position[3];
+                        outsideRight += position[0] > position[3];
+                        outsideBottom += position[1] < -position[3];
+                        outsideTop += position[1] > position[3];
+
+                        screen[corner] = irr::core::vector2df(
+                            screenSize.Width * 0.5f * (1.f + position[0] / position[3]),
+                            screenSize.Height * 0.5f * (1.f - position[1] / position[3]));
+                    }
+
+                    if (behindCamera == 3 || outsideLeft == 3 || outsideRight == 3 || outsideTop == 3 || outsideBottom == 3)
+                    {
+                        continue;
+                    }
+
+                    auto screenEdge1 = screen[1] - screen[0];
+                    auto screenEdge2 = screen[2] - screen[0];
+
+                    auto screenArea = std::fabs((screenEdge1.X * screenEdge2.Y) - (screenEdge1.Y * screenEdge2.X)) * 0.5f;
+
+                    // one screen pixel should map to at most one texel of the chosen level
+                    irr::u32 level = coarsestLevel;
+
+                    if (screenArea > 0.f && triangleUv->texelArea > 0.f)
+                    {
+                        auto idealLevel = std::floor(0.5f * std::log2(triangleUv->texelArea / screenArea));
+
+                        level = static_cast<irr::u32>(irr::core::clamp(idealLevel, 0.f, static_cast<irr::f32>(coarsestLevel)));
+                    }
+
+                    requestPages(level, triangleUv->uvRect, requestedPages);
+                }
+            });
+        }
+
+        // keep what is already resident from being evicted by the pages loaded below
+        for (const auto& page : requestedPages)
+        {
+            auto resident = residentPages.find(page);
+
+            if (resident != residentPages.end())
+            {
+                lruPages.splice(lruPages.end(), lruPages, resident->second.second);
+            }
+        }
+    }
+
+    // coarse pages first, so a view which needs more pages than there are slots is still fully covered
+    irr::u32 uploadedPageCount = 0;
+
+    hasPendingPages = false;
+
+    for (auto page = requestedPages.rbegin(); page != requestedPages.rend(); ++page)
+    {
+        if (residentPages.find(*page) != residentPages.end())
+        {
+            continue;
+        }
+
+        if (uploadedPageCount == MAX_PAGE_UPLOADS_PER_FRAME)
+        {
+            hasPendingPages = true;
+            break;
+        }
+
+        // the pages without a slot to go to stay out until the view changes
+        if (!makeResident(*page, requestedPages))
+        {
+            break;
+        }
+
+        ++uploadedPageCount;
+    }
+}
+
+bool VirtualTexture::makeResident(const Page& page, const std::set<Page>& requestedPages)
+{
+    irr::u32 slot = 0;
+
+    auto freeSlot = std::find(slotUsed.begin(), slotUsed.end(), false);
+
+    if (freeSlot != slotUsed.end())
+    {
+        slot = static_cast<irr::u32>(freeSlot - slotUsed.begin());
+    }
+    else
+    {
+        const Page coarsestPage = { pyramid.getLevelCount() - 1, 0, 0 };
+
+        auto victim = std::find_if(lruPages.begin(), lruPages.end(), [&](const Page& residentPage) {
+            return requestedPages.find(residentPage) == requestedPages.end() && residentPage.level != coarsestPage.level;
+        });
+
+        if (victim == lruPages.end())
+        {
+            return false;
+        }
+
+        auto victimEntry = residentPages.find(*victim);
+
+        slot = victimEntry->second.first;
+
+        pagesToUpload.erase(*victim);
+        residentPages.erase(victimEntry);
+        lruPages.erase(victim);
+    }
+
+    slotUsed[slot] = true;
+    slotPages[slot] = page;
+
+    lruPages.push_back(page);
+    residentPages[page] = std::make_pair(slot, std::prev(lruPages.end()));
+
+    pagesToUpload.insert(page);
+
+    pageTableChanged = true;
+
+    return true;
+}
+
+void VirtualTexture::markDirty(irr::u32 level, const irr::core::recti& rect)
+{
+    if (rect.getArea() == 0)
+    {
+        return;
+    }
+
+    // the border of a page repeats the texels next to it
+    auto pageX0 = static_cast<irr::u32>(std::max(0, rect.UpperLeftCorner.X - static_cast<irr::s32>(PAGE_BORDER))) / PAGE_SIZE;
+    auto pageY0 = static_cast<irr::u32>(std::max(0, rect.UpperLeftCorner.Y - static_cast<irr::s32>(PAGE_BORDER))) / PAGE_SIZE;
+    auto pageX1 = std::min(getPageCountX(level) - 1, static_cast<irr::u32>(std::max(0, rect.LowerRightCorner.X + static_cast<irr::s32>(PAGE_BORDER))) / PAGE_SIZE);
+    auto pageY1 = std::min(getPageCountY(level) - 1, static_cast<irr::u32>(std::max(0, rect.LowerRightCorner.Y + static_cast<irr::s32>(PAGE_BORDER))) / PAGE_SIZE);
+
+    for (auto y = pageY0; y <= pageY1; ++y)
+    {
+        for (auto x = pageX0; x <= pageX1; ++x)
+        {
+            Page page = { level, x, y };
+
+            if (residentPages.find(page) != residentPages.end())
+            {
+                pagesToUpload.insert(page);
+            }
+        }
+    }
+}
+
+void VirtualTexture::upload()
+{
+    if (!pagesToUpload.empty())
+    {
+        // Irrlicht always submits the whole cache on unlock, but only the touched slots are rewritten on the CPU side
+        auto cacheData = static_cast<irr::u8*>(pageCache->lock());
+
+        if (cacheData != nullptr)
+        {
+            for (const auto& page : pagesToUpload)
+            {
+                writePage(page, residentPages[page].first, cacheData, pageCache->getPitch());
+            }
+
+            pageCache->unlock();
+        }
+
+        pagesToUpload.clear();
+    }
+
+    if (pageTableChanged)
+    {
+        updatePageTable();
+
+        pageTableChanged = false;
+    }
+}
+
+void VirtualTexture::writePage(const Page& page, irr::u32 slot, irr::u8* cacheData, irr::u32 cachePitch) const
+{
+    const auto slotSize = PAGE_SIZE + (2 * PAGE_BORDER);
+
+    // every pyramid level is A8R8G8B8, like the cache, so rows are copied as they are
+    auto image = pyramid.getLevel(page.level);
+    auto imageSize = image->getDimension();
+    auto imageTexels = static_cast<const irr::u8*>(image->lock());
+    auto imagePitch = image->getPitch();
+
+    auto slotX = (slot % slotsPerRow) * slotSize;
+    auto slotY = (slot / slotsPerRow) * slotSize;
+
+    auto originX = static_cast<irr::s32>(page.x * PAGE_SIZE) - static_cast<irr::s32>(PAGE_BORDER);
+    auto originY = static_cast<irr::s32>(page.y * PAGE_SIZE) - static_cast<irr::s32>(PAGE_BORDER);
+
+    // the texels of the slot within the image; the ones outside repeat the image's edge
+    auto copyX0 = static_cast<irr::u32>(irr::core::clamp<irr::s32>(-originX, 0, slotSize));
+    auto copyX1 = static_cast<irr::u32>(irr::core::clamp<irr::s32>(static_cast<irr::s32>(imageSize.Width) - originX, copyX0, slotSize));
+
+    for (irr::u32 y = 0; y < slotSize; ++y)
+    {
+        auto sourceY = irr::core::clamp<irr::s32>(originY + y, 0, imageSize.Height - 1);
+        auto sourceRow = reinterpret_cast<const irr::u32*>(imageTexels + (sourceY * imagePitch));
+        auto row = reinterpret_cast<irr::u32*>(cacheData + ((slotY + y) * cachePitch)) + slotX;
+
+        std::fill(row, row + copyX0, sourceRow[0]);
+        std::memcpy(row + copyX0, sourceRow + originX + copyX0, (copyX1 - copyX0) * sizeof(irr::u32));
+        std::fill(row + copyX1, row + slotSize, sourceRow[imageSize.Width - 1]);
+    }
+
+    image->unlock();
+}
+
+void VirtualTexture::updatePageTable()
+{
+    auto tableData = static_cast<irr::u8*>(pageTable->lock());
+
+    if (tableData == nullptr)
+    {
+        return;
+    }
+
+    auto pitch = pageTable->getPitch();
+    auto pageCountX = getPageCountX(0);
+    auto pageCountY = getPageCountY(0);
+
+    // coarse pages are written first and then overwritten by the finer ones they contain
+    for (auto resident = residentPages.rbegin(); resident != residentPages.rend(); ++resident)
+    {
+        const auto& page = resident->first;
+        auto slot = resident->second.first;
+
+        auto entry = irr::video::SColor(255, slot % slotsPerRow, slot / slotsPerRow, page.level).color;
+
+        auto x0 = page.x << page.level;
+        auto y0 = page.y << page.level;
+        auto x1 = std::min(pageCountX, (page.x + 1) << page.level);
+        auto y1 = std::min(pageCountY, (page.y + 1) << page.level);
+
+        for (auto y = y0; y < y1; ++y)
+        {
+            auto row = reinterpret_cast<irr::u32*>(tableData + (y * pitch));
+
+            for (auto x = x0; x < x1; ++x)
+            {
+                row[x] = entry;
+            }
+        }
+    }
+
+    pageTable->unlock();
+}
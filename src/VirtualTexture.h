@@ -0,0 +1,116 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <irrlicht/irrlicht.h>
+
+#include "MipPyramid.h"
+#include "ResourceHandle.h"
+
+//! Shows an image too large for one texture by keeping only the pages the current view needs on the GPU.
+/** The image is split into PAGE_SIZE pages on every mip level. Resident pages live in slots of a single page cache texture
+    and are evicted least recently used first. A page table texture maps every mip 0 page to the finest resident page covering it,
+    and a GLSL material samples the page cache through it. The coarsest level always fits into one page and is never evicted. */
+class VirtualTexture
+{
+public:
+    static const irr::u32 PAGE_SIZE = 128;
+
+    //! texels repeated around every page, so bilinear filtering does not pick up the neighbouring slot
+    static const irr::u32 PAGE_BORDER = 1;
+
+    static const irr::u32 CACHE_SIZE = 2048;
+
+    static const irr::u32 MAX_PAGE_UPLOADS_PER_FRAME = 32;
+
+    VirtualTexture(irr::video::IVideoDriver* driver, const MipPyramid& pyramid);
+
+    VirtualTexture(const VirtualTexture&) = delete;
+    VirtualTexture& operator=(const VirtualTexture&) = delete;
+
+    static bool isSupported(irr::video::IVideoDriver* driver);
+
+    //! sets up a material to render through the page table
+    void applyTo(irr::video::SMaterial& material) const;
+
+    //! requests the pages the given mesh buffers need from the camera's point of view
+    void updateResidency(irr::scene::ICameraSceneNode* camera, const irr::core::matrix4& world, const std::vector<irr::scene::IMeshBuffer*>& meshBuffers);
+
+    //! queues every resident page covering a changed rectangle of a pyramid level for re-upload
+    void markDirty(irr::u32 level, const irr::core::recti& rect);
+
+    //! uploads the pages which became resident or changed since the last call
+    void upload();
+
+private:
+    struct Page
+    {
+        irr::u32 level;
+        irr::u32 x;
+        irr::u32 y;
+
+        bool operator<(const Page& other) const;
+    };
+
+    //! what a triangle covers of the texture, which does not depend on the view
+    struct TriangleUvs
+    {
+        irr::core::rectf uvRect;
+
+        //! in texels of the base level
+        irr::f32 texelArea;
+    };
+
+    class ShaderCallback;
+
+    irr::u32 getPageCountX(irr::u32 level) const;
+    irr::u32 getPageCountY(irr::u32 level) const;
+
+    void requestPages(irr::u32 level, const irr::core::rectf& uvRect, std::set<Page>& pages) const;
+
+    void updateTriangleUvs(const std::vector<irr::scene::IMeshBuffer*>& meshBuffers);
+
+    bool makeResident(const Page& page, const std::set<Page>& requestedPages);
+
+    void writePage(const Page& page, irr::u32 slot, irr::u8* cacheData, irr::u32 cachePitch) const;
+
+    void updatePageTable();
+
+    irr::video::IVideoDriver* driver;
+
+    const MipPyramid& pyramid;
+
+    TextureHandle pageCache;
+    TextureHandle pageTable;
+
+    irr::s32 materialType;
+
+    irr::u32 slotsPerRow;
+
+    //! pages owning a slot, indexed by slot
+    std::vector<Page> slotPages;
+    std::vector<bool> slotUsed;
+
+    //! resident pages, least recently used first
+    std::list<Page> lruPages;
+    std::map<Page, std::pair<irr::u32, std::list<Page>::iterator>> residentPages;
+
+    std::set<Page> pagesToUpload;
+
+    //! the mesh buffers, transform and screen size the requested pages were worked out for; they only change with the view
+    std::vector<irr::scene::IMeshBuffer*> requestedMeshBuffers;
+    irr::core::matrix4 requestedTransform;
+    irr::core::dimension2du requestedScreenSize;
+    std::set<Page> requestedPages;
+
+    //! set while requested pages are left to load because of the upload limit
+    bool hasPendingPages;
+
+    //! per triangle of requestedMeshBuffers, in order
+    std::vector<TriangleUvs> triangleUvs;
+
+    bool pageTableChanged;
+};
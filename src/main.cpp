@@ -1,9 +1,40 @@
 #include "Application.h"
+#include "BlendKernels.h"
+#include "DdsExporter.h"
+#include "ProjectFile.h"
 
+#include <cstring>
 #include <memory>
 
-int main() {
-    std::unique_ptr<Application> app = std::make_unique<Application>();
+int main(int argc, char* argv[]) {
+    auto isProfilingStartup = false;
+    auto isProfilingLoading = false;
+
+    for (auto i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--test-and-exit") == 0) {
+            TestBlendKernels testBlendKernels;
+            TestDdsExporter testDdsExporter;
+            TestProjectFile testProjectFile;
+
+            return testBlendKernels.hasPassed() && testDdsExporter.hasPassed() && testProjectFile.hasPassed() ? 0 : 1;
+        }
+
+        if (std::strcmp(argv[i], "--benchmark-and-exit") == 0) {
+            benchmarkBlendKernels();
+
+            return 0;
+        }
+
+        if (std::strcmp(argv[i], "--profile-startup") == 0) {
+            isProfilingStartup = true;
+        }
+
+        if (std::strcmp(argv[i], "--profile-loading") == 0) {
+            isProfilingLoading = true;
+        }
+    }
+
+    std::unique_ptr<Application> app = std::make_unique<Application>(isProfilingStartup, isProfilingLoading);
 
     app->run();
 